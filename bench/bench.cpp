@@ -0,0 +1,635 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <libdrm/amdgpu_drm.h>
+#include <ftxui/dom/elements.hpp>
+#include <ftxui/screen/screen.hpp>
+#include "block_sampler.hpp"
+#include "compare.hpp"
+#include "device_watcher.hpp"
+#include "fixture.hpp"
+#include "flight_recorder.hpp"
+#include "gpu_metrics.hpp"
+#include "layout.hpp"
+#include "process_info.hpp"
+#include "rules.hpp"
+#include "trace_writer.hpp"
+
+#ifndef AMDGPU_TOP_REVISION
+#define AMDGPU_TOP_REVISION "unknown"
+#endif
+
+// Every allocation of the process, the benchmarks run single threaded
+static std::atomic<uint64_t> allocation_count{0};
+static std::atomic<uint64_t> allocation_bytes{0};
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* ptr = malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+/**
+ * Syscalls made by this process
+ *
+ * Counts the raw_syscalls:sys_enter tracepoint through perf where the
+ * tracepoint and perf_event_paranoid allow it. Otherwise falls back to the
+ * syscr/syscw counters of /proc/self/io, which only see the read and write
+ * family but need no privileges; getSource() tells which one is in use.
+ */
+class SyscallCounter {
+public:
+    SyscallCounter() {
+        if (openTracepoint()) {
+            source = "raw_syscalls";
+        } else if ((io_fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC)) >= 0) {
+            source = "proc_io";
+        }
+
+        // The counter's own reads show up between two readings, measure them on an empty batch
+        if (isAvailable()) {
+            uint64_t first = read();
+            overhead = read() - first;
+        }
+    }
+
+    ~SyscallCounter() {
+        if (perf_fd >= 0) close(perf_fd);
+        if (io_fd >= 0) close(io_fd);
+    }
+
+    bool isAvailable() const { return perf_fd >= 0 || io_fd >= 0; }
+    const char* getSource() const { return source; }
+
+    // Syscalls between two readings, less those of the readings themselves
+    uint64_t between(uint64_t start, uint64_t end) const {
+        return end - start > overhead ? end - start - overhead : 0;
+    }
+
+    uint64_t read() const {
+        uint64_t count = 0;
+        if (perf_fd >= 0) {
+            if (::read(perf_fd, &count, sizeof(count)) != sizeof(count)) return 0;
+            return count;
+        }
+        if (io_fd < 0) return 0;
+
+        char buf[512];
+        ssize_t len = pread(io_fd, buf, sizeof(buf) - 1, 0);
+        if (len <= 0) return 0;
+        buf[len] = '\0';
+        const char* syscr = strstr(buf, "syscr:");
+        const char* syscw = strstr(buf, "syscw:");
+        if (syscr) count += strtoull(syscr + 6, nullptr, 10);
+        if (syscw) count += strtoull(syscw + 6, nullptr, 10);
+        return count;
+    }
+
+private:
+    int perf_fd = -1;
+    int io_fd = -1;
+    uint64_t overhead = 0;
+    const char* source = "none";
+
+    bool openTracepoint() {
+        static const char* const paths[] = {
+            "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+            "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+        };
+        for (const char* path : paths) {
+            FILE* file = fopen(path, "re");
+            if (!file) continue;
+            unsigned long long id = 0;
+            bool ok = fscanf(file, "%llu", &id) == 1;
+            fclose(file);
+            if (!ok) continue;
+
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_TRACEPOINT;
+            attr.size = sizeof(attr);
+            attr.config = id;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            perf_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+            if (perf_fd >= 0) return true;
+        }
+        return false;
+    }
+};
+
+struct BenchOptions {
+    std::vector<size_t> scales = {10, 100, 1000, 10000, 100000};
+    unsigned min_time_ms = 200;
+    std::string filter;
+    FixtureOptions fixture;
+    std::string dir;
+    std::string label;
+    bool text = false;
+};
+
+struct BenchResult {
+    std::string name;
+    size_t scale = 0;
+    uint64_t iterations = 0;
+    double ns_per_op = 0;
+    double allocs_per_op = 0;
+    double bytes_per_op = 0;
+    double syscalls_per_op = -1;  // negative without a syscall counter
+};
+
+class BenchRunner {
+public:
+    explicit BenchRunner(const BenchOptions& options) : options(options) {}
+
+    bool isSelected(const std::string& name) const {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    // Run fn in growing batches until one batch takes min_time_ms, and report that batch
+    void run(const std::string& name, size_t scale, const std::function<void()>& fn) {
+        if (!isSelected(name)) return;
+
+        fn();  // Warm caches and first-use allocations
+        auto min_time = std::chrono::milliseconds(options.min_time_ms);
+        uint64_t iterations = 1;
+        while (true) {
+            uint64_t allocs = allocation_count.load(std::memory_order_relaxed);
+            uint64_t bytes = allocation_bytes.load(std::memory_order_relaxed);
+            uint64_t syscalls = syscall_counter.read();
+            auto start = std::chrono::steady_clock::now();
+
+            for (uint64_t i = 0; i < iterations; i++) {
+                fn();
+            }
+
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            uint64_t syscalls_end = syscall_counter.read();
+            if (elapsed >= min_time || iterations >= (1ull << 32)) {
+                BenchResult result;
+                result.name = name;
+                result.scale = scale;
+                result.iterations = iterations;
+                result.ns_per_op = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+                result.allocs_per_op = double(allocation_count.load(std::memory_order_relaxed) - allocs) / iterations;
+                result.bytes_per_op = double(allocation_bytes.load(std::memory_order_relaxed) - bytes) / iterations;
+                if (syscall_counter.isAvailable()) {
+                    result.syscalls_per_op = double(syscall_counter.between(syscalls, syscalls_end)) / iterations;
+                }
+                report(result);
+                return;
+            }
+
+            // Aim for min_time with the rate seen so far, growing at most 10x per round
+            double ns = std::max(1.0, std::chrono::duration<double, std::nano>(elapsed).count());
+            double wanted = iterations * (std::chrono::duration<double, std::nano>(min_time).count() * 1.2 / ns);
+            iterations = std::max<uint64_t>(iterations + 1, std::min<double>(wanted, iterations * 10.0));
+        }
+    }
+
+private:
+    const BenchOptions& options;
+    SyscallCounter syscall_counter;
+
+    void report(const BenchResult& result) const {
+        if (options.text) {
+            printf("%-28s %8zu %10llu %14.1f %10.1f %12.1f", result.name.c_str(), result.scale,
+                   (unsigned long long)result.iterations, result.ns_per_op, result.allocs_per_op,
+                   result.bytes_per_op);
+            if (result.syscalls_per_op >= 0) {
+                printf(" %10.1f\n", result.syscalls_per_op);
+            } else {
+                printf(" %10s\n", "-");
+            }
+        } else {
+            printf("{\"bench\":\"%s\",\"scale\":%zu,\"iterations\":%llu,\"ns_per_op\":%.1f,"
+                   "\"allocs_per_op\":%.2f,\"bytes_per_op\":%.1f,",
+                   result.name.c_str(), result.scale, (unsigned long long)result.iterations, result.ns_per_op,
+                   result.allocs_per_op, result.bytes_per_op);
+            if (result.syscalls_per_op >= 0) {
+                printf("\"syscalls_per_op\":%.2f,", result.syscalls_per_op);
+            } else {
+                printf("\"syscalls_per_op\":null,");
+            }
+            printf("\"syscall_source\":\"%s\",\"revision\":\"%s\",\"label\":\"%s\"}\n",
+                   syscall_counter.getSource(), AMDGPU_TOP_REVISION, options.label.c_str());
+        }
+        fflush(stdout);
+    }
+};
+
+// Full scans of a synthetic /proc, after a first scan so the engine deltas have a baseline
+static void benchScan(BenchRunner& runner, const BenchOptions& options, size_t scale) {
+    std::string name = "scan";
+    if (!runner.isSelected(name)) return;
+
+    FixtureOptions fixture_options = options.fixture;
+    fixture_options.total_fds = scale;
+    ProcFixture fixture;
+    if (!fixture.create(options.dir + "/procfs-" + std::to_string(scale), fixture_options)) {
+        fprintf(stderr, "Skipping %s/%zu: cannot create the fixture\n", name.c_str(), scale);
+        return;
+    }
+
+    ProcessMonitor::setProcRoot(fixture.getRoot(), ProcFixture::DEVICE_MAJOR);
+    runner.run(name, scale, [&fixture] {
+        std::vector<ProcessInfo> processes = ProcessMonitor::getProcesses(fixture.getDRMNodes());
+        if (processes.empty()) abort();  // The fixture has clients, the scan must find them
+    });
+    ProcessMonitor::setProcRoot("/proc");
+}
+
+static void benchFdinfo(BenchRunner& runner, const BenchOptions& options) {
+    const auto& variants = options.fixture.variants.empty() ? ProcFixture::getVariants() : options.fixture.variants;
+    for (const std::string& variant : variants) {
+        std::string content = ProcFixture::formatFdinfo(variant, 7, 1048576, 65536, 123456789012ULL);
+        FILE* file = fmemopen(&content[0], content.size(), "r");
+        if (!file) continue;
+        runner.run("parse_fdinfo/" + variant, 1, [file] {
+            rewind(file);
+            ProcessInfo proc;
+            unsigned client_id = 0;
+            if (!ProcessMonitor::parseFdinfo(file, proc, client_id)) abort();
+        });
+        fclose(file);
+    }
+}
+
+static void benchEngineDelta(BenchRunner& runner) {
+    ProcessCache previous = {};
+    ProcessCache current = {};
+    clock_gettime(CLOCK_MONOTONIC, &previous.last_measurement_time);
+    ProcessInfo proc;
+
+    runner.run("engine_delta", 1, [&] {
+        current = previous;
+        current.gfx_engine_used += 400000000;
+        current.compute_engine_used += 200000000;
+        current.enc_engine_used += 1000000;
+        current.dec_engine_used += 2000000;
+        current.last_measurement_time.tv_sec += 1;
+        proc.gfx_engine_used = current.gfx_engine_used;
+        proc.compute_engine_used = current.compute_engine_used;
+        proc.enc_engine_used = current.enc_engine_used;
+        proc.dec_engine_used = current.dec_engine_used;
+        ProcessMonitor::updateEngineUsage(proc, &previous, current);
+        previous = current;
+    });
+}
+
+static void benchGPUMetrics(BenchRunner& runner) {
+    for (unsigned revision = 0; revision <= 5; revision++) {
+        std::vector<uint8_t> data = makeGPUMetricsTable(revision, revision + 1);
+        GPUMetricsTable table;
+        runner.run("gpu_metrics/v1." + std::to_string(revision), 1, [&] {
+            if (!GPUMetricsReader::parse(data.data(), data.size(), table)) abort();
+        });
+    }
+}
+
+// Decoding a stored register dump: GUI_ACTIVE in every second sample, SPI_BUSY in every fourth
+static void benchBlockReplay(BenchRunner& runner) {
+    const auto& layout = BlockBusyAccumulator::layoutForFamily(AMDGPU_FAMILY_AI);
+    char* text = nullptr;
+    size_t size = 0;
+    FILE* out = open_memstream(&text, &size);
+    writeBlockDumpHeader(out, layout);
+    for (unsigned i = 0; i < 4000; i++) {
+        uint32_t values[BlockBusyAccumulator::MAX_REGISTERS] = {};
+        if (i % 2 == 0) values[0] |= 1u << 31;
+        if (i % 4 == 0) values[0] |= 1u << 22;
+        writeBlockDumpSample(out, layout, values);
+    }
+    fclose(out);
+
+    runner.run("block_replay", 4000, [&] {
+        FILE* dump = fmemopen(text, size, "r");
+        std::vector<BlockUsage> usage;
+        uint64_t samples = 0;
+        std::string error;
+        if (!replayBlockDump(dump, usage, samples, error) || samples != 4000) abort();
+        fclose(dump);
+        for (const auto& block : usage) {
+            float expected = strcmp(block.name, "GUI") == 0 ? 50.0f : strcmp(block.name, "Shader") == 0 ? 25.0f : 0.0f;
+            if (block.busy != expected) abort();
+        }
+    });
+    free(text);
+}
+
+// Flight recorder triggers as users write them, checked against an idle GPU with full VRAM
+static void benchTrigger(BenchRunner& runner) {
+    static const char* const expressions[] = {
+        "gpu_usage < 10% for 5 s while VRAM > 90%",
+        "gpu_usage < 10% for 5s while vram > 90%",
+        "GPU_USAGE<10 FOR 5 WHILE Vram>90%",
+    };
+    amdgpu_top_gpu gpu = {};
+    gpu.metrics.gpu_usage = 5;
+    gpu.metrics.memory_total = 100;
+    gpu.metrics.memory_used = 95;
+
+    runner.run("trigger_parse", 1, [&] {
+        for (const char* expression : expressions) {
+            FlightTrigger trigger;
+            std::string error;
+            if (!trigger.parse(expression, error) || trigger.getHoldNs() != 5000000000ULL || !trigger.matches(gpu)) {
+                abort();
+            }
+        }
+    });
+}
+
+// The rules shown in rules.hpp and the README, so the documentation cannot drift from the parser
+static void benchRules(BenchRunner& runner) {
+    static const char* const rules[] = {
+        "gpu[*].temperature > 95 for 30s",
+        "gpu.usage < 5% and vram > 80%",
+        "rate(proc.vram) > 1GiB/min",
+        "proc[ollama].vram > 40GiB or proc[ollama].gtt > 8GiB for 1m",
+        "gpu.temperature > 95C for 30s",
+        "gpu[*].temperature > 95C for 30s",
+        "gpu[0].usage < 5% and vram > 80%",
+        "proc[ollama].vram > 40GiB or rate(proc[ollama].gtt, 5m) > 100MiB/min",
+    };
+
+    runner.run("rules_parse", 1, [&] {
+        for (const char* rule : rules) {
+            RuleEngine engine;
+            std::string error;
+            if (!engine.add(rule, "", error)) {
+                fprintf(stderr, "%s: %s\n", rule, error.c_str());
+                abort();
+            }
+        }
+    });
+}
+
+// A phase begun between the samples of two scans and ended between two later ones covers
+// exactly the samples in between (3 to 5 here) when compare reads back the trace
+static void benchTracePhases(BenchRunner& runner, const BenchOptions& options) {
+    std::string path = options.dir + "/phases.json";
+    timespec realtime, monotonic;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    uint64_t start_ns = (uint64_t)realtime.tv_sec * 1000000000ULL + realtime.tv_nsec;
+    uint64_t start_monotonic_ns = (uint64_t)monotonic.tv_sec * 1000000000ULL + monotonic.tv_nsec;
+
+    runner.run("trace_phases", 1, [&] {
+        {
+            TraceWriter writer(path);
+            if (!writer.open()) abort();
+            Snapshot snapshot;
+            for (unsigned i = 0; i < 10; i++) {
+                makeSnapshot(snapshot, 1, 2, i);
+                snapshot.timestamp_ns = start_ns + i * 1000000000ULL;
+                snapshot.gpus[0].metrics.timestamp_ns = snapshot.timestamp_ns;
+                snapshot.gpus[0].metrics.gpu_usage = i * 10;
+                snapshot.gpus[0].nodes[0].processes_timestamp_ns = snapshot.timestamp_ns;
+                if (i == 3 || i == 6) {
+                    PhaseMarker marker;
+                    marker.pid = 1000;
+                    marker.begin = i == 3;
+                    marker.name = "build";
+                    marker.timestamp_ns = start_monotonic_ns + i * 1000000000ULL - 500000000ULL;
+                    snapshot.markers.push_back(marker);
+                }
+                writer.write(snapshot);
+            }
+        }
+
+        CompareRun run(true, 0, 0);
+        std::string error;
+        if (!run.read(path, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            abort();
+        }
+        auto phase = run.getGroups().find("build");
+        if (phase == run.getGroups().end()) abort();
+        auto usage = phase->second.find({"gpu0", "usage %"});
+        if (usage == phase->second.end() || usage->second.distribution.getCount() != 3 ||
+            usage->second.distribution.getMean() != 40) {
+            abort();
+        }
+    });
+    unlink(path.c_str());
+}
+
+// A render node appearing and going away in a scratch /dev/dri, each seen by exactly one settled callback
+static void benchDeviceWatcher(BenchRunner& runner, const BenchOptions& options) {
+    std::string name = "device_watch";
+    if (!runner.isSelected(name)) return;
+
+    std::string dir = options.dir + "/dri";
+    std::string node = dir + "/renderD128";
+    if (mkdir(dir.c_str(), 0755) < 0) {
+        fprintf(stderr, "Skipping %s: cannot create %s\n", name.c_str(), dir.c_str());
+        return;
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    unsigned changes = 0;
+    DeviceWatcher watcher([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        changes++;
+        changed.notify_all();
+    });
+    if (!watcher.start(dir)) {
+        fprintf(stderr, "Skipping %s: inotify is not available\n", name.c_str());
+        rmdir(dir.c_str());
+        return;
+    }
+
+    // Waits past the settle time, so a second callback for the same change would be counted
+    auto expectChange = [&](unsigned expected) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!changed.wait_for(lock, std::chrono::seconds(5), [&] { return changes >= expected; })) abort();
+        auto settle = std::chrono::milliseconds(2 * DeviceWatcher::SETTLE_MS);
+        if (changed.wait_for(lock, settle, [&] { return changes > expected; })) abort();
+    };
+
+    runner.run(name, 1, [&] {
+        unsigned expected;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            expected = changes + 1;
+        }
+        int fd = open(node.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+        if (fd < 0) abort();
+        close(fd);
+        expectChange(expected);
+        if (unlink(node.c_str()) < 0) abort();
+        expectChange(expected + 1);
+    });
+
+    watcher.stop();
+    rmdir(dir.c_str());
+}
+
+// Front-end work for one refresh at the client count of a fixture of this scale
+static void benchLayout(BenchRunner& runner, const BenchOptions& options, size_t scale) {
+    size_t clients = std::max<size_t>(1, scale * options.fixture.drm_ratio);
+    Snapshot source_snapshot;
+    makeSnapshot(source_snapshot, options.fixture.gpus, clients, options.fixture.seed);
+
+    Layout layout([&source_snapshot](Snapshot& snapshot) {
+        snapshot = source_snapshot;
+        return true;
+    });
+
+    runner.run("format_text", scale, [&layout] {
+        std::string text = layout.getMetricsText();
+        if (text.empty()) abort();
+    });
+
+    runner.run("layout_update", scale, [&layout] {
+        layout.update();
+    });
+
+    auto screen = ftxui::Screen::Create(ftxui::Dimension::Fixed(200), ftxui::Dimension::Fixed(60));
+    runner.run("render", scale, [&layout, &screen] {
+        ftxui::Render(screen, layout.render());
+    });
+}
+
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+static void printUsage(const char* name) {
+    printf("Usage: %s [options]\n", name);
+    printf("  --scales N,...        fd counts of the synthetic /proc (default 10,100,1000,10000,100000)\n");
+    printf("  --min-time-ms MS      minimum duration of a measured batch (default 200)\n");
+    printf("  --filter TEXT         only run benchmarks whose name contains TEXT\n");
+    printf("  --fds-per-pid N       fds per synthetic process (default 16)\n");
+    printf("  --drm-ratio R         share of fds that are DRM clients (default 0.25)\n");
+    printf("  --gpus N              fake GPUs, at most 5 in /proc, any number to render (default 2)\n");
+    printf("  --variants V,...      fdinfo formats to mix: 5.14, 5.19, 6.5, 6.11 (default all)\n");
+    printf("  --seed N              seed of the fixture generator (default 1)\n");
+    printf("  --dir PATH            where to build the fixtures (default a fresh directory in /tmp)\n");
+    printf("  --label TEXT          label added to every JSON record\n");
+    printf("  --format json|text    JSON lines (default) or a table\n");
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--scales") == 0 && has_value) {
+            options.scales.clear();
+            for (const std::string& scale : splitList(argv[++i])) {
+                options.scales.push_back(strtoull(scale.c_str(), nullptr, 10));
+            }
+        } else if (strcmp(argv[i], "--min-time-ms") == 0 && has_value) {
+            options.min_time_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && has_value) {
+            options.filter = argv[++i];
+        } else if (strcmp(argv[i], "--fds-per-pid") == 0 && has_value) {
+            options.fixture.fds_per_pid = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--drm-ratio") == 0 && has_value) {
+            options.fixture.drm_ratio = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--gpus") == 0 && has_value) {
+            options.fixture.gpus = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--variants") == 0 && has_value) {
+            options.fixture.variants = splitList(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && has_value) {
+            options.fixture.seed = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dir") == 0 && has_value) {
+            options.dir = argv[++i];
+        } else if (strcmp(argv[i], "--label") == 0 && has_value) {
+            options.label = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0 && has_value) {
+            options.text = strcmp(argv[++i], "text") == 0;
+        } else {
+            printUsage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    for (const std::string& variant : options.fixture.variants) {
+        const auto& known = ProcFixture::getVariants();
+        if (std::find(known.begin(), known.end(), variant) == known.end()) {
+            fprintf(stderr, "Unknown fdinfo variant %s\n", variant.c_str());
+            return 1;
+        }
+    }
+
+    bool temporary_dir = options.dir.empty();
+    if (temporary_dir) {
+        char path[] = "/tmp/amdgpu-top-bench.XXXXXX";
+        if (!mkdtemp(path)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        options.dir = path;
+    }
+
+    if (options.text) {
+        printf("%-28s %8s %10s %14s %10s %12s %10s\n", "bench", "scale", "iters", "ns/op", "allocs/op",
+               "bytes/op", "syscalls");
+    }
+
+    BenchRunner runner(options);
+    benchFdinfo(runner, options);
+    benchEngineDelta(runner);
+    benchGPUMetrics(runner);
+    benchBlockReplay(runner);
+    benchTrigger(runner);
+    benchRules(runner);
+    benchTracePhases(runner, options);
+    benchDeviceWatcher(runner, options);
+    for (size_t scale : options.scales) {
+        benchScan(runner, options, scale);
+        benchLayout(runner, options, scale);
+    }
+
+    if (temporary_dir) {
+        rmdir(options.dir.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,253 @@
+#include "fixture.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <ftw.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include "logger.hpp"
+
+// Memory devices every system has, standing in for render nodes
+static const char* const FAKE_DEVICES[] = {"/dev/null", "/dev/zero", "/dev/full", "/dev/random", "/dev/urandom"};
+static constexpr unsigned MAX_FAKE_DEVICES = sizeof(FAKE_DEVICES) / sizeof(FAKE_DEVICES[0]);
+
+static bool writeFile(const std::string& path, const std::string& content) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    bool ok = write(fd, content.data(), content.size()) == (ssize_t)content.size();
+    return close(fd) == 0 && ok;
+}
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*) {
+    return ::remove(path);
+}
+
+ProcFixture::~ProcFixture() {
+    remove();
+}
+
+const std::vector<std::string>& ProcFixture::getVariants() {
+    static const std::vector<std::string> variants = {"5.14", "5.19", "6.5", "6.11"};
+    return variants;
+}
+
+/**
+ * The amdgpu fdinfo formats the parser has to cope with:
+ *
+ *   5.14  pasid and "vram mem"/"gtt mem" only, engine usage in percent
+ *   5.19  DRM client usage stats: drm-client-id, drm-engine-* in ns
+ *   6.5   drm-memory-* plus the amd-* eviction and request counters
+ *   6.11  common drm-total/shared/active/resident/purgeable memory keys
+ */
+std::string ProcFixture::formatFdinfo(const std::string& variant, unsigned client_id, uint64_t vram_kib,
+                                      uint64_t gtt_kib, uint64_t engine_ns) {
+    char buf[2048];
+    int len = snprintf(buf, sizeof(buf), "pos:\t0\nflags:\t02100002\nmnt_id:\t25\nino:\t%u\n", 1000 + client_id);
+
+    if (variant == "5.14") {
+        len += snprintf(buf + len, sizeof(buf) - len,
+                        "pdev:\t0000:03:00.0\npasid:\t%u\nvram mem:\t%llu kB\ngtt mem:\t%llu kB\ncpu mem:\t0 kB\n"
+                        "gfx0:\t%.2f%%\ncompute0:\t%.2f%%\n",
+                        32768 + client_id, (unsigned long long)vram_kib, (unsigned long long)gtt_kib,
+                        (engine_ns % 10000) / 100.0, (engine_ns % 7000) / 100.0);
+    } else if (variant == "5.19") {
+        len += snprintf(buf + len, sizeof(buf) - len,
+                        "drm-driver:\tamdgpu\ndrm-pdev:\t0000:03:00.0\ndrm-client-id:\t%u\npasid:\t%u\n"
+                        "vram mem:\t%llu kB\ngtt mem:\t%llu kB\ncpu mem:\t0 kB\n"
+                        "drm-engine-gfx:\t%llu ns\ndrm-engine-compute:\t%llu ns\n"
+                        "drm-engine-dec:\t%llu ns\ndrm-engine-enc:\t%llu ns\n",
+                        client_id, 32768 + client_id, (unsigned long long)vram_kib, (unsigned long long)gtt_kib,
+                        (unsigned long long)engine_ns, (unsigned long long)engine_ns / 2,
+                        (unsigned long long)engine_ns / 8, (unsigned long long)engine_ns / 16);
+    } else if (variant == "6.5") {
+        len += snprintf(buf + len, sizeof(buf) - len,
+                        "drm-driver:\tamdgpu\ndrm-pdev:\t0000:03:00.0\ndrm-client-id:\t%u\npasid:\t%u\n"
+                        "drm-memory-vram:\t%llu KiB\ndrm-memory-gtt:\t%llu KiB\ndrm-memory-cpu:\t0 KiB\n"
+                        "amd-memory-visible-vram:\t%llu KiB\namd-evicted-vram:\t0 KiB\namd-evicted-visible-vram:\t0 KiB\n"
+                        "amd-requested-vram:\t%llu KiB\namd-requested-visible-vram:\t0 KiB\namd-requested-gtt:\t%llu KiB\n"
+                        "drm-engine-gfx:\t%llu ns\ndrm-engine-compute:\t%llu ns\n"
+                        "drm-engine-dec:\t%llu ns\ndrm-engine-enc:\t%llu ns\n",
+                        client_id, 32768 + client_id, (unsigned long long)vram_kib, (unsigned long long)gtt_kib,
+                        (unsigned long long)vram_kib / 4, (unsigned long long)vram_kib, (unsigned long long)gtt_kib,
+                        (unsigned long long)engine_ns, (unsigned long long)engine_ns / 2,
+                        (unsigned long long)engine_ns / 8, (unsigned long long)engine_ns / 16);
+    } else {
+        len += snprintf(buf + len, sizeof(buf) - len,
+                        "drm-driver:\tamdgpu\ndrm-client-id:\t%u\ndrm-pdev:\t0000:03:00.0\npasid:\t%u\n"
+                        "drm-total-cpu:\t0\ndrm-shared-cpu:\t0\ndrm-active-cpu:\t0\ndrm-resident-cpu:\t0\n"
+                        "drm-purgeable-cpu:\t0\ndrm-total-gtt:\t%llu KiB\ndrm-shared-gtt:\t0\ndrm-active-gtt:\t0\n"
+                        "drm-resident-gtt:\t%llu KiB\ndrm-purgeable-gtt:\t0\ndrm-total-vram:\t%llu KiB\n"
+                        "drm-shared-vram:\t0\ndrm-active-vram:\t0\ndrm-resident-vram:\t%llu KiB\n"
+                        "drm-purgeable-vram:\t0\ndrm-memory-vram:\t%llu KiB\ndrm-memory-gtt:\t%llu KiB\n"
+                        "amd-evicted-vram:\t0 KiB\namd-requested-vram:\t%llu KiB\namd-requested-gtt:\t%llu KiB\n"
+                        "drm-engine-gfx:\t%llu ns\ndrm-engine-compute:\t%llu ns\n"
+                        "drm-engine-dec:\t%llu ns\ndrm-engine-enc:\t%llu ns\n",
+                        client_id, 32768 + client_id, (unsigned long long)gtt_kib, (unsigned long long)gtt_kib,
+                        (unsigned long long)vram_kib, (unsigned long long)vram_kib, (unsigned long long)vram_kib,
+                        (unsigned long long)gtt_kib, (unsigned long long)vram_kib, (unsigned long long)gtt_kib,
+                        (unsigned long long)engine_ns, (unsigned long long)engine_ns / 2,
+                        (unsigned long long)engine_ns / 8, (unsigned long long)engine_ns / 16);
+    }
+    return std::string(buf, std::min<size_t>(len, sizeof(buf) - 1));
+}
+
+// /proc/<pid>/stat with the fields of proc(5) the scanner reads set, the rest plausible
+static std::string formatStat(pid_t pid, const std::string& name, uint64_t ticks, unsigned threads) {
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "%d (%s) S 1 %d %d 0 -1 4194560 1000 0 0 0 %llu %llu 0 0 20 0 %u 0 %llu 104857600 2560 "
+             "18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 17 3 0 0 %llu 0 0 0 0 0 0 0 0 0 0\n",
+             pid, name.c_str(), pid, pid, (unsigned long long)ticks, (unsigned long long)ticks / 4, threads,
+             (unsigned long long)(1000 + pid), (unsigned long long)ticks / 100);
+    return buf;
+}
+
+bool ProcFixture::create(const std::string& dir, const FixtureOptions& options) {
+    remove();
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+        Logger::error("Cannot create fixture " + dir + ": " + strerror(errno));
+        return false;
+    }
+    root = dir;
+
+    const auto& variants = options.variants.empty() ? getVariants() : options.variants;
+    unsigned gpus = std::max(1u, std::min(options.gpus, MAX_FAKE_DEVICES));
+    std::vector<std::string> devices;
+    for (unsigned i = 0; i < gpus; i++) {
+        struct stat st;
+        if (stat(FAKE_DEVICES[i], &st) == 0 && S_ISCHR(st.st_mode)) {
+            devices.push_back(FAKE_DEVICES[i]);
+            drm_nodes[st.st_rdev] = st.st_rdev;
+        }
+    }
+    if (devices.empty()) {
+        Logger::error("No character devices to stand in for render nodes");
+        return false;
+    }
+
+    // Targets of the non-DRM fds
+    std::string regular = root + "/regular";
+    writeFile(regular, "");
+
+    // A few of the non-PID entries procfs has, which the scanner must skip
+    mkdir((root + "/sys").c_str(), 0755);
+    writeFile(root + "/meminfo", "MemTotal: 65536000 kB\n");
+
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<uint64_t> memory(1024, 4 * 1024 * 1024);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    size_t fds_per_pid = std::max<size_t>(1, options.fds_per_pid);
+    pid_count = std::max<size_t>(1, options.total_fds / fds_per_pid);
+    drm_fd_count = 0;
+    unsigned client_id = 1;
+
+    for (size_t p = 0; p < pid_count; p++) {
+        pid_t pid = 1000 + p;
+        std::string pid_dir = root + "/" + std::to_string(pid);
+        std::string name = "worker-" + std::to_string(p % 97);
+        if (mkdir(pid_dir.c_str(), 0755) < 0 || mkdir((pid_dir + "/fd").c_str(), 0755) < 0 ||
+            mkdir((pid_dir + "/fdinfo").c_str(), 0755) < 0) {
+            Logger::error("Cannot populate fixture " + pid_dir + ": " + strerror(errno));
+            return false;
+        }
+
+        writeFile(pid_dir + "/comm", name + "\n");
+        writeFile(pid_dir + "/stat", formatStat(pid, name, rng() % 100000, 1 + rng() % 64));
+        writeFile(pid_dir + "/statm", "262144 " + std::to_string(memory(rng) / 4) + " 1024 100 0 65536 0\n");
+
+        size_t fds = p + 1 == pid_count ? options.total_fds - fds_per_pid * p : fds_per_pid;
+        for (size_t fd = 0; fd < std::max<size_t>(1, fds); fd++) {
+            std::string link = pid_dir + "/fd/" + std::to_string(fd);
+            if (chance(rng) >= options.drm_ratio) {
+                if (symlink(regular.c_str(), link.c_str()) < 0) return false;
+                continue;
+            }
+
+            const std::string& device = devices[rng() % devices.size()];
+            if (symlink(device.c_str(), link.c_str()) < 0) return false;
+            const std::string& variant = variants[rng() % variants.size()];
+            writeFile(pid_dir + "/fdinfo/" + std::to_string(fd),
+                      formatFdinfo(variant, client_id++, memory(rng), memory(rng) / 4, rng() % 1000000000000ULL));
+            drm_fd_count++;
+        }
+    }
+    return true;
+}
+
+void ProcFixture::remove() {
+    if (root.empty()) return;
+    nftw(root.c_str(), removeEntry, 64, FTW_DEPTH | FTW_PHYS);
+    root.clear();
+    drm_nodes.clear();
+}
+
+std::vector<uint8_t> makeGPUMetricsTable(unsigned content_revision, unsigned seed) {
+    // Larger than any v1 revision, the parser ignores what it does not know
+    std::vector<uint8_t> table(2048);
+    std::mt19937 rng(seed);
+    for (size_t i = 4; i + 1 < table.size(); i += 2) {
+        uint16_t value = rng() % 3000;
+        memcpy(&table[i], &value, sizeof(value));
+    }
+    uint16_t size = table.size();
+    memcpy(&table[0], &size, sizeof(size));
+    table[2] = 1;
+    table[3] = content_revision;
+    return table;
+}
+
+void makeSnapshot(Snapshot& snapshot, unsigned gpus, size_t clients, unsigned seed) {
+    std::mt19937 rng(seed);
+    snapshot = Snapshot();
+    snapshot.timestamp_ns = 1700000000000000000ULL;
+
+    for (unsigned g = 0; g < std::max(1u, gpus); g++) {
+        GPUSnapshot gpu;
+        gpu.market_name = "AMD Instinct MI300X";
+        gpu.pci_path = "0000:" + std::to_string(10 + g) + ":00.0";
+
+        GPUDevice::Metrics& metrics = gpu.metrics;
+        metrics.gpu_usage = rng() % 100;
+        metrics.memory_total = 196608;
+        metrics.memory_used = rng() % 196608;
+        metrics.gtt_total = 65536;
+        metrics.gtt_used = rng() % 4096;
+        metrics.temperature = 40 + rng() % 40;
+        metrics.power_usage = 300 + rng() % 400;
+        metrics.power_cap = 750;
+        metrics.gpu_clock = 2100;
+        metrics.memory_clock = 1300;
+        metrics.energy = rng() % 1000000;
+        metrics.link.pcie_speed = metrics.link.pcie_max_speed = 32;
+        metrics.link.pcie_width = metrics.link.pcie_max_width = 16;
+        metrics.sclk_residency = {{"500Mhz", 20, 10}, {"1500Mhz", 30, 40}, {"2100Mhz", 50, 50}};
+        metrics.mclk_residency = {{"900Mhz", 10, 5}, {"1300Mhz", 90, 95}};
+        metrics.throttle_residency = {{"None", 80, 70}, {"Power", 20, 30}};
+
+        NodeSnapshot node;
+        node.partition = -1;
+        node.metrics = metrics;
+        gpu.nodes.push_back(node);
+        snapshot.gpus.push_back(gpu);
+    }
+
+    for (size_t i = 0; i < clients; i++) {
+        ProcessInfo proc;
+        proc.pid = 1000 + i;
+        proc.name = "worker-" + std::to_string(i % 97);
+        proc.drm_device = i % snapshot.gpus.size();
+        proc.gfx_usage = rng() % 100;
+        proc.compute_usage = rng() % 100;
+        proc.memory_usage = (uint64_t)(rng() % 65536) << 20;
+        proc.gtt_usage = (uint64_t)(rng() % 1024) << 20;
+        proc.energy_joules = rng() % 100000;
+        proc.cpu_usage = rng() % 100;
+        proc.rss = (uint64_t)(rng() % 16384) << 20;
+        proc.threads = 1 + rng() % 64;
+        snapshot.gpus[i % snapshot.gpus.size()].nodes[0].processes.push_back(proc);
+    }
+}
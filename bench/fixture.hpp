@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "snapshot.hpp"
+
+struct FixtureOptions {
+    size_t total_fds = 1000;
+    size_t fds_per_pid = 16;
+    double drm_ratio = 0.25;  // share of the fds that are DRM clients
+    unsigned gpus = 2;
+    std::vector<std::string> variants;  // fdinfo formats to mix, all if empty
+    unsigned seed = 1;
+};
+
+/**
+ * Synthetic /proc tree for ProcessMonitor
+ *
+ * Every PID gets fd/, fdinfo/, stat, statm and comm. Creating DRM character
+ * devices needs privileges, so DRM fds are symlinks to the memory devices
+ * (/dev/null, /dev/zero, ...) instead, one per fake GPU, and the scanner is
+ * pointed at their major number. Other fds link to a regular file and have
+ * no fdinfo, which the scanner never reads for them anyway.
+ */
+class ProcFixture {
+public:
+    static constexpr unsigned DEVICE_MAJOR = 1;
+
+    ~ProcFixture();
+
+    bool create(const std::string& dir, const FixtureOptions& options);
+    void remove();
+
+    const std::string& getRoot() const { return root; }
+    // Fake render nodes, in the form GPUStats hands to the scanner
+    const std::map<dev_t, dev_t>& getDRMNodes() const { return drm_nodes; }
+    size_t getPidCount() const { return pid_count; }
+    size_t getDRMFdCount() const { return drm_fd_count; }
+
+    // fdinfo of one DRM client as written by the kernel generation variant
+    static std::string formatFdinfo(const std::string& variant, unsigned client_id, uint64_t vram_kib,
+                                    uint64_t gtt_kib, uint64_t engine_ns);
+    static const std::vector<std::string>& getVariants();
+
+private:
+    std::string root;
+    std::map<dev_t, dev_t> drm_nodes;
+    size_t pid_count = 0;
+    size_t drm_fd_count = 0;
+};
+
+// Raw gpu_metrics table of the given v1 content revision, filled with plausible values
+std::vector<uint8_t> makeGPUMetricsTable(unsigned content_revision, unsigned seed);
+
+// Device side of a sample: GPUs, partitions and clients as GPUStats::getSnapshot() builds it
+void makeSnapshot(Snapshot& snapshot, unsigned gpus, size_t clients, unsigned seed);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <time.h>
+#include "process_info.hpp"
+
+/**
+ * Cumulative per-process and per-cgroup GPU accounting
+ *
+ * Engine-time deltas and VRAM residency from every process scan are summed
+ * into totals keyed by (pid, start time), so a recycled PID never inherits
+ * someone else's usage, and into totals per cgroup. Totals outlive the
+ * process: exited entries are written once more with state X and then
+ * dropped from memory, while their cgroup keeps the usage.
+ *
+ * The ledger file is append-only, one tab separated record per changed
+ * entity and flush interval. Every record carries cumulative totals, so the
+ * last record of a key is authoritative and a restarted monitor resumes
+ * from it:
+ *
+ *   P <unix time> <pid> <start time> <R|X> <gfx ns> <compute ns> <enc ns> <dec ns> <vram byte-s> <name> <cgroup> <energy J>
+ *   C <unix time> <cgroup> <gfx ns> <compute ns> <enc ns> <dec ns> <vram byte-s> <energy J>
+ *
+ * Once the file has doubled since it was last compacted (and is at least
+ * COMPACT_MIN_BYTES), or a day after the last compaction, it is rewritten
+ * with only the last record of every key: each closed session folds into
+ * its final X record. X records older than EXITED_RETENTION_S are dropped,
+ * their usage stays in the totals of their cgroup.
+ */
+class AccountingLedger {
+public:
+    struct Usage {
+        uint64_t gfx_ns = 0;
+        uint64_t compute_ns = 0;
+        uint64_t enc_ns = 0;
+        uint64_t dec_ns = 0;
+        double vram_byte_seconds = 0;
+        double energy_joules = 0;
+    };
+
+    static constexpr long COMPACT_MIN_BYTES = 4 << 20;
+    static constexpr time_t COMPACT_INTERVAL_S = 24 * 3600;
+    static constexpr time_t EXITED_RETENTION_S = 30 * 24 * 3600;
+
+    explicit AccountingLedger(const std::string& path, unsigned flush_interval_s = 10);
+    ~AccountingLedger();
+
+    // Replay existing records and open the file for appending
+    bool open();
+
+    // Account one process scan; flushes when the interval has elapsed
+    void update(const std::vector<ProcessInfo>& processes);
+
+    // Append records for everything that changed since the last flush
+    bool flush();
+
+    // Rewrite the file with the last record of every key
+    bool compact();
+
+    const std::map<std::string, Usage>& getCgroupUsage() const { return cgroups; }
+
+private:
+    struct ProcessEntry {
+        pid_t pid = 0;
+        uint64_t start_time = 0;
+        std::string name;
+        std::string cgroup;
+        Usage usage;
+        bool exited = false;
+        bool seen = false;
+        bool dirty = false;
+    };
+
+    std::string path;
+    unsigned flush_interval_s;
+    FILE* file;
+    timespec last_flush;
+    timespec last_compaction;
+    long compacted_size = 0;  // File size after the last compaction
+
+    std::map<std::string, ProcessEntry> processes;  // "pid:start time"
+    std::map<pid_t, std::string> live_pids;         // pid -> key of its live entry
+    std::map<std::string, Usage> cgroups;
+    std::map<std::string, bool> dirty_cgroups;
+
+    void load();
+    ProcessEntry& lookup(const ProcessInfo& proc);
+
+    static bool readStartTime(pid_t pid, uint64_t& start_time);
+    static std::string readCgroup(pid_t pid);
+    static void addUsage(Usage& usage, const ProcessInfo& proc);
+};
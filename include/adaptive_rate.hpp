@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Sampling interval of one source, following how fast its signals move
+ *
+ * After each sample the source reports its signals with a threshold for
+ * each. If any of them moved by more than its threshold since the last
+ * change the interval drops to the minimum, otherwise it doubles, up to the
+ * maximum. A bursty device is sampled at the fastest rate while it changes
+ * and an idle one settles at the slowest within a few samples; a slow drift
+ * adds up until it crosses the threshold and brings the rate back up.
+ *
+ * The CPU time of the samples is averaged, so SamplingBudget can stretch
+ * the intervals of all sources when together they cost more than allowed.
+ */
+class AdaptiveRate {
+public:
+    static constexpr uint64_t DEFAULT_MIN_NS = 250000000ULL;
+    static constexpr uint64_t DEFAULT_MAX_NS = 8000000000ULL;
+
+    void setLimits(uint64_t min_ns, uint64_t max_ns);
+
+    // A sample taken at now_ns (CLOCK_MONOTONIC) that took cpu_ns; values and thresholds have count
+    // entries. Returns true if a value moved by more than its threshold.
+    bool observe(uint64_t now_ns, uint64_t cpu_ns, const float* values, const float* thresholds, size_t count);
+
+    // Back to the fastest rate, for a source that should follow activity seen elsewhere
+    void activate() { interval_ns = min_ns; }
+
+    bool hasSample() const { return last_ns != 0; }
+    uint64_t getInterval() const { return interval_ns; }
+    // Due time of the next sample with the interval stretched by stretch (>= 1)
+    uint64_t getNextSample(double stretch) const;
+    // Fraction of one CPU the source costs at its current interval
+    double getLoad() const { return interval_ns ? cpu_ns / interval_ns : 0; }
+
+private:
+    uint64_t min_ns = DEFAULT_MIN_NS;
+    uint64_t max_ns = DEFAULT_MAX_NS;
+    uint64_t interval_ns = DEFAULT_MIN_NS;
+    uint64_t last_ns = 0;
+    double cpu_ns = 0;  // per sample, moving average
+    std::vector<float> last_values;  // at the last change
+};
+
+/**
+ * Overall CPU budget of a set of AdaptiveRate sources
+ *
+ * The stretch is the factor every interval is multiplied with so that the
+ * sources together stay within budget_percent of one CPU; 1 while they do.
+ * It may push intervals past the sources' maximum: the budget wins.
+ */
+class SamplingBudget {
+public:
+    explicit SamplingBudget(float budget_percent = 1.0f) : budget(budget_percent / 100.0) {}
+
+    void setBudget(float budget_percent) { budget = budget_percent / 100.0; }
+
+    // Start a new round of getLoad() sums
+    void clear() { load = 0; }
+    void add(const AdaptiveRate& rate) { load += rate.getLoad(); }
+    // Work done once per sampling pass whatever it sampled, taking cpu_ns every interval_ns
+    void addPass(double cpu_ns, uint64_t interval_ns) { load += interval_ns ? cpu_ns / interval_ns : 0; }
+
+    double getStretch() const { return budget > 0 && load > budget ? load / budget : 1.0; }
+    float getLoadPercent() const { return load * 100.0; }
+
+private:
+    double budget;
+    double load = 0;
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+/*
+ * C API of libamdgpu-top
+ *
+ * A collector handle owns the opened GPUs. Snapshots are flattened into
+ * buffers the caller provides: arrays of GPUs, DRM nodes and processes with
+ * their capacities, and the *_total fields tell how large the arrays must be
+ * to hold everything. Filling a snapshot (amdgpu_top_get_snapshot, the
+ * callback buffer) allocates nothing; sampling (amdgpu_top_sample, the
+ * background thread) runs the collectors, which do.
+ *
+ * Errors are returned as negative errno values, no C++ exception leaves
+ * the library: -ENOMEM when out of memory, -EIO when a collector failed
+ * otherwise (the reason goes to the log).
+ *
+ * The record types below are plain data with a fixed layout. The
+ * shared-memory segment of amdgpu-top --publish uses the same records.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AMDGPU_TOP_API_VERSION 3
+
+#define AMDGPU_TOP_LABEL_SIZE 16
+#define AMDGPU_TOP_MAX_BLOCKS 16
+#define AMDGPU_TOP_MAX_CLOCK_LEVELS 16
+#define AMDGPU_TOP_MAX_THROTTLE_STATES 8
+#define AMDGPU_TOP_MAX_THROTTLE_REASONS 16
+
+/* Returned when a snapshot did not fit into the caller's arrays */
+#define AMDGPU_TOP_TRUNCATED 1
+
+/* amdgpu_top_process.growth_flags: the memory has grown steadily for a while, as leaks do */
+#define AMDGPU_TOP_GROWTH_VRAM 0x1
+#define AMDGPU_TOP_GROWTH_GTT 0x2
+
+/* Time share of a clock level or throttling state, in percent */
+typedef struct amdgpu_top_share {
+    char label[AMDGPU_TOP_LABEL_SIZE];
+    float session;
+    float window;
+} amdgpu_top_share;
+
+typedef struct amdgpu_top_block {
+    char name[AMDGPU_TOP_LABEL_SIZE];
+    float busy;  /* percent */
+} amdgpu_top_block;
+
+typedef struct amdgpu_top_metrics {
+    float gpu_usage;
+    float memory_used;                  /* MiB */
+    float memory_total;
+    float memory_cpu_accessible_used;
+    float memory_cpu_accessible_total;
+    float gtt_used;
+    float gtt_total;
+    float evictions_rate;               /* per second */
+    float bytes_moved_rate;
+    float cpu_page_faults_rate;
+    uint32_t vram_lost_counter;
+    uint32_t reset_count;
+    uint32_t eviction_pressure;         /* 0 none, 1 moderate, 2 severe */
+    uint32_t temperature;               /* °C */
+    uint32_t temperature_junction;
+    uint32_t temperature_memory;
+    uint32_t power_usage;               /* W */
+    uint32_t power_cap;
+    uint32_t fan_speed;                 /* RPM */
+    uint32_t fan_pwm;                   /* percent */
+    uint32_t voltage_gfx;               /* mV */
+    uint32_t voltage_northbridge;
+    uint32_t gpu_clock;                 /* MHz */
+    uint32_t memory_clock;
+    double energy;                      /* J since the collector started */
+    uint32_t energy_from_accumulator;
+
+    float pcie_speed;                   /* GT/s */
+    float pcie_max_speed;
+    uint32_t pcie_width;
+    uint32_t pcie_max_width;
+    float pcie_rx_rate;                 /* bytes per second, -1 if unknown */
+    float pcie_tx_rate;
+    float pcie_bandwidth;
+    uint32_t xgmi_width;
+    uint32_t xgmi_speed;                /* Gbps */
+    uint32_t xgmi_links;
+    float xgmi_read_rate;
+    float xgmi_write_rate;
+
+    uint64_t timestamp_ns;              /* CLOCK_REALTIME of the sensor sample */
+} amdgpu_top_metrics;
+
+/* A physical GPU; its DRM nodes are nodes[first_node, first_node + node_count) */
+typedef struct amdgpu_top_gpu {
+    char market_name[64];
+    char pci_path[16];
+    char partition_mode[8];
+    uint32_t first_node;
+    uint32_t node_count;
+    amdgpu_top_metrics metrics;  /* device wide, memory combined over partitions */
+
+    uint32_t block_count;
+    uint32_t sclk_count;
+    uint32_t mclk_count;
+    uint32_t throttle_count;
+    uint32_t throttle_reason_count;
+    amdgpu_top_block blocks[AMDGPU_TOP_MAX_BLOCKS];
+    amdgpu_top_share sclk[AMDGPU_TOP_MAX_CLOCK_LEVELS];
+    amdgpu_top_share mclk[AMDGPU_TOP_MAX_CLOCK_LEVELS];
+    amdgpu_top_share throttle[AMDGPU_TOP_MAX_THROTTLE_STATES];
+    char throttle_reasons[AMDGPU_TOP_MAX_THROTTLE_REASONS][AMDGPU_TOP_LABEL_SIZE];  /* active at the sample */
+} amdgpu_top_gpu;
+
+/* A DRM node (the whole GPU or one compute partition); its clients are
+ * processes[first_process, first_process + process_count) */
+typedef struct amdgpu_top_node {
+    uint32_t gpu;
+    int32_t partition;  /* -1 on GPUs without partitioning */
+    uint32_t first_process;
+    uint32_t process_count;
+    amdgpu_top_metrics metrics;
+    uint64_t processes_timestamp_ns;  /* CLOCK_REALTIME of the process scan */
+} amdgpu_top_node;
+
+typedef struct amdgpu_top_process {
+    int32_t pid;
+    uint32_t node;
+    char name[32];
+    uint32_t is_rocm;
+    float gfx_usage;      /* percent */
+    float compute_usage;
+    float enc_usage;
+    float dec_usage;
+    float cpu_usage;      /* percent of one core */
+    float io_wait;
+    uint32_t threads;
+    uint64_t memory_usage;  /* bytes */
+    uint64_t gtt_usage;
+    uint64_t rss;
+    double energy_joules;
+    float vram_growth;        /* bytes per second, fitted over the last hour */
+    float gtt_growth;
+    float vram_full_seconds;  /* until VRAM is full at vram_growth, 0 unless growing */
+    uint32_t growth_flags;    /* AMDGPU_TOP_GROWTH_* */
+} amdgpu_top_process;
+
+/* Caller owned snapshot buffer: set the array pointers and capacities, the
+ * collector fills in the rest. *_count is what was written, *_total what
+ * the snapshot holds; a GPU is only written together with all its nodes. */
+typedef struct amdgpu_top_snapshot {
+    uint64_t timestamp_ns;  /* CLOCK_REALTIME of the newest sample, see the per-record times */
+    uint64_t sample_count;
+
+    amdgpu_top_gpu* gpus;
+    uint32_t gpu_capacity;
+    uint32_t gpu_count;
+    uint32_t gpu_total;
+
+    amdgpu_top_node* nodes;
+    uint32_t node_capacity;
+    uint32_t node_count;
+    uint32_t node_total;
+
+    amdgpu_top_process* processes;
+    uint32_t process_capacity;
+    uint32_t process_count;
+    uint32_t process_total;
+} amdgpu_top_snapshot;
+
+typedef struct amdgpu_top amdgpu_top;
+
+/* Runs on the background thread with the buffer given to amdgpu_top_start(),
+ * whose contents are only valid during the call */
+typedef void (*amdgpu_top_callback)(const amdgpu_top_snapshot* snapshot, void* user_data);
+
+unsigned amdgpu_top_api_version(void);
+
+/* Open every AMD GPU; NULL if there is none that can be used */
+amdgpu_top* amdgpu_top_create(void);
+void amdgpu_top_destroy(amdgpu_top* handle);
+
+/* Optional collectors, see the amdgpu-top options of the same names; 0 or a negative errno */
+int amdgpu_top_watch_devices(amdgpu_top* handle);
+int amdgpu_top_start_block_sampling(amdgpu_top* handle, unsigned rate_hz);
+int amdgpu_top_open_ledger(amdgpu_top* handle, const char* path);
+int amdgpu_top_publish(amdgpu_top* handle, const char* name);
+int amdgpu_top_trace(amdgpu_top* handle, const char* path);
+int amdgpu_top_start_flight_recorder(amdgpu_top* handle, const char* trigger, const char* directory,
+                                     unsigned pre_s, unsigned post_s);
+
+/* Let the background thread sample each GPU and the process scan at a rate of its own,
+ * between min and max interval depending on how fast their metrics move, within
+ * cpu_budget_percent of one CPU (0 for no limit). amdgpu_top_start()'s interval_ms is
+ * then ignored; metrics and nodes carry the time of their own sample. Call it before
+ * amdgpu_top_start_flight_recorder(), which sizes its window for the fastest rate. */
+int amdgpu_top_adaptive_sampling(amdgpu_top* handle, unsigned min_interval_ms, unsigned max_interval_ms,
+                                 float cpu_budget_percent);
+
+/* Evaluate an alert rule (amdgpu-top --alert syntax) on every sample. exec, which may be
+ * NULL, is run through /bin/sh when the rule fires or clears, with the alert in
+ * AMDGPU_TOP_STATE, AMDGPU_TOP_RULE, AMDGPU_TOP_TARGET and AMDGPU_TOP_VALUE.
+ * -EINVAL if the rule does not parse, the reason goes to the log. */
+int amdgpu_top_add_rule(amdgpu_top* handle, const char* rule, const char* exec);
+
+/* Sample all GPUs now and fill snapshot (may be NULL). Returns 0,
+ * AMDGPU_TOP_TRUNCATED, -EBUSY while the background mode runs, or -EIO. */
+int amdgpu_top_sample(amdgpu_top* handle, amdgpu_top_snapshot* snapshot);
+
+/* Fill snapshot from the latest sample without taking a new one */
+int amdgpu_top_get_snapshot(amdgpu_top* handle, amdgpu_top_snapshot* snapshot);
+
+/* Sample every interval_ms on a background thread and pass each snapshot,
+ * flattened into the caller's buffer, to callback. The buffer must stay
+ * valid until amdgpu_top_stop(), which must not be called from the callback.
+ * -EAGAIN if the thread cannot be created. */
+int amdgpu_top_start(amdgpu_top* handle, unsigned interval_ms, amdgpu_top_snapshot* buffer,
+                     amdgpu_top_callback callback, void* user_data);
+void amdgpu_top_stop(amdgpu_top* handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * Phase markers for amdgpu-top --annotate
+ *
+ * Self-contained and header-only, so workloads can include it without
+ * linking anything. A marker is one fixed-size datagram on a Unix socket,
+ * sent without blocking: when amdgpu-top is not running or its queue is
+ * full the marker is dropped and counted, never waited for, so markers can
+ * be sent every iteration.
+ *
+ *     AnnotationClient annotations;
+ *     for (;;) {
+ *         AnnotationScope load(annotations, "data load");
+ *         ...
+ *     }
+ *
+ * Markers are tagged with the PID of the sender (the monitor takes it from
+ * the socket credentials when it can, so PID namespaces do not matter) and
+ * the CLOCK_MONOTONIC time they were sent. Phases of a process may nest.
+ */
+
+static constexpr uint32_t ANNOTATION_MAGIC = 0x4D544741;  // "AGTM"
+static constexpr uint16_t ANNOTATION_VERSION = 1;
+static constexpr const char* ANNOTATION_DEFAULT_NAME = "amdgpu-top/annotations";
+static constexpr size_t ANNOTATION_NAME_SIZE = 48;
+
+enum AnnotationType : uint16_t {
+    ANNOTATION_BEGIN = 1,
+    ANNOTATION_END = 2
+};
+
+struct AnnotationMessage {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;
+    int32_t pid;
+    uint32_t reserved;
+    uint64_t timestamp_ns;             // CLOCK_MONOTONIC
+    char name[ANNOTATION_NAME_SIZE];   // phase, need not be terminated
+};
+
+static_assert(sizeof(AnnotationMessage) == 72, "AnnotationMessage is part of the wire format");
+
+// A name starting with '/' is a socket path, anything else a Linux abstract socket name
+inline socklen_t annotationAddress(const char* name, sockaddr_un& address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    size_t length = std::min(strlen(name), sizeof(address.sun_path) - 1);
+    if (name[0] == '/') {
+        memcpy(address.sun_path, name, length);
+        return offsetof(sockaddr_un, sun_path) + length + 1;
+    }
+    memcpy(address.sun_path + 1, name, length);
+    return offsetof(sockaddr_un, sun_path) + 1 + length;
+}
+
+class AnnotationClient {
+public:
+    static constexpr uint64_t RECONNECT_NS = 1000000000ULL;
+
+    explicit AnnotationClient(const char* name = ANNOTATION_DEFAULT_NAME) : pid(getpid()) {
+        address_size = annotationAddress(name, address);
+        fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    }
+    ~AnnotationClient() {
+        if (fd >= 0) close(fd);
+    }
+    AnnotationClient(const AnnotationClient&) = delete;
+    AnnotationClient& operator=(const AnnotationClient&) = delete;
+
+    // False if the marker was dropped
+    bool begin(const char* phase) { return send(ANNOTATION_BEGIN, phase); }
+    bool end(const char* phase) { return send(ANNOTATION_END, phase); }
+
+    uint64_t getDropped() const { return dropped; }
+
+private:
+    int fd = -1;
+    pid_t pid;
+    sockaddr_un address;
+    socklen_t address_size;
+    bool connected = false;
+    uint64_t next_connect_ns = 0;
+    uint64_t dropped = 0;
+
+    bool send(uint16_t type, const char* phase) {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        AnnotationMessage message = {};
+        message.magic = ANNOTATION_MAGIC;
+        message.version = ANNOTATION_VERSION;
+        message.type = type;
+        message.pid = pid;
+        message.timestamp_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+        strncpy(message.name, phase, sizeof(message.name));
+
+        if (connected || connect(message.timestamp_ns)) {
+            if (::send(fd, &message, sizeof(message), MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)sizeof(message)) {
+                return true;
+            }
+            // A full queue drops this marker only; a vanished monitor is looked for again later
+            if (errno != EAGAIN && errno != EWOULDBLOCK) connected = false;
+        }
+        dropped++;
+        return false;
+    }
+
+    bool connect(uint64_t now_ns) {
+        if (fd < 0 || now_ns < next_connect_ns) return false;
+        next_connect_ns = now_ns + RECONNECT_NS;
+        connected = ::connect(fd, reinterpret_cast<const sockaddr*>(&address), address_size) == 0;
+        return connected;
+    }
+};
+
+// Marks a phase for the lifetime of a scope
+class AnnotationScope {
+public:
+    AnnotationScope(AnnotationClient& client, const char* phase) : client(client), phase(phase) {
+        client.begin(phase);
+    }
+    ~AnnotationScope() { client.end(phase); }
+    AnnotationScope(const AnnotationScope&) = delete;
+    AnnotationScope& operator=(const AnnotationScope&) = delete;
+
+private:
+    AnnotationClient& client;
+    const char* phase;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+#include "annotation_client.hpp"
+#include "process_info.hpp"
+
+// A phase marker as received, timestamp on CLOCK_MONOTONIC
+struct PhaseMarker {
+    pid_t pid = 0;
+    bool begin = false;
+    uint64_t timestamp_ns = 0;
+    std::string name;
+};
+
+// GPU use of one process while it was in one phase
+struct PhaseStats {
+    pid_t pid = 0;
+    std::string name;
+    bool active = false;   // Open at the last update
+    uint64_t count = 0;    // Completed phases
+    uint64_t time_ns = 0;  // Total time in the phase
+    double usage_ns = 0;   // GFX + compute percent, weighted by time
+    double vram_ns = 0;    // MiB, weighted by time
+    float vram_peak = 0;   // MiB
+
+    float getUsage() const { return time_ns ? usage_ns / time_ns : 0; }
+    float getVRAM() const { return time_ns ? vram_ns / time_ns : 0; }
+};
+
+/**
+ * Receives phase markers from AnnotationClient and accounts GPU use per phase
+ *
+ * A thread drains the socket as markers arrive, so bursts do not overflow
+ * its queue between two updates. Each update splits the interval since the
+ * previous one among the phases each process was in and adds the engine
+ * usage and VRAM the process had over that interval, weighted by the time
+ * spent in each phase. Phases much shorter than the update interval share
+ * the interval's average; their counts and durations stay exact.
+ */
+class AnnotationCollector {
+public:
+    static constexpr size_t MAX_PENDING = 65536;  // Markers between two updates
+    static constexpr size_t MAX_NESTING = 16;     // Open phases per process
+    static constexpr size_t MAX_PHASES = 1024;    // (process, phase) pairs kept
+    static constexpr unsigned RECEIVE_BATCH = 64;
+
+    explicit AnnotationCollector(const std::string& name = ANNOTATION_DEFAULT_NAME) : name(name) {}
+    ~AnnotationCollector();
+
+    bool start();
+    void stop();
+
+    // Account the interval up to now_ns (CLOCK_MONOTONIC) with the processes of this update
+    void update(uint64_t now_ns, const std::vector<ProcessInfo>& processes);
+
+    // Markers received in the interval of the last update
+    const std::vector<PhaseMarker>& getMarkers() const { return markers; }
+    void getPhases(std::vector<PhaseStats>& phases) const;
+    uint64_t getDropped() const;
+
+private:
+    struct OpenPhase {
+        std::string name;
+        uint64_t since_ns;
+    };
+
+    std::string name;
+    int socket_fd = -1;
+    int wake_fd = -1;
+    std::atomic<bool> running{false};
+    std::thread thread;
+
+    // Filled by the receive thread
+    mutable std::mutex mutex;
+    std::vector<PhaseMarker> pending;
+    uint64_t dropped = 0;  // Markers over MAX_PENDING, or malformed
+
+    // Owned by update()
+    std::vector<PhaseMarker> markers;
+    std::map<pid_t, std::vector<OpenPhase>> open;
+    std::map<std::pair<pid_t, std::string>, PhaseStats> stats;
+    uint64_t last_update_ns = 0;
+
+    void run();
+    void receive();
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <libdrm/amdgpu.h>
+
+// Busy fraction of one hardware block over the last collection interval
+struct BlockUsage {
+    const char* name;
+    float busy;  // percent
+};
+
+/**
+ * Vertical (bitsliced) counters for the 32 bits of a status register
+ *
+ * Bit i of planes[k] holds bit k of lane i's count, so one sample bumps all
+ * 32 per-bit counters with a short ripple-carry over the planes instead of
+ * testing every bit. The planes are folded into 64-bit totals before they
+ * can overflow, and on every drain.
+ */
+class BitslicedCounter {
+public:
+    static constexpr unsigned PLANES = 16;
+
+    void add(uint32_t mask);
+    uint64_t get(unsigned bit) const;
+    void clear();
+
+private:
+    uint32_t planes[PLANES] = {};
+    uint32_t pending = 0;
+    uint64_t totals[32] = {};
+
+    void fold();
+};
+
+/**
+ * Decodes GRBM/SRBM status samples into per-block busy fractions
+ *
+ * Purely a function of the raw register values, so recorded register dumps
+ * can be replayed through accumulate() without a GPU.
+ */
+class BlockBusyAccumulator {
+public:
+    static constexpr unsigned MAX_REGISTERS = 4;
+
+    struct BlockBit {
+        const char* name;
+        unsigned reg;   // index into the register set
+        unsigned bit;
+    };
+
+    struct RegisterLayout {
+        const char* family;
+        unsigned count;
+        uint32_t offsets[MAX_REGISTERS];  // dword offsets for amdgpu_read_mm_registers
+        std::vector<BlockBit> blocks;
+    };
+
+    explicit BlockBusyAccumulator(const RegisterLayout& layout) : layout(layout) {}
+
+    // Register layout for an AMDGPU_FAMILY_* id
+    static const RegisterLayout& layoutForFamily(uint32_t family_id);
+    // Register layout by its family name, as block dumps record it; nullptr if unknown
+    static const RegisterLayout* layoutForName(const std::string& family);
+
+    const RegisterLayout& getLayout() const { return layout; }
+
+    // One sample: values[i] is the content of layout.offsets[i]
+    void accumulate(const uint32_t* values);
+
+    uint64_t getSampleCount() const { return samples; }
+
+    // Busy percentages since the previous collect()
+    std::vector<BlockUsage> collect();
+
+private:
+    const RegisterLayout& layout;
+    BitslicedCounter counters[MAX_REGISTERS];
+    uint64_t samples = 0;
+};
+
+/**
+ * Register dumps: a header line naming the layout and its register offsets,
+ * then one line of hex register values per sample
+ *
+ *   amdgpu-top blocks GFX9+ 0x2004 0x2002
+ *   a0000000 00000000
+ */
+void writeBlockDumpHeader(FILE* file, const BlockBusyAccumulator::RegisterLayout& layout);
+void writeBlockDumpSample(FILE* file, const BlockBusyAccumulator::RegisterLayout& layout, const uint32_t* values);
+
+// Decode a whole dump into the busy percentages over all of its samples
+bool replayBlockDump(FILE* file, std::vector<BlockUsage>& usage, uint64_t& samples, std::string& error);
+
+/**
+ * radeontop-style sampler polling the status registers on its own thread
+ *
+ * AMDGPU_INFO_SENSOR_GPU_LOAD is a slow SMU average; polling GRBM_STATUS
+ * at kHz rates gives the busy fraction of each pipeline block instead.
+ * With record() every sample is also written to a register dump.
+ */
+class BlockSampler {
+public:
+    static constexpr unsigned DEFAULT_RATE_HZ = 1000;
+
+    BlockSampler(amdgpu_device_handle device, uint32_t family_id, unsigned rate_hz = DEFAULT_RATE_HZ);
+    ~BlockSampler();
+
+    bool start();
+    void stop();
+
+    // Write the samples to a register dump at path, call before start()
+    bool record(const std::string& path);
+
+    std::vector<BlockUsage> collect();
+
+private:
+    amdgpu_device_handle device;
+    unsigned rate_hz;
+    BlockBusyAccumulator accumulator;
+    std::mutex accumulator_mutex;
+    std::atomic<bool> running;
+    std::thread thread;
+    FILE* dump = nullptr;
+
+    void run();
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include "snapshot.hpp"
+#include "snapshot_stream.hpp"
+
+static constexpr uint16_t AGENT_DEFAULT_PORT = 7411;
+
+// "/path" for a Unix socket, otherwise "host", "host:port" or "[v6 address]:port"
+bool resolveAgentAddress(const std::string& address, bool passive, sockaddr_storage& addr, socklen_t& addr_len);
+
+/**
+ * Serves the snapshots of this host to aggregators
+ *
+ * Every reader gets a keyframe when it connects and the shared delta
+ * stream after that. Sockets are non-blocking and driven by epoll from
+ * poll(), so a stalled reader never holds up sampling; one that falls
+ * MAX_PENDING_BYTES behind is dropped and starts over when it reconnects.
+ */
+class SnapshotAgent {
+public:
+    static constexpr size_t MAX_PENDING_BYTES = 4 << 20;
+
+    explicit SnapshotAgent(const std::string& address) : address(address) {}
+    ~SnapshotAgent();
+
+    bool open();
+
+    // Queue snapshot for every reader and send what the sockets take right away
+    void publish(const Snapshot& snapshot);
+
+    // Accept readers and flush queued frames for timeout_ms
+    void poll(int timeout_ms);
+
+    size_t getClientCount() const { return clients.size(); }
+
+private:
+    struct Client {
+        std::vector<uint8_t> pending;
+        size_t sent = 0;
+        bool needs_keyframe = true;
+        bool want_write = false;
+    };
+
+    std::string address;
+    std::string unix_path;  // unlinked again on close
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    std::map<int, Client> clients;
+    SnapshotEncoder encoder;
+    std::vector<uint8_t> delta;
+    std::vector<uint8_t> keyframe;
+
+    void acceptClients();
+    bool flush(int fd, Client& client);
+    void drop(int fd);
+};
+
+/**
+ * Merges the snapshot streams of many agents
+ *
+ * One thread runs an epoll loop over non-blocking connections to all
+ * agents, reconnecting after RECONNECT_MS and dropping agents that sent
+ * nothing for STALE_MS. Addresses are resolved once by start(), so a
+ * slow name server cannot stall the loop. getSnapshot() returns the GPUs
+ * of every agent tagged with its address; agents without a snapshot are
+ * listed as unreachable.
+ */
+class ClusterAggregator {
+public:
+    static constexpr int RECONNECT_MS = 2000;
+    static constexpr int STALE_MS = 5000;
+
+    explicit ClusterAggregator(const std::vector<std::string>& addresses);
+    ~ClusterAggregator();
+
+    bool start();
+    void stop();
+
+    // Merged snapshot of all agents; false if nothing changed since the last call
+    bool getSnapshot(Snapshot& snapshot);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Peer {
+        std::string address;
+        sockaddr_storage addr;     // Resolved once by start(), the loop never blocks on DNS
+        socklen_t addr_len = 0;    // 0 if the address did not resolve
+        int fd = -1;
+        bool connecting = false;
+        std::vector<uint8_t> input;
+        SnapshotDecoder decoder;
+        Snapshot scratch;          // Only touched by the event loop
+        Snapshot snapshot;         // Guarded by mutex
+        bool has_snapshot = false; // Guarded by mutex
+        Clock::time_point retry_at;
+        Clock::time_point last_frame;
+    };
+
+    std::vector<Peer> peers;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    std::atomic<bool> running;
+    std::thread thread;
+
+    std::mutex mutex;
+    bool changed = true;
+
+    void run();
+    void connectPeer(size_t index);
+    void finishConnect(size_t index);
+    void receive(size_t index);
+    void disconnect(size_t index);
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Distribution of one metric over a run, in bounded memory
+ *
+ * Values go into log-linear bins of 1/SCALE resolution at the bottom and
+ * 1/2^SUB_BITS (about 3%) relative width above, kept sparse, so a metric
+ * costs at most a few thousand bins however long the run. Mean and
+ * variance are exact (Welford), and the lag-1 autocorrelation of the
+ * sequence gives the effective number of independent samples, which is
+ * what significance tests on a time series need: a GPU sampled every
+ * 250 ms does not give four new observations a second.
+ */
+class MetricDistribution {
+public:
+    static constexpr unsigned SUB_BITS = 5;
+    static constexpr double SCALE = 64;
+
+    void add(double value);
+
+    uint64_t getCount() const { return count; }
+    double getMean() const { return mean; }
+    double getVariance() const { return count > 1 ? m2 / (count - 1) : 0; }
+    double getEffectiveCount() const;
+    double getPercentile(double percent) const;
+
+    // Largest difference of the two cumulative distributions (Kolmogorov-Smirnov D)
+    static double distance(const MetricDistribution& a, const MetricDistribution& b);
+
+private:
+    std::map<uint32_t, uint64_t> bins;
+    uint64_t count = 0;
+    double mean = 0;
+    double m2 = 0;
+    // Lag-1 products around the first value, which keeps the sums small
+    double origin = 0;
+    double previous = 0;
+    double sum_products = 0;
+    double sum_current = 0;
+    double sum_previous = 0;
+
+    static uint32_t binOf(double value);
+    static double binLow(uint32_t bin);
+};
+
+// One metric of a run: its distribution and, for counters and engine usage, its total
+struct CompareMetric {
+    MetricDistribution distribution;
+    bool cumulative = false;  // a counter such as energy, compared by its increase
+    double total = 0;         // increase of a counter, or integral over time (% s for usage)
+
+    // Values at one timestamp are summed first (the clients of one name, partitions)
+    double pending_s = -1;
+    double pending = 0;
+
+    void add(double time_s, double value);
+    void finish();
+};
+
+/**
+ * Everything compare reads from one recording
+ *
+ * Understands the .agtn frame streams of the flight recorder, the Chrome
+ * JSON traces of --trace and CSV files with a time column. Files are read
+ * once, front to back; only the current snapshot or event and the
+ * per-metric distributions are kept. Samples are grouped by the phase
+ * markers open at the time, or all into one group when aligning by time.
+ */
+class CompareRun {
+public:
+    // Metrics by group (phase name, or "" for the whole run) and (section, metric)
+    typedef std::map<std::pair<std::string, std::string>, CompareMetric> Metrics;
+
+    CompareRun(bool by_phase, double skip_s, double duration_s)
+        : by_phase(by_phase), skip_s(skip_s), duration_s(duration_s) {}
+
+    bool read(const std::string& path, std::string& error);
+
+    const std::map<std::string, Metrics>& getGroups() const { return groups; }
+    uint64_t getSampleCount() const { return samples; }
+    double getDuration() const { return last_s > first_s ? last_s - first_s : 0; }
+    bool hasMarkers() const { return has_markers; }
+
+private:
+    bool by_phase;
+    double skip_s;
+    double duration_s;
+
+    std::map<std::string, Metrics> groups;
+    std::map<std::string, unsigned> open_phases;  // markers begun and not ended yet
+    uint64_t samples = 0;
+    double origin_s = -1;  // first timestamp, aligning by time is relative to it
+    double first_s = -1;
+    double last_s = -1;
+    bool has_markers = false;
+
+    bool readStream(FILE* file, std::string& error);
+    bool readTrace(FILE* file, std::string& error);
+    bool readCSV(FILE* file, std::string& error);
+
+    void beginPhase(const std::string& name);
+    void endPhase(const std::string& name);
+    // Account one value at time_s (seconds, any origin), which held for the seconds before it,
+    // to the groups open now; a cumulative value is the increase of a counter
+    void add(double time_s, const std::string& section, const std::string& metric, double value, double seconds,
+             bool cumulative = false);
+    void finish();
+};
+
+struct CompareOptions {
+    bool by_phase = false;
+    double skip_s = 0;      // leading seconds of each run left out when aligning by time
+    double duration_s = 0;  // seconds compared after that, 0 for all
+};
+
+// Print the differences of recording b against recording a; false with a message in error
+// if either can not be read
+bool compareRecordings(const std::string& a, const std::string& b, const CompareOptions& options, FILE* out,
+                       std::string& error);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+/**
+ * Watches the DRM device directory for nodes coming and going
+ *
+ * inotify on /dev/dri sees driver binds/unbinds, hot-plug and partition
+ * nodes being (re)created. Bursts of events are coalesced and the callback
+ * runs on the watcher thread once the directory has been quiet for a
+ * moment, so udev has finished creating the nodes and fixing permissions.
+ */
+class DeviceWatcher {
+public:
+    static constexpr int SETTLE_MS = 250;
+
+    explicit DeviceWatcher(std::function<void()> on_change)
+        : on_change(std::move(on_change)), running(false) {}
+    ~DeviceWatcher();
+
+    bool start(const std::string& path = "/dev/dri");
+    void stop();
+
+    // Run the callback as if the directory had changed, e.g. after a device stopped answering
+    void trigger();
+
+private:
+    std::function<void()> on_change;
+    int inotify_fd = -1;
+    int wake_fd = -1;
+    std::atomic<bool> running;
+    std::thread thread;
+
+    void run();
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "amdgpu_top.h"
+#include "snapshot_stream.hpp"
+
+struct Snapshot;
+
+/**
+ * Condition on the device metrics of one GPU
+ *
+ * "gpu_usage < 10 and vram > 90 for 5s": comparisons joined by "and" (or
+ * "while"), optionally held for a number of seconds before it fires.
+ * Percent signs are allowed after values. The fields are gpu_usage, vram
+ * and gtt (percent used), temp and junction (°C), power (W), power_cap
+ * (percent of the cap), throttled (active throttle reasons) and evictions
+ * (per second).
+ */
+class FlightTrigger {
+public:
+    // False with a message in error if the expression does not parse
+    bool parse(const std::string& expression, std::string& error);
+
+    bool matches(const amdgpu_top_gpu& gpu) const;
+    uint64_t getHoldNs() const { return hold_ns; }
+    const std::string& getExpression() const { return expression; }
+
+private:
+    enum Field { GPU_USAGE, VRAM, GTT, TEMP, JUNCTION, POWER, POWER_CAP, THROTTLED, EVICTIONS };
+    enum Op { LESS, LESS_EQUAL, GREATER, GREATER_EQUAL };
+
+    struct Condition {
+        Field field;
+        Op op;
+        float value;
+    };
+
+    std::string expression;
+    std::vector<Condition> conditions;
+    uint64_t hold_ns = 0;
+
+    static float getValue(const amdgpu_top_gpu& gpu, Field field);
+};
+
+/**
+ * Always-on recorder of the last samples, dumped around a trigger
+ *
+ * Every update is flattened into the next slot of a ring sized for the
+ * pre- and post-trigger windows at samples_per_s. An update that comes
+ * sooner than one such period after the newest slot overwrites it, so the
+ * ring spans the windows however often the sampler records. Slots are
+ * preallocated and written under a per-slot sequence lock, so recording
+ * never allocates, locks or waits for the flush thread. Once a trigger has held and the post window has
+ * been recorded, the flush thread copies the window out of the ring and
+ * writes it in the agent stream format (see SnapshotEncoder) to
+ * flight-<time>-gpu<N>.agtn in the output directory. Phase markers of each
+ * process scan go to a ring of their own under the same scheme and are
+ * written in time order between the snapshots, as STREAM_MARKERS frames.
+ */
+class FlightRecorder {
+public:
+    static constexpr uint32_t MAX_GPUS = 16;
+    static constexpr uint32_t MAX_NODES = 128;
+    static constexpr uint32_t MAX_PROCESSES = 1024;
+    static constexpr uint32_t MAX_MARKERS = 4096;
+
+    // samples_per_s sizes the ring, more than one with adaptive sampling. Records that come
+    // faster than that replace the newest slot rather than take a slot of their own.
+    FlightRecorder(const FlightTrigger& trigger, const std::string& directory, unsigned pre_s, unsigned post_s,
+                   unsigned samples_per_s = 1);
+    ~FlightRecorder();
+
+    bool start();
+
+    // Called by the sampler after every update
+    void record(const Snapshot& snapshot);
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};  // odd while written
+        uint64_t sample = 0;
+        amdgpu_top_snapshot flat = {};
+        std::vector<amdgpu_top_gpu> gpus;
+        std::vector<amdgpu_top_node> nodes;
+        std::vector<amdgpu_top_process> processes;
+    };
+
+    struct MarkerSlot {
+        std::atomic<uint64_t> sequence{0};  // odd while written
+        uint64_t index = 0;
+        StreamMarker marker = {};
+    };
+
+    enum State { WATCHING, CAPTURING, FLUSHING };
+
+    FlightTrigger trigger;
+    std::string directory;
+    uint64_t pre_ns;
+    uint64_t post_ns;
+
+    std::unique_ptr<Slot[]> slots;
+    size_t slot_count;
+    uint64_t slot_spacing_ns;  // shortest time between the first records of two slots
+    uint64_t slot_started_ns = 0;  // CLOCK_REALTIME of the first record in the newest slot
+    std::atomic<uint64_t> next_sample{0};
+
+    std::unique_ptr<MarkerSlot[]> markers;
+    std::atomic<uint64_t> next_marker{0};
+    uint64_t last_scan_ns = 0;  // markers stay in the snapshots until the next scan
+
+    // Sampler side
+    State state = WATCHING;
+    std::vector<uint64_t> holding_since;  // per GPU, 0 while the trigger does not match
+    uint64_t trigger_ns = 0;
+    uint32_t trigger_gpu = 0;
+
+    // Handed to the flush thread, request set last
+    std::atomic<bool> request{false};
+    std::atomic<uint64_t> dump_start_ns{0};
+    std::atomic<uint64_t> dump_end_ns{0};
+    std::atomic<uint64_t> dump_trigger_ns{0};
+    std::atomic<uint32_t> dump_gpu{0};
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<bool> running{false};
+    std::thread thread;
+
+    void recordMarkers(const Snapshot& snapshot);
+    void evaluate(const amdgpu_top_snapshot& flat);
+    void runFlush();
+    void dump();
+    bool copySlot(uint64_t sample, Slot& copy) const;
+    void copyMarkers(uint64_t start_ns, uint64_t end_ns, std::vector<StreamMarker>& copy) const;
+};
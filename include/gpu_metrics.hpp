@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "sysfs.hpp"
+
+/**
+ * Normalized view of the SMU metrics table exported in sysfs gpu_metrics
+ *
+ * The layout depends on the table revision (see kgd_pp_interface.h); fields
+ * the revision does not provide keep their has_* flag cleared.
+ */
+struct GPUMetricsTable {
+    static constexpr int MAX_XGMI_LINKS = 8;
+
+    uint8_t format_revision = 0;
+    uint8_t content_revision = 0;
+
+    // Driver timestamp of the sample in nanoseconds
+    uint64_t system_clock_counter = 0;
+
+    // Socket power in watts
+    bool has_socket_power = false;
+    uint16_t socket_power = 0;
+
+    // Energy accumulator in 15.259 uJ units, wraps at energy_accumulator_bits
+    bool has_energy = false;
+    uint64_t energy_accumulator = 0;
+    unsigned energy_accumulator_bits = 64;
+
+    // Current clocks in MHz
+    bool has_current_clocks = false;
+    uint16_t current_gfxclk = 0;
+    uint16_t current_uclk = 0;
+
+    // ASIC specific throttler bits, and the ASIC independent SMU_THROTTLER_* bits (v1.3)
+    bool has_throttle_status = false;
+    uint32_t throttle_status = 0;
+    bool has_indep_throttle_status = false;
+    uint64_t indep_throttle_status = 0;
+
+    // Negotiated PCIe link, speed in 0.1 GT/s
+    bool has_pcie_link = false;
+    uint16_t pcie_link_width = 0;
+    uint16_t pcie_link_speed = 0;
+
+    // PCIe bandwidth in GB/s (MI300)
+    bool has_pcie_bandwidth = false;
+    uint64_t pcie_bandwidth_acc = 0;
+    uint64_t pcie_bandwidth_inst = 0;
+
+    // XGMI links: width, bitrate in Gbps and per-link data counters in KB (MI300)
+    bool has_xgmi = false;
+    uint16_t xgmi_link_width = 0;
+    uint16_t xgmi_link_speed = 0;
+    uint64_t xgmi_read_data_acc[MAX_XGMI_LINKS] = {};
+    uint64_t xgmi_write_data_acc[MAX_XGMI_LINKS] = {};
+};
+
+class GPUMetricsReader {
+public:
+    static constexpr double ENERGY_UNIT_JOULES = 15.259e-6;
+
+    // device_path is the sysfs directory of the PCI device
+    bool open(const std::string& device_path);
+    bool isOpen() const { return file.isOpen(); }
+    bool read(GPUMetricsTable& table) const;
+
+    // Decode a raw table; exposed for recorded dumps
+    static bool parse(const uint8_t* data, size_t size, GPUMetricsTable& table);
+
+private:
+    SysfsFile file;
+};
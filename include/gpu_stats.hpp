@@ -1,16 +1,46 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sys/types.h>
 #include <libdrm/amdgpu.h>
 #include <libdrm/amdgpu_drm.h>
 #include <xf86drm.h>
 #include "process_info.hpp"
+#include "accounting.hpp"
+#include "adaptive_rate.hpp"
+#include "gpu_metrics.hpp"
+#include "block_sampler.hpp"
+#include "hwmon.hpp"
+#include "link_sampler.hpp"
+#include "residency.hpp"
+#include "device_watcher.hpp"
+#include "growth_trend.hpp"
+#include "sched_trace.hpp"
+
+struct Snapshot;
+class SnapshotPublisher;
+class FlightRecorder;
+class FlightTrigger;
+class TraceWriter;
+class AnnotationCollector;
+class RuleEngine;
 
 class GPUDevice {
 public:
+    // How hard VRAM oversubscription is hitting the device
+    enum PressureLevel {
+        PRESSURE_NONE,
+        PRESSURE_MODERATE,
+        PRESSURE_SEVERE
+    };
+
     // GPU Metrics (sensor data, memory usage, etc.)
     struct Metrics {
         float gpu_usage = 0;
@@ -18,35 +48,128 @@ public:
         float memory_total = 0;
         float memory_cpu_accessible_total = 0;
         float memory_cpu_accessible_used = 0;
+        float gtt_used = 0;
+        float gtt_total = 0;
+        float evictions_rate = 0;         // Buffer evictions per second
+        float bytes_moved_rate = 0;       // Bytes migrated per second
+        float cpu_page_faults_rate = 0;   // CPU page faults on VRAM per second
+        uint32_t vram_lost_counter = 0;
+        uint32_t reset_count = 0;         // VRAM-losing resets seen while monitoring
+        PressureLevel eviction_pressure = PRESSURE_NONE;
         uint32_t temperature = 0;
+        uint32_t temperature_junction = 0;
+        uint32_t temperature_memory = 0;
         uint32_t power_usage = 0;
-        uint32_t fan_speed = 0;
+        uint32_t power_cap = 0;
+        uint32_t fan_speed = 0;           // RPM
+        uint32_t fan_pwm = 0;             // Percent
+        uint32_t voltage_gfx = 0;         // mV
+        uint32_t voltage_northbridge = 0; // mV
         uint32_t gpu_clock = 0;
         uint32_t memory_clock = 0;
+        double energy = 0;                // Joules since monitoring started
+        bool energy_from_accumulator = false;
+        std::vector<BlockUsage> block_usage;  // Empty unless block sampling is on
+        LinkStats link;
+        std::vector<ResidencyShare> sclk_residency;      // per DPM level
+        std::vector<ResidencyShare> mclk_residency;
+        std::vector<ResidencyShare> throttle_residency;  // per throttler category
+        std::vector<std::string> throttle_reasons;       // active at this update
+        uint64_t timestamp_ns = 0;                       // CLOCK_REALTIME of this sample
     };
 
-    GPUDevice(int fd, amdgpu_device_handle device, drmVersionPtr version, const std::string& pci_path);
+    GPUDevice(int fd, amdgpu_device_handle device, drmVersionPtr version, const std::string& pci_path,
+              dev_t render_node, dev_t primary_node, int partition = -1);
     ~GPUDevice();
 
     // Device identification
     const char* getGPUName() const;
     const char* getMarketName() const;
     const std::string& getPCIPath() const { return pci_path; }
+    std::string getSysfsPath() const { return "/sys/bus/pci/devices/" + pci_path; }
+    dev_t getRenderNode() const { return render_node; }
+    dev_t getPrimaryNode() const { return primary_node; }
+
+    // Compute partition (XCP) served by this node, -1 on GPUs without partitioning.
+    // Partition 0 is the PCI function's own node and owns the device wide sensors.
+    int getPartition() const { return partition; }
+    const std::string& getPartitionMode() const { return partition_mode; }
+
+    // The device stopped answering (unbound, unplugged), its handle is dead
+    bool isLost() const { return lost; }
 
-    // Metrics and process info
+    // Poll GRBM/SRBM status registers on a dedicated thread, recording to
+    // <record_dir>/<pci path>.blocks if given
+    bool startBlockSampler(unsigned rate_hz, const std::string& record_dir = "");
+
+    // Metrics and process info as of the last GPUStats::update()
     Metrics getMetrics() const;
     std::vector<ProcessInfo> getProcesses() const;
 
 private:
+    friend class GPUStats;
+
     int fd;
     amdgpu_device_handle device;
     drmVersionPtr version;
     std::string pci_path;
+    dev_t render_node;
+    dev_t primary_node;
+    int partition;
+    std::string partition_mode;  // SPX, DPX, TPX, QPX or CPX
+    SysfsFile compute_partition;
+    bool partition_mode_changed = false;
+    bool lost = false;
+    bool has_vram_lost_counter = false;
     mutable std::string market_name_cache;
 
+    Metrics metrics;
+    std::vector<ProcessInfo> processes;
+
+    HwmonSensors hwmon;
+    HwmonReadings hwmon_readings;
+    LinkSampler links;
+    ResidencyTracker residency;
+
+    // Energy integration state
+    GPUMetricsReader gpu_metrics;
+    GPUMetricsTable metrics_table;
+    bool has_metrics_table = false;
+    bool has_energy_accumulator = false;
+    uint64_t last_energy_accumulator = 0;
+    uint32_t last_power = 0;
+    uint64_t last_update = 0;  // CLOCK_MONOTONIC ns
+    double energy_delta = 0;
+    double energy_unattributed = 0;  // since the last process scan
+    std::map<std::pair<pid_t, dev_t>, double> process_energy;
+
+    // VRAM and GTT trend of each client, for leak detection
+    struct MemoryTrend {
+        GrowthTrend vram;
+        GrowthTrend gtt;
+    };
+    std::map<pid_t, MemoryTrend> memory_trends;
+
+    AdaptiveRate sensor_rate;
+
+    std::unique_ptr<BlockSampler> block_sampler;
+
+    // Buffer migration counters of the previous update
+    bool has_migration_counters = false;
+    uint64_t last_evictions = 0;
+    uint64_t last_bytes_moved = 0;
+    uint64_t last_cpu_page_faults = 0;
+
     // Helper functions
+    // Sample at the time of the sampling pass, now_ns on CLOCK_MONOTONIC and timestamp_ns on
+    // CLOCK_REALTIME. Returns true if the sensors moved since the previous sample, see AdaptiveRate
+    bool update(uint64_t now_ns, uint64_t timestamp_ns);
+    bool checkDeviceState();
     void updateMetrics(Metrics& metrics) const;
-    void updateProcessInfo(std::vector<ProcessInfo>& processes) const;
+    void updateEnergy(double elapsed);
+    void updateMemoryPressure(double elapsed);
+    void attributeEnergy(const std::vector<GPUDevice*>& nodes);
+    void updateMemoryTrends(uint64_t now_ns);
 };
 
 class GPUStats {
@@ -55,10 +178,127 @@ public:
     ~GPUStats();
 
     bool initialize();
+    // Every DRM node, compute partitions included
     size_t getGPUCount() const { return gpus.size(); }
     GPUDevice* getGPU(size_t index);
     const GPUDevice* getGPU(size_t index) const;
 
+    // Physical GPUs and the getGPU() indices of their nodes, partition 0 first
+    size_t getPhysicalGPUCount() const { return physical_gpus.size(); }
+    const std::vector<size_t>& getPartitions(size_t physical) const { return physical_gpus[physical]; }
+
+    // Device wide metrics of a physical GPU, with memory combined over its partitions
+    GPUDevice::Metrics getAggregatedMetrics(size_t physical) const;
+
+    // Copy of everything the last update() sampled, grouped by physical GPU
+    void getSnapshot(Snapshot& snapshot) const;
+
+    // Sample all devices and scan /proc once for their clients
+    void update();
+
+    // Sample the devices only; the process lists stay those of the last scan.
+    // Lets front ends show the GPUs before the first /proc walk is done.
+    void sampleDevices();
+
+    // Sample each device and the process scan at a rate of its own, between min_ms and
+    // max_ms depending on how fast their metrics move, within cpu_budget_percent of one CPU.
+    // Set before startFlightRecorder(), which sizes its window for the fastest rate.
+    void setAdaptiveSampling(unsigned min_ms, unsigned max_ms, float cpu_budget_percent);
+    bool isAdaptive() const { return adaptive; }
+
+    // Sample what is due by now; the same as update() unless sampling is adaptive
+    void updateDue();
+    // When the next device or process scan is due with adaptive sampling
+    std::chrono::steady_clock::time_point getNextSampleTime() const;
+
+    // Watch /dev/dri and add, remove or reopen devices while sampling continues
+    bool watchDevices();
+
+    // Sample per-block busy bits on every device, returns false if none supports it;
+    // with record_dir every device also writes a register dump there
+    bool startBlockSampling(unsigned rate_hz, const std::string& record_dir = "");
+
+    // Keep cumulative per-process and per-cgroup usage in an append-only file
+    bool openLedger(const std::string& path);
+    const AccountingLedger* getLedger() const { return ledger.get(); }
+
+    // Periodically rewrite path with the clock and throttle residency of every GPU
+    void exportResidency(const std::string& path);
+    bool writeResidency() const;
+
+    // Publish every update into a shared-memory segment for local readers
+    bool publishSnapshots(const std::string& name);
+
+    // Keep the last samples in memory and write them to directory when trigger fires
+    bool startFlightRecorder(const FlightTrigger& trigger, const std::string& directory, unsigned pre_s,
+                             unsigned post_s);
+
+    // Take phase markers from workloads on the annotation socket name, see annotation_client.hpp
+    bool collectAnnotations(const std::string& name);
+
+    // Job latencies from the GPU scheduler tracepoints (needs tracefs access), also
+    // recorded to record_dir for replay when it is not empty
+    bool startSchedTrace(const std::string& record_dir);
+
+    // Append every update to a Chrome JSON trace at path
+    bool startTrace(const std::string& path);
+
+    // Evaluate an alert rule (see rules.hpp) on every update, running exec when it fires
+    // or clears. False with the parse error in error.
+    bool addAlertRule(const std::string& rule, const std::string& exec, std::string& error);
+    void setAlertLog(FILE* file);
+    const RuleEngine* getRuleEngine() const { return rules.get(); }
+
 private:
+    static constexpr unsigned RESIDENCY_EXPORT_INTERVAL_S = 10;
+
+    // What a removed device leaves for its successor at the same PCI path and partition
+    struct DeviceHistory {
+        double energy;
+        ResidencyTracker residency;
+    };
+
     std::vector<std::unique_ptr<GPUDevice>> gpus;
+    std::vector<std::vector<size_t>> physical_gpus;
+    std::map<dev_t, dev_t> drm_nodes;  // primary/render node -> render node
+    std::unique_ptr<AccountingLedger> ledger;
+    std::string residency_path;
+    timespec last_residency_export = {0, 0};
+    unsigned block_rate_hz = 0;
+    std::string block_record_dir;
+    std::map<std::string, DeviceHistory> history;
+    uint64_t last_update_ns = 0;  // CLOCK_REALTIME
+    uint64_t last_scan_ns = 0;
+    bool has_process_scan = false;
+    bool adaptive = false;
+    uint64_t adaptive_min_ns = AdaptiveRate::DEFAULT_MIN_NS;
+    uint64_t adaptive_max_ns = AdaptiveRate::DEFAULT_MAX_NS;
+    AdaptiveRate scan_rate;
+    SamplingBudget budget;
+    double pass_cpu_ns = 0;  // finishUpdate() per adaptive pass, moving average
+    std::unique_ptr<SnapshotPublisher> publisher;
+    std::unique_ptr<FlightRecorder> recorder;
+    std::unique_ptr<TraceWriter> tracer;
+    std::unique_ptr<AnnotationCollector> annotations;
+    std::unique_ptr<SchedTracer> sched_tracer;
+    std::unique_ptr<RuleEngine> rules;
+    std::vector<SchedLatency> sched_latencies;  // as of the last update
+    std::unique_ptr<Snapshot> recorded_snapshot;  // reused by every update for the collectors above
+
+    // Written by the watcher thread, applied by the next update()
+    std::mutex pending_mutex;
+    std::set<dev_t> held_nodes;  // render nodes open in gpus or pending
+    std::set<dev_t> present_nodes;
+    std::vector<std::unique_ptr<GPUDevice>> pending_devices;
+    std::vector<std::unique_ptr<GPUDevice>> retired_devices;  // removed by update(), destroyed by the watcher
+    bool has_pending_scan = false;
+
+    std::unique_ptr<DeviceWatcher> watcher;
+
+    void addDevice(std::unique_ptr<GPUDevice> gpu);
+    void scanProcesses();
+    void finishUpdate();
+    void regroup();
+    void rescan();
+    void applyPendingScan();
 }; 
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Trend of a memory counter, for telling a leak from a working set
+ *
+ * Samples are averaged over BUCKETS_PER_WINDOW slices of the window, which
+ * takes out the jitter of allocators and caches, and an exponentially
+ * weighted least-squares line is fitted through the averages, the weight
+ * of a point falling by e every window. The weighted means and
+ * (co)variances of time and value are updated in place, so a sample costs
+ * a handful of operations and the state is a few doubles. Variances are
+ * kept around the means, which stays exact for byte counts in the hundreds
+ * of GiB where sums of squares would cancel.
+ *
+ * Growth counts as sustained once the counter has been followed for a
+ * quarter of the window, the slope is at least MIN_GROWTH and the line
+ * explains MIN_FIT of the variance: a steady or stepwise leak fits a line
+ * well, a single jump (a model being loaded) or a fluctuating cache does
+ * not.
+ */
+class GrowthTrend {
+public:
+    static constexpr double DEFAULT_WINDOW_S = 3600;
+    static constexpr double MIN_GROWTH = 16.0 * 1048576 / 3600;  // bytes per second, 16 MiB/h
+    static constexpr double MIN_FIT = 0.8;                       // r^2
+    static constexpr unsigned BUCKETS_PER_WINDOW = 24;
+
+    explicit GrowthTrend(double window_seconds = DEFAULT_WINDOW_S) : window_seconds(window_seconds) {}
+
+    // A sample of the counter at now_ns (CLOCK_MONOTONIC)
+    void add(uint64_t now_ns, double value);
+
+    // Units per second, 0 until two slices are complete
+    double getSlope() const { return time_variance > 0 ? covariance / time_variance : 0; }
+    // Share of the weighted variance the line explains, 0 to 1
+    double getFit() const;
+    double getSpan() const { return span; }
+    bool isGrowing() const;
+
+private:
+    double window_seconds;
+    uint64_t first_ns = 0;
+    double span = 0;  // seconds followed
+
+    // Slice being averaged
+    double bucket_end = 0;
+    double bucket_sum = 0;
+    unsigned bucket_count = 0;
+
+    // Line through the slice averages
+    double last_t = 0;
+    double weight = 0;
+    double mean_t = 0;
+    double mean_value = 0;
+    double time_variance = 0;  // weighted sums of squared deviations
+    double value_variance = 0;
+    double covariance = 0;
+
+    void addPoint(double t, double value);
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "sysfs.hpp"
+
+// One pass over the hwmon attributes; -1 marks sensors the board lacks
+struct HwmonReadings {
+    int64_t fan_rpm = -1;
+    int64_t fan_pwm = -1;              // percent of pwm1_max
+    int64_t temp_edge = -1;            // millidegrees Celsius
+    int64_t temp_junction = -1;
+    int64_t temp_memory = -1;
+    int64_t voltage_gfx = -1;          // millivolts
+    int64_t voltage_northbridge = -1;
+    int64_t power_cap = -1;            // microwatts
+    int64_t power_average = -1;
+};
+
+/**
+ * The amdgpu hwmon sensors of one GPU
+ *
+ * The hwmonX directory is discovered once and every attribute stays open,
+ * each tick costs one pread() per sensor and no open/close.
+ */
+class HwmonSensors {
+public:
+    // device_path is the sysfs directory of the PCI device
+    bool open(const std::string& device_path);
+    bool isOpen() const { return !hwmon_path.empty(); }
+    const std::string& getPath() const { return hwmon_path; }
+
+    HwmonReadings read() const;
+
+private:
+    enum Sensor {
+        FAN_RPM,
+        FAN_PWM,
+        TEMP_EDGE,
+        TEMP_JUNCTION,
+        TEMP_MEMORY,
+        VOLTAGE_GFX,
+        VOLTAGE_NORTHBRIDGE,
+        POWER_CAP,
+        POWER_AVERAGE,
+        SENSOR_COUNT
+    };
+
+    std::string hwmon_path;
+    SysfsFile files[SENSOR_COUNT];
+    int64_t pwm_max = 255;
+
+    int64_t readSensor(Sensor sensor) const;
+};
@@ -1,33 +1,82 @@
 #pragma once
 
+#include <functional>
 #include <ftxui/dom/elements.hpp>
-#include "gpu_stats.hpp"
+#include <ftxui/component/event.hpp>
 #include "process_info.hpp"
+#include "process_table.hpp"
+#include "snapshot.hpp"
 
 class Layout {
 public:
-    Layout();
+    // Fills in the next snapshot, sampled locally or read from a published segment;
+    // returns false to keep showing the previous one
+    typedef std::function<bool(Snapshot&)> SnapshotSource;
+
+    explicit Layout(SnapshotSource source);
+    void update();
     ftxui::Element render();
+
+    // Process table navigation, sorting and filtering; true if the event was used
+    bool handleEvent(const ftxui::Event& event);
     std::string getMetricsText() const;
 
 private:
-    GPUStats gpu_stats;
+    SnapshotSource source;
+    Snapshot snapshot;
+    ProcessTable process_table;
+    bool cluster = false;                 // GPUs come from agents, see ClusterAggregator
+    std::vector<std::string> gpu_labels;  // GPU column of the process table
+    bool filter_editing = false;
+    ftxui::Box process_box;  // Where the table rows landed in the last frame
+    int screen_width = 80;   // Terminal columns, read once per frame
+    int bar_width = 70;      // Usage bars of the GPU blocks being rendered
+    bool heatmap = false;    // The last frame showed GPUs as heatmap cells
+    size_t selected_gpu = 0; // Heatmap cell under the cursor
+    bool gpu_detail = false; // Showing the block of selected_gpu instead of the heatmap
     
     // GPU Grid rendering
     ftxui::Element renderGPUGrid();
-    ftxui::Element renderGPUBlock(const GPUDevice* device);
+    ftxui::Element renderGPUBlock(const GPUSnapshot& gpu);
+    ftxui::Element renderGPUHeatmap();
+    ftxui::Element renderHeatmapCell(size_t index);
+    ftxui::Element renderClusterGrid();
+    ftxui::Element renderClusterCell(const GPUSnapshot& gpu);
+    ftxui::Element renderPartitions(const GPUSnapshot& gpu);
     
     // Individual components
     ftxui::Element renderGPUUsage(const GPUDevice::Metrics& metrics);
     ftxui::Element renderMemoryUsage(const GPUDevice::Metrics& metrics);
+    ftxui::Element renderMemoryPressure(const GPUDevice::Metrics& metrics);
+    ftxui::Element renderBlockUsage(const GPUDevice::Metrics& metrics);
+    ftxui::Element renderSensors(const GPUDevice::Metrics& metrics);
+    ftxui::Element renderResidency(const GPUDevice::Metrics& metrics);
     ftxui::Element renderUsageBar(const std::string& title, float value, uint32_t clock = 0);
     ftxui::Element renderUsageBar(const std::string& title, float value, const std::string& details);
+    ftxui::Element renderLinkPanel();
+    std::string formatBusiestLinks() const;
+    ftxui::Element renderPhasePanel();
+    ftxui::Element renderSchedPanel();
     ftxui::Element renderProcessTable();
-    ftxui::Element renderProcessRow(const ProcessInfo& proc);
+    ftxui::Element renderProcessRow(const ProcessTable::Entry& entry, bool selected);
+    ftxui::Element renderProcessHeader(const std::string& title, ProcessTable::SortColumn column, int width);
     
-    static constexpr size_t GRID_COLUMNS = 4;  // 4 columns for up to 8 GPUs
+    static constexpr int GPU_BLOCK_WIDTH = 64;     // Narrowest column a GPU block gets
+    static constexpr size_t MAX_BLOCK_ROWS = 2;    // More GPUs than fit in these rows become heatmap cells
+    static constexpr int HEATMAP_CELL_WIDTH = 16;  // Index and three 4-column values
+    static constexpr float HEATMAP_HOT_C = 100.0f; // Temperature at the hot end of the scale
+    static constexpr size_t DEFAULT_PROCESS_ROWS = 20;  // Until the first frame is laid out
+    static constexpr int HOST_COLUMN_WIDTH = 20;
+    static constexpr int CLUSTER_CELL_WIDTH = 30;
+    static constexpr size_t PHASE_ROWS = 8;  // Phases with the most time
+    static constexpr size_t SCHED_ROWS = 8;  // Rings with the most jobs per second
+    static constexpr float CPU_BOUND_PERCENT = 90.0f;   // One core saturated...
+    static constexpr float GPU_STARVED_PERCENT = 50.0f; // ...while the GPU engines idle
     
     // Text mode helpers
-    std::string formatGPUMetrics(const GPUDevice* device) const;
+    std::string formatGPUMetrics(const GPUSnapshot& gpu) const;
+    std::string formatPartitions(const GPUSnapshot& gpu) const;
     std::string formatProcessInfo(const std::vector<ProcessInfo>& processes) const;
+    std::string formatPhases() const;
+    std::string formatSchedLatencies() const;
 }; 
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "gpu_metrics.hpp"
+#include "sysfs.hpp"
+
+// Host and fabric link state of one GPU; rates are bytes per second, -1 if unknown
+struct LinkStats {
+    float pcie_speed = 0;          // GT/s
+    float pcie_max_speed = 0;
+    uint32_t pcie_width = 0;       // lanes
+    uint32_t pcie_max_width = 0;
+    float pcie_rx_rate = -1;       // from pcie_bw
+    float pcie_tx_rate = -1;
+    float pcie_bandwidth = -1;     // from gpu_metrics
+
+    uint32_t xgmi_width = 0;       // 0 when the GPU has no active XGMI link
+    uint32_t xgmi_speed = 0;       // Gbps
+    unsigned xgmi_links = 0;       // links that moved data
+    float xgmi_read_rate = -1;
+    float xgmi_write_rate = -1;
+
+    // The link trained below what both ends support
+    bool isDowngraded() const {
+        return pcie_max_speed > 0 && pcie_max_width > 0 &&
+               (pcie_speed < pcie_max_speed || pcie_width < pcie_max_width);
+    }
+};
+
+/**
+ * PCIe and XGMI link monitoring for one GPU
+ *
+ * Link speed/width come from the PCI sysfs attributes, PCIe and XGMI
+ * throughput from the gpu_metrics accumulators where the SMU exports them.
+ * Reading pcie_bw blocks for a second inside the driver while it counts
+ * packets, so that attribute is polled on its own thread and the update
+ * path only picks up its latest result. The destructor joins the thread
+ * and so may wait for the read in progress; stop() lets owners of many
+ * samplers end all their reads at once.
+ */
+class LinkSampler {
+public:
+    LinkSampler() : running(false) {}
+    ~LinkSampler();
+
+    // Ask the pcie_bw thread to exit after its current read, without waiting for it
+    void stop() { running = false; }
+
+    // device_path is the sysfs directory of the PCI device
+    bool open(const std::string& device_path);
+
+    // table may be null when the device has no gpu_metrics
+    void update(const GPUMetricsTable* table, double elapsed, LinkStats& stats);
+
+    // Forget the XGMI accumulators, the SMU restarts them after a GPU reset
+    void resetCounters() { has_xgmi_sample = false; }
+
+private:
+    SysfsFile current_speed;
+    SysfsFile current_width;
+    SysfsFile max_speed;
+    SysfsFile max_width;
+    SysfsFile pcie_bw;
+
+    // Latest pcie_bw result
+    std::mutex pcie_bw_mutex;
+    float pcie_rx_rate = -1;
+    float pcie_tx_rate = -1;
+    std::atomic<bool> running;
+    std::thread pcie_bw_thread;
+
+    // XGMI accumulators of the previous update
+    bool has_xgmi_sample = false;
+    uint64_t last_xgmi_read[GPUMetricsTable::MAX_XGMI_LINKS] = {};
+    uint64_t last_xgmi_write[GPUMetricsTable::MAX_XGMI_LINKS] = {};
+
+    void runPCIeBandwidth();
+    static float readSpeed(const SysfsFile& file);
+};
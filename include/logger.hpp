@@ -3,6 +3,7 @@
 #include <fstream>
 #include <iostream>
 #include <ctime>
+#include <mutex>
 #include <sstream>
 
 class Logger {
@@ -15,6 +16,7 @@ public:
     };
 
     static void init(const std::string& log_file = "", Level level = INFO) {
+        std::lock_guard<std::mutex> lock(instance().mutex);
         instance().log_level = level;
         if (!log_file.empty()) {
             instance().log_file.open(log_file, std::ios::app);
@@ -46,12 +48,15 @@ private:
         }
 
         std::time_t now = std::time(nullptr);
+        std::tm local;
         char timestamp[32];
-        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime_r(&now, &local));
 
         std::stringstream log_message;
         log_message << "[" << timestamp << "] [" << level_str << "] " << message << std::endl;
 
+        // Sampler, watcher and collector threads all log
+        std::lock_guard<std::mutex> lock(instance().mutex);
         if (instance().log_file.is_open()) {
             instance().log_file << log_message.str();
             instance().log_file.flush();
@@ -64,6 +69,7 @@ private:
 
     Level log_level;
     std::ofstream log_file;
+    std::mutex mutex;
 };
 
 #define LOG_DEBUG(msg) Logger::getInstance().debug(msg) 
\ No newline at end of file
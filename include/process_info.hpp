@@ -10,6 +10,7 @@
 #include <xf86drm.h>
 #include "uthash.h"
 #include <map>
+#include "sysfs.hpp"
 
 struct ProcessMemoryInfo {
     uint64_t memory_usage;
@@ -25,6 +26,9 @@ struct ProcessInfo {
     pid_t pid;
     std::string name;
     bool is_rocm;
+
+    // Render node (st_rdev) of the GPU this entry belongs to
+    dev_t drm_device;
     
     // Usage percentages
     float gfx_usage;
@@ -37,9 +41,37 @@ struct ProcessInfo {
     uint64_t compute_engine_used;
     uint64_t enc_engine_used;
     uint64_t dec_engine_used;
+
+    // Engine time consumed since the previous scan in nanoseconds
+    uint64_t gfx_engine_delta;
+    uint64_t compute_engine_delta;
+    uint64_t enc_engine_delta;
+    uint64_t dec_engine_delta;
+
+    // Interval covered by the engine deltas in nanoseconds
+    uint64_t sample_interval_ns;
     
     // Memory usage in bytes
     uint64_t memory_usage;
+    uint64_t gtt_usage;
+
+    // Memory growth fitted over the last hour in bytes per second, see GrowthTrend
+    float vram_growth;
+    float gtt_growth;
+    bool vram_growing;        // sustained growth, as a leak shows
+    bool gtt_growing;
+    float vram_full_seconds;  // until VRAM is full at vram_growth, 0 unless vram_growing
+
+    // GPU energy apportioned by engine-time share, in joules
+    double energy_delta_joules;
+    double energy_joules;
+
+    // Host side of the process, from /proc/<pid>/stat and statm
+    float cpu_usage;    // Percent of one core
+    float io_wait;      // Percent of the interval blocked on block IO (needs delay accounting)
+    uint64_t rss;       // Bytes
+    uint32_t threads;
+    uint64_t start_time;  // Clock ticks after boot, tells a recycled PID apart; 0 if unknown
     
     // Timestamp of last measurement
     timespec last_measurement_time;
@@ -51,6 +83,7 @@ struct ProcessInfo {
     ProcessInfo() : 
         pid(0), 
         is_rocm(false),
+        drm_device(0),
         gfx_usage(0),
         compute_usage(0),
         enc_usage(0),
@@ -59,7 +92,25 @@ struct ProcessInfo {
         compute_engine_used(0),
         enc_engine_used(0),
         dec_engine_used(0),
-        memory_usage(0) {
+        gfx_engine_delta(0),
+        compute_engine_delta(0),
+        enc_engine_delta(0),
+        dec_engine_delta(0),
+        sample_interval_ns(0),
+        memory_usage(0),
+        gtt_usage(0),
+        vram_growth(0),
+        gtt_growth(0),
+        vram_growing(false),
+        gtt_growing(false),
+        vram_full_seconds(0),
+        energy_delta_joules(0),
+        energy_joules(0),
+        cpu_usage(0),
+        io_wait(0),
+        rss(0),
+        threads(0),
+        start_time(0) {
         last_measurement_time = {0, 0};
         rock_info = {0, 0};
     }
@@ -101,19 +152,48 @@ struct FdinfoCallback {
 
 class ProcessMonitor {
 public:
-    static std::vector<ProcessInfo> getProcesses(amdgpu_device_handle device, float gpu_usage);
+    static constexpr unsigned DRM_MAJOR = 226;
 
-private:
+    // Scan /proc once and return one entry per (process, GPU) pair. DRM fds are
+    // attributed through the device number of the node they refer to; drm_nodes
+    // maps primary and render node numbers onto the render node of their GPU.
+    static std::vector<ProcessInfo> getProcesses(const std::map<dev_t, dev_t>& drm_nodes);
+
+    // Scan a synthetic procfs tree instead, whose DRM fds point at character devices
+    // of drm_major. Forgets the previous scan.
+    static void setProcRoot(const std::string& root, unsigned drm_major = DRM_MAJOR);
+
+    // Steps of getProcesses(), public for the benchmarks
     static bool parseFdinfo(FILE* fdinfo_file, ProcessInfo& proc, unsigned& client_id);
-    static bool isDRMFd(int fd_dir_fd, const char* name);
+    static void updateEngineUsage(ProcessInfo& proc, const ProcessCache* cache, const ProcessCache& current);
+
+private:
+    // Cache entries are kept per DRM client, so that engine deltas stay correct
+    // for processes with several contexts or clients on several GPUs
+    typedef std::pair<pid_t, unsigned> ClientKey;
+
+    // /proc/<pid>/stat and statm of GPU clients, kept open between scans
+    struct ProcessStatFiles {
+        SysfsFile stat;
+        SysfsFile statm;
+        uint64_t start_time = 0;
+        uint64_t cpu_ticks = 0;
+        uint64_t blkio_ticks = 0;
+        timespec last_read = {0, 0};
+    };
+
+    static bool isDRMFd(int fd_dir_fd, const char* name, dev_t& rdev);
     static bool isROCmProcess(pid_t pid);
     static bool updateROCkProcessInfo(ProcessInfo& proc, amdgpu_device_handle device);
     static bool getROCkComputeUsage(ProcessInfo& proc, amdgpu_device_handle device);
     static bool getROCkMemoryUsage(ProcessInfo& proc, amdgpu_device_handle device);
     static uint64_t getTimeDiffNs(const timespec& start, const timespec& end);
-    static void updateEngineUsage(ProcessInfo& proc, const ProcessCache* cache, const timespec& current_time);
+    static bool readProcessStats(pid_t pid, ProcessStatFiles& files, ProcessInfo& proc, const timespec& now);
     
-    static std::vector<ProcessCache> last_process_cache;
+    static std::string proc_root;
+    static unsigned drm_major;
+    static std::map<ClientKey, ProcessCache> last_process_cache;
+    static std::map<pid_t, ProcessStatFiles> process_stat_files;
     static struct amdgpu_process_info_cache* last_update_process_cache;
     static struct amdgpu_process_info_cache* current_update_process_cache;
     static std::vector<FdinfoCallback> fdinfo_callbacks;
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "process_info.hpp"
+
+/**
+ * Sort, filter and scroll state of the process table
+ *
+ * Only the visible window is ever ordered: nth_element puts the first
+ * visible row in place and partial_sort orders the rows after it, so a
+ * redraw costs O(n + rows log rows) no matter how many clients there are.
+ * Narrowing the filter only rescans the rows that matched before.
+ */
+class ProcessTable {
+public:
+    enum SortColumn {
+        SORT_PID,
+        SORT_NAME,
+        SORT_GPU,
+        SORT_GFX,
+        SORT_COMPUTE,
+        SORT_ENC,
+        SORT_DEC,
+        SORT_VRAM,
+        SORT_GTT,
+        SORT_ENERGY,
+        SORT_CPU,
+        SORT_RSS,
+        SORT_GROWTH
+    };
+
+    struct Entry {
+        ProcessInfo proc;
+        size_t gpu;  // physical GPU index
+    };
+
+    // Replace the rows with a new scan, the selection stays on the same client
+    void setEntries(std::vector<Entry> entries);
+
+    // Sorting by the current column again flips the direction
+    void sortBy(SortColumn column);
+    SortColumn getSortColumn() const { return sort_column; }
+    bool isDescending() const { return descending; }
+
+    // Case-insensitive name substring or PID prefix
+    void setFilter(const std::string& filter);
+    const std::string& getFilter() const { return filter; }
+
+    void moveSelection(long delta);
+    void selectFirst();
+    void selectLast();
+
+    // The rows of a window of the given height around the selection
+    std::vector<const Entry*> getVisibleRows(size_t rows);
+    size_t getSelectedRow() const { return selected - offset; }
+    size_t getOffset() const { return offset; }
+    size_t getMatchCount() const { return matches.size(); }
+    size_t getEntryCount() const { return entries.size(); }
+
+private:
+    std::vector<Entry> entries;
+    std::vector<uint32_t> matches;  // indices of entries passing the filter
+    std::string filter;
+    SortColumn sort_column = SORT_VRAM;
+    bool descending = true;
+    size_t selected = 0;  // position in sort order
+    size_t offset = 0;    // position of the first visible row
+
+    // Client the selection follows across updates
+    bool has_selection_key = false;
+    pid_t selected_pid = 0;
+    dev_t selected_device = 0;
+
+    bool matchesFilter(const Entry& entry, const std::string& lower_filter) const;
+    bool before(uint32_t a, uint32_t b) const;
+    void refilter(bool narrow);
+    void rememberSelection();
+    void followSelection();
+    void clampSelection();
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "gpu_metrics.hpp"
+#include "sysfs.hpp"
+
+// Share of time one state was active, in percent of the session and of the rolling window
+struct ResidencyShare {
+    std::string label;
+    float session;
+    float window;
+};
+
+/**
+ * Time spent in each of a set of states, over the session and a rolling window
+ *
+ * Several states may be active in the same interval (a GPU can be power and
+ * thermal throttled at once), so shares are relative to elapsed time and do
+ * not necessarily add up to 100%. The window keeps its intervals in arrival
+ * order and expires them from the front, so record() never rescans history.
+ */
+class ResidencyHistogram {
+public:
+    static constexpr double DEFAULT_WINDOW_S = 60;
+
+    explicit ResidencyHistogram(double window_seconds = DEFAULT_WINDOW_S) : window_seconds(window_seconds) {}
+
+    // Index of the bucket for label, created on first use; buckets keep declaration order
+    size_t declare(const std::string& label);
+
+    // Account an interval ending at now (monotonic seconds) in which the given buckets were active
+    void record(double seconds, double now, const std::vector<size_t>& active);
+
+    std::vector<ResidencyShare> getShares() const;
+    double getSessionTime() const { return session_time; }
+    double getWindowTime() const { return window_time; }
+
+    // Tab separated "<prefix> <label> <session s> <session %> <window s> <window %>" lines
+    void write(FILE* file, const std::string& prefix) const;
+
+private:
+    struct Bucket {
+        std::string label;
+        double session = 0;
+        double window = 0;
+    };
+
+    struct Interval {
+        double end;
+        double seconds;
+        std::vector<size_t> active;
+    };
+
+    double window_seconds;
+    std::vector<Bucket> buckets;
+    std::map<std::string, size_t> index;
+    std::deque<Interval> intervals;
+    double session_time = 0;
+    double window_time = 0;
+};
+
+/**
+ * DPM level and throttler residency of one GPU
+ *
+ * Clock levels come from pp_dpm_sclk/pp_dpm_mclk, where the driver marks
+ * the active level with '*'. Without those attributes (virtual functions,
+ * some APUs) the current clocks from gpu_metrics or the sensor query are
+ * bucketed to 100 MHz instead. Throttling is decoded from the ASIC
+ * independent indep_throttle_status bits when the SMU provides them, and
+ * otherwise reported per raw throttle_status bit.
+ */
+class ResidencyTracker {
+public:
+    // device_path is the sysfs directory of the PCI device
+    bool open(const std::string& device_path);
+
+    // table may be null; the clocks are the sensor values in MHz
+    void update(const GPUMetricsTable* table, uint32_t gpu_clock, uint32_t memory_clock, double elapsed);
+
+    // Shares ordered by clock, lowest first
+    std::vector<ResidencyShare> getSclkShares() const;
+    std::vector<ResidencyShare> getMclkShares() const;
+
+    // Power/Current/Thermal/Other, and the individual reasons
+    std::vector<ResidencyShare> getThrottleShares() const { return throttle.getShares(); }
+    std::vector<ResidencyShare> getThrottleReasonShares() const { return throttle_reasons.getShares(); }
+
+    // Reasons active at the last update
+    const std::vector<std::string>& getActiveThrottleReasons() const { return active_reasons; }
+
+    void write(FILE* file, const std::string& prefix) const;
+
+    // Continue the histograms of a tracker whose device went away and came back
+    void inheritHistory(const ResidencyTracker& previous);
+
+    // Names and categories of the SMU_THROTTLER_* bits set in status
+    static void decodeIndepThrottleStatus(uint64_t status, std::vector<const char*>& reasons,
+                                          std::vector<const char*>& categories);
+
+private:
+    SysfsFile pp_dpm_sclk;
+    SysfsFile pp_dpm_mclk;
+
+    ResidencyHistogram sclk;
+    ResidencyHistogram mclk;
+    ResidencyHistogram throttle;
+    ResidencyHistogram throttle_reasons;
+    std::vector<std::string> active_reasons;
+
+    static void recordClock(ResidencyHistogram& histogram, const SysfsFile& levels, uint32_t clock,
+                            double elapsed, double now);
+    static bool parseLevels(const std::string& content, std::vector<std::string>& labels, int& active);
+    static std::vector<ResidencyShare> sortByClock(std::vector<ResidencyShare> shares);
+};
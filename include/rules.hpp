@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+struct Snapshot;
+
+/**
+ * Alert rules evaluated on every snapshot
+ *
+ *   gpu[*].temperature > 95 for 30s
+ *   gpu.usage < 5% and vram > 80%
+ *   rate(proc.vram) > 1GiB/min
+ *   proc[ollama].vram > 40GiB or proc[ollama].gtt > 8GiB for 1m
+ *
+ * A term is gpu.FIELD or proc.FIELD, limited with [N] to GPU N or PID N
+ * or with [NAME] to the processes of that name; [*], every GPU or every
+ * process, is the default. A bare FIELD looks at what the rest of the
+ * rule does (GPUs if nothing says). A rule is evaluated separately for
+ * each GPU or process it covers. "and" binds tighter than "or".
+ * rate(TERM[, WINDOW]) is the change per second, smoothed over WINDOW (1
+ * minute by default): about the change over the last WINDOW divided by
+ * it. Values take units that are checked against the field (%, B to TiB,
+ * /s, /min and /h, °C, W, MHz, J), and "for DURATION" makes a rule fire
+ * only once its condition has held that long.
+ *
+ * Rules are compiled once into terms and conditions; every (rule, target)
+ * keeps O(1) state, the smoothed rates and since when the condition holds.
+ * Each target is evaluated when its sample is new, at the time it was
+ * taken, so adaptive sampling does not skew rates or hold times.
+ */
+class RuleEngine {
+public:
+    static constexpr uint64_t DEFAULT_RATE_WINDOW_NS = 60000000000ULL;
+    static constexpr size_t MAX_HOOKS = 8;  // exec hooks running at once
+
+    RuleEngine() = default;
+    RuleEngine(const RuleEngine&) = delete;
+    RuleEngine& operator=(const RuleEngine&) = delete;
+    ~RuleEngine();
+
+    // Compile a rule; exec (may be empty) is run through /bin/sh when it fires or clears.
+    // False with a message in error if the rule does not parse.
+    bool add(const std::string& rule, const std::string& exec, std::string& error);
+
+    // Lines for fired and cleared alerts, nullptr for none
+    void setLog(FILE* file) { log = file; }
+
+    void evaluate(const Snapshot& snapshot);
+
+    size_t getRuleCount() const { return rules.size(); }
+    uint64_t getFiredCount() const { return fired; }
+    size_t getFiringCount() const;
+
+private:
+    enum Scope { GPU, PROCESS };
+    enum Op { LESS, LESS_EQUAL, GREATER, GREATER_EQUAL };
+
+    struct Term {
+        std::string name;
+        int field = -1;  // resolved once the scope of the rule is known
+        bool rate = false;
+        uint64_t window_ns = DEFAULT_RATE_WINDOW_NS;
+    };
+
+    struct Condition {
+        size_t term;
+        Op op;
+        double value;   // in the field's base unit (bytes, W, ...), per second for rates
+        int unit = -1;  // kind of the unit it was written with, -1 for none
+        bool per_time = false;
+    };
+
+    struct TargetState {
+        std::string label;           // "gpu0 0000:03:00.0", "pid 1234 (name)"
+        std::vector<double> values;  // per term, at the last sample
+        std::vector<double> rates;
+        uint64_t sampled_ns = 0;
+        uint64_t holding_since_ns = 0;
+        bool holding = false;
+        bool firing = false;
+        uint64_t generation = 0;  // of the last evaluation that saw the target
+    };
+
+    struct Rule {
+        std::string text;
+        std::string exec;
+        Scope scope = GPU;
+        long index = -1;       // [N]: GPU index or PID
+        std::string selector;  // [NAME]: process name
+        std::vector<Term> terms;
+        std::vector<std::vector<Condition>> any_of;  // or of ands
+        uint64_t hold_ns = 0;
+        std::unordered_map<std::string, TargetState> targets;
+    };
+
+    std::vector<Rule> rules;
+    std::vector<double> values;  // of the target being evaluated
+    FILE* log = nullptr;
+    uint64_t fired = 0;
+    uint64_t generation = 0;
+    uint64_t last_scan_ns = 0;
+    std::vector<pid_t> hooks;
+
+    static bool parseTerm(const char*& p, Rule& rule, bool& scoped, Term& term, std::string& error);
+    void evaluateTarget(Rule& rule, const std::string& key, const std::string& target, uint64_t now_ns);
+    void notify(const Rule& rule, const std::string& target, bool firing, const TargetState& state);
+    void runHook(const Rule& rule, const std::string& target, bool firing, const std::string& value);
+    void reapHooks();
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "gpu_stats.hpp"
+#include "snapshot.hpp"
+
+/**
+ * Samples GPUStats on its own thread and hands snapshots to the front end
+ *
+ * Startup is staged so the first frame does not wait for a full /proc walk:
+ * the first snapshot has the devices only, the second the processes of the
+ * first scan, and PRIME_INTERVAL later a second scan gives the engine usage
+ * deltas a baseline. After that it samples every UPDATE_INTERVAL, or
+ * whenever a device or the process scan is due with adaptive sampling. The
+ * callback runs on the sampler thread after each new snapshot.
+ */
+class SamplerThread {
+public:
+    static constexpr std::chrono::milliseconds PRIME_INTERVAL{100};
+    static constexpr std::chrono::milliseconds UPDATE_INTERVAL{1000};
+
+    explicit SamplerThread(GPUStats& stats) : stats(stats) {}
+    ~SamplerThread();
+
+    void start(std::function<void()> on_sample);
+    void stop();
+
+    // Move the newest snapshot into snapshot; false if there was none since the last call
+    bool takeSnapshot(Snapshot& snapshot);
+
+private:
+    GPUStats& stats;
+    std::function<void()> on_sample;
+    Snapshot scratch;  // Only touched by the sampler thread
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread thread;
+    bool running = false;
+    Snapshot latest;
+    bool has_latest = false;
+
+    void run();
+    void deliver();
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * Log-linear latency histogram: four buckets per power of two, so a
+ * percentile is off by at most 12.5% at any scale. Fixed size, recording
+ * is a few instructions.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BITS = 2;
+    static constexpr unsigned BUCKETS = 64 << SUB_BITS;
+
+    void record(uint64_t ns);
+    void merge(const LatencyHistogram& other);
+
+    uint64_t getCount() const { return count; }
+    uint64_t getMax() const { return max; }
+    double getMean() const { return count ? (double)sum / count : 0; }
+    // Middle of the bucket holding the percentile, 0 when empty
+    uint64_t getPercentile(double percent) const;
+
+private:
+    uint64_t counts[BUCKETS] = {};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    static unsigned bucketOf(uint64_t ns);
+    static uint64_t bucketLow(unsigned bucket);
+};
+
+// Jobs of one process on one scheduler ring
+struct SchedJobStats {
+    pid_t pid = 0;
+    std::string ring;
+    LatencyHistogram queue;  // submit -> run
+    LatencyHistogram exec;   // run -> done
+    LatencyHistogram total;  // submit -> done
+};
+
+// Summary of SchedJobStats for the front ends
+struct SchedLatency {
+    pid_t pid = 0;
+    std::string ring;
+    uint64_t jobs = 0;
+    float jobs_per_second = 0;  // Since the previous summary
+    uint64_t queue_p50_ns = 0;
+    uint64_t queue_p99_ns = 0;
+    uint64_t exec_p50_ns = 0;
+    uint64_t exec_p99_ns = 0;
+    uint64_t total_p99_ns = 0;
+};
+
+/**
+ * Decoder of tracefs ring-buffer pages (trace_pipe_raw) into job latencies
+ *
+ * Event layouts come from the tracefs format files, so field offsets follow
+ * whatever the running kernel declares. Records are read in place from the
+ * page, strings included; the only per-job state is the pending job table.
+ *
+ * A job is followed by its scheduler fence (the fence pointer on older
+ * kernels, fence context and seqno on newer ones) through amdgpu_cs_ioctl
+ * and drm_sched_job (submitted, in the submitter's context), drm_run_job
+ * (handed to the ring) and drm_sched_process_job (signalled). Pages of
+ * different CPUs may arrive in any order; a job is accounted once all
+ * three stages are seen, and dropped if it stays incomplete for STALE_NS.
+ *
+ * The events carry the submitting thread, so jobs are keyed by its thread
+ * group instead, looked up once per thread in /proc/<tid>/status when
+ * resolving live, or taken from a recorded map on replay.
+ */
+class SchedTraceDecoder {
+public:
+    static constexpr uint64_t STALE_NS = 10000000000ULL;
+    static constexpr size_t MAX_PENDING_JOBS = 1 << 16;
+    static constexpr unsigned SWEEP_EVENTS = 4096;
+
+    // Learn the layout of an event from its format file; false if it is not one of ours
+    bool addFormat(const std::string& format);
+    // Page header layout from events/header_page; 64-bit defaults until then
+    void setHeaderPage(const std::string& header_page);
+
+    // Decode one page in place, returns the number of events
+    size_t decodePage(const uint8_t* page, size_t size);
+
+    // Timestamp of the first event of a page
+    static uint64_t getPageTimestamp(const uint8_t* page) {
+        uint64_t timestamp;
+        memcpy(&timestamp, page, sizeof(timestamp));
+        return timestamp;
+    }
+
+    const std::map<std::pair<pid_t, uint16_t>, SchedJobStats>& getStats() const { return stats; }
+    bool hasFormats() const { return !formats.empty(); }
+    uint64_t getLostPages() const { return lost_pages; }
+    uint64_t getStaleJobs() const { return stale_jobs; }
+
+    // Drop the statistics of processes that are gone, for long-running live tracing
+    void forgetExitedProcesses();
+
+    // Map submitting threads to their process through /proc, appending "<tid> <tgid>"
+    // lines to record if given; without it threads are only mapped by addThreadGroup()
+    void resolveThreadGroups(FILE* record) { resolve_tgids = true; tgid_record = record; }
+    void addThreadGroup(pid_t tid, pid_t tgid) { tgids[tid] = tgid; }
+
+private:
+    enum Kind { CS_IOCTL, SCHED_JOB, RUN_JOB, PROCESS_JOB };
+
+    struct Field {
+        uint16_t offset = 0;
+        uint16_t size = 0;  // 0 if the event does not have it
+    };
+
+    struct EventFormat {
+        Kind kind;
+        Field fence;          // struct dma_fence *
+        Field fence_context;  // or context and seqno
+        Field fence_seqno;
+        Field ring;           // __data_loc char[]
+    };
+
+    struct Job {
+        uint64_t submit_ns = 0;
+        uint64_t run_ns = 0;
+        uint64_t done_ns = 0;
+        pid_t pid = 0;
+        uint16_t ring = 0;
+        bool has_ring = false;
+    };
+
+    size_t commit_size = 8;
+    size_t data_offset = 16;
+    std::unordered_map<uint16_t, EventFormat> formats;  // by common_type
+    std::vector<std::string> rings;
+    std::unordered_map<uint64_t, Job> jobs;  // by fence
+    std::map<std::pair<pid_t, uint16_t>, SchedJobStats> stats;
+    std::unordered_map<pid_t, pid_t> tgids;  // thread -> process
+    bool resolve_tgids = false;
+    FILE* tgid_record = nullptr;
+    uint64_t newest_ns = 0;
+    unsigned events_since_sweep = 0;
+    uint64_t lost_pages = 0;
+    uint64_t stale_jobs = 0;
+
+    void decodeEvent(const uint8_t* data, size_t length, uint64_t timestamp);
+    uint16_t internRing(const char* name, size_t length);
+    pid_t getThreadGroup(pid_t tid);
+    void sweep();
+};
+
+/**
+ * Live job latencies from the gpu_scheduler and amdgpu tracepoints
+ *
+ * Events are enabled in a tracefs instance of our own, with the monotonic
+ * trace clock, so the global trace buffer and other tracers are left
+ * alone. A thread polls the per-CPU trace_pipe_raw files and decodes pages
+ * as they fill. With a record directory the format files and raw pages are
+ * also written there, for replaySchedTrace() on another machine.
+ */
+class SchedTracer {
+public:
+    static constexpr const char* TRACEFS_PATH = "/sys/kernel/tracing";
+    static constexpr const char* INSTANCE_NAME = "amdgpu-top";
+
+    explicit SchedTracer(const std::string& record_dir = "") : record_dir(record_dir) {}
+    ~SchedTracer();
+
+    bool start();
+    void stop();
+
+    // Every (process, ring) seen, with job rates since the previous call
+    void getLatencies(std::vector<SchedLatency>& latencies);
+
+private:
+    std::string record_dir;
+    std::string instance_path;
+    std::vector<int> cpu_fds;
+    std::vector<FILE*> record_files;
+    FILE* tgid_file = nullptr;
+    size_t page_size = 4096;
+    int wake_fd = -1;
+    std::atomic<bool> running{false};
+    std::thread thread;
+
+    std::mutex mutex;  // Guards the decoder
+    SchedTraceDecoder decoder;
+    std::map<std::pair<pid_t, uint16_t>, uint64_t> reported_jobs;
+    uint64_t last_summary_ns = 0;
+
+    bool loadFormats(const std::string& events_path);
+    void run();
+    void cleanup();
+};
+
+// "850 ns", "12.3 us", "4.56 ms", "1.20 s"
+std::string formatLatency(uint64_t ns);
+
+// Decode a recording of SchedTracer, pages of all CPUs merged in time order
+bool replaySchedTrace(const std::string& dir, SchedTraceDecoder& decoder);
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "amdgpu_top.h"
+
+/**
+ * Shared-memory snapshot segment written by amdgpu-top --publish
+ *
+ * This header and amdgpu_top.h are the whole reader library: they only need
+ * the C++ standard library and POSIX shared memory, so agents can use them to
+ * map the segment and read the latest sample of every GPU and its process
+ * table without polling the devices themselves.
+ *
+ * The segment has a fixed layout, identified by magic, version and size.
+ * One writer guards it with a sequence lock: the sequence is odd while a
+ * snapshot is being written and advances to the next even value when it is
+ * complete. Readers never block the writer; they read in place and retry if
+ * the sequence moved underneath them.
+ */
+
+static constexpr uint32_t SHM_SNAPSHOT_MAGIC = 0x53544741;  // "AGTS"
+static constexpr uint32_t SHM_SNAPSHOT_VERSION = 3;
+static constexpr const char* SHM_SNAPSHOT_DEFAULT_NAME = "/amdgpu-top";
+
+static constexpr uint32_t SHM_MAX_GPUS = 64;
+static constexpr uint32_t SHM_MAX_NODES = 256;
+static constexpr uint32_t SHM_MAX_PROCESSES = 4096;
+
+// The records are those of the C API
+typedef amdgpu_top_share ShmShare;
+typedef amdgpu_top_block ShmBlock;
+typedef amdgpu_top_metrics ShmMetrics;
+typedef amdgpu_top_gpu ShmGPU;
+typedef amdgpu_top_node ShmNode;
+typedef amdgpu_top_process ShmProcess;
+
+struct ShmSnapshot {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;        // sizeof(ShmSnapshot) of the writer
+    int32_t writer_pid;
+    uint32_t reserved;
+    std::atomic<uint64_t> sequence;  // odd while a snapshot is written, 0 until the first one
+
+    uint64_t timestamp_ns;  // CLOCK_REALTIME of the sample
+    uint64_t sample_count;
+    uint32_t gpu_count;
+    uint32_t node_count;
+    uint32_t process_count;
+    uint32_t dropped_processes;  // clients that did not fit
+    ShmGPU gpus[SHM_MAX_GPUS];
+    ShmNode nodes[SHM_MAX_NODES];
+    ShmProcess processes[SHM_MAX_PROCESSES];
+
+    // Counts and ranges clamped to the arrays, so a torn read can not run off them
+    uint32_t gpuCount() const { return std::min(gpu_count, SHM_MAX_GPUS); }
+    uint32_t nodeCount() const { return std::min(node_count, SHM_MAX_NODES); }
+    uint32_t processCount() const { return std::min(process_count, SHM_MAX_PROCESSES); }
+    uint32_t nodeEnd(const ShmGPU& gpu) const {
+        return std::min(std::min(gpu.first_node, nodeCount()) + std::min(gpu.node_count, SHM_MAX_NODES), nodeCount());
+    }
+    uint32_t processEnd(const ShmNode& node) const {
+        return std::min(std::min(node.first_process, processCount()) + std::min(node.process_count, SHM_MAX_PROCESSES),
+                        processCount());
+    }
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sequence must be usable across processes");
+
+// A fixed size string field, which need not be terminated in a torn read
+template <size_t N>
+inline std::string shmString(const char (&field)[N]) {
+    return std::string(field, strnlen(field, N));
+}
+
+/**
+ * Maps a published segment read-only
+ *
+ * read() costs no system calls: the callback gets the live segment and must
+ * only copy out what it needs, because it may see a snapshot the writer is
+ * changing. In that case it runs again once the writer is done, and only the
+ * last run, whose sequence did not move, counts.
+ */
+class ShmSnapshotReader {
+public:
+    ShmSnapshotReader() = default;
+    ShmSnapshotReader(const ShmSnapshotReader&) = delete;
+    ShmSnapshotReader& operator=(const ShmSnapshotReader&) = delete;
+    ~ShmSnapshotReader() { close(); }
+
+    bool open(const std::string& name = SHM_SNAPSHOT_DEFAULT_NAME) {
+        close();
+        int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ShmSnapshot)) {
+            ::close(fd);
+            return false;
+        }
+        void* mapping = mmap(nullptr, sizeof(ShmSnapshot), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) return false;
+
+        segment = static_cast<const ShmSnapshot*>(mapping);
+        inode = st.st_ino;
+        this->name = name;
+        if (segment->magic != SHM_SNAPSHOT_MAGIC || segment->version != SHM_SNAPSHOT_VERSION ||
+            segment->size != sizeof(ShmSnapshot)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (segment) {
+            munmap(const_cast<ShmSnapshot*>(segment), sizeof(ShmSnapshot));
+            segment = nullptr;
+        }
+    }
+
+    bool isOpen() const { return segment != nullptr; }
+
+    // Even and increasing with every published snapshot
+    uint64_t getSequence() const { return segment ? segment->sequence.load(std::memory_order_acquire) : 0; }
+
+    // Call fn(const ShmSnapshot&) until it saw a consistent snapshot; false if none
+    // was published yet or the writer kept changing it for max_attempts tries
+    template <typename Fn>
+    bool read(Fn&& fn, unsigned max_attempts = 1000) const {
+        if (!segment) return false;
+        for (unsigned attempt = 0; attempt < max_attempts; attempt++) {
+            uint64_t begin = segment->sequence.load(std::memory_order_acquire);
+            if (begin == 0) return false;
+            if (begin & 1) {
+                sched_yield();
+                continue;
+            }
+            fn(*segment);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (segment->sequence.load(std::memory_order_relaxed) == begin) return true;
+        }
+        return false;
+    }
+
+    // A restarted writer creates a new segment under the same name; this
+    // mapping then keeps the last snapshot of the old one. Costs a shm_open,
+    // so check it when snapshots stop advancing rather than on every read.
+    bool isReplaced() const {
+        if (!segment) return true;
+        int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0) return false;  // Writer gone, nothing newer to map
+        struct stat st;
+        bool replaced = fstat(fd, &st) == 0 && st.st_ino != inode;
+        ::close(fd);
+        return replaced;
+    }
+
+private:
+    const ShmSnapshot* segment = nullptr;
+    ino_t inode = 0;
+    std::string name;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "gpu_stats.hpp"
+#include "amdgpu_top.h"
+#include "annotations.hpp"
+#include "sched_trace.hpp"
+#include "process_info.hpp"
+#include "shm_snapshot.hpp"
+
+// One DRM node of a GPU: the whole device, or one compute partition
+struct NodeSnapshot {
+    int partition = -1;
+    GPUDevice::Metrics metrics;
+    std::vector<ProcessInfo> processes;
+    uint64_t processes_timestamp_ns = 0;  // CLOCK_REALTIME of the scan they come from
+};
+
+// One physical GPU as the front ends show it
+struct GPUSnapshot {
+    std::string host;  // Agent it came from, empty for local GPUs
+    std::string market_name;
+    std::string pci_path;
+    std::string partition_mode;
+    GPUDevice::Metrics metrics;       // device wide, memory combined over partitions
+    std::vector<NodeSnapshot> nodes;  // partition 0 first
+};
+
+/**
+ * Everything one update sampled, detached from the devices it came from
+ *
+ * The TUI and text mode render from a snapshot, so they look the same
+ * whether it was taken locally or read from a published segment.
+ */
+struct Snapshot {
+    uint64_t timestamp_ns = 0;  // CLOCK_REALTIME of the newest sample, devices and scans have their own
+    bool processes_pending = false;  // Devices sampled, the first /proc scan not done yet
+    std::vector<GPUSnapshot> gpus;
+    std::vector<std::string> unreachable_hosts;  // Agents an aggregator has no snapshot from
+    std::vector<PhaseMarker> markers;  // Received before the last process scan, with --annotate
+    std::vector<PhaseStats> phases;
+    std::vector<SchedLatency> sched_latencies;  // With --sched
+};
+
+// Flatten into the caller's arrays of the C API records; true if something did not fit
+bool flattenSnapshot(const Snapshot& snapshot, amdgpu_top_snapshot& flat);
+
+// Rebuild a snapshot from flat records; false if a GPU is left without nodes
+bool expandSnapshot(const amdgpu_top_gpu* gpus, uint32_t gpu_count, const amdgpu_top_node* nodes,
+                    uint32_t node_count, const amdgpu_top_process* processes, uint32_t process_count,
+                    Snapshot& snapshot);
+
+// Flatten into the shared layout; processes and labels that do not fit are dropped
+void fillSharedSnapshot(const Snapshot& snapshot, uint64_t sample_count, ShmSnapshot& segment);
+
+// Latest consistent snapshot of the segment, snapshot is left alone if there is none
+bool readSharedSnapshot(const ShmSnapshotReader& reader, Snapshot& snapshot);
+
+/**
+ * Owner of a published snapshot segment
+ *
+ * The segment is created readable by everyone, so unprivileged agents can
+ * attach to a monitor running as root. It is unlinked again on exit; a
+ * stale segment from a crashed run with the same layout is taken over in
+ * place, so readers that kept it mapped see the new snapshots.
+ */
+class SnapshotPublisher {
+public:
+    explicit SnapshotPublisher(const std::string& name = SHM_SNAPSHOT_DEFAULT_NAME) : name(name) {}
+    ~SnapshotPublisher();
+
+    bool open();
+    void publish(const Snapshot& snapshot);
+
+    const std::string& getName() const { return name; }
+
+private:
+    std::string name;
+    ShmSnapshot* segment = nullptr;
+    uint64_t sample_count = 0;
+};
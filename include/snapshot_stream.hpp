@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "amdgpu_top.h"
+#include "snapshot.hpp"
+
+static constexpr uint32_t STREAM_MAGIC = 0x4E544741;  // "AGTN"
+static constexpr uint16_t STREAM_VERSION = 1;
+static constexpr uint16_t STREAM_KEYFRAME = 1;
+static constexpr uint16_t STREAM_MARKERS = 2;  // phase markers instead of a snapshot
+static constexpr uint32_t STREAM_MAX_PAYLOAD = 16 << 20;
+static constexpr uint32_t STREAM_MAX_RECORDS = 1 << 20;
+
+struct StreamFrameHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    // Records travel in host byte order and layout, mismatched peers are refused
+    uint16_t gpu_record_size;
+    uint16_t node_record_size;
+    uint16_t process_record_size;
+    uint16_t reserved;
+    uint32_t payload_size;
+    uint32_t gpu_count;
+    uint32_t node_count;
+    uint32_t process_count;
+    uint64_t sequence;
+    uint64_t timestamp_ns;
+};
+
+static_assert(sizeof(StreamFrameHeader) == 48, "StreamFrameHeader is part of the wire format");
+
+// Record of a STREAM_MARKERS frame, whose payload is payload_size / reserved of them.
+// Only flight recordings carry these frames, each before the first snapshot frame that
+// is not older than its markers; SnapshotDecoder refuses them.
+struct StreamMarker {
+    uint64_t timestamp_ns;  // CLOCK_REALTIME, like the snapshots
+    int32_t pid;
+    uint32_t begin;         // 1 for a begin marker, 0 for an end marker
+    char name[48];          // need not be terminated
+};
+
+static_assert(sizeof(StreamMarker) == 64, "StreamMarker is part of the wire format");
+
+// Append a STREAM_MARKERS frame holding count markers
+void encodeMarkers(const StreamMarker* markers, size_t count, std::vector<uint8_t>& frame);
+
+// The markers of a STREAM_MARKERS frame; false if it is malformed
+bool decodeMarkers(const StreamFrameHeader& header, const uint8_t* payload, std::vector<StreamMarker>& markers);
+
+/**
+ * Encoder of an agent's snapshot stream
+ *
+ * A frame is a StreamFrameHeader and the GPU, node and process records of
+ * the snapshot (the C API records), XORed with the records of the previous
+ * frame and run-length encoded: a run of unchanged bytes costs a varint, so
+ * only what changed travels, typically a few hundred bytes per GPU. A
+ * keyframe is encoded against nothing and starts a stream.
+ */
+class SnapshotEncoder {
+public:
+    // Append the frame of snapshot, a delta against the snapshot of the previous call
+    void encode(const Snapshot& snapshot, std::vector<uint8_t>& frame);
+
+    // The same from flat records; bytes they leave unused should be zero, or they travel too
+    void encode(const amdgpu_top_snapshot& flat, std::vector<uint8_t>& frame);
+
+    // Append the last encoded snapshot again as a keyframe, for a reader that just joined
+    void encodeKeyframe(std::vector<uint8_t>& frame) const;
+
+private:
+    std::vector<amdgpu_top_gpu> gpus;
+    std::vector<amdgpu_top_node> nodes;
+    std::vector<amdgpu_top_process> processes;
+    std::vector<uint8_t> current;   // records of the last snapshot
+    std::vector<uint8_t> previous;  // and of the one before
+    StreamFrameHeader header = {};
+
+    void appendFrame(uint16_t flags, const std::vector<uint8_t>& base, std::vector<uint8_t>& frame) const;
+};
+
+// Decoder of one agent's stream
+class SnapshotDecoder {
+public:
+    // Apply one frame; false if it is malformed or a delta with no keyframe before it
+    bool decode(const StreamFrameHeader& header, const uint8_t* payload, Snapshot& snapshot);
+
+    // After a reconnect, deltas are refused until the next keyframe
+    void reset() { has_keyframe = false; }
+
+    // Header of a frame from another version or architecture
+    static bool isCompatible(const StreamFrameHeader& header);
+
+private:
+    std::vector<uint8_t> records;
+    std::vector<amdgpu_top_gpu> gpus;
+    std::vector<amdgpu_top_node> nodes;
+    std::vector<amdgpu_top_process> processes;
+    bool has_keyframe = false;
+};
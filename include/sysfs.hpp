@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+/**
+ * A sysfs attribute kept open for the lifetime of the monitor
+ *
+ * sysfs regenerates the attribute content on every read at offset 0, so
+ * re-reading with pread() saves the open/close pair per sample.
+ */
+class SysfsFile {
+public:
+    SysfsFile() : fd(-1) {}
+    explicit SysfsFile(const std::string& path) : fd(-1) { open(path); }
+    ~SysfsFile();
+
+    SysfsFile(const SysfsFile&) = delete;
+    SysfsFile& operator=(const SysfsFile&) = delete;
+    SysfsFile(SysfsFile&& other) noexcept : fd(other.fd) { other.fd = -1; }
+    SysfsFile& operator=(SysfsFile&& other) noexcept;
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return fd >= 0; }
+
+    // Read the whole attribute from offset 0
+    ssize_t read(void* buf, size_t size) const;
+    bool readString(std::string& value) const;
+    bool readInt(int64_t& value) const;
+
+private:
+    int fd;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+struct Snapshot;
+struct GPUSnapshot;
+
+/**
+ * Chrome JSON trace of the GPU and per-process timelines, for Perfetto
+ *
+ * Every snapshot becomes counter events: device metrics on one track group
+ * per GPU (a pseudo process numbered above pid_max), engine utilization and
+ * memory on the real PID of each client, so they land next to the tracks
+ * of a CPU trace from the same host. Phase markers become slices on the
+ * main thread of their process. Timestamps are CLOCK_MONOTONIC, those of
+ * the device and of the process scan the sample was actually taken at. The
+ * file is the array form of the format, which stays loadable when the
+ * monitor is killed mid-run, and each snapshot is flushed as it comes, so
+ * memory use does not grow with the length of the run.
+ */
+class TraceWriter {
+public:
+    static constexpr long GPU_PID_BASE = 1L << 22;  // PID_MAX_LIMIT, no real process gets it
+
+    explicit TraceWriter(const std::string& path) : path(path) {}
+    ~TraceWriter();
+
+    bool open();
+    void write(const Snapshot& snapshot);
+
+private:
+    using Arg = std::pair<const char*, double>;
+    using Track = std::pair<pid_t, std::string>;
+
+    std::string path;
+    FILE* file = nullptr;
+    std::string buffer;  // events of one snapshot
+    bool has_events = false;
+    std::vector<std::string> gpu_names;  // as last written into the metadata
+    std::vector<uint64_t> gpu_samples;   // sensor sample time last written, per GPU
+    uint64_t last_scan_ns = 0;           // process scan last written
+    std::set<Track> tracks;  // process tracks of the previous snapshot, zeroed when they go away
+    std::set<Track> live_tracks;
+
+    void beginEvent(const char* phase, const std::string& name, long pid, uint64_t ts_ns, long tid = 0);
+    void counter(long pid, uint64_t ts_ns, const std::string& name, std::initializer_list<Arg> args);
+    void counter(long pid, uint64_t ts_ns, const std::string& name, const Arg* args, size_t count);
+    void processName(long pid, const std::string& name, int sort_index);
+    void writeDevice(const GPUSnapshot& gpu, long pid, uint64_t ts_ns);
+};
@@ -0,0 +1,346 @@
+#include "accounting.hpp"
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include "logger.hpp"
+
+AccountingLedger::AccountingLedger(const std::string& path, unsigned flush_interval_s)
+    : path(path), flush_interval_s(flush_interval_s), file(nullptr) {
+    clock_gettime(CLOCK_MONOTONIC, &last_flush);
+    last_compaction = last_flush;
+}
+
+AccountingLedger::~AccountingLedger() {
+    if (file) {
+        flush();
+        fclose(file);
+    }
+}
+
+bool AccountingLedger::open() {
+    load();
+
+    file = fopen(path.c_str(), "a");
+    if (!file) {
+        Logger::error("Failed to open accounting ledger " + path + ": " + strerror(errno));
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    compacted_size = ftell(file);
+    return true;
+}
+
+// Split a ledger record into its tab separated fields
+static std::vector<std::string> splitRecord(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t end = line.find('\t', start);
+        fields.push_back(line.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos) break;
+        start = end + 1;
+    }
+    return fields;
+}
+
+// Names and cgroup paths must not break the record format
+static std::string sanitize(const std::string& value) {
+    std::string result = value;
+    for (auto& c : result) {
+        if (c == '\t' || c == '\n') c = ' ';
+    }
+    return result;
+}
+
+void AccountingLedger::load() {
+    std::ifstream in(path);
+    if (!in) return;
+
+    std::string line;
+    size_t records = 0;
+    while (std::getline(in, line)) {
+        auto fields = splitRecord(line);
+        Usage usage;
+
+        if (fields[0] == "P" && fields.size() >= 12) {
+            usage.gfx_ns = strtoull(fields[5].c_str(), nullptr, 10);
+            usage.compute_ns = strtoull(fields[6].c_str(), nullptr, 10);
+            usage.enc_ns = strtoull(fields[7].c_str(), nullptr, 10);
+            usage.dec_ns = strtoull(fields[8].c_str(), nullptr, 10);
+            usage.vram_byte_seconds = strtod(fields[9].c_str(), nullptr);
+            if (fields.size() >= 13) {
+                usage.energy_joules = strtod(fields[12].c_str(), nullptr);
+            }
+
+            std::string key = fields[2] + ":" + fields[3];
+            if (fields[4] == "X") {
+                processes.erase(key);  // Final record, nothing left to resume
+            } else {
+                ProcessEntry& entry = processes[key];
+                entry.pid = atoi(fields[2].c_str());
+                entry.start_time = strtoull(fields[3].c_str(), nullptr, 10);
+                entry.name = fields[10];
+                entry.cgroup = fields[11];
+                entry.usage = usage;
+            }
+            records++;
+        } else if (fields[0] == "C" && fields.size() >= 8) {
+            usage.gfx_ns = strtoull(fields[3].c_str(), nullptr, 10);
+            usage.compute_ns = strtoull(fields[4].c_str(), nullptr, 10);
+            usage.enc_ns = strtoull(fields[5].c_str(), nullptr, 10);
+            usage.dec_ns = strtoull(fields[6].c_str(), nullptr, 10);
+            usage.vram_byte_seconds = strtod(fields[7].c_str(), nullptr);
+            if (fields.size() >= 9) {
+                usage.energy_joules = strtod(fields[8].c_str(), nullptr);
+            }
+            cgroups[fields[2]] = usage;
+            records++;
+        }
+    }
+
+    Logger::info("Loaded " + std::to_string(records) + " accounting records from " + path);
+}
+
+bool AccountingLedger::readStartTime(pid_t pid, uint64_t& start_time) {
+    std::ifstream stat_file("/proc/" + std::to_string(pid) + "/stat");
+    std::string stat;
+    if (!stat_file || !std::getline(stat_file, stat)) return false;
+
+    // comm may contain spaces and parentheses, the fields start after the last ')'
+    size_t pos = stat.rfind(')');
+    if (pos == std::string::npos) return false;
+
+    // starttime is field 22, the 20th after the closing parenthesis
+    std::istringstream fields(stat.substr(pos + 2));
+    std::string field;
+    for (int i = 0; i < 20 && fields >> field; i++) {}
+    if (!fields) return false;
+
+    start_time = strtoull(field.c_str(), nullptr, 10);
+    return true;
+}
+
+std::string AccountingLedger::readCgroup(pid_t pid) {
+    std::ifstream cgroup_file("/proc/" + std::to_string(pid) + "/cgroup");
+    std::string line;
+    std::string first;
+
+    while (std::getline(cgroup_file, line)) {
+        // Unified hierarchy: "0::/path"
+        if (line.compare(0, 3, "0::") == 0) {
+            return line.substr(3);
+        }
+        if (first.empty()) {
+            size_t pos = line.find(':', line.find(':') + 1);
+            if (pos != std::string::npos) first = line.substr(pos + 1);
+        }
+    }
+    return first.empty() ? "/" : first;
+}
+
+void AccountingLedger::addUsage(Usage& usage, const ProcessInfo& proc) {
+    usage.gfx_ns += proc.gfx_engine_delta;
+    usage.compute_ns += proc.compute_engine_delta;
+    usage.enc_ns += proc.enc_engine_delta;
+    usage.dec_ns += proc.dec_engine_delta;
+    usage.vram_byte_seconds += proc.memory_usage * (proc.sample_interval_ns / 1e9);
+    usage.energy_joules += proc.energy_delta_joules;
+}
+
+AccountingLedger::ProcessEntry& AccountingLedger::lookup(const ProcessInfo& proc) {
+    uint64_t start_time = proc.start_time;
+    auto live = live_pids.find(proc.pid);
+    if (live != live_pids.end()) {
+        ProcessEntry& entry = processes[live->second];
+        if (start_time == 0 || entry.start_time == start_time) {
+            return entry;
+        }
+        // The PID was recycled since, its previous owner is gone
+        entry.exited = true;
+        entry.dirty = true;
+        live_pids.erase(live);
+    }
+
+    // First sighting of this process, either a new one or one we resume
+    if (start_time == 0) readStartTime(proc.pid, start_time);
+    std::string key = std::to_string(proc.pid) + ":" + std::to_string(start_time);
+    live_pids[proc.pid] = key;
+
+    ProcessEntry& entry = processes[key];
+    if (entry.pid == 0) {
+        entry.pid = proc.pid;
+        entry.start_time = start_time;
+        entry.name = sanitize(proc.name);
+        entry.cgroup = sanitize(readCgroup(proc.pid));
+        Logger::debug("Accounting new process " + std::to_string(proc.pid) + " in cgroup " + entry.cgroup);
+    }
+    return entry;
+}
+
+void AccountingLedger::update(const std::vector<ProcessInfo>& processes) {
+    for (auto& entry : this->processes) {
+        entry.second.seen = false;
+    }
+
+    // A process appears once per GPU it uses, all of them feed the same entry
+    for (const auto& proc : processes) {
+        ProcessEntry& entry = lookup(proc);
+        entry.seen = true;
+
+        if (proc.sample_interval_ns == 0) continue;
+
+        addUsage(entry.usage, proc);
+        addUsage(cgroups[entry.cgroup], proc);
+        entry.dirty = true;
+        dirty_cgroups[entry.cgroup] = true;
+    }
+
+    // Entries not seen either closed their last GPU client or exited; only the
+    // latter are final, a process that comes back keeps accumulating. Start
+    // times come with the scan, so a recycled PID that shows up on a GPU has
+    // already been told apart by lookup().
+    for (auto& entry : this->processes) {
+        if (!entry.second.seen && !entry.second.exited) {
+            if (kill(entry.second.pid, 0) == 0 || errno != ESRCH) {
+                continue;
+            }
+
+            entry.second.exited = true;
+            entry.second.dirty = true;
+
+            auto live = live_pids.find(entry.second.pid);
+            if (live != live_pids.end() && live->second == entry.first) {
+                live_pids.erase(live);
+            }
+        }
+    }
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (file && now.tv_sec - last_flush.tv_sec >= (time_t)flush_interval_s) {
+        flush();
+    }
+}
+
+bool AccountingLedger::flush() {
+    if (!file) return false;
+
+    clock_gettime(CLOCK_MONOTONIC, &last_flush);
+    long long wall = (long long)time(nullptr);
+
+    for (auto it = processes.begin(); it != processes.end();) {
+        ProcessEntry& entry = it->second;
+        if (entry.dirty) {
+            fprintf(file, "P\t%lld\t%d\t%llu\t%c\t%llu\t%llu\t%llu\t%llu\t%.0f\t%s\t%s\t%.3f\n",
+                    wall, (int)entry.pid, (unsigned long long)entry.start_time,
+                    entry.exited ? 'X' : 'R',
+                    (unsigned long long)entry.usage.gfx_ns,
+                    (unsigned long long)entry.usage.compute_ns,
+                    (unsigned long long)entry.usage.enc_ns,
+                    (unsigned long long)entry.usage.dec_ns,
+                    entry.usage.vram_byte_seconds,
+                    entry.name.c_str(), entry.cgroup.c_str(),
+                    entry.usage.energy_joules);
+            entry.dirty = false;
+        }
+
+        // Exited processes live on in the file and in their cgroup totals
+        if (entry.exited) {
+            it = processes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (const auto& dirty : dirty_cgroups) {
+        const Usage& usage = cgroups[dirty.first];
+        fprintf(file, "C\t%lld\t%s\t%llu\t%llu\t%llu\t%llu\t%.0f\t%.3f\n",
+                wall, dirty.first.c_str(),
+                (unsigned long long)usage.gfx_ns,
+                (unsigned long long)usage.compute_ns,
+                (unsigned long long)usage.enc_ns,
+                (unsigned long long)usage.dec_ns,
+                usage.vram_byte_seconds,
+                usage.energy_joules);
+    }
+    dirty_cgroups.clear();
+
+    if (fflush(file) != 0) {
+        Logger::error("Failed to write accounting ledger " + path + ": " + strerror(errno));
+        return false;
+    }
+
+    long size = ftell(file);
+    bool grown = size >= COMPACT_MIN_BYTES && size >= 2 * compacted_size;
+    bool due = size > compacted_size && last_flush.tv_sec - last_compaction.tv_sec >= COMPACT_INTERVAL_S;
+    if (grown || due) {
+        return compact();
+    }
+    return true;
+}
+
+bool AccountingLedger::compact() {
+    if (!file) return false;
+    clock_gettime(CLOCK_MONOTONIC, &last_compaction);
+
+    // Last record of every process session and cgroup
+    std::map<std::string, std::string> latest;
+    {
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line)) {
+            auto fields = splitRecord(line);
+            if (fields[0] == "P" && fields.size() >= 12) {
+                latest["P\t" + fields[2] + ":" + fields[3]] = line;
+            } else if (fields[0] == "C" && fields.size() >= 8) {
+                latest["C\t" + fields[2]] = line;
+            }
+        }
+    }
+
+    std::string temp_path = path + ".compact";
+    FILE* out = fopen(temp_path.c_str(), "w");
+    if (!out) {
+        Logger::error("Failed to compact accounting ledger " + path + ": " + strerror(errno));
+        return false;
+    }
+    long long oldest = (long long)time(nullptr) - EXITED_RETENTION_S;
+    size_t dropped = 0;
+    for (const auto& record : latest) {
+        auto fields = splitRecord(record.second);
+        if (fields[0] == "P" && fields[4] == "X" && atoll(fields[1].c_str()) < oldest) {
+            dropped++;
+            continue;
+        }
+        fprintf(out, "%s\n", record.second.c_str());
+    }
+    if (fflush(out) != 0 || fsync(fileno(out)) != 0) {
+        Logger::error("Failed to compact accounting ledger " + path + ": " + strerror(errno));
+        fclose(out);
+        unlink(temp_path.c_str());
+        return false;
+    }
+    fclose(out);
+
+    // Readers see the old file or the new one, never a partial one
+    if (rename(temp_path.c_str(), path.c_str()) != 0) {
+        Logger::error("Failed to replace accounting ledger " + path + ": " + strerror(errno));
+        unlink(temp_path.c_str());
+        return false;
+    }
+    fclose(file);
+    file = fopen(path.c_str(), "a");
+    if (!file) {
+        Logger::error("Failed to reopen accounting ledger " + path + ": " + strerror(errno));
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    compacted_size = ftell(file);
+    Logger::info("Compacted accounting ledger " + path + " to " + std::to_string(latest.size() - dropped) +
+                 " records, " + std::to_string(dropped) + " expired sessions dropped");
+    return true;
+}
@@ -0,0 +1,35 @@
+#include "adaptive_rate.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Weight of the newest sample in the CPU cost average
+static constexpr double COST_WEIGHT = 0.25;
+
+void AdaptiveRate::setLimits(uint64_t min, uint64_t max) {
+    min_ns = std::max<uint64_t>(min, 1);
+    max_ns = std::max(max, min_ns);
+    interval_ns = std::min(std::max(interval_ns, min_ns), max_ns);
+}
+
+bool AdaptiveRate::observe(uint64_t now_ns, uint64_t cost_ns, const float* values, const float* thresholds,
+                           size_t count) {
+    bool changed = last_values.size() != count;
+    for (size_t i = 0; i < count && !changed; i++) {
+        changed = std::fabs(values[i] - last_values[i]) > thresholds[i];
+    }
+    if (changed) {
+        // Values are compared with the last change rather than the last sample, so slow drifts add up
+        last_values.assign(values, values + count);
+        interval_ns = min_ns;
+    } else {
+        interval_ns = std::min(interval_ns * 2, max_ns);
+    }
+
+    cpu_ns = last_ns ? cpu_ns + (cost_ns - cpu_ns) * COST_WEIGHT : cost_ns;
+    last_ns = now_ns;
+    return changed;
+}
+
+uint64_t AdaptiveRate::getNextSample(double stretch) const {
+    return last_ns + (uint64_t)(interval_ns * std::max(stretch, 1.0));
+}
@@ -0,0 +1,246 @@
+#include "amdgpu_top.h"
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include "flight_recorder.hpp"
+#include "gpu_stats.hpp"
+#include "logger.hpp"
+#include "snapshot.hpp"
+
+struct amdgpu_top {
+    GPUStats stats;
+    Snapshot snapshot;  // Reused, so steady-state samples do not reallocate it
+    uint64_t sample_count = 0;
+
+    // Guards everything above against the background thread
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread thread;
+    bool running = false;
+};
+
+// Run the body of an entry point; exceptions must not reach C callers, they become
+// a negative errno: -ENOMEM when out of memory, failure for anything else
+template <typename Fn>
+static int guarded(int failure, Fn fn) {
+    try {
+        return fn();
+    } catch (const std::bad_alloc&) {
+        return -ENOMEM;
+    } catch (const std::exception& e) {
+        Logger::error(std::string("libamdgpu-top: ") + e.what());
+        return failure;
+    } catch (...) {
+        Logger::error("libamdgpu-top: unknown exception");
+        return failure;
+    }
+}
+
+// Sample into the handle's snapshot, with its mutex held; only what is due with adaptive sampling
+static int sampleLocked(amdgpu_top* handle, bool due_only = false) {
+    return guarded(-EIO, [&] {
+        if (due_only) {
+            handle->stats.updateDue();
+        } else {
+            handle->stats.update();
+        }
+        handle->stats.getSnapshot(handle->snapshot);
+        handle->sample_count++;
+        return 0;
+    });
+}
+
+static int fillLocked(amdgpu_top* handle, amdgpu_top_snapshot* snapshot) {
+    if (!snapshot) return 0;
+    bool truncated = flattenSnapshot(handle->snapshot, *snapshot);
+    snapshot->sample_count = handle->sample_count;
+    return truncated ? AMDGPU_TOP_TRUNCATED : 0;
+}
+
+static void runBackground(amdgpu_top* handle, unsigned interval_ms, amdgpu_top_snapshot* buffer,
+                          amdgpu_top_callback callback, void* user_data) {
+    std::unique_lock<std::mutex> lock(handle->mutex);
+    auto next = std::chrono::steady_clock::now();
+
+    while (handle->running) {
+        if (sampleLocked(handle, true) == 0) {
+            fillLocked(handle, buffer);
+            // Callers may fetch snapshots or change collectors while the callback runs
+            lock.unlock();
+            callback(buffer, user_data);
+            lock.lock();
+        }
+
+        // Fixed rate rather than fixed delay, so a slow callback does not stretch the interval
+        if (handle->stats.isAdaptive()) {
+            next = handle->stats.getNextSampleTime();
+        } else {
+            next += std::chrono::milliseconds(interval_ms);
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (next < now) next = now;
+        handle->wake.wait_until(lock, next, [handle] { return !handle->running; });
+    }
+}
+
+unsigned amdgpu_top_api_version(void) {
+    return AMDGPU_TOP_API_VERSION;
+}
+
+amdgpu_top* amdgpu_top_create(void) {
+    amdgpu_top* handle = new (std::nothrow) amdgpu_top;
+    if (!handle) return nullptr;
+
+    int result = guarded(-EIO, [handle] {
+        return handle->stats.initialize() && handle->stats.getPhysicalGPUCount() > 0 ? 0 : -ENODEV;
+    });
+    if (result == 0) return handle;
+    if (result == -ENOMEM) Logger::error("Out of memory opening GPUs");
+    delete handle;
+    return nullptr;
+}
+
+void amdgpu_top_destroy(amdgpu_top* handle) {
+    if (!handle) return;
+    amdgpu_top_stop(handle);
+    delete handle;
+}
+
+int amdgpu_top_watch_devices(amdgpu_top* handle) {
+    if (!handle) return -EINVAL;
+    return guarded(-EIO, [&] {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        return handle->stats.watchDevices() ? 0 : -EIO;
+    });
+}
+
+int amdgpu_top_start_block_sampling(amdgpu_top* handle, unsigned rate_hz) {
+    if (!handle || rate_hz == 0) return -EINVAL;
+    return guarded(-EIO, [&] {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        return handle->stats.startBlockSampling(rate_hz) ? 0 : -ENOTSUP;
+    });
+}
+
+int amdgpu_top_open_ledger(amdgpu_top* handle, const char* path) {
+    if (!handle || !path) return -EINVAL;
+    return guarded(-EIO, [&] {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        return handle->stats.openLedger(path) ? 0 : -EIO;
+    });
+}
+
+int amdgpu_top_publish(amdgpu_top* handle, const char* name) {
+    if (!handle) return -EINVAL;
+    return guarded(-EIO, [&] {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        return handle->stats.publishSnapshots(name ? name : SHM_SNAPSHOT_DEFAULT_NAME) ? 0 : -EIO;
+    });
+}
+
+int amdgpu_top_trace(amdgpu_top* handle, const char* path) {
+    if (!handle || !path) return -EINVAL;
+    return guarded(-EIO, [&] {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        return handle->stats.startTrace(path) ? 0 : -EIO;
+    });
+}
+
+int amdgpu_top_start_flight_recorder(amdgpu_top* handle, const char* trigger, const char* directory,
+                                     unsigned pre_s, unsigned post_s) {
+    if (!handle || !trigger) return -EINVAL;
+    return guarded(-EIO, [&] {
+        FlightTrigger parsed;
+        std::string error;
+        if (!parsed.parse(trigger, error)) {
+            Logger::error("Invalid flight trigger \"" + std::string(trigger) + "\": " + error);
+            return -EINVAL;
+        }
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        return handle->stats.startFlightRecorder(parsed, directory ? directory : ".", pre_s, post_s) ? 0 : -EIO;
+    });
+}
+
+int amdgpu_top_adaptive_sampling(amdgpu_top* handle, unsigned min_interval_ms, unsigned max_interval_ms,
+                                 float cpu_budget_percent) {
+    if (!handle || min_interval_ms == 0 || max_interval_ms < min_interval_ms || cpu_budget_percent < 0) {
+        return -EINVAL;
+    }
+    return guarded(-EIO, [&] {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        handle->stats.setAdaptiveSampling(min_interval_ms, max_interval_ms, cpu_budget_percent);
+        return 0;
+    });
+}
+
+int amdgpu_top_add_rule(amdgpu_top* handle, const char* rule, const char* exec) {
+    if (!handle || !rule) return -EINVAL;
+    return guarded(-EIO, [&] {
+        std::string error;
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        if (!handle->stats.addAlertRule(rule, exec ? exec : "", error)) {
+            Logger::error("Invalid alert rule \"" + std::string(rule) + "\": " + error);
+            return -EINVAL;
+        }
+        return 0;
+    });
+}
+
+int amdgpu_top_sample(amdgpu_top* handle, amdgpu_top_snapshot* snapshot) {
+    if (!handle) return -EINVAL;
+    return guarded(-EIO, [&] {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        // The background thread owns the sampling interval
+        if (handle->running) return -EBUSY;
+
+        int result = sampleLocked(handle);
+        return result < 0 ? result : fillLocked(handle, snapshot);
+    });
+}
+
+int amdgpu_top_get_snapshot(amdgpu_top* handle, amdgpu_top_snapshot* snapshot) {
+    if (!handle || !snapshot) return -EINVAL;
+    return guarded(-EIO, [&] {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        return fillLocked(handle, snapshot);
+    });
+}
+
+int amdgpu_top_start(amdgpu_top* handle, unsigned interval_ms, amdgpu_top_snapshot* buffer,
+                     amdgpu_top_callback callback, void* user_data) {
+    if (!handle || !buffer || !callback || interval_ms == 0) return -EINVAL;
+    return guarded(-EIO, [&] {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        if (handle->running) return -EBUSY;
+
+        handle->running = true;
+        try {
+            handle->thread = std::thread(runBackground, handle, interval_ms, buffer, callback, user_data);
+        } catch (const std::system_error& e) {
+            handle->running = false;
+            Logger::error(std::string("Cannot start the sampling thread: ") + e.what());
+            return -EAGAIN;
+        }
+        return 0;
+    });
+}
+
+void amdgpu_top_stop(amdgpu_top* handle) {
+    if (!handle) return;
+    guarded(0, [handle] {
+        {
+            std::lock_guard<std::mutex> lock(handle->mutex);
+            handle->running = false;
+        }
+        handle->wake.notify_all();
+        // Joining fails with EDEADLK when called from the callback
+        if (handle->thread.joinable()) {
+            handle->thread.join();
+        }
+        return 0;
+    });
+}
@@ -0,0 +1,247 @@
+#include "annotations.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include "logger.hpp"
+
+AnnotationCollector::~AnnotationCollector() {
+    stop();
+}
+
+bool AnnotationCollector::start() {
+    sockaddr_un address;
+    socklen_t address_size = annotationAddress(name.c_str(), address);
+
+    socket_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (socket_fd < 0) {
+        Logger::error(std::string("Cannot create the annotation socket: ") + strerror(errno));
+        return false;
+    }
+
+    // Credentials give the sender's PID as seen from here, also from other PID namespaces
+    int one = 1;
+    setsockopt(socket_fd, SOL_SOCKET, SO_PASSCRED, &one, sizeof(one));
+    int buffer_size = 1 << 20;
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+    if (name[0] == '/') {
+        unlink(name.c_str());
+    }
+    if (bind(socket_fd, reinterpret_cast<const sockaddr*>(&address), address_size) < 0) {
+        Logger::error("Cannot bind the annotation socket " + name + ": " + strerror(errno));
+        close(socket_fd);
+        socket_fd = -1;
+        return false;
+    }
+    // A monitor running as root takes markers from every user
+    if (name[0] == '/') {
+        chmod(name.c_str(), 0666);
+    }
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        Logger::error(std::string("eventfd failed: ") + strerror(errno));
+        close(socket_fd);
+        socket_fd = -1;
+        return false;
+    }
+
+    running = true;
+    thread = std::thread(&AnnotationCollector::run, this);
+    Logger::info("Receiving phase markers on " + name);
+    return true;
+}
+
+void AnnotationCollector::stop() {
+    if (running) {
+        running = false;
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0) {
+            Logger::debug(std::string("Annotation collector wakeup failed: ") + strerror(errno));
+        }
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+    if (socket_fd >= 0) {
+        close(socket_fd);
+        socket_fd = -1;
+        if (name[0] == '/') {
+            unlink(name.c_str());
+        }
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+}
+
+void AnnotationCollector::run() {
+    pollfd fds[2] = {
+        {socket_fd, POLLIN, 0},
+        {wake_fd, POLLIN, 0}
+    };
+
+    while (running) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            Logger::error(std::string("Annotation collector poll failed: ") + strerror(errno));
+            break;
+        }
+        receive();
+    }
+}
+
+void AnnotationCollector::receive() {
+    AnnotationMessage messages[RECEIVE_BATCH];
+    iovec vectors[RECEIVE_BATCH];
+    mmsghdr headers[RECEIVE_BATCH];
+    union {
+        cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(ucred))];
+    } controls[RECEIVE_BATCH];
+
+    while (true) {
+        for (unsigned i = 0; i < RECEIVE_BATCH; i++) {
+            vectors[i] = {&messages[i], sizeof(messages[i])};
+            headers[i] = {};
+            headers[i].msg_hdr.msg_iov = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+            headers[i].msg_hdr.msg_control = controls[i].buffer;
+            headers[i].msg_hdr.msg_controllen = sizeof(controls[i].buffer);
+        }
+
+        int received = recvmmsg(socket_fd, headers, RECEIVE_BATCH, MSG_DONTWAIT, nullptr);
+        if (received <= 0) return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < received; i++) {
+            const AnnotationMessage& message = messages[i];
+            if (headers[i].msg_len != sizeof(message) || message.magic != ANNOTATION_MAGIC ||
+                message.version != ANNOTATION_VERSION ||
+                (message.type != ANNOTATION_BEGIN && message.type != ANNOTATION_END) ||
+                pending.size() >= MAX_PENDING) {
+                dropped++;
+                continue;
+            }
+
+            PhaseMarker marker;
+            marker.pid = message.pid;
+            for (cmsghdr* control = CMSG_FIRSTHDR(&headers[i].msg_hdr); control;
+                 control = CMSG_NXTHDR(&headers[i].msg_hdr, control)) {
+                if (control->cmsg_level == SOL_SOCKET && control->cmsg_type == SCM_CREDENTIALS) {
+                    ucred credentials;
+                    memcpy(&credentials, CMSG_DATA(control), sizeof(credentials));
+                    marker.pid = credentials.pid;
+                }
+            }
+            marker.begin = message.type == ANNOTATION_BEGIN;
+            marker.timestamp_ns = message.timestamp_ns;
+            marker.name.assign(message.name, strnlen(message.name, sizeof(message.name)));
+            pending.push_back(std::move(marker));
+        }
+        if (received < (int)RECEIVE_BATCH) return;
+    }
+}
+
+void AnnotationCollector::update(uint64_t now_ns, const std::vector<ProcessInfo>& processes) {
+    markers.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        markers.swap(pending);
+    }
+
+    // Engine usage and VRAM of each process over this interval, summed over its GPUs
+    std::map<pid_t, std::pair<float, float>> load;
+    for (const auto& process : processes) {
+        auto& entry = load[process.pid];
+        entry.first += process.gfx_usage + process.compute_usage;
+        entry.second += process.memory_usage / (1024.0f * 1024.0f);
+    }
+
+    uint64_t start_ns = last_update_ns ? last_update_ns : now_ns;
+    auto attribute = [&](pid_t pid, const std::string& phase, uint64_t from, uint64_t to) -> PhaseStats* {
+        auto key = std::make_pair(pid, phase);
+        auto it = stats.find(key);
+        if (it == stats.end()) {
+            if (stats.size() >= MAX_PHASES) return nullptr;
+            it = stats.emplace(key, PhaseStats()).first;
+            it->second.pid = pid;
+            it->second.name = phase;
+        }
+        PhaseStats& phase_stats = it->second;
+        from = std::max(from, start_ns);
+        to = std::min(to, now_ns);
+        if (to > from) {
+            uint64_t overlap = to - from;
+            phase_stats.time_ns += overlap;
+            auto used = load.find(pid);
+            if (used != load.end()) {
+                phase_stats.usage_ns += (double)used->second.first * overlap;
+                phase_stats.vram_ns += (double)used->second.second * overlap;
+                phase_stats.vram_peak = std::max(phase_stats.vram_peak, used->second.second);
+            }
+        }
+        return &phase_stats;
+    };
+
+    for (const auto& marker : markers) {
+        auto& phases = open[marker.pid];
+        if (marker.begin) {
+            if (phases.size() < MAX_NESTING) {
+                phases.push_back({marker.name, marker.timestamp_ns});
+            }
+            continue;
+        }
+        // The innermost open phase of that name; an end without a begin is ignored
+        for (size_t i = phases.size(); i-- > 0;) {
+            if (phases[i].name != marker.name) continue;
+            PhaseStats* ended = attribute(marker.pid, marker.name, phases[i].since_ns, marker.timestamp_ns);
+            if (ended) ended->count++;
+            phases.erase(phases.begin() + i);
+            break;
+        }
+    }
+
+    for (auto& entry : stats) {
+        entry.second.active = false;
+    }
+    for (auto it = open.begin(); it != open.end();) {
+        // Forget processes that exited, with the phases they left open
+        if (!load.count(it->first) && kill(it->first, 0) < 0 && errno == ESRCH) {
+            it = open.erase(it);
+            continue;
+        }
+        for (const auto& phase : it->second) {
+            PhaseStats* active = attribute(it->first, phase.name, phase.since_ns, now_ns);
+            if (active) active->active = true;
+        }
+        ++it;
+    }
+    for (auto it = stats.begin(); it != stats.end();) {
+        if (!it->second.active && !load.count(it->first.first) && kill(it->first.first, 0) < 0 && errno == ESRCH) {
+            it = stats.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    last_update_ns = now_ns;
+}
+
+void AnnotationCollector::getPhases(std::vector<PhaseStats>& phases) const {
+    phases.clear();
+    for (const auto& entry : stats) {
+        phases.push_back(entry.second);
+    }
+}
+
+uint64_t AnnotationCollector::getDropped() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return dropped;
+}
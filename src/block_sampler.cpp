@@ -0,0 +1,281 @@
+#include "block_sampler.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#include <libdrm/amdgpu_drm.h>
+#include "logger.hpp"
+
+// Status register dword offsets, identical from SI up to GFX11
+static constexpr uint32_t mmGRBM_STATUS = 0x2004;
+static constexpr uint32_t mmGRBM_STATUS2 = 0x2002;
+static constexpr uint32_t mmSRBM_STATUS = 0x0394;
+static constexpr uint32_t mmSRBM_STATUS2 = 0x0393;
+
+// Bit positions in GRBM_STATUS (register 0) and GRBM_STATUS2 (register 1)
+#define GRBM_BLOCKS \
+    {"GUI", 0, 31},    /* GUI_ACTIVE: graphics pipe busy */ \
+    {"Shader", 0, 22}, /* SPI_BUSY */ \
+    {"TA", 0, 14},     /* texture addresser */ \
+    {"TC", 1, 25},     /* texture cache */ \
+    {"VGT", 0, 17},    /* vertex grouper/tessellator */ \
+    {"PA", 0, 25},     /* primitive assembly */ \
+    {"SC", 0, 24},     /* scan converter */ \
+    {"SX", 0, 20},     /* shader export */ \
+    {"DB", 0, 26},     /* depth block */ \
+    {"CB", 0, 30},     /* color block */ \
+    {"CP", 0, 29},     /* command processor */ \
+    {"RLC", 1, 24}
+
+// SI/CI/VI also allow SRBM_STATUS/SRBM_STATUS2 reads, which carry the SDMA
+// and UVD/VCE engines. SOC15 parts only whitelist GRBM and CP registers.
+static const BlockBusyAccumulator::RegisterLayout LEGACY_LAYOUT = {
+    "SI/CI/VI",
+    4,
+    {mmGRBM_STATUS, mmGRBM_STATUS2, mmSRBM_STATUS, mmSRBM_STATUS2},
+    {
+        GRBM_BLOCKS,
+        {"UVD", 2, 19},
+        {"SDMA0", 3, 5},
+        {"SDMA1", 3, 6},
+        {"VCE", 3, 7},
+    }
+};
+
+static const BlockBusyAccumulator::RegisterLayout SOC15_LAYOUT = {
+    "GFX9+",
+    2,
+    {mmGRBM_STATUS, mmGRBM_STATUS2},
+    {
+        GRBM_BLOCKS,
+    }
+};
+
+void BitslicedCounter::add(uint32_t mask) {
+    // Ripple the carry through the planes, stopping as soon as it dies out
+    uint32_t carry = mask;
+    for (unsigned k = 0; k < PLANES && carry; k++) {
+        uint32_t next = planes[k] & carry;
+        planes[k] ^= carry;
+        carry = next;
+    }
+
+    if (++pending == (1u << PLANES) - 1) {
+        fold();
+    }
+}
+
+void BitslicedCounter::fold() {
+    for (unsigned bit = 0; bit < 32; bit++) {
+        uint64_t count = 0;
+        for (unsigned k = 0; k < PLANES; k++) {
+            count |= (uint64_t)((planes[k] >> bit) & 1) << k;
+        }
+        totals[bit] += count;
+    }
+    for (unsigned k = 0; k < PLANES; k++) {
+        planes[k] = 0;
+    }
+    pending = 0;
+}
+
+uint64_t BitslicedCounter::get(unsigned bit) const {
+    uint64_t count = totals[bit];
+    for (unsigned k = 0; k < PLANES; k++) {
+        count += (uint64_t)((planes[k] >> bit) & 1) << k;
+    }
+    return count;
+}
+
+void BitslicedCounter::clear() {
+    *this = BitslicedCounter();
+}
+
+const BlockBusyAccumulator::RegisterLayout& BlockBusyAccumulator::layoutForFamily(uint32_t family_id) {
+    return family_id < AMDGPU_FAMILY_AI ? LEGACY_LAYOUT : SOC15_LAYOUT;
+}
+
+const BlockBusyAccumulator::RegisterLayout* BlockBusyAccumulator::layoutForName(const std::string& family) {
+    for (const RegisterLayout* layout : {&LEGACY_LAYOUT, &SOC15_LAYOUT}) {
+        if (family == layout->family) return layout;
+    }
+    return nullptr;
+}
+
+void BlockBusyAccumulator::accumulate(const uint32_t* values) {
+    for (unsigned i = 0; i < layout.count; i++) {
+        counters[i].add(values[i]);
+    }
+    samples++;
+}
+
+std::vector<BlockUsage> BlockBusyAccumulator::collect() {
+    std::vector<BlockUsage> usage;
+    if (samples == 0) return usage;
+
+    for (const auto& block : layout.blocks) {
+        float busy = (float)counters[block.reg].get(block.bit) / samples * 100.0f;
+        usage.push_back({block.name, busy});
+    }
+
+    for (auto& counter : counters) {
+        counter.clear();
+    }
+    samples = 0;
+    return usage;
+}
+
+void writeBlockDumpHeader(FILE* file, const BlockBusyAccumulator::RegisterLayout& layout) {
+    fprintf(file, "amdgpu-top blocks %s", layout.family);
+    for (unsigned i = 0; i < layout.count; i++) {
+        fprintf(file, " 0x%04x", layout.offsets[i]);
+    }
+    fputc('\n', file);
+}
+
+void writeBlockDumpSample(FILE* file, const BlockBusyAccumulator::RegisterLayout& layout, const uint32_t* values) {
+    for (unsigned i = 0; i < layout.count; i++) {
+        fprintf(file, i ? " %08x" : "%08x", values[i]);
+    }
+    fputc('\n', file);
+}
+
+bool replayBlockDump(FILE* file, std::vector<BlockUsage>& usage, uint64_t& samples, std::string& error) {
+    char line[256];
+    char family[32];
+    if (!fgets(line, sizeof(line), file) || sscanf(line, "amdgpu-top blocks %31s", family) != 1) {
+        error = "not a block register dump";
+        return false;
+    }
+    const BlockBusyAccumulator::RegisterLayout* layout = BlockBusyAccumulator::layoutForName(family);
+    if (!layout) {
+        error = std::string("unknown register layout ") + family;
+        return false;
+    }
+
+    // The offsets must be the ones the layout decodes
+    const char* p = strchr(line + strlen("amdgpu-top blocks "), ' ');
+    for (unsigned i = 0; i < layout->count; i++) {
+        char* end;
+        unsigned long offset = p ? strtoul(p, &end, 16) : 0;
+        if (!p || end == p || offset != layout->offsets[i]) {
+            error = std::string("register offsets do not match the ") + family + " layout";
+            return false;
+        }
+        p = end;
+    }
+
+    BlockBusyAccumulator accumulator(*layout);
+    uint32_t values[BlockBusyAccumulator::MAX_REGISTERS];
+    unsigned long number = 1;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        char* q = line;
+        for (unsigned i = 0; i < layout->count; i++) {
+            char* end;
+            values[i] = strtoul(q, &end, 16);
+            if (end == q) {
+                error = "malformed sample on line " + std::to_string(number);
+                return false;
+            }
+            q = end;
+        }
+        accumulator.accumulate(values);
+    }
+    samples = accumulator.getSampleCount();
+    usage = accumulator.collect();
+    return true;
+}
+
+BlockSampler::BlockSampler(amdgpu_device_handle device, uint32_t family_id, unsigned rate_hz)
+    : device(device),
+      rate_hz(rate_hz ? rate_hz : DEFAULT_RATE_HZ),
+      accumulator(BlockBusyAccumulator::layoutForFamily(family_id)),
+      running(false) {}
+
+BlockSampler::~BlockSampler() {
+    stop();
+    if (dump) {
+        fclose(dump);
+    }
+}
+
+bool BlockSampler::record(const std::string& path) {
+    dump = fopen(path.c_str(), "we");
+    if (!dump) {
+        Logger::error("Cannot write block dump " + path + ": " + strerror(errno));
+        return false;
+    }
+    writeBlockDumpHeader(dump, accumulator.getLayout());
+    return true;
+}
+
+bool BlockSampler::start() {
+    // Registers outside the kernel's whitelist fail here rather than on the thread
+    uint32_t value;
+    const auto& layout = accumulator.getLayout();
+    for (unsigned i = 0; i < layout.count; i++) {
+        if (amdgpu_read_mm_registers(device, layout.offsets[i], 1, 0xffffffff, 0, &value) != 0) {
+            char offset[16];
+            snprintf(offset, sizeof(offset), "0x%04x", layout.offsets[i]);
+            Logger::warning(std::string("Cannot read status register ") + offset +
+                            " for " + layout.family + " block sampling");
+            return false;
+        }
+    }
+
+    running = true;
+    thread = std::thread(&BlockSampler::run, this);
+    return true;
+}
+
+void BlockSampler::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+std::vector<BlockUsage> BlockSampler::collect() {
+    std::lock_guard<std::mutex> lock(accumulator_mutex);
+    return accumulator.collect();
+}
+
+void BlockSampler::run() {
+    const auto& layout = accumulator.getLayout();
+    uint32_t values[BlockBusyAccumulator::MAX_REGISTERS];
+    const long period_ns = 1000000000L / rate_hz;
+
+    timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (running) {
+        bool valid = true;
+        for (unsigned i = 0; i < layout.count && valid; i++) {
+            valid = amdgpu_read_mm_registers(device, layout.offsets[i], 1, 0xffffffff, 0, &values[i]) == 0;
+        }
+        if (valid) {
+            std::lock_guard<std::mutex> lock(accumulator_mutex);
+            accumulator.accumulate(values);
+        }
+        if (valid && dump) {
+            writeBlockDumpSample(dump, layout, values);  // Buffered, written out in blocks
+        }
+
+        next.tv_nsec += period_ns;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+
+        // Skip missed periods instead of bursting to catch up
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec)) {
+            next = now;
+            continue;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+    }
+}
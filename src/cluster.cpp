@@ -0,0 +1,502 @@
+#include "cluster.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "logger.hpp"
+
+static constexpr uint64_t WAKE_ID = UINT64_MAX;
+static constexpr int MAX_EVENTS = 64;
+
+bool resolveAgentAddress(const std::string& address, bool passive, sockaddr_storage& addr, socklen_t& addr_len) {
+    memset(&addr, 0, sizeof(addr));
+
+    if (!address.empty() && address[0] == '/') {
+        sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&addr);
+        if (address.size() >= sizeof(un->sun_path)) {
+            Logger::error("Socket path too long: " + address);
+            return false;
+        }
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, address.c_str(), address.size() + 1);
+        addr_len = offsetof(sockaddr_un, sun_path) + address.size() + 1;
+        return true;
+    }
+
+    std::string host = address;
+    std::string port = std::to_string(AGENT_DEFAULT_PORT);
+    if (!host.empty() && host[0] == '[') {
+        size_t close = host.find(']');
+        if (close == std::string::npos) {
+            Logger::error("Malformed address " + address);
+            return false;
+        }
+        if (close + 1 < host.size() && host[close + 1] == ':') {
+            port = host.substr(close + 2);
+        }
+        host = host.substr(1, close - 1);
+    } else {
+        // A single colon separates the port, more than one is a bare IPv6 address
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos && host.find(':') == colon) {
+            port = host.substr(colon + 1);
+            host = host.substr(0, colon);
+        }
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo* result = nullptr;
+    int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+    if (error != 0 || !result) {
+        Logger::error("Cannot resolve " + address + ": " + gai_strerror(error));
+        return false;
+    }
+    memcpy(&addr, result->ai_addr, result->ai_addrlen);
+    addr_len = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+SnapshotAgent::~SnapshotAgent() {
+    for (const auto& client : clients) {
+        close(client.first);
+    }
+    if (listen_fd >= 0) close(listen_fd);
+    if (epoll_fd >= 0) close(epoll_fd);
+    if (!unix_path.empty()) unlink(unix_path.c_str());
+}
+
+bool SnapshotAgent::open() {
+    sockaddr_storage addr;
+    socklen_t addr_len;
+    if (!resolveAgentAddress(address, true, addr, addr_len)) return false;
+
+    listen_fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        Logger::error("Cannot create agent socket: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    if (addr.ss_family == AF_UNIX) {
+        // A socket left behind by a crashed agent would fail the bind
+        struct stat st;
+        if (stat(address.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(address.c_str());
+        }
+    } else {
+        int reuse = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), addr_len) < 0 || listen(listen_fd, 64) < 0) {
+        Logger::error("Cannot listen on " + address + ": " + strerror(errno));
+        return false;
+    }
+    if (addr.ss_family == AF_UNIX) {
+        unix_path = address;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd;
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) < 0) {
+        Logger::error("Cannot set up epoll: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    Logger::info("Serving snapshots on " + address);
+    return true;
+}
+
+void SnapshotAgent::publish(const Snapshot& snapshot) {
+    delta.clear();
+    encoder.encode(snapshot, delta);
+    keyframe.clear();
+
+    std::vector<int> fds;
+    for (const auto& client : clients) {
+        fds.push_back(client.first);
+    }
+
+    for (int fd : fds) {
+        Client& client = clients[fd];
+        if (client.sent == client.pending.size()) {
+            client.pending.clear();
+            client.sent = 0;
+        }
+
+        if (client.needs_keyframe) {
+            if (keyframe.empty()) {
+                encoder.encodeKeyframe(keyframe);
+            }
+            client.pending.insert(client.pending.end(), keyframe.begin(), keyframe.end());
+            client.needs_keyframe = false;
+        } else {
+            client.pending.insert(client.pending.end(), delta.begin(), delta.end());
+        }
+
+        if (client.pending.size() - client.sent > MAX_PENDING_BYTES) {
+            Logger::warning("Dropping a reader that fell behind");
+            drop(fd);
+            continue;
+        }
+        flush(fd, client);
+    }
+}
+
+void SnapshotAgent::poll(int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    epoll_event events[MAX_EVENTS];
+
+    while (true) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, std::max<long>(0, remaining));
+        if (count < 0) return;  // Interrupted, likely by a signal to stop
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                acceptClients();
+                continue;
+            }
+
+            auto client = clients.find(fd);
+            if (client == clients.end()) continue;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                drop(fd);
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                // Readers have nothing to say, input only tells that they went away
+                char buf[256];
+                ssize_t length = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (length == 0 || (length < 0 && errno != EAGAIN && errno != EINTR)) {
+                    drop(fd);
+                    continue;
+                }
+            }
+            if (events[i].events & EPOLLOUT) {
+                flush(fd, client->second);
+            }
+        }
+        if (remaining <= 0) return;
+    }
+}
+
+void SnapshotAgent::acceptClients() {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            continue;
+        }
+        clients[fd] = Client();
+        Logger::info("Reader connected, " + std::to_string(clients.size()) + " in total");
+    }
+}
+
+bool SnapshotAgent::flush(int fd, Client& client) {
+    while (client.sent < client.pending.size()) {
+        ssize_t length = send(fd, client.pending.data() + client.sent, client.pending.size() - client.sent,
+                              MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (length > 0) {
+            client.sent += length;
+        } else if (length < 0 && errno == EINTR) {
+            continue;
+        } else if (length < 0 && errno == EAGAIN) {
+            break;
+        } else {
+            drop(fd);
+            return false;
+        }
+    }
+
+    // Only ask for writability while something is queued
+    bool want_write = client.sent < client.pending.size();
+    if (want_write != client.want_write) {
+        epoll_event event = {};
+        event.events = EPOLLIN | (want_write ? (uint32_t)EPOLLOUT : 0u);
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+        client.want_write = want_write;
+    }
+    return true;
+}
+
+void SnapshotAgent::drop(int fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    clients.erase(fd);
+    Logger::info("Reader disconnected, " + std::to_string(clients.size()) + " left");
+}
+
+ClusterAggregator::ClusterAggregator(const std::vector<std::string>& addresses)
+    : peers(addresses.size()), running(false) {
+    for (size_t i = 0; i < addresses.size(); i++) {
+        peers[i].address = addresses[i];
+    }
+}
+
+ClusterAggregator::~ClusterAggregator() {
+    stop();
+}
+
+bool ClusterAggregator::start() {
+    size_t resolved = 0;
+    for (auto& peer : peers) {
+        if (resolveAgentAddress(peer.address, false, peer.addr, peer.addr_len)) {
+            resolved++;
+        } else {
+            peer.addr_len = 0;
+            Logger::warning("Leaving out agent " + peer.address);
+        }
+    }
+    if (resolved == 0) {
+        Logger::error("None of the agent addresses resolved");
+        return false;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0) {
+        Logger::error("Cannot set up the aggregator: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_ID;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+
+    running = true;
+    thread = std::thread(&ClusterAggregator::run, this);
+    return true;
+}
+
+void ClusterAggregator::stop() {
+    if (running) {
+        running = false;
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0) {
+            Logger::debug("Aggregator wakeup failed: " + std::string(strerror(errno)));
+        }
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+    for (auto& peer : peers) {
+        if (peer.fd >= 0) {
+            close(peer.fd);
+            peer.fd = -1;
+        }
+    }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+}
+
+void ClusterAggregator::run() {
+    epoll_event events[MAX_EVENTS];
+
+    while (running) {
+        auto now = Clock::now();
+        int timeout_ms = 1000;
+        for (size_t i = 0; i < peers.size(); i++) {
+            Peer& peer = peers[i];
+            if (peer.addr_len == 0) continue;
+            if (peer.fd < 0) {
+                if (now >= peer.retry_at) {
+                    connectPeer(i);
+                }
+                if (peer.fd < 0) {
+                    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(peer.retry_at - now).count();
+                    timeout_ms = std::max(0, std::min<int>(timeout_ms, wait));
+                }
+            } else if (now - peer.last_frame > std::chrono::milliseconds(STALE_MS)) {
+                Logger::warning("No snapshots from " + peer.address + " for " + std::to_string(STALE_MS) + " ms");
+                disconnect(i);
+            }
+        }
+
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+        for (int k = 0; k < count; k++) {
+            uint64_t id = events[k].data.u64;
+            if (id == WAKE_ID) continue;  // Only stop() writes it, the loop condition does the rest
+            if (id >= peers.size() || peers[id].fd < 0) continue;
+            if (peers[id].connecting) {
+                finishConnect(id);
+            } else {
+                receive(id);
+            }
+        }
+    }
+}
+
+void ClusterAggregator::connectPeer(size_t index) {
+    Peer& peer = peers[index];
+    auto now = Clock::now();
+    peer.retry_at = now + std::chrono::milliseconds(RECONNECT_MS);
+    peer.last_frame = now;
+
+    int fd = socket(peer.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return;
+
+    int result = connect(fd, reinterpret_cast<const sockaddr*>(&peer.addr), peer.addr_len);
+    if (result < 0 && errno != EINPROGRESS) {
+        Logger::debug("Cannot connect to " + peer.address + ": " + strerror(errno));
+        close(fd);
+        return;
+    }
+
+    epoll_event event = {};
+    event.events = result == 0 ? EPOLLIN : EPOLLOUT;
+    event.data.u64 = index;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        close(fd);
+        return;
+    }
+    peer.fd = fd;
+    peer.connecting = result < 0;
+    peer.input.clear();
+    peer.decoder.reset();
+}
+
+void ClusterAggregator::finishConnect(size_t index) {
+    Peer& peer = peers[index];
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(peer.fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+        Logger::debug("Cannot connect to " + peer.address + ": " + strerror(error));
+        disconnect(index);
+        return;
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = index;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, peer.fd, &event);
+    peer.connecting = false;
+    Logger::info("Connected to agent " + peer.address);
+}
+
+void ClusterAggregator::receive(size_t index) {
+    Peer& peer = peers[index];
+    uint8_t buf[65536];
+    while (true) {
+        ssize_t length = recv(peer.fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (length > 0) {
+            peer.input.insert(peer.input.end(), buf, buf + length);
+            continue;
+        }
+        if (length < 0 && errno == EINTR) continue;
+        if (length < 0 && errno == EAGAIN) break;
+        disconnect(index);
+        return;
+    }
+
+    size_t offset = 0;
+    while (peer.input.size() - offset >= sizeof(StreamFrameHeader)) {
+        StreamFrameHeader header;
+        memcpy(&header, peer.input.data() + offset, sizeof(header));
+        if (!SnapshotDecoder::isCompatible(header)) {
+            Logger::warning("Incompatible snapshot stream from " + peer.address);
+            disconnect(index);
+            return;
+        }
+        if (peer.input.size() - offset - sizeof(header) < header.payload_size) break;
+
+        const uint8_t* payload = peer.input.data() + offset + sizeof(header);
+        if (!peer.decoder.decode(header, payload, peer.scratch)) {
+            Logger::warning("Malformed snapshot from " + peer.address);
+            disconnect(index);
+            return;
+        }
+        offset += sizeof(header) + header.payload_size;
+        peer.last_frame = Clock::now();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(peer.snapshot, peer.scratch);
+        peer.has_snapshot = true;
+        changed = true;
+    }
+    peer.input.erase(peer.input.begin(), peer.input.begin() + offset);
+}
+
+void ClusterAggregator::disconnect(size_t index) {
+    Peer& peer = peers[index];
+    if (peer.fd >= 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, peer.fd, nullptr);
+        close(peer.fd);
+        peer.fd = -1;
+    }
+    if (!peer.connecting) {
+        Logger::warning("Lost agent " + peer.address);
+    }
+    peer.connecting = false;
+    peer.input.clear();
+    peer.decoder.reset();
+    peer.retry_at = Clock::now() + std::chrono::milliseconds(RECONNECT_MS);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (peer.has_snapshot) {
+        peer.has_snapshot = false;
+        changed = true;
+    }
+}
+
+bool ClusterAggregator::getSnapshot(Snapshot& snapshot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!changed) return false;
+    changed = false;
+
+    snapshot.timestamp_ns = 0;
+    snapshot.processes_pending = false;
+    snapshot.gpus.clear();
+    snapshot.unreachable_hosts.clear();
+
+    // Node indices stand in for render nodes, offset so clients of different agents stay apart
+    dev_t node_offset = 0;
+    for (const auto& peer : peers) {
+        if (!peer.has_snapshot) {
+            snapshot.unreachable_hosts.push_back(peer.address);
+            continue;
+        }
+        snapshot.timestamp_ns = std::max(snapshot.timestamp_ns, peer.snapshot.timestamp_ns);
+
+        dev_t peer_nodes = 0;
+        for (const auto& peer_gpu : peer.snapshot.gpus) {
+            snapshot.gpus.push_back(peer_gpu);
+            GPUSnapshot& gpu = snapshot.gpus.back();
+            gpu.host = peer.address;
+            for (auto& node : gpu.nodes) {
+                for (auto& proc : node.processes) {
+                    proc.drm_device += node_offset;
+                }
+            }
+            peer_nodes += gpu.nodes.size();
+        }
+        node_offset += peer_nodes;
+    }
+    return true;
+}
@@ -0,0 +1,843 @@
+#include "compare.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "snapshot.hpp"
+#include "snapshot_stream.hpp"
+#include "trace_writer.hpp"
+
+// Longest event of a JSON trace that is parsed, longer ones are skipped
+static constexpr size_t MAX_EVENT_SIZE = 1 << 20;
+
+void MetricDistribution::add(double value) {
+    bins[binOf(value)]++;
+    count++;
+    double delta = value - mean;
+    mean += delta / count;
+    m2 += delta * (value - mean);
+
+    if (count == 1) {
+        origin = value;
+    } else {
+        sum_products += (value - origin) * previous;
+        sum_current += value - origin;
+        sum_previous += previous;
+    }
+    previous = value - origin;
+}
+
+double MetricDistribution::getEffectiveCount() const {
+    uint64_t pairs = count - 1;
+    if (count < 3 || m2 <= 0) return count;
+    double covariance = (sum_products - sum_current * sum_previous / pairs) / pairs;
+    double correlation = std::min(std::max(covariance / (m2 / count), 0.0), 0.99);
+    return std::max(1.0, count * (1 - correlation) / (1 + correlation));
+}
+
+uint32_t MetricDistribution::binOf(double value) {
+    uint64_t scaled = value > 0 ? (uint64_t)std::min(value * SCALE, 1e18) : 0;
+    if (scaled < (1u << SUB_BITS)) return scaled;
+    unsigned exponent = 63 - __builtin_clzll(scaled);
+    return ((exponent - SUB_BITS + 1) << SUB_BITS) + ((scaled >> (exponent - SUB_BITS)) & ((1u << SUB_BITS) - 1));
+}
+
+double MetricDistribution::binLow(uint32_t bin) {
+    if (bin < (1u << SUB_BITS)) return bin / SCALE;
+    unsigned exponent = (bin >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t mantissa = (1u << SUB_BITS) + (bin & ((1u << SUB_BITS) - 1));
+    return (mantissa << (exponent - SUB_BITS)) / SCALE;
+}
+
+double MetricDistribution::getPercentile(double percent) const {
+    if (!count) return 0;
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)(percent / 100.0 * count + 0.5));
+    uint64_t seen = 0;
+    for (const auto& bin : bins) {
+        seen += bin.second;
+        if (seen >= rank) return (binLow(bin.first) + binLow(bin.first + 1)) / 2;
+    }
+    return binLow(bins.rbegin()->first);
+}
+
+double MetricDistribution::distance(const MetricDistribution& a, const MetricDistribution& b) {
+    if (!a.count || !b.count) return 0;
+    auto ia = a.bins.begin();
+    auto ib = b.bins.begin();
+    uint64_t seen_a = 0, seen_b = 0;
+    double largest = 0;
+    while (ia != a.bins.end() || ib != b.bins.end()) {
+        // Step over the next bin of either, both if they share it
+        uint32_t bin = std::min(ia != a.bins.end() ? ia->first : UINT32_MAX, ib != b.bins.end() ? ib->first : UINT32_MAX);
+        if (ia != a.bins.end() && ia->first == bin) seen_a += (ia++)->second;
+        if (ib != b.bins.end() && ib->first == bin) seen_b += (ib++)->second;
+        largest = std::max(largest, std::fabs((double)seen_a / a.count - (double)seen_b / b.count));
+    }
+    return largest;
+}
+
+void CompareMetric::add(double time_s, double value) {
+    if (pending_s >= 0 && time_s != pending_s) {
+        distribution.add(pending);
+        pending = 0;
+    }
+    pending_s = time_s;
+    pending += value;
+}
+
+void CompareMetric::finish() {
+    if (pending_s >= 0) {
+        distribution.add(pending);
+    }
+    pending_s = -1;
+    pending = 0;
+}
+
+void CompareRun::beginPhase(const std::string& name) {
+    has_markers = true;
+    open_phases[name]++;
+}
+
+void CompareRun::endPhase(const std::string& name) {
+    auto it = open_phases.find(name);
+    if (it != open_phases.end() && --it->second == 0) {
+        open_phases.erase(it);
+    }
+}
+
+void CompareRun::add(double time_s, const std::string& section, const std::string& metric, double value,
+                     double seconds, bool cumulative) {
+    if (origin_s < 0) origin_s = time_s;
+
+    auto account = [&](const std::string& group) {
+        CompareMetric& entry = groups[group][{section, metric}];
+        entry.cumulative = cumulative;
+        if (cumulative) {
+            entry.total += value;
+        } else {
+            entry.add(time_s, value);
+            entry.total += value * seconds;
+        }
+    };
+    if (by_phase) {
+        if (open_phases.empty()) return;
+        for (const auto& phase : open_phases) {
+            account(phase.first);
+        }
+    } else {
+        double elapsed = time_s - origin_s;
+        if (elapsed < skip_s || (duration_s > 0 && elapsed >= skip_s + duration_s)) return;
+        account("");
+    }
+
+    if (time_s != last_s) samples++;
+    if (first_s < 0 || time_s < first_s) first_s = time_s;
+    last_s = std::max(last_s, time_s);
+}
+
+void CompareRun::finish() {
+    for (auto& group : groups) {
+        for (auto& metric : group.second) {
+            metric.second.finish();
+        }
+    }
+}
+
+bool CompareRun::read(const std::string& path, std::string& error) {
+    FILE* file = fopen(path.c_str(), "rbe");
+    if (!file) {
+        error = "cannot open " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    // Frame streams start with their magic, traces with an array or an object
+    uint32_t magic = 0;
+    size_t peeked = fread(&magic, 1, sizeof(magic), file);
+    rewind(file);
+    int first = fgetc(file);
+    while (first != EOF && isspace(first)) first = fgetc(file);
+    ungetc(first, file);
+
+    bool ok;
+    if (peeked == sizeof(magic) && magic == STREAM_MAGIC) {
+        rewind(file);
+        ok = readStream(file, error);
+    } else if (first == '[' || first == '{') {
+        ok = readTrace(file, error);
+    } else {
+        ok = readCSV(file, error);
+    }
+    fclose(file);
+    if (!ok) {
+        error = path + ": " + error;
+        return false;
+    }
+    finish();
+    if (by_phase && !has_markers) {
+        error = path + " has no phase markers to align by";
+        return false;
+    }
+    return true;
+}
+
+// Flight recordings and other frame streams: one snapshot per frame
+bool CompareRun::readStream(FILE* file, std::string& error) {
+    SnapshotDecoder decoder;
+    Snapshot snapshot;
+    StreamFrameHeader header;
+    std::vector<uint8_t> payload;
+    std::vector<StreamMarker> markers;
+    std::vector<uint64_t> sampled;  // per GPU, time of its last sample
+    std::vector<double> energy;
+    uint64_t scanned = 0;
+
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        if (!SnapshotDecoder::isCompatible(header)) {
+            error = "recorded by another version of amdgpu-top";
+            return false;
+        }
+        if (header.payload_size > STREAM_MAX_PAYLOAD) {
+            error = "frame of " + std::to_string(header.payload_size) + " bytes";
+            return false;
+        }
+        payload.resize(header.payload_size);
+        if (fread(payload.data(), 1, payload.size(), file) != payload.size()) {
+            error = "truncated or corrupt frame";
+            return false;
+        }
+
+        // Phase markers come before the samples they cover
+        if (header.flags & STREAM_MARKERS) {
+            if (!decodeMarkers(header, payload.data(), markers)) {
+                error = "corrupt phase marker frame";
+                return false;
+            }
+            for (const auto& marker : markers) {
+                std::string name(marker.name, strnlen(marker.name, sizeof(marker.name)));
+                if (marker.begin) {
+                    beginPhase(name);
+                } else {
+                    endPhase(name);
+                }
+            }
+            continue;
+        }
+        if (!decoder.decode(header, payload.data(), snapshot)) {
+            error = "truncated or corrupt frame";
+            return false;
+        }
+
+        sampled.resize(std::max(sampled.size(), snapshot.gpus.size()), 0);
+        energy.resize(sampled.size(), -1);
+        for (size_t i = 0; i < snapshot.gpus.size(); i++) {
+            const GPUDevice::Metrics& metrics = snapshot.gpus[i].metrics;
+            uint64_t timestamp = metrics.timestamp_ns ? metrics.timestamp_ns : snapshot.timestamp_ns;
+            if (timestamp == sampled[i]) continue;  // not sampled again, with adaptive sampling
+            double seconds = sampled[i] && timestamp > sampled[i] ? (timestamp - sampled[i]) / 1e9 : 0;
+            sampled[i] = timestamp;
+
+            double t = timestamp / 1e9;
+            std::string section = "gpu" + std::to_string(i);
+            add(t, section, "usage %", metrics.gpu_usage, seconds);
+            add(t, section, "sclk MHz", metrics.gpu_clock, seconds);
+            add(t, section, "mclk MHz", metrics.memory_clock, seconds);
+            add(t, section, "power W", metrics.power_usage, seconds);
+            add(t, section, "temperature °C", metrics.temperature, seconds);
+            add(t, section, "vram MiB", metrics.memory_used, seconds);
+            if (energy[i] >= 0 && metrics.energy >= energy[i]) {
+                add(t, section, "energy J", metrics.energy - energy[i], 0, true);
+            }
+            energy[i] = metrics.energy;
+        }
+
+        uint64_t scan = snapshot.timestamp_ns;
+        if (!snapshot.gpus.empty() && !snapshot.gpus[0].nodes.empty() && snapshot.gpus[0].nodes[0].processes_timestamp_ns) {
+            scan = snapshot.gpus[0].nodes[0].processes_timestamp_ns;
+        }
+        if (snapshot.processes_pending || scan == scanned) continue;
+        double seconds = scanned && scan > scanned ? (scan - scanned) / 1e9 : 0;
+        scanned = scan;
+        for (size_t i = 0; i < snapshot.gpus.size(); i++) {
+            for (const auto& node : snapshot.gpus[i].nodes) {
+                for (const auto& proc : node.processes) {
+                    add(scan / 1e9, proc.name, "gpu" + std::to_string(i) + " engine %",
+                        proc.gfx_usage + proc.compute_usage + proc.enc_usage + proc.dec_usage, seconds);
+                }
+            }
+        }
+    }
+    if (ferror(file)) {
+        error = strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+// The parts of a trace event compare looks at
+struct TraceEvent {
+    std::string ph;
+    std::string name;
+    long pid = 0;
+    double ts = 0;  // microseconds
+    std::vector<std::pair<std::string, double>> args;
+    std::string arg_name;  // args.name of metadata events
+};
+
+// Minimal JSON reader over one event's text
+class EventParser {
+public:
+    explicit EventParser(const std::string& text) : p(text.c_str()), end(text.c_str() + text.size()) {}
+
+    bool parse(TraceEvent& event) {
+        return object([&](const std::string& key) {
+            if (key == "ph") return string(event.ph);
+            if (key == "name") return string(event.name);
+            if (key == "pid") return number(event.pid);
+            if (key == "ts") return number(event.ts);
+            if (key == "args") {
+                return object([&](const std::string& arg) {
+                    space();
+                    if (p < end && *p == '"') {
+                        return arg == "name" ? string(event.arg_name) : skip();
+                    }
+                    double value;
+                    if (!number(value)) return skip();
+                    event.args.emplace_back(arg, value);
+                    return true;
+                });
+            }
+            return skip();
+        });
+    }
+
+private:
+    const char* p;
+    const char* end;
+
+    void space() {
+        while (p < end && isspace((unsigned char)*p)) p++;
+    }
+
+    template <typename Member>
+    bool object(Member member) {
+        space();
+        if (p >= end || *p != '{') return false;
+        p++;
+        space();
+        if (p < end && *p == '}') {
+            p++;
+            return true;
+        }
+        while (p < end) {
+            std::string key;
+            space();
+            if (!string(key)) return false;
+            space();
+            if (p >= end || *p++ != ':') return false;
+            if (!member(key)) return false;
+            space();
+            if (p < end && *p == ',') {
+                p++;
+            } else if (p < end && *p == '}') {
+                p++;
+                return true;
+            } else {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool string(std::string& out) {
+        space();
+        if (p >= end || *p != '"') return false;
+        out.clear();
+        for (p++; p < end && *p != '"'; p++) {
+            if (*p == '\\' && p + 1 < end) {
+                p++;
+                // \uXXXX is kept as it is, names only need to match each other
+                out += *p == 'n' ? '\n' : *p == 't' ? '\t' : *p;
+            } else {
+                out += *p;
+            }
+        }
+        if (p >= end) return false;
+        p++;
+        return true;
+    }
+
+    template <typename T>
+    bool number(T& out) {
+        space();
+        char* after;
+        double value = strtod(p, &after);
+        if (after == p || after > end) return false;
+        p = after;
+        out = (T)value;
+        return true;
+    }
+
+    // Any value, nested ones included
+    bool skip() {
+        space();
+        if (p >= end) return false;
+        if (*p == '"') {
+            std::string ignored;
+            return string(ignored);
+        }
+        if (*p == '{' || *p == '[') {
+            int depth = 0;
+            for (; p < end; p++) {
+                if (*p == '"') {
+                    std::string ignored;
+                    if (!string(ignored)) return false;
+                    p--;
+                } else if (*p == '{' || *p == '[') {
+                    depth++;
+                } else if ((*p == '}' || *p == ']') && --depth == 0) {
+                    p++;
+                    return true;
+                }
+            }
+            return false;
+        }
+        while (p < end && *p != ',' && *p != '}' && *p != ']') p++;
+        return true;
+    }
+};
+
+// "GPU 3/1 engines %" -> "gpu3"
+static std::string gpuOfTrack(const std::string& track) {
+    if (track.compare(0, 4, "GPU ") != 0) return "";
+    size_t end = 4;
+    while (end < track.size() && isdigit((unsigned char)track[end])) end++;
+    return end > 4 ? "gpu" + track.substr(4, end - 4) : "";
+}
+
+/**
+ * Chrome JSON traces, the array form of --trace or {"traceEvents": [...]}
+ *
+ * Events are cut out of the file one at a time by following the nesting,
+ * so memory stays flat however large the trace is. GPU tracks are the
+ * pseudo processes named "GPU N: ..."; the "engines %" counters of real
+ * processes are their engine usage.
+ */
+bool CompareRun::readTrace(FILE* file, std::string& error) {
+    std::map<long, std::string> gpus;       // pseudo process -> section
+    std::map<long, std::string> processes;  // pid -> name
+    std::map<std::pair<long, std::string>, double> track_times;  // last ts of each counter track
+    std::map<long, double> energy;
+    std::vector<TraceEvent> markers;  // not applied yet, newer than the samples read so far
+    auto applyMarker = [this](const TraceEvent& marker) {
+        if (marker.ph == "B") {
+            beginPhase(marker.name);
+        } else {
+            endPhase(marker.name);
+        }
+    };
+
+    auto handle = [&](const TraceEvent& event) {
+        if (event.ph == "M" && event.name == "process_name") {
+            std::string gpu = gpuOfTrack(event.arg_name);
+            if (!gpu.empty()) {
+                gpus[event.pid] = gpu;
+            } else {
+                processes[event.pid] = event.arg_name;
+            }
+            return;
+        }
+        // A phase starts or ends with the first sample at or after its marker, wherever the
+        // marker is in the file
+        if (event.ph == "B" || event.ph == "E") {
+            markers.push_back(event);
+            return;
+        }
+        if (event.ph != "C" || event.args.empty()) return;
+
+        auto due = std::stable_partition(markers.begin(), markers.end(),
+                                         [&event](const TraceEvent& marker) { return marker.ts > event.ts; });
+        for (auto marker = due; marker != markers.end(); ++marker) {
+            applyMarker(*marker);
+        }
+        markers.erase(due, markers.end());
+
+        double t = event.ts / 1e6;
+        double& last = track_times[{event.pid, event.name}];
+        double seconds = last > 0 && t > last ? t - last : 0;
+        last = t;
+
+        auto gpu = gpus.find(event.pid);
+        if (gpu == gpus.end() && event.pid >= TraceWriter::GPU_PID_BASE) {
+            gpu = gpus.emplace(event.pid, "gpu" + std::to_string(event.pid - TraceWriter::GPU_PID_BASE)).first;
+        }
+        if (gpu != gpus.end()) {
+            static const struct {
+                const char* counter;
+                const char* arg;
+                const char* metric;
+            } MAPPING[] = {
+                {"usage %", "gpu", "usage %"},         {"clock MHz", "sclk", "sclk MHz"},
+                {"clock MHz", "mclk", "mclk MHz"},     {"power W", "power", "power W"},
+                {"temperature °C", "edge", "temperature °C"}, {"memory MiB", "vram", "vram MiB"},
+            };
+            for (const auto& arg : event.args) {
+                if (event.name == "energy J" && arg.first == "energy") {
+                    auto previous = energy.find(event.pid);
+                    if (previous != energy.end() && arg.second >= previous->second) {
+                        add(t, gpu->second, "energy J", arg.second - previous->second, 0, true);
+                    }
+                    energy[event.pid] = arg.second;
+                    continue;
+                }
+                for (const auto& mapping : MAPPING) {
+                    if (event.name == mapping.counter && arg.first == mapping.arg) {
+                        add(t, gpu->second, mapping.metric, arg.second, seconds);
+                    }
+                }
+            }
+            return;
+        }
+
+        size_t suffix = event.name.rfind(" engines %");
+        if (suffix == std::string::npos || suffix + 10 != event.name.size()) return;
+        std::string section = gpuOfTrack(event.name);
+        auto process = processes.find(event.pid);
+        double usage = 0;
+        for (const auto& arg : event.args) {
+            usage += arg.second;
+        }
+        add(t, process != processes.end() ? process->second : "pid " + std::to_string(event.pid),
+            (section.empty() ? std::string("gpu") : section) + " engine %", usage, seconds);
+    };
+
+    // Depth of the events: in the top-level array, or in the traceEvents array of an object
+    int first = fgetc(file);
+    int event_depth = first == '[' ? 2 : 3;
+    int depth = 1;
+    bool in_string = false, escaped = false;
+    bool capturing = false, too_long = false;
+    std::string text;
+    TraceEvent event;
+
+    for (int c = fgetc(file); c != EOF; c = fgetc(file)) {
+        if (capturing) {
+            if (text.size() < MAX_EVENT_SIZE) {
+                text += (char)c;
+            } else {
+                too_long = true;
+            }
+        }
+        if (in_string) {
+            if (escaped) {
+                escaped = false;
+            } else if (c == '\\') {
+                escaped = true;
+            } else if (c == '"') {
+                in_string = false;
+            }
+            continue;
+        }
+        if (c == '"') {
+            in_string = true;
+        } else if (c == '{' || c == '[') {
+            if (++depth == event_depth && c == '{') {
+                capturing = true;
+                too_long = false;
+                text = "{";
+            }
+        } else if (c == '}' || c == ']') {
+            if (depth-- == event_depth && capturing) {
+                capturing = false;
+                event = TraceEvent();
+                if (!too_long && EventParser(text).parse(event)) {
+                    handle(event);
+                }
+            }
+        }
+    }
+    for (const auto& marker : markers) {
+        applyMarker(marker);
+    }
+    if (ferror(file)) {
+        error = strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+static std::vector<std::string> splitCSV(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (start <= line.size()) {
+        size_t comma = line.find(',', start);
+        if (comma == std::string::npos) comma = line.size();
+        std::string field = line.substr(start, comma - start);
+        size_t first = field.find_first_not_of(" \t\r\n\"");
+        size_t last = field.find_last_not_of(" \t\r\n\"");
+        fields.push_back(first == std::string::npos ? "" : field.substr(first, last - first + 1));
+        start = comma + 1;
+    }
+    return fields;
+}
+
+/**
+ * CSV captures: a header row, then one sample per row
+ *
+ * The time is in a "time" (seconds), "timestamp_ms" or "timestamp_ns"
+ * column. Optional "gpu" and "process" columns say what a row describes and
+ * "phase" the phase it belongs to; every other column is a metric of that
+ * name, "energy" being a counter in joules.
+ */
+bool CompareRun::readCSV(FILE* file, std::string& error) {
+    char* line = nullptr;
+    size_t capacity = 0;
+    std::vector<std::string> columns;
+    long time_column = -1, gpu_column = -1, process_column = -1, phase_column = -1;
+    double time_scale = 1;
+    std::string phase;
+    std::map<std::string, double> last_times;  // per section
+    std::map<std::string, double> energy;
+
+    ssize_t length;
+    while ((length = getline(&line, &capacity, file)) >= 0) {
+        std::vector<std::string> fields = splitCSV(std::string(line, length));
+        if (fields.size() == 1 && fields[0].empty()) continue;
+        if (columns.empty()) {
+            columns = fields;
+            for (size_t i = 0; i < columns.size(); i++) {
+                const std::string& name = columns[i];
+                if (name == "time" || name == "time_s") {
+                    time_column = i;
+                } else if (name == "timestamp_ms") {
+                    time_column = i;
+                    time_scale = 1e-3;
+                } else if (name == "timestamp_ns") {
+                    time_column = i;
+                    time_scale = 1e-9;
+                } else if (name == "gpu") {
+                    gpu_column = i;
+                } else if (name == "process") {
+                    process_column = i;
+                } else if (name == "phase") {
+                    phase_column = i;
+                }
+            }
+            if (time_column < 0) {
+                free(line);
+                error = "no time, timestamp_ms or timestamp_ns column";
+                return false;
+            }
+            continue;
+        }
+        if (fields.size() <= (size_t)time_column) continue;
+
+        if (phase_column >= 0 && (size_t)phase_column < fields.size() && fields[phase_column] != phase) {
+            if (!phase.empty()) endPhase(phase);
+            phase = fields[phase_column];
+            if (!phase.empty()) beginPhase(phase);
+        }
+
+        double t = strtod(fields[time_column].c_str(), nullptr) * time_scale;
+        std::string section = "gpu";
+        if (process_column >= 0 && (size_t)process_column < fields.size() && !fields[process_column].empty()) {
+            section = fields[process_column];
+        } else if (gpu_column >= 0 && (size_t)gpu_column < fields.size()) {
+            section = "gpu" + fields[gpu_column];
+        }
+        double& last = last_times[section];
+        double seconds = last > 0 && t > last ? t - last : 0;
+        last = t;
+
+        for (size_t i = 0; i < fields.size() && i < columns.size(); i++) {
+            if ((long)i == time_column || (long)i == gpu_column || (long)i == process_column ||
+                (long)i == phase_column || fields[i].empty()) {
+                continue;
+            }
+            char* end;
+            double value = strtod(fields[i].c_str(), &end);
+            if (*end) continue;  // not a number
+            if (columns[i] == "energy") {
+                auto previous = energy.find(section);
+                if (previous != energy.end() && value >= previous->second) {
+                    add(t, section, "energy J", value - previous->second, 0, true);
+                }
+                energy[section] = value;
+            } else {
+                add(t, section, columns[i], value, seconds);
+            }
+        }
+    }
+    free(line);
+    if (ferror(file)) {
+        error = strerror(errno);
+        return false;
+    }
+    if (columns.empty()) {
+        error = "empty file";
+        return false;
+    }
+    return true;
+}
+
+// Two-sided p of a difference of means, Welch's test on the effective sample sizes
+static double meanP(const MetricDistribution& a, const MetricDistribution& b) {
+    double na = a.getEffectiveCount(), nb = b.getEffectiveCount();
+    if (na < 2 || nb < 2) return NAN;
+    double error = std::sqrt(a.getVariance() / na + b.getVariance() / nb);
+    if (error == 0) return a.getMean() == b.getMean() ? 1 : 0;
+    return std::erfc(std::fabs(b.getMean() - a.getMean()) / error / std::sqrt(2.0));
+}
+
+// p of the Kolmogorov-Smirnov distance of two distributions, asymptotic
+static double distributionP(const MetricDistribution& a, const MetricDistribution& b) {
+    double na = a.getEffectiveCount(), nb = b.getEffectiveCount();
+    if (na < 2 || nb < 2) return NAN;
+    double n = na * nb / (na + nb);
+    double lambda = (std::sqrt(n) + 0.12 + 0.11 / std::sqrt(n)) * MetricDistribution::distance(a, b);
+    if (lambda < 0.3) return 1;
+    double sum = 0, sign = 1;
+    for (int k = 1; k <= 100; k++) {
+        double term = sign * std::exp(-2.0 * k * k * lambda * lambda);
+        sum += term;
+        if (std::fabs(term) < 1e-10) break;
+        sign = -sign;
+    }
+    return std::min(std::max(2 * sum, 0.0), 1.0);
+}
+
+static std::string formatP(double p) {
+    if (std::isnan(p)) return "-";
+    char text[16];
+    if (p < 0.001) return "<0.001";
+    snprintf(text, sizeof(text), "%.3f", p);
+    return text;
+}
+
+static const char* stars(double p) {
+    if (std::isnan(p)) return "";
+    return p < 0.001 ? "***" : p < 0.01 ? "**" : p < 0.05 ? "*" : "";
+}
+
+static std::string formatChange(double a, double b) {
+    if (a == 0) return b == 0 ? "0%" : "new";
+    char text[24];
+    snprintf(text, sizeof(text), "%+.1f%%", (b - a) / std::fabs(a) * 100);
+    return text;
+}
+
+// "850 J", "12.4 kJ", "3.21 MJ"
+static std::string formatEnergy(double joules) {
+    char text[24];
+    if (joules >= 1e6) {
+        snprintf(text, sizeof(text), "%.2f MJ", joules / 1e6);
+    } else if (joules >= 1e3) {
+        snprintf(text, sizeof(text), "%.1f kJ", joules / 1e3);
+    } else {
+        snprintf(text, sizeof(text), "%.0f J", joules);
+    }
+    return text;
+}
+
+static std::string formatDuration(double seconds) {
+    char text[24];
+    unsigned long whole = (unsigned long)seconds;
+    if (whole >= 3600) {
+        snprintf(text, sizeof(text), "%luh%02lum", whole / 3600, whole / 60 % 60);
+    } else {
+        snprintf(text, sizeof(text), "%lum%02lus", whole / 60, whole % 60);
+    }
+    return text;
+}
+
+static void printGroup(const CompareRun::Metrics& a, const CompareRun::Metrics& b, FILE* out) {
+    fprintf(out, "  %-32s %10s %10s %8s %17s %17s %7s %7s\n", "", "A", "B", "change", "p50 A -> B", "p95 A -> B",
+            "p(mean)", "p(dist)");
+    std::string section;
+    for (const auto& entry : a) {
+        auto other = b.find(entry.first);
+        if (other == b.end()) continue;
+        const CompareMetric& ma = entry.second;
+        const CompareMetric& mb = other->second;
+        if (entry.first.first != section) {
+            section = entry.first.first;
+            fprintf(out, "  %s\n", section.c_str());
+        }
+        const std::string& metric = entry.first.second;
+        char label[64];
+        snprintf(label, sizeof(label), "    %s", metric.c_str());
+
+        if (ma.cumulative) {
+            fprintf(out, "  %-32s %10s %10s %8s\n", label, formatEnergy(ma.total).c_str(),
+                    formatEnergy(mb.total).c_str(), formatChange(ma.total, mb.total).c_str());
+            continue;
+        }
+
+        const MetricDistribution& da = ma.distribution;
+        const MetricDistribution& db = mb.distribution;
+        char p50[32], p95[32];
+        snprintf(p50, sizeof(p50), "%.0f -> %.0f", da.getPercentile(50), db.getPercentile(50));
+        snprintf(p95, sizeof(p95), "%.0f -> %.0f", da.getPercentile(95), db.getPercentile(95));
+        double p_mean = meanP(da, db);
+        double p_distribution = distributionP(da, db);
+        fprintf(out, "  %-32s %10.1f %10.1f %8s %17s %17s %7s %7s %s\n", label, da.getMean(), db.getMean(),
+                formatChange(da.getMean(), db.getMean()).c_str(), p50, p95, formatP(p_mean).c_str(),
+                formatP(p_distribution).c_str(), stars(std::min(p_mean, p_distribution)));
+
+        // Engine usage integrates to engine time
+        if (metric.size() > 9 && metric.compare(metric.size() - 9, 9, " engine %") == 0) {
+            snprintf(label, sizeof(label), "    %s engine time s", metric.substr(0, metric.size() - 9).c_str());
+            fprintf(out, "  %-32s %10.1f %10.1f %8s\n", label, ma.total / 100, mb.total / 100,
+                    formatChange(ma.total, mb.total).c_str());
+        }
+    }
+
+    for (const auto& entry : a) {
+        if (!b.count(entry.first)) fprintf(out, "  only in A: %s %s\n", entry.first.first.c_str(), entry.first.second.c_str());
+    }
+    for (const auto& entry : b) {
+        if (!a.count(entry.first)) fprintf(out, "  only in B: %s %s\n", entry.first.first.c_str(), entry.first.second.c_str());
+    }
+}
+
+/**
+ * Both recordings are read one after the other, each into per-metric
+ * distributions, and only those are compared: the report costs the same
+ * memory for a minute and for a day of samples.
+ */
+bool compareRecordings(const std::string& a, const std::string& b, const CompareOptions& options, FILE* out,
+                       std::string& error) {
+    CompareRun run_a(options.by_phase, options.skip_s, options.duration_s);
+    CompareRun run_b(options.by_phase, options.skip_s, options.duration_s);
+    if (!run_a.read(a, error) || !run_b.read(b, error)) {
+        return false;
+    }
+
+    fprintf(out, "A: %s, %llu samples over %s\n", a.c_str(), (unsigned long long)run_a.getSampleCount(),
+            formatDuration(run_a.getDuration()).c_str());
+    fprintf(out, "B: %s, %llu samples over %s\n", b.c_str(), (unsigned long long)run_b.getSampleCount(),
+            formatDuration(run_b.getDuration()).c_str());
+    fprintf(out, "Aligned by %s; p(mean): Welch's t-test, p(dist): Kolmogorov-Smirnov, on samples discounted "
+                 "for autocorrelation; * p < 0.05, ** p < 0.01, *** p < 0.001\n",
+            options.by_phase ? "phase markers" : "time since the first sample");
+
+    const auto& groups_a = run_a.getGroups();
+    const auto& groups_b = run_b.getGroups();
+    for (const auto& group : groups_a) {
+        auto other = groups_b.find(group.first);
+        if (other == groups_b.end()) {
+            fprintf(out, "\nPhase %s: only in A\n", group.first.c_str());
+            continue;
+        }
+        fprintf(out, "\n%s\n", options.by_phase ? ("Phase " + group.first).c_str() : "Whole run");
+        printGroup(group.second, other->second, out);
+    }
+    for (const auto& group : groups_b) {
+        if (!groups_a.count(group.first)) fprintf(out, "\nPhase %s: only in B\n", group.first.c_str());
+    }
+    if (groups_a.empty() || groups_b.empty()) {
+        fprintf(out, "\nNothing to compare in the aligned range\n");
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+#include "device_watcher.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include "logger.hpp"
+
+DeviceWatcher::~DeviceWatcher() {
+    stop();
+}
+
+bool DeviceWatcher::start(const std::string& path) {
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        Logger::error(std::string("inotify_init1 failed: ") + strerror(errno));
+        return false;
+    }
+    if (inotify_add_watch(inotify_fd, path.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM) < 0) {
+        Logger::error("Cannot watch " + path + ": " + strerror(errno));
+        close(inotify_fd);
+        inotify_fd = -1;
+        return false;
+    }
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        Logger::error(std::string("eventfd failed: ") + strerror(errno));
+        close(inotify_fd);
+        inotify_fd = -1;
+        return false;
+    }
+
+    running = true;
+    thread = std::thread(&DeviceWatcher::run, this);
+    Logger::info("Watching " + path + " for device changes");
+    return true;
+}
+
+void DeviceWatcher::stop() {
+    if (running) {
+        running = false;
+        trigger();
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+}
+
+void DeviceWatcher::trigger() {
+    uint64_t one = 1;
+    if (wake_fd >= 0 && write(wake_fd, &one, sizeof(one)) < 0) {
+        Logger::debug(std::string("Device watcher wakeup failed: ") + strerror(errno));
+    }
+}
+
+// Consume everything queued on a non-blocking fd
+static void drain(int fd) {
+    char buf[4096];
+    while (read(fd, buf, sizeof(buf)) > 0) {}
+}
+
+void DeviceWatcher::run() {
+    pollfd fds[2] = {
+        {inotify_fd, POLLIN, 0},
+        {wake_fd, POLLIN, 0}
+    };
+
+    while (running) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            Logger::error(std::string("Device watcher poll failed: ") + strerror(errno));
+            break;
+        }
+
+        // Coalesce the burst of events a bind or reset produces
+        do {
+            drain(inotify_fd);
+            drain(wake_fd);
+        } while (running && poll(fds, 2, SETTLE_MS) > 0);
+
+        if (running) {
+            on_change();
+        }
+    }
+}
@@ -0,0 +1,393 @@
+#include "flight_recorder.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include "logger.hpp"
+#include "snapshot.hpp"
+#include "snapshot_stream.hpp"
+
+static constexpr uint64_t NS_PER_S = 1000000000ULL;
+
+bool FlightTrigger::parse(const std::string& text, std::string& error) {
+    static const std::pair<const char*, Field> fields[] = {
+        {"gpu_usage", GPU_USAGE}, {"vram", VRAM}, {"gtt", GTT}, {"temp", TEMP}, {"junction", JUNCTION},
+        {"power", POWER}, {"power_cap", POWER_CAP}, {"throttled", THROTTLED}, {"evictions", EVICTIONS},
+    };
+
+    expression = text;
+    conditions.clear();
+    hold_ns = 0;
+
+    const char* p = text.c_str();
+    while (true) {
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+
+        const char* word_start = p;
+        while (isalnum((unsigned char)*p) || *p == '_') p++;
+        std::string word(word_start, p);
+        if (word.empty()) {
+            error = std::string("unexpected '") + *p + "'";
+            return false;
+        }
+        // Keywords and fields in any case, "VRAM > 90%" reads as well as "vram > 90%"
+        std::string name = word;
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return tolower(c); });
+        if (name == "and" || name == "while") continue;
+
+        if (name == "for") {
+            char* end;
+            double seconds = strtod(p, &end);
+            if (end == p || seconds < 0) {
+                error = "expected a duration after 'for'";
+                return false;
+            }
+            p = end;
+            while (isspace((unsigned char)*p)) p++;
+            if (*p == 's' && !isalnum((unsigned char)p[1]) && p[1] != '_') p++;
+            hold_ns = (uint64_t)(seconds * NS_PER_S);
+            continue;
+        }
+
+        Condition condition;
+        auto field = std::find_if(std::begin(fields), std::end(fields),
+                                  [&](const std::pair<const char*, Field>& entry) { return name == entry.first; });
+        if (field == std::end(fields)) {
+            error = "unknown field '" + word + "'";
+            return false;
+        }
+        condition.field = field->second;
+
+        while (isspace((unsigned char)*p)) p++;
+        if (p[0] == '<' && p[1] == '=') {
+            condition.op = LESS_EQUAL;
+            p += 2;
+        } else if (p[0] == '>' && p[1] == '=') {
+            condition.op = GREATER_EQUAL;
+            p += 2;
+        } else if (p[0] == '<') {
+            condition.op = LESS;
+            p++;
+        } else if (p[0] == '>') {
+            condition.op = GREATER;
+            p++;
+        } else {
+            error = "expected <, <=, > or >= after '" + word + "'";
+            return false;
+        }
+
+        char* end;
+        condition.value = strtof(p, &end);
+        if (end == p) {
+            error = "expected a number after the comparison of '" + word + "'";
+            return false;
+        }
+        p = end;
+        if (*p == '%') p++;
+        conditions.push_back(condition);
+    }
+
+    if (conditions.empty()) {
+        error = "no condition";
+        return false;
+    }
+    return true;
+}
+
+float FlightTrigger::getValue(const amdgpu_top_gpu& gpu, Field field) {
+    const amdgpu_top_metrics& metrics = gpu.metrics;
+    switch (field) {
+        case GPU_USAGE: return metrics.gpu_usage;
+        case VRAM: return metrics.memory_total > 0 ? metrics.memory_used * 100.0f / metrics.memory_total : 0;
+        case GTT: return metrics.gtt_total > 0 ? metrics.gtt_used * 100.0f / metrics.gtt_total : 0;
+        case TEMP: return metrics.temperature;
+        case JUNCTION: return metrics.temperature_junction;
+        case POWER: return metrics.power_usage;
+        case POWER_CAP: return metrics.power_cap > 0 ? metrics.power_usage * 100.0f / metrics.power_cap : 0;
+        case THROTTLED: return gpu.throttle_reason_count;
+        case EVICTIONS: return metrics.evictions_rate;
+    }
+    return 0;
+}
+
+bool FlightTrigger::matches(const amdgpu_top_gpu& gpu) const {
+    for (const auto& condition : conditions) {
+        float value = getValue(gpu, condition.field);
+        bool holds = condition.op == LESS ? value < condition.value :
+                     condition.op == LESS_EQUAL ? value <= condition.value :
+                     condition.op == GREATER ? value > condition.value :
+                     value >= condition.value;
+        if (!holds) return false;
+    }
+    return !conditions.empty();
+}
+
+FlightRecorder::FlightRecorder(const FlightTrigger& trigger, const std::string& directory, unsigned pre_s,
+                               unsigned post_s, unsigned samples_per_s)
+    : trigger(trigger), directory(directory), pre_ns(pre_s * NS_PER_S), post_ns(post_s * NS_PER_S) {
+    // Sized for the fastest update rate, with slack for the flush to copy the window out
+    unsigned window = (pre_s + post_s) * std::max(samples_per_s, 1u);
+    slot_count = window + std::max(10u, window / 4);
+    slot_spacing_ns = window ? (pre_ns + post_ns) / window : 0;
+    slots.reset(new Slot[slot_count]);
+    for (size_t i = 0; i < slot_count; i++) {
+        Slot& slot = slots[i];
+        slot.gpus.resize(MAX_GPUS);
+        slot.nodes.resize(MAX_NODES);
+        slot.processes.resize(MAX_PROCESSES);
+        slot.flat.gpus = slot.gpus.data();
+        slot.flat.gpu_capacity = MAX_GPUS;
+        slot.flat.nodes = slot.nodes.data();
+        slot.flat.node_capacity = MAX_NODES;
+        slot.flat.processes = slot.processes.data();
+        slot.flat.process_capacity = MAX_PROCESSES;
+    }
+    holding_since.resize(MAX_GPUS);
+    markers.reset(new MarkerSlot[MAX_MARKERS]);
+}
+
+FlightRecorder::~FlightRecorder() {
+    running = false;
+    wake.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+bool FlightRecorder::start() {
+    running = true;
+    thread = std::thread(&FlightRecorder::runFlush, this);
+    Logger::info("Flight recorder armed: " + trigger.getExpression() + ", " +
+                 std::to_string(slot_count) + " samples kept");
+    return true;
+}
+
+void FlightRecorder::record(const Snapshot& snapshot) {
+    // A record sooner than slot_spacing_ns after the newest slot replaces it, so however often
+    // the sampler calls, the ring covers the whole window instead of wrapping within it
+    uint64_t sample = next_sample.load(std::memory_order_relaxed);
+    if (sample > 0 && snapshot.timestamp_ns >= slot_started_ns &&
+        snapshot.timestamp_ns - slot_started_ns < slot_spacing_ns) {
+        sample--;
+    } else {
+        slot_started_ns = snapshot.timestamp_ns;
+    }
+    Slot& slot = slots[sample % slot_count];
+
+    uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // Cleared so labels and padding do not carry bytes of older samples into the dump
+    memset(slot.gpus.data(), 0, MAX_GPUS * sizeof(amdgpu_top_gpu));
+    memset(slot.nodes.data(), 0, MAX_NODES * sizeof(amdgpu_top_node));
+    memset(slot.processes.data(), 0, MAX_PROCESSES * sizeof(amdgpu_top_process));
+    flattenSnapshot(snapshot, slot.flat);
+    slot.flat.sample_count = sample;
+    slot.sample = sample;
+
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    next_sample.store(sample + 1, std::memory_order_release);
+
+    recordMarkers(snapshot);
+    evaluate(slot.flat);
+}
+
+void FlightRecorder::recordMarkers(const Snapshot& snapshot) {
+    uint64_t scanned = snapshot.timestamp_ns;
+    if (!snapshot.gpus.empty() && !snapshot.gpus[0].nodes.empty() && snapshot.gpus[0].nodes[0].processes_timestamp_ns) {
+        scanned = snapshot.gpus[0].nodes[0].processes_timestamp_ns;
+    }
+    if (snapshot.processes_pending || scanned == last_scan_ns) return;
+    last_scan_ns = scanned;
+    if (snapshot.markers.empty()) return;
+
+    // Markers carry monotonic time, the samples wall clock time
+    timespec monotonic, realtime;
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    int64_t offset = (int64_t)(realtime.tv_sec - monotonic.tv_sec) * (int64_t)NS_PER_S +
+                     (realtime.tv_nsec - monotonic.tv_nsec);
+
+    for (const auto& marker : snapshot.markers) {
+        uint64_t index = next_marker.load(std::memory_order_relaxed);
+        MarkerSlot& slot = markers[index % MAX_MARKERS];
+        uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.index = index;
+        slot.marker = StreamMarker();
+        slot.marker.timestamp_ns = std::max<int64_t>((int64_t)marker.timestamp_ns + offset, 0);
+        slot.marker.pid = marker.pid;
+        slot.marker.begin = marker.begin;
+        memcpy(slot.marker.name, marker.name.data(), std::min(marker.name.size(), sizeof(slot.marker.name)));
+
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+        next_marker.store(index + 1, std::memory_order_release);
+    }
+}
+
+void FlightRecorder::evaluate(const amdgpu_top_snapshot& flat) {
+    uint64_t now = flat.timestamp_ns;
+
+    if (state == WATCHING) {
+        uint32_t gpus = std::min<uint32_t>(flat.gpu_count, holding_since.size());
+        for (uint32_t i = 0; i < gpus; i++) {
+            if (!trigger.matches(flat.gpus[i])) {
+                holding_since[i] = 0;
+                continue;
+            }
+            if (!holding_since[i]) holding_since[i] = now;
+            if (now - holding_since[i] >= trigger.getHoldNs()) {
+                state = CAPTURING;
+                trigger_ns = now;
+                trigger_gpu = i;
+                break;
+            }
+        }
+    }
+
+    if (state == CAPTURING && now - trigger_ns >= post_ns) {
+        dump_start_ns.store(trigger_ns - std::min(pre_ns, trigger_ns), std::memory_order_relaxed);
+        dump_end_ns.store(now, std::memory_order_relaxed);
+        dump_trigger_ns.store(trigger_ns, std::memory_order_relaxed);
+        dump_gpu.store(trigger_gpu, std::memory_order_relaxed);
+        request.store(true, std::memory_order_release);
+        // Without the mutex the flush thread may miss this, its timed wait picks it up
+        wake.notify_one();
+        state = FLUSHING;
+    } else if (state == FLUSHING && !request.load(std::memory_order_acquire)) {
+        std::fill(holding_since.begin(), holding_since.end(), 0);
+        state = WATCHING;
+    }
+}
+
+void FlightRecorder::runFlush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        wake.wait_for(lock, std::chrono::milliseconds(250), [this] {
+            return !running || request.load(std::memory_order_acquire);
+        });
+        if (!request.load(std::memory_order_acquire)) continue;
+
+        lock.unlock();
+        dump();
+        request.store(false, std::memory_order_release);
+        lock.lock();
+    }
+}
+
+bool FlightRecorder::copySlot(uint64_t sample, Slot& copy) const {
+    const Slot& slot = slots[sample % slot_count];
+    uint64_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before & 1) return false;
+
+    copy.sample = slot.sample;
+    copy.flat.timestamp_ns = slot.flat.timestamp_ns;
+    copy.flat.sample_count = slot.flat.sample_count;
+    copy.flat.gpu_count = std::min(slot.flat.gpu_count, MAX_GPUS);
+    copy.flat.node_count = std::min(slot.flat.node_count, MAX_NODES);
+    copy.flat.process_count = std::min(slot.flat.process_count, MAX_PROCESSES);
+    memcpy(copy.gpus.data(), slot.gpus.data(), MAX_GPUS * sizeof(amdgpu_top_gpu));
+    memcpy(copy.nodes.data(), slot.nodes.data(), MAX_NODES * sizeof(amdgpu_top_node));
+    memcpy(copy.processes.data(), slot.processes.data(), copy.flat.process_count * sizeof(amdgpu_top_process));
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == before && copy.sample == sample;
+}
+
+void FlightRecorder::copyMarkers(uint64_t start_ns, uint64_t end_ns, std::vector<StreamMarker>& copy) const {
+    uint64_t last = next_marker.load(std::memory_order_acquire);
+    for (uint64_t index = last > MAX_MARKERS ? last - MAX_MARKERS : 0; index < last; index++) {
+        const MarkerSlot& slot = markers[index % MAX_MARKERS];
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        StreamMarker marker = slot.marker;
+        uint64_t slot_index = slot.index;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before || slot_index != index) continue;
+        if (marker.timestamp_ns >= start_ns && marker.timestamp_ns <= end_ns) copy.push_back(marker);
+    }
+    // Clients stamp their own markers, a scan may bring them slightly out of order
+    std::stable_sort(copy.begin(), copy.end(), [](const StreamMarker& a, const StreamMarker& b) {
+        return a.timestamp_ns < b.timestamp_ns;
+    });
+}
+
+void FlightRecorder::dump() {
+    uint64_t start_ns = dump_start_ns.load(std::memory_order_relaxed);
+    uint64_t end_ns = dump_end_ns.load(std::memory_order_relaxed);
+    uint64_t at_ns = dump_trigger_ns.load(std::memory_order_relaxed);
+    uint32_t gpu = dump_gpu.load(std::memory_order_relaxed);
+
+    time_t at = at_ns / NS_PER_S;
+    struct tm local;
+    localtime_r(&at, &local);
+    char name[64];
+    strftime(name, sizeof(name), "flight-%Y%m%d-%H%M%S", &local);
+    std::string path = directory + "/" + name + "-gpu" + std::to_string(gpu) + ".agtn";
+
+    FILE* file = fopen(path.c_str(), "wbe");
+    if (!file) {
+        Logger::error("Cannot write flight recording " + path + ": " + strerror(errno));
+        return;
+    }
+
+    Slot copy;
+    copy.gpus.resize(MAX_GPUS);
+    copy.nodes.resize(MAX_NODES);
+    copy.processes.resize(MAX_PROCESSES);
+    copy.flat.gpus = copy.gpus.data();
+    copy.flat.nodes = copy.nodes.data();
+    copy.flat.processes = copy.processes.data();
+
+    std::vector<StreamMarker> window_markers;
+    copyMarkers(start_ns, end_ns, window_markers);
+    size_t next_marker_out = 0;
+
+    SnapshotEncoder encoder;
+    std::vector<uint8_t> frame;
+    size_t frames = 0;
+    size_t overwritten = 0;
+    uint64_t last = next_sample.load(std::memory_order_acquire);
+    for (uint64_t sample = last > slot_count ? last - slot_count : 0; sample < last; sample++) {
+        if (!copySlot(sample, copy)) {
+            overwritten++;
+            continue;
+        }
+        if (copy.flat.timestamp_ns < start_ns || copy.flat.timestamp_ns > end_ns) continue;
+
+        // Markers up to this sample go first, so readers see phases open before their samples
+        frame.clear();
+        size_t count = 0;
+        while (next_marker_out + count < window_markers.size() &&
+               window_markers[next_marker_out + count].timestamp_ns <= copy.flat.timestamp_ns) {
+            count++;
+        }
+        if (count) {
+            encodeMarkers(&window_markers[next_marker_out], count, frame);
+            next_marker_out += count;
+        }
+        encoder.encode(copy.flat, frame);
+        if (fwrite(frame.data(), 1, frame.size(), file) != frame.size()) break;
+        frames++;
+    }
+    if (next_marker_out < window_markers.size()) {
+        frame.clear();
+        encodeMarkers(&window_markers[next_marker_out], window_markers.size() - next_marker_out, frame);
+        fwrite(frame.data(), 1, frame.size(), file);
+    }
+
+    bool ok = fflush(file) == 0 && !ferror(file);
+    fclose(file);
+    if (!ok) {
+        Logger::error("Cannot write flight recording " + path + ": " + strerror(errno));
+        return;
+    }
+    Logger::info("Flight recorder: \"" + trigger.getExpression() + "\" on GPU " + std::to_string(gpu) +
+                 ", " + std::to_string(frames) + " samples and " + std::to_string(window_markers.size()) +
+                 " phase markers written to " + path +
+                 (overwritten ? ", " + std::to_string(overwritten) + " overwritten before the flush" : ""));
+}
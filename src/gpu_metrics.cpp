@@ -0,0 +1,335 @@
+#include "gpu_metrics.hpp"
+#include <cstring>
+#include "logger.hpp"
+
+namespace {
+
+// Mirrors of the kernel's gpu_metrics layouts (drivers/gpu/drm/amd/include/kgd_pp_interface.h)
+constexpr int NUM_HBM_INSTANCES = 4;
+constexpr int NUM_VCN = 4;
+constexpr int NUM_JPEG_ENG = 32;
+constexpr int NUM_XGMI_LINKS = 8;
+constexpr int MAX_GFX_CLKS = 8;
+constexpr int MAX_CLKS = 4;
+
+struct metrics_table_header {
+    uint16_t structure_size;
+    uint8_t format_revision;
+    uint8_t content_revision;
+};
+
+struct gpu_metrics_v1_0 {
+    metrics_table_header common_header;
+    uint64_t system_clock_counter;
+    uint16_t temperature_edge;
+    uint16_t temperature_hotspot;
+    uint16_t temperature_mem;
+    uint16_t temperature_vrgfx;
+    uint16_t temperature_vrsoc;
+    uint16_t temperature_vrmem;
+    uint16_t average_gfx_activity;
+    uint16_t average_umc_activity;
+    uint16_t average_mm_activity;
+    uint16_t average_socket_power;
+    uint32_t energy_accumulator;
+    uint16_t average_gfxclk_frequency;
+    uint16_t average_socclk_frequency;
+    uint16_t average_uclk_frequency;
+    uint16_t average_vclk0_frequency;
+    uint16_t average_dclk0_frequency;
+    uint16_t average_vclk1_frequency;
+    uint16_t average_dclk1_frequency;
+    uint16_t current_gfxclk;
+    uint16_t current_socclk;
+    uint16_t current_uclk;
+    uint16_t current_vclk0;
+    uint16_t current_dclk0;
+    uint16_t current_vclk1;
+    uint16_t current_dclk1;
+    uint32_t throttle_status;
+    uint16_t current_fan_speed;
+    uint8_t pcie_link_width;
+    uint8_t pcie_link_speed;
+};
+
+// v1.1 to v1.3 share this prefix, later revisions only append
+struct gpu_metrics_v1_3 {
+    metrics_table_header common_header;
+    uint16_t temperature_edge;
+    uint16_t temperature_hotspot;
+    uint16_t temperature_mem;
+    uint16_t temperature_vrgfx;
+    uint16_t temperature_vrsoc;
+    uint16_t temperature_vrmem;
+    uint16_t average_gfx_activity;
+    uint16_t average_umc_activity;
+    uint16_t average_mm_activity;
+    uint16_t average_socket_power;
+    uint64_t energy_accumulator;
+    uint64_t system_clock_counter;
+    uint16_t average_gfxclk_frequency;
+    uint16_t average_socclk_frequency;
+    uint16_t average_uclk_frequency;
+    uint16_t average_vclk0_frequency;
+    uint16_t average_dclk0_frequency;
+    uint16_t average_vclk1_frequency;
+    uint16_t average_dclk1_frequency;
+    uint16_t current_gfxclk;
+    uint16_t current_socclk;
+    uint16_t current_uclk;
+    uint16_t current_vclk0;
+    uint16_t current_dclk0;
+    uint16_t current_vclk1;
+    uint16_t current_dclk1;
+    uint32_t throttle_status;
+    uint16_t current_fan_speed;
+    uint16_t pcie_link_width;
+    uint16_t pcie_link_speed;
+    uint16_t padding;
+    uint32_t gfx_activity_acc;
+    uint32_t mem_activity_acc;
+    uint16_t temperature_hbm[NUM_HBM_INSTANCES];
+    // v1.2
+    uint64_t firmware_timestamp;
+    // v1.3
+    uint16_t voltage_soc;
+    uint16_t voltage_gfx;
+    uint16_t voltage_mem;
+    uint16_t padding1;
+    uint64_t indep_throttle_status;
+};
+
+constexpr size_t GPU_METRICS_V1_1_SIZE = offsetof(gpu_metrics_v1_3, firmware_timestamp);
+constexpr size_t GPU_METRICS_V1_2_SIZE = offsetof(gpu_metrics_v1_3, voltage_soc);
+
+// MI300 (v1.4) and its v1.5 successor
+struct gpu_metrics_v1_4 {
+    metrics_table_header common_header;
+    uint16_t temperature_hotspot;
+    uint16_t temperature_mem;
+    uint16_t temperature_vrsoc;
+    uint16_t curr_socket_power;
+    uint16_t average_gfx_activity;
+    uint16_t average_umc_activity;
+    uint16_t vcn_activity[NUM_VCN];
+    uint64_t energy_accumulator;
+    uint64_t system_clock_counter;
+    uint32_t throttle_status;
+    uint32_t gfxclk_lock_status;
+    uint16_t pcie_link_width;
+    uint16_t pcie_link_speed;
+    uint16_t xgmi_link_width;
+    uint16_t xgmi_link_speed;
+    uint32_t gfx_activity_acc;
+    uint32_t mem_activity_acc;
+    uint64_t pcie_bandwidth_acc;
+    uint64_t pcie_bandwidth_inst;
+    uint64_t pcie_l0_to_recov_count_acc;
+    uint64_t pcie_replay_count_acc;
+    uint64_t pcie_replay_rover_count_acc;
+    uint64_t xgmi_read_data_acc[NUM_XGMI_LINKS];
+    uint64_t xgmi_write_data_acc[NUM_XGMI_LINKS];
+    uint64_t firmware_timestamp;
+    uint16_t current_gfxclk[MAX_GFX_CLKS];
+    uint16_t current_socclk[MAX_CLKS];
+    uint16_t current_vclk0[MAX_CLKS];
+    uint16_t current_dclk0[MAX_CLKS];
+    uint16_t current_uclk;
+    uint16_t padding;
+};
+
+struct gpu_metrics_v1_5 {
+    metrics_table_header common_header;
+    uint16_t temperature_hotspot;
+    uint16_t temperature_mem;
+    uint16_t temperature_vrsoc;
+    uint16_t curr_socket_power;
+    uint16_t average_gfx_activity;
+    uint16_t average_umc_activity;
+    uint16_t vcn_activity[NUM_VCN];
+    uint16_t jpeg_activity[NUM_JPEG_ENG];
+    uint64_t energy_accumulator;
+    uint64_t system_clock_counter;
+    uint32_t throttle_status;
+    uint32_t gfxclk_lock_status;
+    uint16_t pcie_link_width;
+    uint16_t pcie_link_speed;
+    uint16_t xgmi_link_width;
+    uint16_t xgmi_link_speed;
+    uint32_t gfx_activity_acc;
+    uint32_t mem_activity_acc;
+    uint64_t pcie_bandwidth_acc;
+    uint64_t pcie_bandwidth_inst;
+    uint64_t pcie_l0_to_recov_count_acc;
+    uint64_t pcie_replay_count_acc;
+    uint64_t pcie_replay_rover_count_acc;
+    uint32_t pcie_nak_sent_count_acc;
+    uint32_t pcie_nak_rcvd_count_acc;
+    uint64_t xgmi_read_data_acc[NUM_XGMI_LINKS];
+    uint64_t xgmi_write_data_acc[NUM_XGMI_LINKS];
+    uint64_t firmware_timestamp;
+    uint16_t current_gfxclk[MAX_GFX_CLKS];
+    uint16_t current_socclk[MAX_CLKS];
+    uint16_t current_vclk0[MAX_CLKS];
+    uint16_t current_dclk0[MAX_CLKS];
+    uint16_t current_uclk;
+    uint16_t padding;
+};
+
+// The table reports 0xffff/0xffffffff for sensors the SMU does not provide
+template <typename T>
+bool isValid(T value) {
+    return value != static_cast<T>(~T(0));
+}
+
+template <typename Table>
+void parseCommonV1(const Table& raw, GPUMetricsTable& table) {
+    table.system_clock_counter = raw.system_clock_counter;
+
+    if (isValid(raw.throttle_status)) {
+        table.has_throttle_status = true;
+        table.throttle_status = raw.throttle_status;
+    }
+
+    if (isValid(raw.energy_accumulator) && raw.energy_accumulator != 0) {
+        table.has_energy = true;
+        table.energy_accumulator = raw.energy_accumulator;
+        table.energy_accumulator_bits = sizeof(raw.energy_accumulator) * 8;
+    }
+}
+
+template <typename Table>
+void parsePCIeLink(const Table& raw, GPUMetricsTable& table) {
+    if (isValid(raw.pcie_link_width) && isValid(raw.pcie_link_speed) && raw.pcie_link_width != 0) {
+        table.has_pcie_link = true;
+        table.pcie_link_width = raw.pcie_link_width;
+        table.pcie_link_speed = raw.pcie_link_speed;
+    }
+}
+
+template <typename Table>
+void parseMI300(const Table& raw, GPUMetricsTable& table) {
+    parseCommonV1(raw, table);
+    parsePCIeLink(raw, table);
+
+    if (isValid(raw.current_gfxclk[0]) && isValid(raw.current_uclk)) {
+        table.has_current_clocks = true;
+        table.current_gfxclk = raw.current_gfxclk[0];
+        table.current_uclk = raw.current_uclk;
+    }
+
+    if (isValid(raw.pcie_bandwidth_acc) && isValid(raw.pcie_bandwidth_inst)) {
+        table.has_pcie_bandwidth = true;
+        table.pcie_bandwidth_acc = raw.pcie_bandwidth_acc;
+        table.pcie_bandwidth_inst = raw.pcie_bandwidth_inst;
+    }
+
+    if (isValid(raw.xgmi_link_width) && raw.xgmi_link_width != 0) {
+        table.has_xgmi = true;
+        table.xgmi_link_width = raw.xgmi_link_width;
+        table.xgmi_link_speed = raw.xgmi_link_speed;
+        for (int i = 0; i < NUM_XGMI_LINKS; i++) {
+            table.xgmi_read_data_acc[i] = isValid(raw.xgmi_read_data_acc[i]) ? raw.xgmi_read_data_acc[i] : 0;
+            table.xgmi_write_data_acc[i] = isValid(raw.xgmi_write_data_acc[i]) ? raw.xgmi_write_data_acc[i] : 0;
+        }
+    }
+
+    if (isValid(raw.curr_socket_power)) {
+        table.has_socket_power = true;
+        table.socket_power = raw.curr_socket_power;
+    }
+}
+
+template <typename Table>
+void parseDiscrete(const Table& raw, GPUMetricsTable& table) {
+    parseCommonV1(raw, table);
+    parsePCIeLink(raw, table);
+
+    if (isValid(raw.current_gfxclk) && isValid(raw.current_uclk)) {
+        table.has_current_clocks = true;
+        table.current_gfxclk = raw.current_gfxclk;
+        table.current_uclk = raw.current_uclk;
+    }
+
+    if (isValid(raw.average_socket_power)) {
+        table.has_socket_power = true;
+        table.socket_power = raw.average_socket_power;
+    }
+}
+
+}  // namespace
+
+bool GPUMetricsReader::open(const std::string& device_path) {
+    if (!file.open(device_path + "/gpu_metrics")) {
+        Logger::debug("No gpu_metrics table at " + device_path);
+        return false;
+    }
+    return true;
+}
+
+bool GPUMetricsReader::read(GPUMetricsTable& table) const {
+    // Largest known table, with room to spare for newer revisions
+    uint8_t buf[2048];
+    ssize_t count = file.read(buf, sizeof(buf));
+    if (count <= 0) return false;
+    return parse(buf, count, table);
+}
+
+bool GPUMetricsReader::parse(const uint8_t* data, size_t size, GPUMetricsTable& table) {
+    metrics_table_header header;
+    if (size < sizeof(header)) return false;
+    memcpy(&header, data, sizeof(header));
+
+    table = GPUMetricsTable();
+    table.format_revision = header.format_revision;
+    table.content_revision = header.content_revision;
+
+    // Only v1 (discrete) tables are decoded, APUs use the v2 family
+    if (header.format_revision != 1) return false;
+
+    // Copy into a zeroed mirror, accepting tables at least as large as the
+    // revision we know and ignoring anything a newer kernel appends
+    size_t available = header.structure_size < size ? header.structure_size : size;
+    auto load = [&](auto& raw, size_t required) {
+        if (available < required) return false;
+        memset(&raw, 0, sizeof(raw));
+        memcpy(&raw, data, available < sizeof(raw) ? available : sizeof(raw));
+        return true;
+    };
+
+    switch (header.content_revision) {
+    case 0: {
+        gpu_metrics_v1_0 raw;
+        if (!load(raw, sizeof(raw))) return false;
+        parseDiscrete(raw, table);
+        return true;
+    }
+    case 1:
+    case 2:
+    case 3: {
+        static const size_t sizes[] = {0, GPU_METRICS_V1_1_SIZE, GPU_METRICS_V1_2_SIZE, sizeof(gpu_metrics_v1_3)};
+        gpu_metrics_v1_3 raw;
+        if (!load(raw, sizes[header.content_revision])) return false;
+        parseDiscrete(raw, table);
+        if (header.content_revision >= 3 && isValid(raw.indep_throttle_status)) {
+            table.has_indep_throttle_status = true;
+            table.indep_throttle_status = raw.indep_throttle_status;
+        }
+        return true;
+    }
+    case 4: {
+        gpu_metrics_v1_4 raw;
+        if (!load(raw, sizeof(raw))) return false;
+        parseMI300(raw, table);
+        return true;
+    }
+    case 5: {
+        gpu_metrics_v1_5 raw;
+        if (!load(raw, sizeof(raw))) return false;
+        parseMI300(raw, table);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
@@ -12,11 +12,41 @@
 #include <fcntl.h>
 #include "process_info.hpp"
 #include <map>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "logger.hpp"
+#include "snapshot.hpp"
+#include "flight_recorder.hpp"
+#include "trace_writer.hpp"
+#include "annotations.hpp"
+#include "sched_trace.hpp"
+#include "rules.hpp"
 
-GPUDevice::GPUDevice(int fd, amdgpu_device_handle device, drmVersionPtr version, const std::string& pci_path)
-    : fd(fd), device(device), version(version), pci_path(pci_path) {}
+GPUDevice::GPUDevice(int fd, amdgpu_device_handle device, drmVersionPtr version, const std::string& pci_path,
+                     dev_t render_node, dev_t primary_node, int partition)
+    : fd(fd), device(device), version(version), pci_path(pci_path),
+      render_node(render_node), primary_node(primary_node), partition(partition) {
+    // Further partitions share the PCI function, whose sensors partition 0 samples
+    if (partition > 0) return;
+
+    gpu_metrics.open(getSysfsPath());
+    hwmon.open(getSysfsPath());
+    links.open(getSysfsPath());
+    residency.open(getSysfsPath());
+
+    if (partition == 0) {
+        compute_partition.open(getSysfsPath() + "/current_compute_partition");
+        compute_partition.readString(partition_mode);
+    }
+}
 
 GPUDevice::~GPUDevice() {
+    // The sampler thread reads through the device handle
+    block_sampler.reset();
+
     if (device) {
         amdgpu_device_deinitialize(device);
     }
@@ -41,12 +71,41 @@ void GPUDevice::updateMetrics(Metrics& metrics) const {
     if (amdgpu_query_sensor_info(device, AMDGPU_INFO_SENSOR_GPU_TEMP, 
                                sizeof(value), &value) == 0) {
         metrics.temperature = value / 1000;
+    } else if (hwmon_readings.temp_edge >= 0) {
+        metrics.temperature = hwmon_readings.temp_edge / 1000;
+    }
+
+    // Get hwmon-only sensors: junction/memory temperature, fan, voltages, power cap
+    if (hwmon_readings.temp_junction >= 0) {
+        metrics.temperature_junction = hwmon_readings.temp_junction / 1000;
+    }
+    if (hwmon_readings.temp_memory >= 0) {
+        metrics.temperature_memory = hwmon_readings.temp_memory / 1000;
+    }
+    if (hwmon_readings.fan_rpm >= 0) {
+        metrics.fan_speed = hwmon_readings.fan_rpm;
+    }
+    if (hwmon_readings.fan_pwm >= 0) {
+        metrics.fan_pwm = hwmon_readings.fan_pwm;
+    }
+    if (hwmon_readings.voltage_gfx >= 0) {
+        metrics.voltage_gfx = hwmon_readings.voltage_gfx;
+    }
+    if (hwmon_readings.voltage_northbridge >= 0) {
+        metrics.voltage_northbridge = hwmon_readings.voltage_northbridge;
+    }
+    if (hwmon_readings.power_cap >= 0) {
+        metrics.power_cap = hwmon_readings.power_cap / 1000000;
     }
 
     // Get power usage
     if (amdgpu_query_sensor_info(device, AMDGPU_INFO_SENSOR_GPU_AVG_POWER, 
                                sizeof(value), &value) == 0) {
         metrics.power_usage = value;
+    } else if (has_metrics_table && metrics_table.has_socket_power) {
+        metrics.power_usage = metrics_table.socket_power;
+    } else if (hwmon_readings.power_average >= 0) {
+        metrics.power_usage = hwmon_readings.power_average / 1000000;
     }
 
     // Get memory info
@@ -57,6 +116,8 @@ void GPUDevice::updateMetrics(Metrics& metrics) const {
         metrics.memory_cpu_accessible_total = memory_info.cpu_accessible_vram.total_heap_size / (1024.0 * 1024.0);
         metrics.memory_cpu_accessible_used = memory_info.cpu_accessible_vram.heap_usage / (1024.0 * 1024.0);
         metrics.memory_used = memory_info.vram.heap_usage / (1024.0 * 1024.0);
+        metrics.gtt_total = memory_info.gtt.total_heap_size / (1024.0 * 1024.0);
+        metrics.gtt_used = memory_info.gtt.heap_usage / (1024.0 * 1024.0);
     }
 
     // Get clock speeds
@@ -70,15 +131,277 @@ void GPUDevice::updateMetrics(Metrics& metrics) const {
     }
 }
 
-GPUDevice::Metrics GPUDevice::getMetrics() const {
-    Metrics metrics;
+// CPU time of the calling thread, what a sample costs
+static uint64_t threadCPUNs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t clockNs(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Change between two samples that counts as activity for the adaptive rate: percent points of
+// usage, VRAM, GTT and the power cap (W without a cap), °C and evictions per second
+static constexpr float SENSOR_THRESHOLDS[] = {5.0f, 1.0f, 1.0f, 5.0f, 3.0f, 1.0f};
+
+// Processes: clients, percent points of summed engine usage and of the VRAM they hold
+static constexpr float SCAN_THRESHOLDS[] = {0.5f, 5.0f, 1.0f};
+
+// Weight of the newest pass in the average CPU cost of the exports after a pass
+static constexpr double PASS_COST_WEIGHT = 0.25;
+
+bool GPUDevice::update(uint64_t now_ns, uint64_t timestamp_ns) {
+    uint64_t cpu_start = threadCPUNs();
+
+    // Seconds since the previous update, 0 on the first one
+    double elapsed = last_update == 0 ? 0 : (now_ns - last_update) / 1e9;
+
+    if (!checkDeviceState()) return false;
+
+    has_metrics_table = gpu_metrics.isOpen() && gpu_metrics.read(metrics_table);
+    hwmon_readings = hwmon.read();
     updateMetrics(metrics);
+    if (partition <= 0) {
+        updateEnergy(elapsed);
+    }
+    updateMemoryPressure(elapsed);
+    links.update(has_metrics_table ? &metrics_table : nullptr, elapsed, metrics.link);
+
+    residency.update(has_metrics_table ? &metrics_table : nullptr, metrics.gpu_clock, metrics.memory_clock, elapsed);
+    metrics.sclk_residency = residency.getSclkShares();
+    metrics.mclk_residency = residency.getMclkShares();
+    metrics.throttle_residency = residency.getThrottleShares();
+    metrics.throttle_reasons = residency.getActiveThrottleReasons();
+
+    if (block_sampler) {
+        metrics.block_usage = block_sampler->collect();
+    }
+
+    last_update = now_ns;
+    metrics.timestamp_ns = timestamp_ns;
+
+    float power = metrics.power_cap ? metrics.power_usage * 100.0f / metrics.power_cap : metrics.power_usage;
+    const float signals[] = {
+        metrics.gpu_usage,
+        metrics.memory_total > 0 ? metrics.memory_used / metrics.memory_total * 100.0f : 0,
+        metrics.gtt_total > 0 ? metrics.gtt_used / metrics.gtt_total * 100.0f : 0,
+        power,
+        (float)std::max(metrics.temperature, metrics.temperature_junction),
+        metrics.evictions_rate
+    };
+    return sensor_rate.observe(now_ns, threadCPUNs() - cpu_start, signals, SENSOR_THRESHOLDS,
+                               sizeof(signals) / sizeof(signals[0]));
+}
+
+/**
+ * Detect unplug, GPU resets and partition mode switches before sampling
+ *
+ * Returns false once the device is gone: every ioctl on an unbound device
+ * fails with ENODEV and GPUStats replaces the node. A reset that lost VRAM
+ * bumps the VRAM lost counter; the SMU and its accumulators restart with
+ * it, so rate baselines are dropped instead of producing a bogus delta.
+ */
+bool GPUDevice::checkDeviceState() {
+    uint32_t vram_lost = 0;
+    int ret = amdgpu_query_info(device, AMDGPU_INFO_VRAM_LOST_COUNTER, sizeof(vram_lost), &vram_lost);
+    if (ret == -ENODEV) {
+        if (!lost) {
+            Logger::warning("GPU " + pci_path + " is gone");
+        }
+        lost = true;
+        return false;
+    }
+
+    if (ret == 0) {
+        if (has_vram_lost_counter && vram_lost != metrics.vram_lost_counter) {
+            Logger::warning("GPU " + pci_path + " was reset, VRAM lost counter " + std::to_string(vram_lost));
+            metrics.reset_count++;
+            has_energy_accumulator = false;
+            has_migration_counters = false;
+            links.resetCounters();
+        }
+        metrics.vram_lost_counter = vram_lost;
+        has_vram_lost_counter = true;
+    }
+
+    std::string mode;
+    if (compute_partition.isOpen() && compute_partition.readString(mode) && mode != partition_mode) {
+        Logger::info("GPU " + pci_path + " switched from " + partition_mode + " to " + mode);
+        partition_mode = mode;
+        partition_mode_changed = true;
+    }
+    return true;
+}
+
+bool GPUDevice::startBlockSampler(unsigned rate_hz, const std::string& record_dir) {
+    // GRBM status is device wide, partition 0 samples it for all of them
+    if (partition > 0) return false;
+
+    struct amdgpu_gpu_info gpu_info;
+    if (amdgpu_query_gpu_info(device, &gpu_info) != 0) return false;
+
+    auto sampler = std::make_unique<BlockSampler>(device, gpu_info.family_id, rate_hz);
+    if (!record_dir.empty() && !sampler->record(record_dir + "/" + pci_path + ".blocks")) return false;
+    if (!sampler->start()) return false;
+
+    block_sampler = std::move(sampler);
+    return true;
+}
+
+/**
+ * Integrate energy since the previous update
+ *
+ * The SMU energy accumulator is exact and preferred whenever the metrics
+ * table carries one. Otherwise the sampled average power is integrated with
+ * the trapezoidal rule over the actual interval between updates.
+ */
+void GPUDevice::updateEnergy(double elapsed) {
+    energy_delta = 0;
+
+    if (has_metrics_table && metrics_table.has_energy) {
+        if (has_energy_accumulator) {
+            uint64_t mask = metrics_table.energy_accumulator_bits >= 64 ?
+                            ~0ULL : (1ULL << metrics_table.energy_accumulator_bits) - 1;
+            uint64_t delta = (metrics_table.energy_accumulator - last_energy_accumulator) & mask;
+            energy_delta = delta * GPUMetricsReader::ENERGY_UNIT_JOULES;
+        }
+        last_energy_accumulator = metrics_table.energy_accumulator;
+        has_energy_accumulator = true;
+        metrics.energy_from_accumulator = true;
+    } else if (!has_energy_accumulator && elapsed > 0) {
+        // A failed table read is covered by the next accumulator delta, so only
+        // devices without an accumulator fall back to integrating power
+        energy_delta = (last_power + metrics.power_usage) / 2.0 * elapsed;
+    }
+
+    last_power = metrics.power_usage;
+    metrics.energy += energy_delta;
+    energy_unattributed += energy_delta;
+}
+
+// Per-second rate of a monotonic counter, counters restart after a GPU reset
+static float counterRate(uint64_t current, uint64_t previous, double elapsed) {
+    return current >= previous ? (current - previous) / elapsed : 0.0f;
+}
+
+// Thresholds for the eviction pressure indicator
+static constexpr float MODERATE_EVICTIONS_RATE = 1.0f;
+static constexpr float SEVERE_EVICTIONS_RATE = 50.0f;
+static constexpr float MODERATE_BYTES_MOVED_RATE = 32.0f * 1024 * 1024;
+static constexpr float SEVERE_BYTES_MOVED_RATE = 512.0f * 1024 * 1024;
+static constexpr float SEVERE_VRAM_PERCENT = 90.0f;
+
+/**
+ * Turn the driver's buffer migration counters into per-second rates
+ *
+ * Occasional moves are normal (uploads are migrated from GTT on first use),
+ * steady evictions or CPU faults on a nearly full VRAM mean the working set
+ * no longer fits and buffers are thrashing between VRAM and GTT.
+ */
+void GPUDevice::updateMemoryPressure(double elapsed) {
+    uint64_t evictions = 0, bytes_moved = 0, cpu_page_faults = 0;
+
+    bool has_counters =
+        amdgpu_query_info(device, AMDGPU_INFO_NUM_EVICTIONS, sizeof(evictions), &evictions) == 0 &&
+        amdgpu_query_info(device, AMDGPU_INFO_NUM_BYTES_MOVED, sizeof(bytes_moved), &bytes_moved) == 0;
+    if (amdgpu_query_info(device, AMDGPU_INFO_NUM_VRAM_CPU_PAGE_FAULTS,
+                          sizeof(cpu_page_faults), &cpu_page_faults) != 0) {
+        cpu_page_faults = 0;
+    }
+    if (!has_counters) return;
+
+    if (has_migration_counters && elapsed > 0) {
+        metrics.evictions_rate = counterRate(evictions, last_evictions, elapsed);
+        metrics.bytes_moved_rate = counterRate(bytes_moved, last_bytes_moved, elapsed);
+        metrics.cpu_page_faults_rate = counterRate(cpu_page_faults, last_cpu_page_faults, elapsed);
+    }
+    last_evictions = evictions;
+    last_bytes_moved = bytes_moved;
+    last_cpu_page_faults = cpu_page_faults;
+    has_migration_counters = true;
+
+    float vram_percent = metrics.memory_total > 0 ? metrics.memory_used / metrics.memory_total * 100.0f : 0;
+    if (metrics.evictions_rate >= SEVERE_EVICTIONS_RATE ||
+        metrics.bytes_moved_rate >= SEVERE_BYTES_MOVED_RATE ||
+        (metrics.cpu_page_faults_rate > 0 && vram_percent >= SEVERE_VRAM_PERCENT)) {
+        metrics.eviction_pressure = PRESSURE_SEVERE;
+    } else if (metrics.evictions_rate >= MODERATE_EVICTIONS_RATE ||
+               metrics.bytes_moved_rate >= MODERATE_BYTES_MOVED_RATE) {
+        metrics.eviction_pressure = PRESSURE_MODERATE;
+    } else {
+        metrics.eviction_pressure = PRESSURE_NONE;
+    }
+}
+
+/**
+ * Split the energy since the last process scan among the processes on all
+ * nodes of this device (its compute partitions, or just itself) in
+ * proportion to the engine time each of them consumed. With adaptive
+ * sampling several device samples may fall between two scans.
+ */
+void GPUDevice::attributeEnergy(const std::vector<GPUDevice*>& nodes) {
+    uint64_t total_engine = 0;
+    for (const GPUDevice* node : nodes) {
+        for (const auto& proc : node->processes) {
+            total_engine += proc.gfx_engine_delta + proc.compute_engine_delta +
+                            proc.enc_engine_delta + proc.dec_engine_delta;
+        }
+    }
+
+    std::map<std::pair<pid_t, dev_t>, double> current_energy;
+    for (GPUDevice* node : nodes) {
+        for (auto& proc : node->processes) {
+            uint64_t engine = proc.gfx_engine_delta + proc.compute_engine_delta +
+                              proc.enc_engine_delta + proc.dec_engine_delta;
+            if (total_engine > 0) {
+                proc.energy_delta_joules = energy_unattributed * engine / total_engine;
+            }
+
+            auto key = std::make_pair(proc.pid, proc.drm_device);
+            auto previous = process_energy.find(key);
+            proc.energy_joules = (previous != process_energy.end() ? previous->second : 0) + proc.energy_delta_joules;
+            current_energy[key] = proc.energy_joules;
+        }
+    }
+
+    // Processes that went away are dropped, their totals live on in the ledger
+    process_energy = std::move(current_energy);
+    energy_unattributed = 0;
+}
+
+// Fit the memory of every client of this node, after a process scan at now_ns (CLOCK_MONOTONIC)
+void GPUDevice::updateMemoryTrends(uint64_t now_ns) {
+    double vram_free = std::max(0.0f, metrics.memory_total - metrics.memory_used) * 1048576.0;
+
+    std::map<pid_t, MemoryTrend> current_trends;
+    for (auto& proc : processes) {
+        auto previous = memory_trends.find(proc.pid);
+        MemoryTrend& trend = current_trends[proc.pid];
+        if (previous != memory_trends.end()) trend = previous->second;
+
+        trend.vram.add(now_ns, proc.memory_usage);
+        trend.gtt.add(now_ns, proc.gtt_usage);
+        proc.vram_growth = trend.vram.getSlope();
+        proc.gtt_growth = trend.gtt.getSlope();
+        proc.vram_growing = trend.vram.isGrowing();
+        proc.gtt_growing = trend.gtt.isGrowing();
+        proc.vram_full_seconds = proc.vram_growing ? vram_free / proc.vram_growth : 0;
+    }
+
+    // A client that comes back starts a new trend
+    memory_trends = std::move(current_trends);
+}
+
+GPUDevice::Metrics GPUDevice::getMetrics() const {
     return metrics;
 }
 
 std::vector<ProcessInfo> GPUDevice::getProcesses() const {
-    Metrics metrics = getMetrics();  // Get current metrics for GPU usage
-    return ProcessMonitor::getProcesses(device, metrics.gpu_usage);
+    return processes;
 }
 
 const char* GPUDevice::getGPUName() const {
@@ -157,44 +480,694 @@ const char* GPUDevice::getMarketName() const {
 
 GPUStats::GPUStats() {}
 
-GPUStats::~GPUStats() = default;
+GPUStats::~GPUStats() {
+    // The watcher thread calls back into this object
+    watcher.reset();
 
-bool GPUStats::initialize() {
-    drmDevicePtr devices[64];
-    int num_devices = drmGetDevices2(0, devices, 64);
-    
-    for (int i = 0; i < num_devices; i++) {
-        if (devices[i]->available_nodes & 1 << DRM_NODE_RENDER) {
-            int fd = open(devices[i]->nodes[DRM_NODE_RENDER], O_RDWR);
-            if (fd >= 0) {
-                drmVersionPtr version = drmGetVersion(fd);
-                if (version && !strcmp(version->name, "amdgpu")) {
-                    uint32_t major, minor;
-                    amdgpu_device_handle device;
-                    if (amdgpu_device_initialize(fd, &major, &minor, &device) == 0) {
-                        char pci_path[256];
-                        snprintf(pci_path, sizeof(pci_path), "%04x:%02x:%02x.%d",
-                                devices[i]->businfo.pci->domain,
-                                devices[i]->businfo.pci->bus,
-                                devices[i]->businfo.pci->dev,
-                                devices[i]->businfo.pci->func);
-                        
-                        gpus.push_back(std::make_unique<GPUDevice>(fd, device, version, pci_path));
-                        continue;
-                    }
-                }
-                if (version) {
-                    drmFreeVersion(version);
-                }
-                close(fd);
+    // Let every pcie_bw read end at once rather than one GPU after another
+    for (auto* list : {&gpus, &pending_devices, &retired_devices}) {
+        for (auto& gpu : *list) gpu->links.stop();
+    }
+
+    if (!residency_path.empty()) {
+        writeResidency();
+    }
+}
+
+// A render node found in sysfs, before anything is opened
+struct DRMNodeCandidate {
+    std::string render_path;
+    std::string primary_path;
+    std::string pci_path;
+    unsigned render_minor = 0;
+    int partition = -1;
+    int xcp = -1;  // amdgpu_xcp platform device number of partition nodes
+};
+
+// The card node next to a render node in the device's drm directory
+static std::string findPrimaryNode(const std::string& device_dir) {
+    DIR* dir = opendir((device_dir + "/drm").c_str());
+    if (!dir) return "";
+
+    std::string primary;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        unsigned minor;
+        char extra;
+        if (sscanf(entry->d_name, "card%u%c", &minor, &extra) == 1) {
+            primary = std::string("/dev/dri/") + entry->d_name;
+            break;
+        }
+    }
+    closedir(dir);
+    return primary;
+}
+
+static std::string resolveName(const std::string& link) {
+    char resolved[PATH_MAX];
+    if (!realpath(link.c_str(), resolved)) return "";
+    std::string path = resolved;
+    return path.substr(path.rfind('/') + 1);
+}
+
+/**
+ * Find amdgpu render nodes without opening any of them
+ *
+ * PCI nodes are filtered by vendor ID and bound driver. Compute partitions
+ * beyond the first appear as render nodes of amdgpu_xcp platform devices,
+ * which carry no vendor attribute and are returned separately.
+ */
+static void scanDRMNodes(std::vector<DRMNodeCandidate>& physical, std::vector<DRMNodeCandidate>& partitions) {
+    DIR* dir = opendir("/sys/class/drm");
+    if (!dir) {
+        Logger::error("Cannot list /sys/class/drm");
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        DRMNodeCandidate node;
+        if (sscanf(entry->d_name, "renderD%u", &node.render_minor) != 1) continue;
+
+        std::string device_dir = std::string("/sys/class/drm/") + entry->d_name + "/device";
+        char resolved[PATH_MAX];
+        if (!realpath(device_dir.c_str(), resolved)) continue;
+        device_dir = resolved;
+
+        node.render_path = std::string("/dev/dri/") + entry->d_name;
+        node.primary_path = findPrimaryNode(device_dir);
+        std::string name = device_dir.substr(device_dir.rfind('/') + 1);
+
+        std::string vendor;
+        if (SysfsFile(device_dir + "/vendor").readString(vendor)) {
+            if (vendor != "0x1002" || resolveName(device_dir + "/driver") != "amdgpu") continue;
+
+            node.pci_path = name;
+            if (access((device_dir + "/current_compute_partition").c_str(), F_OK) == 0) {
+                node.partition = 0;
             }
+            physical.push_back(node);
+        } else if (sscanf(name.c_str(), "amdgpu_xcp.%d", &node.xcp) == 1) {
+            partitions.push_back(node);
         }
     }
-    
-    drmFreeDevices(devices, num_devices);
+    closedir(dir);
+}
+
+static std::unique_ptr<GPUDevice> openNode(const DRMNodeCandidate& node) {
+    // Partitions not active in the current mode refuse the open
+    int fd = open(node.render_path.c_str(), O_RDWR);
+    if (fd < 0) return nullptr;
+
+    drmVersionPtr version = drmGetVersion(fd);
+    if (version && !strcmp(version->name, "amdgpu")) {
+        uint32_t major, minor;
+        amdgpu_device_handle device;
+        if (amdgpu_device_initialize(fd, &major, &minor, &device) == 0) {
+            // Client fds may refer to either node, both identify this GPU
+            struct stat node_stat;
+            dev_t render_node = fstat(fd, &node_stat) == 0 ? node_stat.st_rdev : 0;
+            dev_t primary_node = 0;
+            if (!node.primary_path.empty() && stat(node.primary_path.c_str(), &node_stat) == 0) {
+                primary_node = node_stat.st_rdev;
+            }
+            return std::make_unique<GPUDevice>(fd, device, version, node.pci_path,
+                                               render_node, primary_node, node.partition);
+        }
+    }
+    if (version) {
+        drmFreeVersion(version);
+    }
+    close(fd);
+    return nullptr;
+}
+
+// amdgpu allocates MAX_XCP - 1 amdgpu_xcp platform nodes per partitionable GPU
+static constexpr unsigned XCP_NODES_PER_DEVICE = 7;
+
+/**
+ * All amdgpu nodes currently in sysfs, with partitions assigned to their GPU
+ *
+ * Partition nodes are not linked to their GPU in sysfs. amdgpu numbers the
+ * amdgpu_xcp devices globally, XCP_NODES_PER_DEVICE per partitionable GPU
+ * in probe order, and the PCI render minors are handed out in that order too.
+ */
+static std::vector<DRMNodeCandidate> planNodes() {
+    std::vector<DRMNodeCandidate> nodes;
+    std::vector<DRMNodeCandidate> partitions;
+    scanDRMNodes(nodes, partitions);
+
+    std::sort(nodes.begin(), nodes.end(), [](const DRMNodeCandidate& a, const DRMNodeCandidate& b) {
+        return a.render_minor < b.render_minor;
+    });
+    std::sort(partitions.begin(), partitions.end(), [](const DRMNodeCandidate& a, const DRMNodeCandidate& b) {
+        return a.xcp < b.xcp;
+    });
+
+    std::vector<size_t> partitionable;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].partition == 0) partitionable.push_back(i);
+    }
+
+    for (auto& node : partitions) {
+        size_t device = node.xcp / XCP_NODES_PER_DEVICE;
+        if (device >= partitionable.size()) {
+            Logger::warning("No partitionable GPU for " + node.render_path);
+            continue;
+        }
+        node.pci_path = nodes[partitionable[device]].pci_path;
+        node.partition = node.xcp % XCP_NODES_PER_DEVICE + 1;
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+/**
+ * Open candidates concurrently
+ *
+ * Device initialization and the sysfs opens dominate startup on large
+ * nodes. Slots of nodes that could not be opened stay empty.
+ */
+static std::vector<std::unique_ptr<GPUDevice>> openNodes(const std::vector<DRMNodeCandidate>& nodes) {
+    std::vector<std::unique_ptr<GPUDevice>> opened(nodes.size());
+    std::atomic<size_t> next(0);
+    size_t workers = std::min<size_t>(nodes.size(), std::max(1u, std::thread::hardware_concurrency()));
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers; i++) {
+        threads.emplace_back([&] {
+            for (size_t index = next++; index < nodes.size(); index = next++) {
+                opened[index] = openNode(nodes[index]);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return opened;
+}
+
+bool GPUStats::initialize() {
+    for (auto& gpu : openNodes(planNodes())) {
+        if (gpu) {
+            addDevice(std::move(gpu));
+        }
+    }
+    regroup();
+
+    Logger::info("Found " + std::to_string(physical_gpus.size()) + " AMD GPUs with " +
+                 std::to_string(gpus.size()) + " DRM nodes");
     return !gpus.empty();
 }
 
+void GPUStats::addDevice(std::unique_ptr<GPUDevice> gpu) {
+    auto previous = history.find(gpu->pci_path + "/" + std::to_string(gpu->partition));
+    if (previous != history.end()) {
+        gpu->metrics.energy = previous->second.energy;
+        gpu->residency.inheritHistory(previous->second.residency);
+        history.erase(previous);
+    }
+    if (block_rate_hz) {
+        gpu->startBlockSampler(block_rate_hz, block_record_dir);
+    }
+    if (adaptive) {
+        gpu->sensor_rate.setLimits(adaptive_min_ns, adaptive_max_ns);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        held_nodes.insert(gpu->render_node);
+    }
+    gpus.push_back(std::move(gpu));
+}
+
+// Rebuild the physical GPU groups and the node map after gpus changed
+void GPUStats::regroup() {
+    // Physical GPUs keep the order they were first seen in, nodes follow partition order
+    std::map<std::string, size_t> rank;
+    for (const auto& gpu : gpus) {
+        rank.insert({gpu->pci_path, rank.size()});
+    }
+    std::stable_sort(gpus.begin(), gpus.end(), [&](const std::unique_ptr<GPUDevice>& a,
+                                                   const std::unique_ptr<GPUDevice>& b) {
+        if (rank[a->pci_path] != rank[b->pci_path]) return rank[a->pci_path] < rank[b->pci_path];
+        return a->partition < b->partition;
+    });
+
+    physical_gpus.clear();
+    drm_nodes.clear();
+    for (size_t i = 0; i < gpus.size(); i++) {
+        if (i == 0 || gpus[i]->pci_path != gpus[i - 1]->pci_path) {
+            physical_gpus.push_back({});
+        }
+        physical_gpus.back().push_back(i);
+
+        // Partitions inherit the mode of the PCI function they belong to
+        if (gpus[i]->partition > 0) {
+            gpus[i]->partition_mode = gpus[physical_gpus.back()[0]]->partition_mode;
+        }
+
+        // Client fds may refer to either node, both identify this GPU
+        drm_nodes[gpus[i]->render_node] = gpus[i]->render_node;
+        if (gpus[i]->primary_node) {
+            drm_nodes[gpus[i]->primary_node] = gpus[i]->render_node;
+        }
+    }
+}
+
+bool GPUStats::watchDevices() {
+    watcher = std::make_unique<DeviceWatcher>([this] { rescan(); });
+    if (!watcher->start()) {
+        watcher.reset();
+        return false;
+    }
+    return true;
+}
+
+// Runs on the watcher thread; opening new nodes must not stall sampling
+void GPUStats::rescan() {
+    // Closing removed devices can take a while too, they are released here
+    std::vector<std::unique_ptr<GPUDevice>> retired;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        retired.swap(retired_devices);
+    }
+    retired.clear();
+
+    std::vector<DRMNodeCandidate> nodes = planNodes();
+    std::set<dev_t> present;
+    std::vector<DRMNodeCandidate> added;
+
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        for (const auto& node : nodes) {
+            struct stat node_stat;
+            if (stat(node.render_path.c_str(), &node_stat) != 0) continue;
+
+            present.insert(node_stat.st_rdev);
+            if (!held_nodes.count(node_stat.st_rdev)) {
+                added.push_back(node);
+            }
+        }
+    }
+
+    auto opened = openNodes(added);
+
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    for (auto& gpu : opened) {
+        if (gpu) {
+            held_nodes.insert(gpu->render_node);
+            pending_devices.push_back(std::move(gpu));
+        }
+    }
+    present_nodes = std::move(present);
+    has_pending_scan = true;
+}
+
+/**
+ * Apply the watcher's last scan and drop dead devices
+ *
+ * Nodes that vanished, devices that stopped answering and partitions of a
+ * GPU that switched partition mode are removed; their energy and residency
+ * history is kept for a device reappearing at the same PCI path.
+ */
+void GPUStats::applyPendingScan() {
+    std::vector<std::unique_ptr<GPUDevice>> added;
+    std::set<dev_t> present;
+    bool has_scan;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        added.swap(pending_devices);
+        present.swap(present_nodes);
+        has_scan = has_pending_scan;
+        has_pending_scan = false;
+    }
+
+    std::set<std::string> repartitioned;
+    for (auto& gpu : gpus) {
+        if (gpu->partition_mode_changed) {
+            repartitioned.insert(gpu->pci_path);
+            gpu->partition_mode_changed = false;
+        }
+    }
+
+    bool changed = !added.empty();
+    bool needs_rescan = false;
+    std::vector<std::unique_ptr<GPUDevice>> removed;
+    for (auto it = gpus.begin(); it != gpus.end();) {
+        GPUDevice& gpu = **it;
+        bool stale_partition = gpu.partition > 0 && repartitioned.count(gpu.pci_path);
+        if (!gpu.lost && !stale_partition && (!has_scan || present.count(gpu.render_node))) {
+            ++it;
+            continue;
+        }
+
+        Logger::info("Removing GPU node " + gpu.pci_path + " partition " + std::to_string(gpu.partition));
+        history[gpu.pci_path + "/" + std::to_string(gpu.partition)] =
+            DeviceHistory{gpu.metrics.energy, std::move(gpu.residency)};
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            held_nodes.erase(gpu.render_node);
+        }
+
+        // A lost node may come back under the same minor, a mode switch brings new partitions
+        needs_rescan = needs_rescan || gpu.lost || stale_partition;
+        removed.push_back(std::move(*it));
+        it = gpus.erase(it);
+        changed = true;
+    }
+
+    // Destroyed on the watcher thread, so other GPUs keep being sampled meanwhile
+    if (!removed.empty() && watcher) {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        for (auto& gpu : removed) {
+            retired_devices.push_back(std::move(gpu));
+        }
+        needs_rescan = true;
+    }
+
+    for (auto& gpu : added) {
+        Logger::info("Adding GPU node " + gpu->pci_path + " partition " + std::to_string(gpu->partition));
+        addDevice(std::move(gpu));
+    }
+
+    if (changed) {
+        regroup();
+    }
+    if (needs_rescan && watcher) {
+        watcher->trigger();
+    }
+}
+
+void GPUStats::sampleDevices() {
+    applyPendingScan();
+
+    uint64_t now = clockNs(CLOCK_MONOTONIC);
+    last_update_ns = clockNs(CLOCK_REALTIME);
+    for (auto& gpu : gpus) {
+        gpu->update(now, last_update_ns);
+    }
+}
+
+void GPUStats::update() {
+    sampleDevices();
+    scanProcesses();
+    finishUpdate();
+}
+
+void GPUStats::setAdaptiveSampling(unsigned min_ms, unsigned max_ms, float cpu_budget_percent) {
+    adaptive = true;
+    adaptive_min_ns = min_ms * 1000000ULL;
+    adaptive_max_ns = max_ms * 1000000ULL;
+    budget.setBudget(cpu_budget_percent);
+    for (auto& gpu : gpus) {
+        gpu->sensor_rate.setLimits(adaptive_min_ns, adaptive_max_ns);
+    }
+    scan_rate.setLimits(adaptive_min_ns, adaptive_max_ns);
+}
+
+/**
+ * Sample the devices whose interval is up and scan /proc if its interval is
+ *
+ * A device whose sensors moved also brings the process scan back to the
+ * fastest rate, so the clients behind a burst are caught while it lasts.
+ * Sources due within a quarter of the fastest interval are taken along in
+ * the same pass and share its timestamp, so the GPUs of a box keep sampling
+ * together instead of drifting into a pass, and a snapshot, each. All
+ * intervals are stretched alike when the samples and the exports after
+ * each pass together cost more CPU time than the budget allows.
+ */
+void GPUStats::updateDue() {
+    if (!adaptive) {
+        update();
+        return;
+    }
+    applyPendingScan();
+
+    uint64_t now = clockNs(CLOCK_MONOTONIC);
+    uint64_t due = now + adaptive_min_ns / 4;
+    uint64_t timestamp = clockNs(CLOCK_REALTIME);
+    double stretch = budget.getStretch();
+    bool sampled = false;
+    for (auto& gpu : gpus) {
+        if (gpu->sensor_rate.hasSample() && due < gpu->sensor_rate.getNextSample(stretch)) continue;
+        if (gpu->update(now, timestamp)) {
+            scan_rate.activate();
+        }
+        sampled = true;
+    }
+    if (sampled) {
+        last_update_ns = timestamp;
+    }
+    if (!scan_rate.hasSample() || due >= scan_rate.getNextSample(stretch)) {
+        scanProcesses();
+        sampled = true;
+    }
+
+    if (sampled) {
+        uint64_t cpu_start = threadCPUNs();
+        finishUpdate();
+        double cost = threadCPUNs() - cpu_start;
+        pass_cpu_ns = pass_cpu_ns > 0 ? pass_cpu_ns + (cost - pass_cpu_ns) * PASS_COST_WEIGHT : cost;
+    }
+
+    // Passes come as often as the fastest source asks for one
+    budget.clear();
+    uint64_t fastest = scan_rate.getInterval();
+    for (const auto& gpu : gpus) {
+        budget.add(gpu->sensor_rate);
+        fastest = std::min(fastest, gpu->sensor_rate.getInterval());
+    }
+    budget.add(scan_rate);
+    budget.addPass(pass_cpu_ns, fastest);
+}
+
+std::chrono::steady_clock::time_point GPUStats::getNextSampleTime() const {
+    double stretch = budget.getStretch();
+    uint64_t next = scan_rate.getNextSample(stretch);
+    for (const auto& gpu : gpus) {
+        next = std::min(next, gpu->sensor_rate.getNextSample(stretch));
+    }
+    // The steady clock is CLOCK_MONOTONIC, which the rates keep their times on
+    return std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(next)));
+}
+
+void GPUStats::scanProcesses() {
+    uint64_t cpu_start = threadCPUNs();
+
+    // A single scan serves all devices, entries are split by render node
+    auto processes = ProcessMonitor::getProcesses(drm_nodes);
+    has_process_scan = true;
+    last_scan_ns = last_update_ns = clockNs(CLOCK_REALTIME);
+
+    std::map<dev_t, std::vector<ProcessInfo>> per_device;
+    for (auto& proc : processes) {
+        per_device[proc.drm_device].push_back(std::move(proc));
+    }
+    for (auto& gpu : gpus) {
+        gpu->processes = std::move(per_device[gpu->render_node]);
+    }
+
+    // Partitions share the power of their GPU, its energy goes to the clients of all of them
+    for (const auto& members : physical_gpus) {
+        std::vector<GPUDevice*> nodes;
+        for (size_t index : members) {
+            nodes.push_back(gpus[index].get());
+        }
+        nodes[0]->attributeEnergy(nodes);
+    }
+    uint64_t now = clockNs(CLOCK_MONOTONIC);
+    for (auto& gpu : gpus) {
+        gpu->updateMemoryTrends(now);
+    }
+
+    if (ledger || annotations) {
+        processes.clear();
+        for (const auto& gpu : gpus) {
+            processes.insert(processes.end(), gpu->processes.begin(), gpu->processes.end());
+        }
+        if (ledger) ledger->update(processes);
+        if (annotations) annotations->update(clockNs(CLOCK_MONOTONIC), processes);
+    }
+
+    float clients = 0, usage = 0, vram = 0, vram_total = 0;
+    for (const auto& gpu : gpus) {
+        for (const auto& proc : gpu->processes) {
+            usage += proc.gfx_usage + proc.compute_usage + proc.enc_usage + proc.dec_usage;
+            vram += proc.memory_usage / (1024.0f * 1024.0f);
+        }
+        clients += gpu->processes.size();
+        vram_total += gpu->metrics.memory_total;
+    }
+    const float signals[] = {clients, usage, vram_total > 0 ? vram / vram_total * 100.0f : 0};
+    scan_rate.observe(clockNs(CLOCK_MONOTONIC), threadCPUNs() - cpu_start, signals, SCAN_THRESHOLDS,
+                      sizeof(signals) / sizeof(signals[0]));
+}
+
+// Exports and collectors that follow every sample
+void GPUStats::finishUpdate() {
+    if (sched_tracer) {
+        sched_tracer->getLatencies(sched_latencies);
+    }
+
+    if (!residency_path.empty()) {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec - last_residency_export.tv_sec >= (time_t)RESIDENCY_EXPORT_INTERVAL_S) {
+            writeResidency();
+            last_residency_export = now;
+        }
+    }
+
+    if (publisher || recorder || tracer || rules) {
+        getSnapshot(*recorded_snapshot);
+        if (publisher) publisher->publish(*recorded_snapshot);
+        if (recorder) recorder->record(*recorded_snapshot);
+        if (tracer) tracer->write(*recorded_snapshot);
+        if (rules) rules->evaluate(*recorded_snapshot);
+    }
+}
+
+GPUDevice::Metrics GPUStats::getAggregatedMetrics(size_t physical) const {
+    const auto& members = physical_gpus[physical];
+    GPUDevice::Metrics aggregated = gpus[members[0]]->metrics;
+
+    // With memory partitioning (NPS2 and up) each partition reports its own
+    // slice of VRAM, otherwise all of them report the shared pool
+    bool shared_memory = true;
+    for (size_t i = 1; i < members.size(); i++) {
+        if (gpus[members[i]]->metrics.memory_total != aggregated.memory_total) {
+            shared_memory = false;
+        }
+    }
+    if (!shared_memory) {
+        for (size_t i = 1; i < members.size(); i++) {
+            aggregated.memory_used += gpus[members[i]]->metrics.memory_used;
+            aggregated.memory_total += gpus[members[i]]->metrics.memory_total;
+        }
+    }
+    return aggregated;
+}
+
+void GPUStats::getSnapshot(Snapshot& snapshot) const {
+    snapshot.timestamp_ns = last_update_ns;
+    snapshot.processes_pending = !has_process_scan;
+    snapshot.sched_latencies = sched_latencies;
+    if (annotations) {
+        snapshot.markers = annotations->getMarkers();
+        annotations->getPhases(snapshot.phases);
+    }
+    snapshot.gpus.resize(physical_gpus.size());
+
+    for (size_t i = 0; i < physical_gpus.size(); i++) {
+        const GPUDevice& primary = *gpus[physical_gpus[i][0]];
+        GPUSnapshot& gpu = snapshot.gpus[i];
+        gpu.market_name = primary.getMarketName();
+        gpu.pci_path = primary.pci_path;
+        gpu.partition_mode = primary.partition_mode;
+        gpu.metrics = getAggregatedMetrics(i);
+
+        gpu.nodes.resize(physical_gpus[i].size());
+        for (size_t j = 0; j < physical_gpus[i].size(); j++) {
+            const GPUDevice& node = *gpus[physical_gpus[i][j]];
+            gpu.nodes[j].partition = node.partition;
+            gpu.nodes[j].metrics = node.metrics;
+            gpu.nodes[j].processes = node.processes;
+            gpu.nodes[j].processes_timestamp_ns = last_scan_ns;
+        }
+    }
+}
+
+bool GPUStats::publishSnapshots(const std::string& name) {
+    publisher = std::make_unique<SnapshotPublisher>(name);
+    if (!publisher->open()) {
+        publisher.reset();
+        return false;
+    }
+    if (!recorded_snapshot) recorded_snapshot = std::make_unique<Snapshot>();
+    return true;
+}
+
+bool GPUStats::collectAnnotations(const std::string& name) {
+    annotations = std::make_unique<AnnotationCollector>(name);
+    if (!annotations->start()) {
+        annotations.reset();
+        return false;
+    }
+    return true;
+}
+
+bool GPUStats::startSchedTrace(const std::string& record_dir) {
+    sched_tracer = std::make_unique<SchedTracer>(record_dir);
+    if (!sched_tracer->start()) {
+        sched_tracer.reset();
+        return false;
+    }
+    return true;
+}
+
+bool GPUStats::startTrace(const std::string& path) {
+    tracer = std::make_unique<TraceWriter>(path);
+    if (!tracer->open()) {
+        tracer.reset();
+        return false;
+    }
+    if (!recorded_snapshot) recorded_snapshot = std::make_unique<Snapshot>();
+    return true;
+}
+
+bool GPUStats::addAlertRule(const std::string& rule, const std::string& exec, std::string& error) {
+    if (!rules) rules = std::make_unique<RuleEngine>();
+    if (!rules->add(rule, exec, error)) return false;
+    if (!recorded_snapshot) recorded_snapshot = std::make_unique<Snapshot>();
+    return true;
+}
+
+void GPUStats::setAlertLog(FILE* file) {
+    if (!rules) rules = std::make_unique<RuleEngine>();
+    rules->setLog(file);
+}
+
+bool GPUStats::startFlightRecorder(const FlightTrigger& trigger, const std::string& directory, unsigned pre_s,
+                                   unsigned post_s) {
+    struct stat st;
+    if (stat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        Logger::error("Flight recorder directory " + directory + " does not exist");
+        return false;
+    }
+    // Adaptive sampling may take several samples a second while the GPUs are busy
+    unsigned samples_per_s = adaptive ? (1000000000ULL + adaptive_min_ns - 1) / adaptive_min_ns : 1;
+    recorder = std::make_unique<FlightRecorder>(trigger, directory, pre_s, post_s, samples_per_s);
+    if (!recorder->start()) {
+        recorder.reset();
+        return false;
+    }
+    if (!recorded_snapshot) recorded_snapshot = std::make_unique<Snapshot>();
+    return true;
+}
+
+bool GPUStats::startBlockSampling(unsigned rate_hz, const std::string& record_dir) {
+    block_rate_hz = rate_hz;  // Devices added later start sampling too
+    block_record_dir = record_dir;
+    bool started = false;
+    for (auto& gpu : gpus) {
+        if (gpu->startBlockSampler(rate_hz, record_dir)) {
+            started = true;
+        }
+    }
+    return started;
+}
+
+bool GPUStats::openLedger(const std::string& path) {
+    ledger = std::make_unique<AccountingLedger>(path);
+    if (!ledger->open()) {
+        ledger.reset();
+        return false;
+    }
+    return true;
+}
+
 GPUDevice* GPUStats::getGPU(size_t index) {
     if (index >= gpus.size()) return nullptr;
     return gpus[index].get();
@@ -203,4 +1176,37 @@ GPUDevice* GPUStats::getGPU(size_t index) {
 const GPUDevice* GPUStats::getGPU(size_t index) const {
     if (index >= gpus.size()) return nullptr;
     return gpus[index].get();
-} 
\ No newline at end of file
+}
+
+void GPUStats::exportResidency(const std::string& path) {
+    residency_path = path;
+    clock_gettime(CLOCK_MONOTONIC, &last_residency_export);
+}
+
+/**
+ * Write the residency histograms of all GPUs, one tab separated line per bucket:
+ *
+ *   <gpu> <pci path> <sclk|mclk|throttle|throttle_reason> <label> <session s> <session %> <window s> <window %>
+ *
+ * The file is replaced atomically so readers never see a partial table.
+ */
+bool GPUStats::writeResidency() const {
+    std::string tmp_path = residency_path + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "w");
+    if (!file) {
+        Logger::error("Failed to write residency export " + tmp_path + ": " + strerror(errno));
+        return false;
+    }
+
+    fprintf(file, "# gpu\tpci\thistogram\tstate\tsession_s\tsession_pct\twindow_s\twindow_pct\n");
+    for (size_t i = 0; i < physical_gpus.size(); i++) {
+        const GPUDevice& gpu = *gpus[physical_gpus[i][0]];
+        gpu.residency.write(file, std::to_string(i) + "\t" + gpu.pci_path);
+    }
+
+    bool ok = fclose(file) == 0 && rename(tmp_path.c_str(), residency_path.c_str()) == 0;
+    if (!ok) {
+        Logger::error("Failed to write residency export " + residency_path + ": " + strerror(errno));
+    }
+    return ok;
+}
@@ -0,0 +1,54 @@
+#include "growth_trend.hpp"
+#include <cmath>
+
+void GrowthTrend::add(uint64_t now_ns, double value) {
+    if (!first_ns) first_ns = now_ns;
+    // Time relative to the first sample keeps the deviations small
+    double t = now_ns > first_ns ? (now_ns - first_ns) / 1e9 : 0;
+    span = t;
+
+    double length = window_seconds / BUCKETS_PER_WINDOW;
+    if (bucket_count > 0 && t >= bucket_end) {
+        addPoint(bucket_end - length / 2, bucket_sum / bucket_count);
+        bucket_sum = 0;
+        bucket_count = 0;
+    }
+    if (bucket_count == 0) {
+        // After a gap in the samples the next slice is the one now falls in
+        bucket_end = (std::floor(t / length) + 1) * length;
+    }
+    bucket_sum += value;
+    bucket_count++;
+}
+
+void GrowthTrend::addPoint(double t, double value) {
+    if (weight == 0) {
+        weight = 1;
+        last_t = mean_t = t;
+        mean_value = value;
+        return;
+    }
+    double decay = std::exp(-(t - last_t) / window_seconds);
+    last_t = t;
+
+    // Weighted Welford update: the old points weigh decay * weight, the new one 1
+    double old_weight = weight * decay;
+    weight = old_weight + 1;
+    double dt = t - mean_t;
+    double dv = value - mean_value;
+    double share = old_weight / weight;
+    mean_t += dt / weight;
+    mean_value += dv / weight;
+    time_variance = time_variance * decay + share * dt * dt;
+    value_variance = value_variance * decay + share * dv * dv;
+    covariance = covariance * decay + share * dt * dv;
+}
+
+double GrowthTrend::getFit() const {
+    if (time_variance <= 0 || value_variance <= 0) return 0;
+    return covariance * covariance / (time_variance * value_variance);
+}
+
+bool GrowthTrend::isGrowing() const {
+    return span >= window_seconds / 4 && getSlope() >= MIN_GROWTH && getFit() >= MIN_FIT;
+}
@@ -0,0 +1,74 @@
+#include "hwmon.hpp"
+#include <cstring>
+#include <dirent.h>
+#include "logger.hpp"
+
+bool HwmonSensors::open(const std::string& device_path) {
+    std::string hwmon_dir = device_path + "/hwmon";
+    DIR* dir = opendir(hwmon_dir.c_str());
+    if (!dir) {
+        Logger::debug("No hwmon directory at " + hwmon_dir);
+        return false;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (strncmp(entry->d_name, "hwmon", 5) == 0) {
+            hwmon_path = hwmon_dir + "/" + entry->d_name;
+            break;
+        }
+    }
+    closedir(dir);
+    if (hwmon_path.empty()) return false;
+
+    static const char* const attributes[SENSOR_COUNT] = {
+        "fan1_input",
+        "pwm1",
+        "temp1_input",
+        "temp2_input",
+        "temp3_input",
+        "in0_input",
+        "in1_input",
+        "power1_cap",
+        "power1_average",
+    };
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        files[i].open(hwmon_path + "/" + attributes[i]);
+    }
+
+    // Newer SMUs only report instantaneous power
+    if (!files[POWER_AVERAGE].isOpen()) {
+        files[POWER_AVERAGE].open(hwmon_path + "/power1_input");
+    }
+
+    SysfsFile pwm_max_file(hwmon_path + "/pwm1_max");
+    int64_t value;
+    if (pwm_max_file.readInt(value) && value > 0) {
+        pwm_max = value;
+    }
+
+    Logger::debug("Using hwmon sensors at " + hwmon_path);
+    return true;
+}
+
+int64_t HwmonSensors::readSensor(Sensor sensor) const {
+    int64_t value;
+    return files[sensor].readInt(value) ? value : -1;
+}
+
+HwmonReadings HwmonSensors::read() const {
+    HwmonReadings readings;
+    if (!isOpen()) return readings;
+
+    readings.fan_rpm = readSensor(FAN_RPM);
+    int64_t pwm = readSensor(FAN_PWM);
+    readings.fan_pwm = pwm >= 0 ? pwm * 100 / pwm_max : -1;
+    readings.temp_edge = readSensor(TEMP_EDGE);
+    readings.temp_junction = readSensor(TEMP_JUNCTION);
+    readings.temp_memory = readSensor(TEMP_MEMORY);
+    readings.voltage_gfx = readSensor(VOLTAGE_GFX);
+    readings.voltage_northbridge = readSensor(VOLTAGE_NORTHBRIDGE);
+    readings.power_cap = readSensor(POWER_CAP);
+    readings.power_average = readSensor(POWER_AVERAGE);
+    return readings;
+}
@@ -4,15 +4,209 @@
 #include <ftxui/dom/elements.hpp>
 #include <ftxui/screen/terminal.hpp>
 #include <ftxui/component/screen_interactive.hpp>
+#include <cmath>
+#include <cstdio>
 #include <iomanip>
 #include "logger.hpp"
 
 using namespace ftxui;
 
-Layout::Layout() {
-    if (!gpu_stats.initialize()) {
-        throw std::runtime_error("Failed to initialize AMD GPU monitoring");
+// Human readable data rate, e.g. "12.0 MiB/s"
+static std::string formatRate(float bytes_per_sec) {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    if (bytes_per_sec >= 1024.0f * 1024 * 1024) {
+        ss << bytes_per_sec / (1024.0f * 1024 * 1024) << " GiB/s";
+    } else {
+        ss << bytes_per_sec / (1024.0f * 1024) << " MiB/s";
+    }
+    return ss.str();
+}
+
+// PCIe generation from the transfer rate in GT/s
+static int pcieGeneration(float speed) {
+    if (speed >= 64.0f) return 6;
+    if (speed >= 32.0f) return 5;
+    if (speed >= 16.0f) return 4;
+    if (speed >= 8.0f) return 3;
+    if (speed >= 5.0f) return 2;
+    return speed > 0 ? 1 : 0;
+}
+
+// "Gen4 x16", or "-" when the link state is unknown
+static std::string formatPCIeLink(float speed, uint32_t width) {
+    if (speed <= 0) return "-";
+    return "Gen" + std::to_string(pcieGeneration(speed)) + " x" + std::to_string(width);
+}
+
+// Rate or "-" for counters the device does not export
+static std::string formatOptionalRate(float bytes_per_sec) {
+    return bytes_per_sec < 0 ? "-" : formatRate(bytes_per_sec);
+}
+
+static const char* pressureName(GPUDevice::PressureLevel level) {
+    switch (level) {
+        case GPUDevice::PRESSURE_SEVERE: return "THRASHING";
+        case GPUDevice::PRESSURE_MODERATE: return "MODERATE";
+        default: return "OK";
+    }
+}
+
+// "edge/junction/memory" temperatures, omitting sensors the board lacks
+static std::string formatTemperatures(const GPUDevice::Metrics& metrics) {
+    std::string temps = std::to_string(metrics.temperature);
+    if (metrics.temperature_junction) temps += "/" + std::to_string(metrics.temperature_junction);
+    if (metrics.temperature_memory) temps += "/" + std::to_string(metrics.temperature_memory);
+    return temps + "°C";
+}
+
+// "power/cap W" when a power cap is known
+static std::string formatPower(const GPUDevice::Metrics& metrics) {
+    std::string power = std::to_string(metrics.power_usage);
+    if (metrics.power_cap) power += "/" + std::to_string(metrics.power_cap);
+    return power + "W";
+}
+
+// Human readable energy, e.g. "850 J", "12.4 kJ", "3.21 MJ"
+static std::string formatEnergy(double joules) {
+    std::stringstream ss;
+    if (joules >= 1e6) {
+        ss << std::fixed << std::setprecision(2) << joules / 1e6 << " MJ";
+    } else if (joules >= 1e3) {
+        ss << std::fixed << std::setprecision(1) << joules / 1e3 << " kJ";
+    } else {
+        ss << std::fixed << std::setprecision(0) << joules << " J";
+    }
+    return ss.str();
+}
+
+// VRAM growth per hour, e.g. "+120 MiB", "-" when the trend is flat or not known yet
+static std::string formatGrowth(float bytes_per_second) {
+    if (std::fabs(bytes_per_second) < GrowthTrend::MIN_GROWTH) return "-";
+    float mib_per_hour = bytes_per_second * 3600 / (1024.0f * 1024.0f);
+    std::stringstream ss;
+    ss << std::showpos << std::fixed << std::setprecision(0);
+    if (std::fabs(mib_per_hour) >= 10240) {
+        ss << std::setprecision(1) << mib_per_hour / 1024 << " GiB";
+    } else {
+        ss << mib_per_hour << " MiB";
+    }
+    return ss.str();
+}
+
+// Coarse time left, e.g. "45m", "3h20m", "2d4h"
+static std::string formatTimeLeft(float seconds) {
+    if (seconds <= 0) return "-";
+    unsigned long minutes = (unsigned long)(seconds / 60);
+    if (minutes < 60) return std::to_string(minutes) + "m";
+    if (minutes < 24 * 60) return std::to_string(minutes / 60) + "h" + std::to_string(minutes % 60) + "m";
+    unsigned long hours = minutes / 60;
+    return hours >= 100 * 24 ? ">99d" : std::to_string(hours / 24) + "d" + std::to_string(hours % 24) + "h";
+}
+
+// "800Mhz 10% 2100Mhz 90%", leaving out states not seen in the window or session
+static std::string formatShares(const std::vector<ResidencyShare>& shares, bool session) {
+    std::string result;
+    for (const auto& share : shares) {
+        float percent = session ? share.session : share.window;
+        if (percent < 0.5f) continue;
+        if (!result.empty()) result += " ";
+        result += share.label + " " + std::to_string((int)(percent + 0.5f)) + "%";
     }
+    return result.empty() ? "-" : result;
+}
+
+static std::string joinReasons(const std::vector<std::string>& reasons) {
+    std::string result;
+    for (const auto& reason : reasons) {
+        result += (result.empty() ? "" : " ") + reason;
+    }
+    return result;
+}
+
+// Engine share of one partition: its clients' GFX and compute usage, capped at 100%
+static int partitionBusy(const std::vector<ProcessInfo>& processes) {
+    float busy = 0;
+    for (const auto& proc : processes) {
+        busy += proc.gfx_usage + proc.compute_usage;
+    }
+    return (int)std::min(busy, 100.0f);
+}
+
+static std::string formatPartitionLine(const NodeSnapshot& node) {
+    std::stringstream ss;
+    ss << "XCP" << node.partition << ": " << node.processes.size() << " procs, busy "
+       << partitionBusy(node.processes) << "%, VRAM " << std::fixed << std::setprecision(1)
+       << node.metrics.memory_used / 1024.0f << "/" << node.metrics.memory_total / 1024.0f << "GB";
+    return ss.str();
+}
+
+// Phases with the most time first
+static std::vector<const PhaseStats*> sortPhases(const std::vector<PhaseStats>& phases) {
+    std::vector<const PhaseStats*> sorted;
+    for (const auto& phase : phases) {
+        sorted.push_back(&phase);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const PhaseStats* a, const PhaseStats* b) {
+        return a->time_ns > b->time_ns;
+    });
+    return sorted;
+}
+
+// Busiest (process, ring) pairs first
+static std::vector<const SchedLatency*> sortSchedLatencies(const std::vector<SchedLatency>& latencies) {
+    std::vector<const SchedLatency*> sorted;
+    for (const auto& latency : latencies) {
+        sorted.push_back(&latency);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const SchedLatency* a, const SchedLatency* b) {
+        return a->jobs_per_second > b->jobs_per_second;
+    });
+    return sorted;
+}
+
+// "1.25 s", "830 ms"
+static std::string formatSeconds(double seconds) {
+    std::stringstream ss;
+    if (seconds >= 1.0) {
+        ss << std::fixed << std::setprecision(2) << seconds << " s";
+    } else {
+        ss << std::fixed << std::setprecision(0) << seconds * 1e3 << " ms";
+    }
+    return ss.str();
+}
+
+Layout::Layout(SnapshotSource source) : source(std::move(source)) {
+    update();
+}
+
+void Layout::update() {
+    if (!source(snapshot)) return;
+
+    cluster = !snapshot.unreachable_hosts.empty() ||
+              (!snapshot.gpus.empty() && !snapshot.gpus[0].host.empty());
+
+    // Cluster rows name the agent and its own GPU index
+    gpu_labels.resize(snapshot.gpus.size());
+    size_t host_index = 0;
+    for (size_t i = 0; i < snapshot.gpus.size(); i++) {
+        if (!cluster) {
+            gpu_labels[i] = std::to_string(i);
+            continue;
+        }
+        host_index = i > 0 && snapshot.gpus[i].host == snapshot.gpus[i - 1].host ? host_index + 1 : 0;
+        gpu_labels[i] = snapshot.gpus[i].host + "/" + std::to_string(host_index);
+    }
+
+    std::vector<ProcessTable::Entry> entries;
+    for (size_t i = 0; i < snapshot.gpus.size(); i++) {
+        for (const auto& node : snapshot.gpus[i].nodes) {
+            for (const auto& proc : node.processes) {
+                entries.push_back({proc, i});
+            }
+        }
+    }
+    process_table.setEntries(std::move(entries));
 }
 
 Element Layout::renderGPUUsage(const GPUDevice::Metrics& metrics) {
@@ -36,9 +230,82 @@ Element Layout::renderMemoryUsage(const GPUDevice::Metrics& metrics) {
                          vram_ss.str() + cpu_vram_ss.str());
 }
 
+Element Layout::renderMemoryPressure(const GPUDevice::Metrics& metrics) {
+    std::stringstream gtt_ss;
+    gtt_ss << std::fixed << std::setprecision(1)
+           << "GTT: " << metrics.gtt_used / 1024.0f << "/" << metrics.gtt_total / 1024.0f << "GB"
+           << " | Evict: " << std::setprecision(0) << metrics.evictions_rate << "/s"
+           << " | Moved: " << formatRate(metrics.bytes_moved_rate)
+           << " | Faults: " << std::setprecision(0) << metrics.cpu_page_faults_rate << "/s | ";
+
+    Color pressure_color = metrics.eviction_pressure == GPUDevice::PRESSURE_SEVERE ? Color::Red :
+                           metrics.eviction_pressure == GPUDevice::PRESSURE_MODERATE ? Color::Yellow :
+                           Color::Green;
+
+    Elements line = {
+        text(gtt_ss.str()),
+        text(pressureName(metrics.eviction_pressure)) | bold | color(pressure_color)
+    };
+    if (metrics.vram_lost_counter > 0) {
+        line.push_back(text(" | VRAM lost: " + std::to_string(metrics.vram_lost_counter)) | color(Color::Red));
+    }
+    if (metrics.reset_count > 0) {
+        line.push_back(text(" | Resets: " + std::to_string(metrics.reset_count)) | color(Color::Red));
+    }
+    return hbox(line);
+}
+
+Element Layout::renderBlockUsage(const GPUDevice::Metrics& metrics) {
+    Elements blocks;
+    for (const auto& block : metrics.block_usage) {
+        if (!blocks.empty()) blocks.push_back(text(" "));
+        Color busy_color = block.busy >= 80.0f ? Color::Red :
+                           block.busy >= 30.0f ? Color::Yellow : Color::Default;
+        blocks.push_back(text(std::string(block.name) + " " + std::to_string((int)block.busy) + "%") |
+                         color(busy_color));
+    }
+    return hbox(blocks);
+}
+
+Element Layout::renderSensors(const GPUDevice::Metrics& metrics) {
+    Elements sensors = {
+        text("Fan: " + (metrics.fan_speed ? std::to_string(metrics.fan_speed) + " RPM" : std::string("-")) +
+             " (" + std::to_string(metrics.fan_pwm) + "%)"),
+        text(" | "),
+        text("VDD: " + std::to_string(metrics.voltage_gfx) + "/" +
+             std::to_string(metrics.voltage_northbridge) + " mV")
+    };
+
+    // Headroom to the power cap, red once the board is pinned against it
+    if (metrics.power_cap) {
+        int headroom = (int)metrics.power_cap - (int)metrics.power_usage;
+        Color headroom_color = headroom <= (int)metrics.power_cap / 20 ? Color::Red : Color::Default;
+        sensors.push_back(text(" | "));
+        sensors.push_back(text("Cap headroom: " + std::to_string(headroom) + "W") | color(headroom_color));
+    }
+    return hbox(sensors) | center;
+}
+
+Element Layout::renderResidency(const GPUDevice::Metrics& metrics) {
+    std::string window = std::to_string((int)ResidencyHistogram::DEFAULT_WINDOW_S) + "s";
+    Elements lines = {
+        text("SCLK " + window + ": " + formatShares(metrics.sclk_residency, false) +
+             " | MCLK " + window + ": " + formatShares(metrics.mclk_residency, false))
+    };
+
+    if (!metrics.throttle_residency.empty()) {
+        Elements throttle = {
+            text("Throttle " + window + ": " + formatShares(metrics.throttle_residency, false))
+        };
+        if (!metrics.throttle_reasons.empty()) {
+            throttle.push_back(text(" [" + joinReasons(metrics.throttle_reasons) + "]") | color(Color::Red));
+        }
+        lines.push_back(hbox(throttle));
+    }
+    return vbox(lines) | center;
+}
+
 Element Layout::renderUsageBar(const std::string& title, float value, uint32_t clock) {
-    auto size = Terminal::Size();
-    int bar_width = size.dimx - 4;
     float usage_fraction = value / 100.0f;
     int filled_width = static_cast<int>(usage_fraction * bar_width);
     
@@ -61,8 +328,6 @@ Element Layout::renderUsageBar(const std::string& title, float value, uint32_t c
 }
 
 Element Layout::renderUsageBar(const std::string& title, float value, const std::string& details) {
-    auto size = Terminal::Size();
-    int bar_width = size.dimx - 4;
     float usage_fraction = value / 100.0f;
     int filled_width = static_cast<int>(usage_fraction * bar_width);
     
@@ -82,45 +347,74 @@ Element Layout::renderUsageBar(const std::string& title, float value, const std:
     });
 }
 
-Element Layout::renderGPUBlock(const GPUDevice* device) {
-    if (!device) return text("") | border;  // Empty block for invalid device
+Element Layout::renderPartitions(const GPUSnapshot& gpu) {
+    Elements lines = {
+        text("Partitions: " + gpu.partition_mode) | bold
+    };
+    for (const auto& node : gpu.nodes) {
+        lines.push_back(text(formatPartitionLine(node)));
+    }
+    return vbox(lines);
+}
 
-    auto metrics = device->getMetrics();
+Element Layout::renderGPUBlock(const GPUSnapshot& gpu) {
+    const GPUDevice::Metrics& metrics = gpu.metrics;
     
     return vbox({
-        text(device->getMarketName()) | bold,
+        text(gpu.market_name) | bold,
         renderGPUUsage(metrics),
+        metrics.block_usage.empty() ? emptyElement() : renderBlockUsage(metrics),
         renderMemoryUsage(metrics),
+        renderMemoryPressure(metrics),
         hbox({
-            text(std::to_string(metrics.temperature) + "°C"),
+            text(formatTemperatures(metrics)),
+            text(" | "),
+            text(formatPower(metrics)),
             text(" | "),
-            text(std::to_string(metrics.power_usage) + "W"),
+            text(formatEnergy(metrics.energy)),
             text(" | "),
             text(std::to_string(metrics.gpu_clock) + "/" + 
                  std::to_string(metrics.memory_clock) + " MHz")
-        }) | center
+        }) | center,
+        renderSensors(metrics),
+        renderResidency(metrics),
+        gpu.nodes.size() > 1 ? renderPartitions(gpu) : emptyElement()
     }) | border;
 }
 
 Element Layout::renderGPUGrid() {
-    size_t gpu_count = gpu_stats.getGPUCount();
-    
-    // Using single block for single GPU
-    if (gpu_count == 1) {
-        return renderGPUBlock(gpu_stats.getGPU(0));
+    // Partitions are shown inside the block of their physical GPU
+    size_t gpu_count = snapshot.gpus.size();
+    if (gpu_count == 0) return emptyElement();
+    selected_gpu = std::min(selected_gpu, gpu_count - 1);
+
+    // As many blocks side by side as the terminal has room for; GPUs that would
+    // need more rows than that are shown as heatmap cells instead
+    size_t columns = std::min<size_t>(gpu_count, std::max(1, screen_width / GPU_BLOCK_WIDTH));
+    heatmap = gpu_count > columns * MAX_BLOCK_ROWS;
+    if (heatmap && !gpu_detail) {
+        return renderGPUHeatmap();
     }
-    
-    // Grid display logic for multiple GPUs
+    if (heatmap) {
+        bar_width = std::max(10, screen_width - 12);  // Panel and block borders, the percentage
+        return vbox({
+            text("GPU " + std::to_string(selected_gpu) + " of " + std::to_string(gpu_count) +
+                 "  (Left/Right: other GPUs, Esc: all GPUs)") | dim,
+            renderGPUBlock(snapshot.gpus[selected_gpu])
+        });
+    }
+
+    bar_width = std::max(10, screen_width / (int)columns - 12);
     std::vector<Element> rows;
-    size_t row_count = (gpu_count + GRID_COLUMNS - 1) / GRID_COLUMNS;  // Ceiling division
+    size_t row_count = (gpu_count + columns - 1) / columns;  // Ceiling division
     
     for (size_t row = 0; row < row_count; ++row) {
         std::vector<Element> gpu_blocks;
         
-        for (size_t col = 0; col < GRID_COLUMNS; ++col) {
-            size_t gpu_index = row * GRID_COLUMNS + col;
+        for (size_t col = 0; col < columns; ++col) {
+            size_t gpu_index = row * columns + col;
             if (gpu_index < gpu_count) {
-                gpu_blocks.push_back(renderGPUBlock(gpu_stats.getGPU(gpu_index)));
+                gpu_blocks.push_back(renderGPUBlock(snapshot.gpus[gpu_index]));
             } else {
                 gpu_blocks.push_back(text("") | border);  // Empty block for alignment
             }
@@ -132,111 +426,579 @@ Element Layout::renderGPUGrid() {
     return vbox(rows);
 }
 
-Element Layout::renderProcessTable() {
+// Background of a heatmap value, from idle to saturated
+static Color heatColor(float fraction) {
+    if (fraction >= 0.9f) return Color::Red;
+    if (fraction >= 0.7f) return Color::Yellow;
+    if (fraction >= 0.3f) return Color::Green;
+    if (fraction >= 0.05f) return Color::Blue;
+    return Color::GrayDark;
+}
+
+// GPU index, then usage, VRAM and temperature on their heat colors; the index
+// turns red while the GPU throttles or thrashes
+Element Layout::renderHeatmapCell(size_t index) {
+    const GPUDevice::Metrics& metrics = snapshot.gpus[index].metrics;
+    float vram = metrics.memory_total > 0 ? metrics.memory_used / metrics.memory_total : 0;
+    char label[8], usage[8], memory[8], temperature[8];
+    snprintf(label, sizeof(label), "%3zu ", index);
+    snprintf(usage, sizeof(usage), "%3d ", std::min(999, (int)metrics.gpu_usage));
+    snprintf(memory, sizeof(memory), "%3d ", std::min(999, (int)(vram * 100)));
+    snprintf(temperature, sizeof(temperature), "%3u ", std::min(999u, metrics.temperature));
+
+    bool alarm = !metrics.throttle_reasons.empty() || metrics.eviction_pressure == GPUDevice::PRESSURE_SEVERE;
+    Element name = text(label) | color(alarm ? Color::Red : Color::Default);
+    return hbox({
+        index == selected_gpu ? name | inverted : name,
+        text(usage) | bgcolor(heatColor(metrics.gpu_usage / 100.0f)) | color(Color::Black),
+        text(memory) | bgcolor(heatColor(vram)) | color(Color::Black),
+        text(temperature) | bgcolor(heatColor(metrics.temperature / HEATMAP_HOT_C)) | color(Color::Black)
+    });
+}
+
+// One cell per GPU, as many per row as fit: a few elements per GPU and no bars
+Element Layout::renderGPUHeatmap() {
+    size_t gpu_count = snapshot.gpus.size();
+    size_t columns = std::max(1, (screen_width - 2) / HEATMAP_CELL_WIDTH);
+
+    float usage = 0, memory_used = 0, memory_total = 0;
+    uint32_t power = 0;
+    size_t hottest = 0;
+    for (size_t i = 0; i < gpu_count; i++) {
+        const GPUDevice::Metrics& metrics = snapshot.gpus[i].metrics;
+        usage += metrics.gpu_usage;
+        memory_used += metrics.memory_used;
+        memory_total += metrics.memory_total;
+        power += metrics.power_usage;
+        if (metrics.temperature > snapshot.gpus[hottest].metrics.temperature) hottest = i;
+    }
+    std::stringstream summary;
+    summary << gpu_count << " GPUs, usage " << (int)(usage / gpu_count) << "%, VRAM " << std::fixed
+            << std::setprecision(0) << memory_used / 1024.0f << "/" << memory_total / 1024.0f << "GB, "
+            << power << "W, hottest GPU " << hottest << " at " << snapshot.gpus[hottest].metrics.temperature << "°C";
+
+    Elements rows;
+    for (size_t start = 0; start < gpu_count; start += columns) {
+        Elements cells;
+        for (size_t i = start; i < std::min(start + columns, gpu_count); i++) {
+            cells.push_back(renderHeatmapCell(i));
+        }
+        rows.push_back(hbox(std::move(cells)));
+    }
+
+    return vbox({
+        text(summary.str()) | bold,
+        vbox(std::move(rows)),
+        text("GPU usage% VRAM% °C   Left/Right: select, Enter: details") | dim
+    }) | border;
+}
+
+// One line per GPU of an agent: usage, VRAM, temperature and power
+Element Layout::renderClusterCell(const GPUSnapshot& gpu) {
+    const GPUDevice::Metrics& metrics = gpu.metrics;
+    std::stringstream ss;
+    ss << std::setw(3) << (int)metrics.gpu_usage << "% " << std::fixed << std::setprecision(0)
+       << metrics.memory_used / 1024.0f << "/" << metrics.memory_total / 1024.0f << "G "
+       << metrics.temperature << "°C " << metrics.power_usage << "W";
+
+    Color usage_color = metrics.gpu_usage >= 80.0f ? Color::Green :
+                        metrics.gpu_usage >= 20.0f ? Color::Yellow : Color::GrayDark;
+    return text(ss.str()) | color(usage_color) | size(WIDTH, EQUAL, CLUSTER_CELL_WIDTH);
+}
+
+// Agents down, their GPUs across
+Element Layout::renderClusterGrid() {
+    std::vector<Element> rows;
+    size_t hosts = 0;
+    for (size_t i = 0; i < snapshot.gpus.size(); hosts++) {
+        const std::string& host = snapshot.gpus[i].host;
+        Elements cells = {text(host) | bold | size(WIDTH, EQUAL, HOST_COLUMN_WIDTH)};
+        for (; i < snapshot.gpus.size() && snapshot.gpus[i].host == host; i++) {
+            cells.push_back(renderClusterCell(snapshot.gpus[i]));
+        }
+        rows.push_back(hbox(cells));
+    }
+    for (const auto& host : snapshot.unreachable_hosts) {
+        rows.push_back(hbox({
+            text(host) | bold | size(WIDTH, EQUAL, HOST_COLUMN_WIDTH),
+            text("unreachable") | color(Color::Red)
+        }));
+    }
+
+    std::string title = "Cluster: " + std::to_string(hosts) + "/" +
+                        std::to_string(hosts + snapshot.unreachable_hosts.size()) + " agents, " +
+                        std::to_string(snapshot.gpus.size()) + " GPUs";
+    return vbox({
+        text(title) | bold | center,
+        separator(),
+        vbox(rows)
+    }) | border;
+}
+
+Element Layout::renderLinkPanel() {
     std::vector<Element> rows;
 
-    // Add header
     rows.push_back(hbox({
-        text("PID") | size(WIDTH, EQUAL, 8),
-        text("Name") | size(WIDTH, EQUAL, 20),
-        text("GFX%") | size(WIDTH, EQUAL, 8),
-        text("CMP%") | size(WIDTH, EQUAL, 8),
-        text("ENC%") | size(WIDTH, EQUAL, 8),
-        text("DEC%") | size(WIDTH, EQUAL, 8),
-        text("VRAM") | size(WIDTH, EQUAL, 10)
+        text("GPU") | size(WIDTH, EQUAL, 5),
+        text("PCI") | size(WIDTH, EQUAL, 14),
+        text("PCIe") | size(WIDTH, EQUAL, 10),
+        text("Max") | size(WIDTH, EQUAL, 10),
+        text("RX") | size(WIDTH, EQUAL, 14),
+        text("TX") | size(WIDTH, EQUAL, 14),
+        text("BW") | size(WIDTH, EQUAL, 14),
+        text("XGMI") | size(WIDTH, EQUAL, 16),
+        text("XGMI Read") | size(WIDTH, EQUAL, 14),
+        text("XGMI Write") | size(WIDTH, EQUAL, 14)
     }) | bold);
 
-    // Add separator after header
-    rows.push_back(separator());
+    // With the GPUs as heatmap cells, one row per GPU would push the process table off the
+    // screen: only the GPU under the cursor, and where the busiest links are
+    size_t first = 0, last = snapshot.gpus.size();
+    if (heatmap && !snapshot.gpus.empty()) {
+        first = std::min(selected_gpu, snapshot.gpus.size() - 1);
+        last = first + 1;
+    }
 
-    // Get processes for each GPU
-    for (size_t i = 0; i < gpu_stats.getGPUCount(); ++i) {
-        const GPUDevice* device = gpu_stats.getGPU(i);
-        if (!device) continue;
+    for (size_t i = first; i < last; ++i) {
+        const GPUSnapshot& gpu = snapshot.gpus[i];
+        const LinkStats& link = gpu.metrics.link;
+        std::string xgmi = link.xgmi_width ?
+            "x" + std::to_string(link.xgmi_width) + " @ " + std::to_string(link.xgmi_speed) + " Gbps" : "-";
 
-        auto processes = device->getProcesses();
-        Logger::debug("Found " + std::to_string(processes.size()) + 
-                     " processes for GPU " + std::to_string(i));
+        rows.push_back(hbox({
+            text(std::to_string(i)) | size(WIDTH, EQUAL, 5),
+            text(gpu.pci_path) | size(WIDTH, EQUAL, 14),
+            text(formatPCIeLink(link.pcie_speed, link.pcie_width)) | size(WIDTH, EQUAL, 10) |
+                color(link.isDowngraded() ? Color::Red : Color::Default),
+            text(formatPCIeLink(link.pcie_max_speed, link.pcie_max_width)) | size(WIDTH, EQUAL, 10),
+            text(formatOptionalRate(link.pcie_rx_rate)) | size(WIDTH, EQUAL, 14),
+            text(formatOptionalRate(link.pcie_tx_rate)) | size(WIDTH, EQUAL, 14),
+            text(formatOptionalRate(link.pcie_bandwidth)) | size(WIDTH, EQUAL, 14),
+            text(xgmi) | size(WIDTH, EQUAL, 16),
+            text(formatOptionalRate(link.xgmi_read_rate)) | size(WIDTH, EQUAL, 14),
+            text(formatOptionalRate(link.xgmi_write_rate)) | size(WIDTH, EQUAL, 14)
+        }));
+    }
+    if (heatmap) {
+        rows.push_back(text(formatBusiestLinks()) | dim);
+    }
 
-        //Sort processes by memory usage
-        std::sort(processes.begin(), processes.end(), [](const ProcessInfo& a, const ProcessInfo& b) {
-            return a.memory_usage > b.memory_usage;
-        });
+    return vbox({
+        text("Links") | bold | center,
+        separator(),
+        vbox(rows)
+    }) | border;
+}
 
-        // Add each process to the table
-        for (const auto& proc : processes) {
-            rows.push_back(renderProcessRow(proc));
-            Logger::debug("Added process " + std::to_string(proc.pid) + 
-                         " to table with memory " + std::to_string(proc.memory_usage));
+// One line over all GPUs: the most loaded PCIe and XGMI links and how many PCIe links run downgraded
+std::string Layout::formatBusiestLinks() const {
+    size_t pcie_gpu = 0, xgmi_gpu = 0, downgraded = 0;
+    float pcie_max = -1, xgmi_max = -1;
+    for (size_t i = 0; i < snapshot.gpus.size(); ++i) {
+        const LinkStats& link = snapshot.gpus[i].metrics.link;
+        float pcie = std::max(link.pcie_rx_rate, 0.0f) + std::max(link.pcie_tx_rate, 0.0f);
+        float xgmi = std::max(link.xgmi_read_rate, 0.0f) + std::max(link.xgmi_write_rate, 0.0f);
+        if (link.pcie_rx_rate >= 0 && pcie > pcie_max) {
+            pcie_max = pcie;
+            pcie_gpu = i;
+        }
+        if (link.xgmi_width && xgmi > xgmi_max) {
+            xgmi_max = xgmi;
+            xgmi_gpu = i;
+        }
+        if (link.isDowngraded()) {
+            downgraded++;
         }
     }
 
+    std::string summary = std::to_string(snapshot.gpus.size()) + " GPUs, busiest PCIe: ";
+    summary += pcie_max < 0 ? "-" : "GPU " + std::to_string(pcie_gpu) + " " + formatRate(pcie_max);
+    summary += ", busiest XGMI: ";
+    summary += xgmi_max < 0 ? "-" : "GPU " + std::to_string(xgmi_gpu) + " " + formatRate(xgmi_max);
+    summary += ", " + std::to_string(downgraded) + " downgraded";
+    return summary;
+}
+
+Element Layout::renderPhasePanel() {
+    std::vector<Element> rows;
+
+    rows.push_back(hbox({
+        text("PID") | size(WIDTH, EQUAL, 8),
+        text("Phase") | size(WIDTH, EQUAL, 24),
+        text("Count") | size(WIDTH, EQUAL, 8),
+        text("Total") | size(WIDTH, EQUAL, 12),
+        text("Mean") | size(WIDTH, EQUAL, 12),
+        text("GPU%") | size(WIDTH, EQUAL, 6),
+        text("VRAM") | size(WIDTH, EQUAL, 12),
+        text("Peak") | size(WIDTH, EQUAL, 12)
+    }) | bold);
+
+    auto phases = sortPhases(snapshot.phases);
+    for (size_t i = 0; i < phases.size() && i < PHASE_ROWS; i++) {
+        const PhaseStats& phase = *phases[i];
+        double seconds = phase.time_ns / 1e9;
+        rows.push_back(hbox({
+            text(std::to_string(phase.pid)) | size(WIDTH, EQUAL, 8),
+            text(phase.name) | size(WIDTH, EQUAL, 24) | color(phase.active ? Color::Green : Color::Default),
+            text(std::to_string(phase.count)) | size(WIDTH, EQUAL, 8),
+            text(formatSeconds(seconds)) | size(WIDTH, EQUAL, 12),
+            text(phase.count ? formatSeconds(seconds / phase.count) : "-") | size(WIDTH, EQUAL, 12),
+            text(std::to_string((int)phase.getUsage())) | size(WIDTH, EQUAL, 6),
+            text(std::to_string((int)phase.getVRAM()) + " MiB") | size(WIDTH, EQUAL, 12),
+            text(std::to_string((int)phase.vram_peak) + " MiB") | size(WIDTH, EQUAL, 12)
+        }));
+    }
+
     return vbox({
-        text("GPU Processes") | bold | center,
+        text("Phases") | bold | center,
         separator(),
-        vbox(rows) | flex
+        vbox(rows)
     }) | border;
 }
 
-Element Layout::renderProcessRow(const ProcessInfo& proc) {
-    Logger::debug("Rendering process " + std::to_string(proc.pid) + 
-                 " with memory usage: " + std::to_string(proc.memory_usage) + " bytes");
+Element Layout::renderSchedPanel() {
+    std::vector<Element> rows;
+
+    rows.push_back(hbox({
+        text("PID") | size(WIDTH, EQUAL, 8),
+        text("Ring") | size(WIDTH, EQUAL, 16),
+        text("Jobs/s") | size(WIDTH, EQUAL, 10),
+        text("Jobs") | size(WIDTH, EQUAL, 10),
+        text("Queue p50") | size(WIDTH, EQUAL, 12),
+        text("Queue p99") | size(WIDTH, EQUAL, 12),
+        text("Exec p50") | size(WIDTH, EQUAL, 12),
+        text("Exec p99") | size(WIDTH, EQUAL, 12),
+        text("Total p99") | size(WIDTH, EQUAL, 12)
+    }) | bold);
+
+    auto latencies = sortSchedLatencies(snapshot.sched_latencies);
+    for (size_t i = 0; i < latencies.size() && i < SCHED_ROWS; i++) {
+        const SchedLatency& latency = *latencies[i];
+        std::stringstream rate;
+        rate << std::fixed << std::setprecision(1) << latency.jobs_per_second;
+        rows.push_back(hbox({
+            text(std::to_string(latency.pid)) | size(WIDTH, EQUAL, 8),
+            text(latency.ring) | size(WIDTH, EQUAL, 16),
+            text(rate.str()) | size(WIDTH, EQUAL, 10),
+            text(std::to_string(latency.jobs)) | size(WIDTH, EQUAL, 10),
+            text(formatLatency(latency.queue_p50_ns)) | size(WIDTH, EQUAL, 12),
+            text(formatLatency(latency.queue_p99_ns)) | size(WIDTH, EQUAL, 12),
+            text(formatLatency(latency.exec_p50_ns)) | size(WIDTH, EQUAL, 12),
+            text(formatLatency(latency.exec_p99_ns)) | size(WIDTH, EQUAL, 12),
+            text(formatLatency(latency.total_p99_ns)) | size(WIDTH, EQUAL, 12)
+        }));
+    }
+
+    return vbox({
+        text("Scheduler") | bold | center,
+        separator(),
+        vbox(rows)
+    }) | border;
+}
+
+Element Layout::renderProcessHeader(const std::string& title, ProcessTable::SortColumn column, int width) {
+    std::string label = title;
+    if (process_table.getSortColumn() == column) {
+        label += process_table.isDescending() ? " v" : " ^";
+    }
+    return text(label) | size(WIDTH, EQUAL, width);
+}
+
+Element Layout::renderProcessTable() {
+    std::vector<Element> rows;
+
+    // Only the rows that fit are ordered and built, sized from the previous frame
+    int box_height = process_box.y_max - process_box.y_min + 1;
+    size_t visible = box_height > 0 ? (size_t)box_height : DEFAULT_PROCESS_ROWS;
+    auto entries = process_table.getVisibleRows(visible);
+    size_t selected = process_table.getSelectedRow();
+    for (size_t i = 0; i < entries.size(); i++) {
+        rows.push_back(renderProcessRow(*entries[i], i == selected));
+    }
+    if (snapshot.processes_pending) {
+        rows.push_back(text("Scanning processes...") | dim);
+    }
+
+    std::string status = "Filter: " + process_table.getFilter() + (filter_editing ? "_" : "") +
+                         " | " + std::to_string(process_table.getMatchCount()) + "/" +
+                         std::to_string(process_table.getEntryCount()) + " clients";
+    if (process_table.getMatchCount() > 0) {
+        status += " | row " + std::to_string(process_table.getOffset() + selected + 1);
+    }
+    status += " | sort: p n u g c e d m t j x s w, r: reverse, /: filter";
+
+    return vbox({
+        text("GPU Processes") | bold | center,
+        separator(),
+        hbox({
+            renderProcessHeader("PID", ProcessTable::SORT_PID, 8),
+            renderProcessHeader("Name", ProcessTable::SORT_NAME, 20),
+            renderProcessHeader("GPU", ProcessTable::SORT_GPU, cluster ? HOST_COLUMN_WIDTH : 5),
+            renderProcessHeader("GFX%", ProcessTable::SORT_GFX, 8),
+            renderProcessHeader("CMP%", ProcessTable::SORT_COMPUTE, 8),
+            renderProcessHeader("ENC%", ProcessTable::SORT_ENC, 8),
+            renderProcessHeader("DEC%", ProcessTable::SORT_DEC, 8),
+            renderProcessHeader("VRAM", ProcessTable::SORT_VRAM, 10),
+            renderProcessHeader("GTT", ProcessTable::SORT_GTT, 10),
+            renderProcessHeader("Energy", ProcessTable::SORT_ENERGY, 10),
+            renderProcessHeader("CPU%", ProcessTable::SORT_CPU, 8),
+            renderProcessHeader("RSS", ProcessTable::SORT_RSS, 10),
+            text("THR") | size(WIDTH, EQUAL, 6),
+            text("IOW%") | size(WIDTH, EQUAL, 6),
+            renderProcessHeader("VRAM/h", ProcessTable::SORT_GROWTH, 10),
+            text("Full") | size(WIDTH, EQUAL, 7)
+        }) | bold,
+        separator(),
+        vbox(rows) | flex | reflect(process_box),
+        separator(),
+        text(status) | dim
+    }) | border | flex;
+}
+
+Element Layout::renderProcessRow(const ProcessTable::Entry& entry, bool selected) {
+    const ProcessInfo& proc = entry.proc;
 
     // Convert bytes to MiB
     float memory_mib = proc.memory_usage / (1024.0f * 1024.0f);
+    float gtt_mib = proc.gtt_usage / (1024.0f * 1024.0f);
+    float rss_mib = proc.rss / (1024.0f * 1024.0f);
 
-    return hbox({
+    // A saturated feeding thread next to an idle GPU points at a CPU-bound job
+    bool cpu_bound = proc.cpu_usage >= CPU_BOUND_PERCENT &&
+                     proc.gfx_usage + proc.compute_usage < GPU_STARVED_PERCENT;
+
+    auto row = hbox({
         text(std::to_string(proc.pid)) | size(WIDTH, EQUAL, 8),
         text(proc.name) | size(WIDTH, EQUAL, 20),
+        text(entry.gpu < gpu_labels.size() ? gpu_labels[entry.gpu] : "-") |
+            size(WIDTH, EQUAL, cluster ? HOST_COLUMN_WIDTH : 5),
         text(proc.gfx_usage > 0 ? std::to_string((int)proc.gfx_usage) + "%" : "-") | size(WIDTH, EQUAL, 8),
         text(proc.compute_usage > 0 ? std::to_string((int)proc.compute_usage) + "%" : "-") | size(WIDTH, EQUAL, 8),
         text(proc.enc_usage > 0 ? std::to_string((int)proc.enc_usage) + "%" : "-") | size(WIDTH, EQUAL, 8),
         text(proc.dec_usage > 0 ? std::to_string((int)proc.dec_usage) + "%" : "-") | size(WIDTH, EQUAL, 8),
-        text(proc.memory_usage > 0 ? std::to_string((int)memory_mib) + " MiB" : "-") | size(WIDTH, EQUAL, 10)
+        text(proc.memory_usage > 0 ? std::to_string((int)memory_mib) + " MiB" : "-") | size(WIDTH, EQUAL, 10),
+        text(proc.gtt_usage > 0 ? std::to_string((int)gtt_mib) + " MiB" : "-") | size(WIDTH, EQUAL, 10) |
+            color(proc.gtt_growing ? Color::Yellow : Color::Default),
+        text(proc.energy_joules > 0 ? formatEnergy(proc.energy_joules) : "-") | size(WIDTH, EQUAL, 10),
+        text(std::to_string((int)proc.cpu_usage) + "%") | size(WIDTH, EQUAL, 8) |
+            color(cpu_bound ? Color::Yellow : Color::Default),
+        text(proc.rss > 0 ? std::to_string((int)rss_mib) + " MiB" : "-") | size(WIDTH, EQUAL, 10),
+        text(std::to_string(proc.threads)) | size(WIDTH, EQUAL, 6),
+        text(proc.io_wait > 0 ? std::to_string((int)proc.io_wait) + "%" : "-") | size(WIDTH, EQUAL, 6),
+        // Sustained growth is what a leak looks like
+        text(formatGrowth(proc.vram_growth)) | size(WIDTH, EQUAL, 10) |
+            color(proc.vram_growing ? Color::Red : Color::Default),
+        text(formatTimeLeft(proc.vram_full_seconds)) | size(WIDTH, EQUAL, 7) |
+            color(proc.vram_growing ? Color::Red : Color::Default)
     });
+    return selected ? row | inverted : row;
+}
+
+bool Layout::handleEvent(const Event& event) {
+    if (filter_editing) {
+        std::string filter = process_table.getFilter();
+        if (event == Event::Return) {
+            filter_editing = false;
+        } else if (event == Event::Escape) {
+            filter_editing = false;
+            process_table.setFilter("");
+        } else if (event == Event::Backspace) {
+            if (!filter.empty()) {
+                filter.pop_back();
+                process_table.setFilter(filter);
+            }
+        } else if (event.is_character()) {
+            process_table.setFilter(filter + event.character());
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // Heatmap navigation and drill-down into one GPU
+    if (heatmap && !snapshot.gpus.empty()) {
+        if (event == Event::ArrowLeft) {
+            selected_gpu = selected_gpu > 0 ? selected_gpu - 1 : 0;
+            return true;
+        } else if (event == Event::ArrowRight) {
+            selected_gpu = std::min(selected_gpu + 1, snapshot.gpus.size() - 1);
+            return true;
+        } else if (event == Event::Return && !gpu_detail) {
+            gpu_detail = true;
+            return true;
+        } else if (event == Event::Escape && gpu_detail) {
+            gpu_detail = false;
+            return true;
+        }
+    }
+
+    long page = std::max(1, process_box.y_max - process_box.y_min + 1);
+    if (event == Event::ArrowUp) {
+        process_table.moveSelection(-1);
+    } else if (event == Event::ArrowDown) {
+        process_table.moveSelection(1);
+    } else if (event == Event::PageUp) {
+        process_table.moveSelection(-page);
+    } else if (event == Event::PageDown) {
+        process_table.moveSelection(page);
+    } else if (event == Event::Home) {
+        process_table.selectFirst();
+    } else if (event == Event::End) {
+        process_table.selectLast();
+    } else if (event == Event::Character('/')) {
+        filter_editing = true;
+    } else if (event == Event::Character('r')) {
+        process_table.sortBy(process_table.getSortColumn());
+    } else if (event.is_character()) {
+        static const std::pair<char, ProcessTable::SortColumn> keys[] = {
+            {'p', ProcessTable::SORT_PID}, {'n', ProcessTable::SORT_NAME}, {'u', ProcessTable::SORT_GPU},
+            {'g', ProcessTable::SORT_GFX}, {'c', ProcessTable::SORT_COMPUTE}, {'e', ProcessTable::SORT_ENC},
+            {'d', ProcessTable::SORT_DEC}, {'m', ProcessTable::SORT_VRAM}, {'t', ProcessTable::SORT_GTT},
+            {'j', ProcessTable::SORT_ENERGY}, {'x', ProcessTable::SORT_CPU}, {'s', ProcessTable::SORT_RSS},
+            {'w', ProcessTable::SORT_GROWTH},
+        };
+        for (const auto& key : keys) {
+            if (event.character() == std::string(1, key.first)) {
+                process_table.sortBy(key.second);
+                return true;
+            }
+        }
+        return false;
+    } else {
+        return false;
+    }
+    return true;
 }
 
 Element Layout::render() {
-    return vbox({
+    screen_width = Terminal::Size().dimx;
+    if (cluster) {
+        return vbox({
+            text("AMD GPU Cluster Monitor") | bold | center,
+            separator(),
+            renderClusterGrid(),
+            renderProcessTable()
+        }) | border;
+    }
+
+    Elements panels = {
         text("AMD GPU Monitor") | bold | center,
         separator(),
         renderGPUGrid(),
         separator(),
-        renderProcessTable()
-    }) | border;
+        renderLinkPanel()
+    };
+    if (!snapshot.sched_latencies.empty()) {
+        panels.push_back(renderSchedPanel());
+    }
+    if (!snapshot.phases.empty()) {
+        panels.push_back(renderPhasePanel());
+    }
+    panels.push_back(renderProcessTable());
+    return vbox(std::move(panels)) | border;
 }
 
 std::string Layout::getMetricsText() const {
     std::stringstream ss;
     
-    for (size_t i = 0; i < gpu_stats.getGPUCount(); i++) {
-        const GPUDevice* device = gpu_stats.getGPU(i);
-        if (!device) continue;
-        
-        ss << formatGPUMetrics(device) << "\n";
+    for (const auto& gpu : snapshot.gpus) {
+        if (!gpu.host.empty()) {
+            ss << "[" << gpu.host << "] ";
+        }
+        ss << formatGPUMetrics(gpu);
+        if (gpu.nodes.size() > 1) {
+            ss << formatPartitions(gpu);
+        }
+        ss << "\n";
         
-        auto processes = device->getProcesses();
+        std::vector<ProcessInfo> processes;
+        for (const auto& node : gpu.nodes) {
+            processes.insert(processes.end(), node.processes.begin(), node.processes.end());
+        }
         if (!processes.empty()) {
             ss << formatProcessInfo(processes) << "\n";
         }
     }
+    for (const auto& host : snapshot.unreachable_hosts) {
+        ss << "[" << host << "] unreachable\n";
+    }
+    if (!snapshot.sched_latencies.empty()) {
+        ss << formatSchedLatencies() << "\n";
+    }
+    if (!snapshot.phases.empty()) {
+        ss << formatPhases() << "\n";
+    }
     
     return ss.str();
 }
 
-std::string Layout::formatGPUMetrics(const GPUDevice* device) const {
-    auto metrics = device->getMetrics();
+std::string Layout::formatPartitions(const GPUSnapshot& gpu) const {
+    std::stringstream ss;
+    ss << "Partitions: " << gpu.partition_mode << "\n";
+    for (const auto& node : gpu.nodes) {
+        ss << "  " << formatPartitionLine(node) << "\n";
+    }
+    return ss.str();
+}
+
+std::string Layout::formatGPUMetrics(const GPUSnapshot& gpu) const {
+    const GPUDevice::Metrics& metrics = gpu.metrics;
     std::stringstream ss;
     
-    ss << "GPU: " << device->getMarketName() << "\n"
+    ss << "GPU: " << gpu.market_name << "\n"
        << "GPU Usage: " << metrics.gpu_usage << "% @ " << metrics.gpu_clock << " MHz\n"
        << "VRAM: " << std::fixed << std::setprecision(1)
        << metrics.memory_used / 1024.0f << "/"
        << metrics.memory_total / 1024.0f << "GB"
        << " [CPU: " << metrics.memory_cpu_accessible_used / 1024.0f << "/"
        << metrics.memory_cpu_accessible_total / 1024.0f << "GB]\n"
-       << "Temperature: " << metrics.temperature << "°C, Power: " 
-       << metrics.power_usage << "W\n";
+       << "GTT: " << metrics.gtt_used / 1024.0f << "/" << metrics.gtt_total / 1024.0f << "GB"
+       << ", Evictions: " << metrics.evictions_rate << "/s"
+       << ", Moved: " << formatRate(metrics.bytes_moved_rate)
+       << ", CPU faults: " << metrics.cpu_page_faults_rate << "/s"
+       << ", VRAM lost: " << metrics.vram_lost_counter
+       << ", Resets: " << metrics.reset_count
+       << ", Pressure: " << pressureName(metrics.eviction_pressure) << "\n";
+
+    if (!metrics.block_usage.empty()) {
+        ss << "Blocks:";
+        for (const auto& block : metrics.block_usage) {
+            ss << " " << block.name << " " << (int)block.busy << "%";
+        }
+        ss << "\n";
+    }
+
+    ss << "Temperature: " << metrics.temperature << "°C (junction " << metrics.temperature_junction
+       << "°C, memory " << metrics.temperature_memory << "°C), Power: "
+       << metrics.power_usage << "/" << metrics.power_cap << "W, Energy: " << formatEnergy(metrics.energy)
+       << (metrics.energy_from_accumulator ? "" : " (integrated)") << "\n"
+       << "Fan: " << metrics.fan_speed << " RPM (" << metrics.fan_pwm << "%), VDDGFX: "
+       << metrics.voltage_gfx << " mV, VDDNB: " << metrics.voltage_northbridge << " mV\n"
+       << "PCIe: " << formatPCIeLink(metrics.link.pcie_speed, metrics.link.pcie_width)
+       << " (max " << formatPCIeLink(metrics.link.pcie_max_speed, metrics.link.pcie_max_width) << ")"
+       << (metrics.link.isDowngraded() ? " DOWNGRADED" : "")
+       << ", RX: " << formatOptionalRate(metrics.link.pcie_rx_rate)
+       << ", TX: " << formatOptionalRate(metrics.link.pcie_tx_rate)
+       << ", BW: " << formatOptionalRate(metrics.link.pcie_bandwidth);
+    if (metrics.link.xgmi_width) {
+        ss << ", XGMI: x" << metrics.link.xgmi_width << " @ " << metrics.link.xgmi_speed << " Gbps"
+           << ", read " << formatOptionalRate(metrics.link.xgmi_read_rate)
+           << ", write " << formatOptionalRate(metrics.link.xgmi_write_rate)
+           << " over " << metrics.link.xgmi_links << " links";
+    }
+    ss << "\n";
+
+    int window = (int)ResidencyHistogram::DEFAULT_WINDOW_S;
+    ss << "SCLK residency: session " << formatShares(metrics.sclk_residency, true)
+       << ", last " << window << "s " << formatShares(metrics.sclk_residency, false) << "\n"
+       << "MCLK residency: session " << formatShares(metrics.mclk_residency, true)
+       << ", last " << window << "s " << formatShares(metrics.mclk_residency, false) << "\n";
+    if (!metrics.throttle_residency.empty()) {
+        ss << "Throttle residency: session " << formatShares(metrics.throttle_residency, true)
+           << ", last " << window << "s " << formatShares(metrics.throttle_residency, false)
+           << (metrics.throttle_reasons.empty() ? "" : ", active: " + joinReasons(metrics.throttle_reasons))
+           << "\n";
+    }
     
     return ss.str();
 }
@@ -245,7 +1007,7 @@ std::string Layout::formatProcessInfo(const std::vector<ProcessInfo>& processes)
     std::stringstream ss;
     
     ss << "Processes:\n"
-       << "PID\tName\t\tROCm\tGFX%\tCMP%\tENC%\tDEC%\tVRAM\n"
+       << "PID\tName\t\tROCm\tGFX%\tCMP%\tENC%\tDEC%\tVRAM\t\tGTT\t\tEnergy\tCPU%\tRSS\t\tTHR\tIOW%\tVRAM/h\t\tFull\n"
        << "------------------------------------------------------------\n";
     
     for (const auto& proc : processes) {
@@ -257,8 +1019,62 @@ std::string Layout::formatProcessInfo(const std::vector<ProcessInfo>& processes)
            << std::setw(3) << (int)proc.compute_usage << "\t"
            << std::setw(3) << (int)proc.enc_usage << "\t"
            << std::setw(3) << (int)proc.dec_usage << "\t"
-           << std::setw(5) << proc.memory_usage << "KiB\n";
+           << std::setw(5) << proc.memory_usage / 1024 << "KiB\t"
+           << std::setw(5) << proc.gtt_usage / 1024 << "KiB\t"
+           << formatEnergy(proc.energy_joules) << "\t"
+           << std::setw(3) << (int)proc.cpu_usage << "\t"
+           << std::setw(5) << proc.rss / 1024 << "KiB\t"
+           << proc.threads << "\t"
+           << std::setw(3) << (int)proc.io_wait << "\t"
+           << std::setw(9) << formatGrowth(proc.vram_growth) << (proc.vram_growing ? "!" : " ") << "\t"
+           << formatTimeLeft(proc.vram_full_seconds) << "\n";
     }
     
     return ss.str();
-} 
\ No newline at end of file
+} 
+
+std::string Layout::formatPhases() const {
+    std::stringstream ss;
+
+    ss << "Phases:\n"
+       << "PID\tPhase\t\t\tCount\tTotal\t\tMean\t\tGPU%\tVRAM\t\tPeak\n"
+       << "------------------------------------------------------------\n";
+
+    for (const PhaseStats* phase : sortPhases(snapshot.phases)) {
+        double seconds = phase->time_ns / 1e9;
+        ss << phase->pid << "\t"
+           << std::left << std::setw(16) << (phase->active ? phase->name + " *" : phase->name) << "\t"
+           << std::right
+           << phase->count << "\t"
+           << std::setw(10) << formatSeconds(seconds) << "\t"
+           << std::setw(10) << (phase->count ? formatSeconds(seconds / phase->count) : "-") << "\t"
+           << std::setw(3) << (int)phase->getUsage() << "\t"
+           << std::setw(5) << (int)phase->getVRAM() << "MiB\t"
+           << std::setw(5) << (int)phase->vram_peak << "MiB\n";
+    }
+
+    return ss.str();
+}
+
+std::string Layout::formatSchedLatencies() const {
+    std::stringstream ss;
+
+    ss << "Scheduler:\n"
+       << "PID\tRing\t\tJobs/s\tJobs\tQueue p50\tQueue p99\tExec p50\tExec p99\tTotal p99\n"
+       << "------------------------------------------------------------\n";
+
+    for (const SchedLatency* latency : sortSchedLatencies(snapshot.sched_latencies)) {
+        ss << latency->pid << "\t"
+           << std::left << std::setw(16) << latency->ring << "\t"
+           << std::right << std::fixed << std::setprecision(1)
+           << latency->jobs_per_second << "\t"
+           << latency->jobs << "\t"
+           << std::setw(10) << formatLatency(latency->queue_p50_ns) << "\t"
+           << std::setw(10) << formatLatency(latency->queue_p99_ns) << "\t"
+           << std::setw(10) << formatLatency(latency->exec_p50_ns) << "\t"
+           << std::setw(10) << formatLatency(latency->exec_p99_ns) << "\t"
+           << std::setw(10) << formatLatency(latency->total_p99_ns) << "\n";
+    }
+
+    return ss.str();
+}
@@ -0,0 +1,104 @@
+#include "link_sampler.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include "logger.hpp"
+
+LinkSampler::~LinkSampler() {
+    stop();
+    if (pcie_bw_thread.joinable()) {
+        pcie_bw_thread.join();
+    }
+}
+
+bool LinkSampler::open(const std::string& device_path) {
+    current_speed.open(device_path + "/current_link_speed");
+    current_width.open(device_path + "/current_link_width");
+    max_speed.open(device_path + "/max_link_speed");
+    max_width.open(device_path + "/max_link_width");
+
+    if (pcie_bw.open(device_path + "/pcie_bw")) {
+        running = true;
+        pcie_bw_thread = std::thread(&LinkSampler::runPCIeBandwidth, this);
+    }
+    return current_speed.isOpen();
+}
+
+// "16.0 GT/s PCIe" -> 16.0, "Unknown" -> 0
+float LinkSampler::readSpeed(const SysfsFile& file) {
+    std::string value;
+    if (!file.readString(value)) return 0;
+    return strtof(value.c_str(), nullptr);
+}
+
+void LinkSampler::runPCIeBandwidth() {
+    while (running) {
+        // "<received packets> <sent packets> <max payload size>" over a one second window
+        char buf[128];
+        ssize_t count = pcie_bw.read(buf, sizeof(buf) - 1);
+        if (count <= 0) {
+            Logger::debug("pcie_bw is not supported, stopping PCIe bandwidth sampling");
+            break;
+        }
+        buf[count] = '\0';
+
+        unsigned long long received, sent;
+        int mps;
+        if (sscanf(buf, "%llu %llu %i", &received, &sent, &mps) != 3) break;
+
+        std::lock_guard<std::mutex> lock(pcie_bw_mutex);
+        pcie_rx_rate = (float)received * mps;
+        pcie_tx_rate = (float)sent * mps;
+    }
+    running = false;
+}
+
+void LinkSampler::update(const GPUMetricsTable* table, double elapsed, LinkStats& stats) {
+    int64_t width;
+    stats.pcie_speed = readSpeed(current_speed);
+    stats.pcie_max_speed = readSpeed(max_speed);
+    stats.pcie_width = current_width.readInt(width) ? width : 0;
+    stats.pcie_max_width = max_width.readInt(width) ? width : 0;
+
+    // Endpoints without link attributes still report the trained link to the SMU
+    if (table && table->has_pcie_link && stats.pcie_speed == 0) {
+        stats.pcie_speed = table->pcie_link_speed / 10.0f;
+        stats.pcie_width = table->pcie_link_width;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pcie_bw_mutex);
+        stats.pcie_rx_rate = pcie_rx_rate;
+        stats.pcie_tx_rate = pcie_tx_rate;
+    }
+
+    if (table && table->has_pcie_bandwidth) {
+        stats.pcie_bandwidth = table->pcie_bandwidth_inst * 1e9f;
+    }
+
+    if (!table || !table->has_xgmi) return;
+
+    stats.xgmi_width = table->xgmi_link_width;
+    stats.xgmi_speed = table->xgmi_link_speed;
+
+    if (has_xgmi_sample && elapsed > 0) {
+        uint64_t read_kb = 0, write_kb = 0;
+        stats.xgmi_links = 0;
+        for (int i = 0; i < GPUMetricsTable::MAX_XGMI_LINKS; i++) {
+            uint64_t link_read = table->xgmi_read_data_acc[i] >= last_xgmi_read[i] ?
+                                 table->xgmi_read_data_acc[i] - last_xgmi_read[i] : 0;
+            uint64_t link_write = table->xgmi_write_data_acc[i] >= last_xgmi_write[i] ?
+                                  table->xgmi_write_data_acc[i] - last_xgmi_write[i] : 0;
+            if (link_read || link_write) stats.xgmi_links++;
+            read_kb += link_read;
+            write_kb += link_write;
+        }
+        stats.xgmi_read_rate = read_kb * 1024.0 / elapsed;
+        stats.xgmi_write_rate = write_kb * 1024.0 / elapsed;
+    }
+
+    for (int i = 0; i < GPUMetricsTable::MAX_XGMI_LINKS; i++) {
+        last_xgmi_read[i] = table->xgmi_read_data_acc[i];
+        last_xgmi_write[i] = table->xgmi_write_data_acc[i];
+    }
+    has_xgmi_sample = true;
+}
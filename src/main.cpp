@@ -5,21 +5,264 @@
 #include "layout.hpp"
 #include <atomic>
 #include <iostream>
+#include <map>
+#include <cerrno>
+#include <cstdio>
 #include <cstring>
+#include <csignal>
+#include <fstream>
+#include "cluster.hpp"
+#include "compare.hpp"
+#include "flight_recorder.hpp"
 #include "logger.hpp"
+#include "rules.hpp"
+#include "sched_trace.hpp"
+#include "sampler_thread.hpp"
+#include "snapshot.hpp"
 
 using namespace ftxui;
 
+static std::atomic<bool> daemon_running(true);
+
+static void stopDaemon(int) {
+    daemon_running = false;
+}
+
+// Next wakeup of a headless loop: every second, earlier when adaptive sampling has something due
+static std::chrono::steady_clock::time_point nextWakeup(const GPUStats& gpu_stats,
+                                                        std::chrono::steady_clock::time_point next) {
+    next += std::chrono::seconds(1);
+    return gpu_stats.isAdaptive() ? std::min(next, gpu_stats.getNextSampleTime()) : next;
+}
+
 void printTextMode(Layout& layout) {
     auto metrics = layout.getMetricsText();
     std::cout << metrics << std::endl;
 }
 
+// Headless sampling loop, used to keep the accounting ledger up to date
+void runDaemon(GPUStats& gpu_stats) {
+    signal(SIGINT, stopDaemon);
+    signal(SIGTERM, stopDaemon);
+
+    auto next = std::chrono::steady_clock::now();
+    while (daemon_running) {
+        gpu_stats.updateDue();
+        next = std::max(nextWakeup(gpu_stats, next), std::chrono::steady_clock::now());
+        std::this_thread::sleep_until(next);
+    }
+}
+
+// Sample until an alert rule fires (exit status 2) or seconds are up (0), for health checks
+int runProbe(GPUStats& gpu_stats, unsigned seconds) {
+    signal(SIGINT, stopDaemon);
+    signal(SIGTERM, stopDaemon);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    auto next = std::chrono::steady_clock::now();
+    while (daemon_running) {
+        gpu_stats.updateDue();
+        if (gpu_stats.getRuleEngine()->getFiredCount() > 0) {
+            return 2;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+        next = std::min(std::max(nextWakeup(gpu_stats, next), std::chrono::steady_clock::now()), deadline);
+        std::this_thread::sleep_until(next);
+    }
+    return 0;
+}
+
+// Rules of a --rules file, one per line; blank lines and # comments are skipped
+static bool readRules(const std::string& path, std::vector<std::string>& rules) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line[start] == '#') continue;
+        rules.push_back(line.substr(start, line.find_last_not_of(" \t\r") + 1 - start));
+    }
+    return true;
+}
+
+// Headless sampling loop serving snapshots to aggregators
+void runAgent(GPUStats& gpu_stats, SnapshotAgent& agent) {
+    signal(SIGINT, stopDaemon);
+    signal(SIGTERM, stopDaemon);
+
+    Snapshot snapshot;
+    auto next = std::chrono::steady_clock::now();
+    while (daemon_running) {
+        gpu_stats.updateDue();
+        gpu_stats.getSnapshot(snapshot);
+        agent.publish(snapshot);
+
+        next = nextWakeup(gpu_stats, next);
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - std::chrono::steady_clock::now());
+        agent.poll(std::max<long>(0, wait.count()));
+    }
+}
+
+// Latency distributions of a scheduler trace recording, per process and ring and per ring
+static void printSchedReport(const SchedTraceDecoder& decoder) {
+    std::map<std::string, SchedJobStats> rings;
+    for (const auto& entry : decoder.getStats()) {
+        const SchedJobStats& stats = entry.second;
+        SchedJobStats& ring = rings[stats.ring];
+        ring.ring = stats.ring;
+        ring.queue.merge(stats.queue);
+        ring.exec.merge(stats.exec);
+        ring.total.merge(stats.total);
+    }
+
+    auto printStats = [](const std::string& label, const SchedJobStats& stats) {
+        std::cout << label << "  " << stats.total.getCount() << " jobs\n";
+        const std::pair<const char*, const LatencyHistogram*> stages[] = {
+            {"submit->run", &stats.queue}, {"run->done", &stats.exec}, {"submit->done", &stats.total}};
+        for (const auto& stage : stages) {
+            const LatencyHistogram& histogram = *stage.second;
+            char line[160];
+            snprintf(line, sizeof(line), "  %-13s mean %-10s p50 %-10s p90 %-10s p99 %-10s max %s\n", stage.first,
+                     formatLatency((uint64_t)histogram.getMean()).c_str(),
+                     formatLatency(histogram.getPercentile(50)).c_str(),
+                     formatLatency(histogram.getPercentile(90)).c_str(),
+                     formatLatency(histogram.getPercentile(99)).c_str(),
+                     formatLatency(histogram.getMax()).c_str());
+            std::cout << line;
+        }
+    };
+
+    for (const auto& entry : decoder.getStats()) {
+        printStats("pid " + std::to_string(entry.second.pid) + " " + entry.second.ring, entry.second);
+    }
+    for (const auto& ring : rings) {
+        printStats("ring " + ring.first, ring.second);
+    }
+    if (decoder.getLostPages() || decoder.getStaleJobs()) {
+        std::cout << decoder.getLostPages() << " pages with lost events, "
+                  << decoder.getStaleJobs() << " jobs left incomplete\n";
+    }
+}
+
+// amdgpu-top compare A B [options]: argv holds what follows "compare"
+static int runCompare(int argc, char* argv[]) {
+    std::vector<std::string> recordings;
+    CompareOptions options;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--align") == 0 && i + 1 < argc) {
+            ++i;
+            if (strcmp(argv[i], "time") != 0 && strcmp(argv[i], "phase") != 0) {
+                std::cerr << "Invalid alignment " << argv[i] << ", expected time or phase" << std::endl;
+                return 1;
+            }
+            options.by_phase = strcmp(argv[i], "phase") == 0;
+        } else if (strcmp(argv[i], "--skip") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%lf", &options.skip_s) != 1 || options.skip_s < 0) {
+                std::cerr << "Invalid skip " << argv[i] << ", expected seconds" << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%lf", &options.duration_s) != 1 || options.duration_s <= 0) {
+                std::cerr << "Invalid duration " << argv[i] << ", expected seconds" << std::endl;
+                return 1;
+            }
+        } else if (argv[i][0] != '-') {
+            recordings.push_back(argv[i]);
+        } else {
+            std::cerr << "Unknown compare option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (recordings.size() != 2) {
+        std::cerr << "Usage: amdgpu-top compare A B [--align time|phase] [--skip S] [--duration S]" << std::endl;
+        return 1;
+    }
+
+    std::string error;
+    if (!compareRecordings(recordings[0], recordings[1], options, stdout, error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Busy percentages of a --blocks-record register dump
+static int replayBlocks(const char* path) {
+    FILE* file = fopen(path, "re");
+    if (!file) {
+        std::cerr << "Cannot open " << path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    std::vector<BlockUsage> usage;
+    uint64_t samples = 0;
+    std::string error;
+    bool ok = replayBlockDump(file, usage, samples, error);
+    fclose(file);
+    if (!ok) {
+        std::cerr << path << ": " << error << std::endl;
+        return 1;
+    }
+
+    std::cout << path << "  " << samples << " samples\n";
+    for (const auto& block : usage) {
+        char line[64];
+        snprintf(line, sizeof(line), "  %-8s %5.1f%%\n", block.name, block.busy);
+        std::cout << line;
+    }
+    return 0;
+}
+
+static std::vector<std::string> splitHosts(const std::string& list) {
+    std::vector<std::string> hosts;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        if (end > start) hosts.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+    return hosts;
+}
+
 void printUsage() {
     std::cout << "Usage: amdgpu-top [OPTIONS]\n"
+              << "       amdgpu-top compare A B [--align time|phase] [--skip S] [--duration S]\n"
+              << "                      Compare two recordings (.agtn, --trace JSON or CSV), aligned by time\n"
+              << "                      from the start or by phase markers\n"
               << "Options:\n"
-              << "  -t, --text     Text-only mode\n"
-              << "  -h, --help     Show this help message\n";
+              << "  -t, --text          Text-only mode\n"
+              << "  -D, --daemon        Sample without output (use with --ledger)\n"
+              << "  -l, --ledger FILE   Append per-process/cgroup GPU accounting to FILE\n"
+              << "  -b, --blocks [HZ]   Sample GRBM/SRBM block busy bits (default 1000 Hz)\n"
+              << "  --blocks-record DIR  Write the sampled status registers of each GPU to DIR\n"
+              << "  --blocks-replay FILE  Print the block busy percentages of a register dump and exit\n"
+              << "  -r, --residency FILE  Export clock/throttle residency histograms to FILE\n"
+              << "  -p, --publish [NAME]  Publish snapshots to shared memory (default " << SHM_SNAPSHOT_DEFAULT_NAME << ")\n"
+              << "  -a, --attach [NAME]   Show the snapshots another instance publishes\n"
+              << "  --agent [ADDR]      Serve snapshots over TCP (default port " << AGENT_DEFAULT_PORT << ") or a Unix socket path\n"
+              << "  --aggregate LIST    Show the agents in LIST (host[:port] or socket paths, comma separated)\n"
+              << "  -F, --flight TRIGGER  Keep recent samples in memory, dump them when TRIGGER holds\n"
+              << "                      (e.g. \"gpu_usage < 10% and vram > 90% for 5s\")\n"
+              << "  --flight-dir DIR    Write flight recordings to DIR (default .)\n"
+              << "  --flight-window PRE,POST  Seconds kept before and after the trigger (default 30,30)\n"
+              << "  --annotate [NAME]   Take phase markers from workloads (socket name, default " << ANNOTATION_DEFAULT_NAME << ")\n"
+              << "  --sched [DIR]       GPU scheduler job latencies from tracepoints (recorded to DIR if given)\n"
+              << "  --sched-replay DIR  Print the job latencies of a --sched recording and exit\n"
+              << "  --trace FILE        Write GPU and per-process timelines to FILE (Chrome JSON, for Perfetto)\n"
+              << "  --adaptive [MIN,MAX]  Sample each GPU and the process scan faster while their metrics move,\n"
+              << "                      every MIN to MAX ms (default 250,8000)\n"
+              << "  --cpu-budget PERCENT  CPU time adaptive sampling may use, in percent of one CPU (default 1)\n"
+              << "  --alert RULE        Log when RULE holds (e.g. \"gpu.temperature > 95C for 30s\", \"rate(proc.vram) > 1GiB/min\"),\n"
+              << "                      may be repeated\n"
+              << "  --rules FILE        Alert rules from FILE, one per line\n"
+              << "  --alert-exec CMD    Run CMD through /bin/sh when an alert fires or clears\n"
+              << "  --alert-log FILE    Append fired and cleared alerts to FILE (default stderr without the TUI)\n"
+              << "  --probe SECONDS     Sample for SECONDS without output, exit with 2 as soon as an alert fires\n"
+              << "  -h, --help          Show this help message\n";
 }
 
 int main(int argc, char* argv[]) {
@@ -29,11 +272,129 @@ int main(int argc, char* argv[]) {
     #endif
 
     bool text_mode = false;
+    bool daemon_mode = false;
+    std::string ledger_path;
+    unsigned block_rate_hz = 0;
+    std::string block_record_dir;
+    std::string residency_path;
+    std::string publish_name;
+    std::string attach_name;
+    std::string agent_address;
+    std::vector<std::string> aggregate_hosts;
+    std::string trace_path;
+    std::string annotation_name;
+    bool sched_trace = false;
+    bool adaptive = false;
+    unsigned adaptive_min_ms = AdaptiveRate::DEFAULT_MIN_NS / 1000000;
+    unsigned adaptive_max_ms = AdaptiveRate::DEFAULT_MAX_NS / 1000000;
+    float cpu_budget = 1.0f;
+    std::string sched_record_dir;
+    std::string flight_trigger;
+    std::string flight_dir = ".";
+    unsigned flight_pre_s = 30;
+    unsigned flight_post_s = 30;
+    std::vector<std::string> alert_rules;
+    std::string alert_exec;
+    std::string alert_log_path;
+    unsigned probe_s = 0;
+    FILE* alert_log = nullptr;  // --alert-log, open until exit
+
+    if (argc >= 2 && strcmp(argv[1], "compare") == 0) {
+        return runCompare(argc - 2, argv + 2);
+    }
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--text") == 0) {
             text_mode = true;
+        } else if (strcmp(argv[i], "-D") == 0 || strcmp(argv[i], "--daemon") == 0) {
+            daemon_mode = true;
+        } else if ((strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--ledger") == 0) && i + 1 < argc) {
+            ledger_path = argv[++i];
+        } else if ((strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--residency") == 0) && i + 1 < argc) {
+            residency_path = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--blocks") == 0) {
+            block_rate_hz = BlockSampler::DEFAULT_RATE_HZ;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) {
+                block_rate_hz = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--blocks-record") == 0 && i + 1 < argc) {
+            block_record_dir = argv[++i];
+        } else if (strcmp(argv[i], "--blocks-replay") == 0 && i + 1 < argc) {
+            return replayBlocks(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--publish") == 0) {
+            publish_name = SHM_SNAPSHOT_DEFAULT_NAME;
+            if (i + 1 < argc && argv[i + 1][0] == '/') {
+                publish_name = argv[++i];
+            }
+        } else if (strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "--attach") == 0) {
+            attach_name = SHM_SNAPSHOT_DEFAULT_NAME;
+            if (i + 1 < argc && argv[i + 1][0] == '/') {
+                attach_name = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--agent") == 0) {
+            agent_address = ":" + std::to_string(AGENT_DEFAULT_PORT);
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                agent_address = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--aggregate") == 0 && i + 1 < argc) {
+            aggregate_hosts = splitHosts(argv[++i]);
+        } else if ((strcmp(argv[i], "-F") == 0 || strcmp(argv[i], "--flight") == 0) && i + 1 < argc) {
+            flight_trigger = argv[++i];
+        } else if (strcmp(argv[i], "--flight-dir") == 0 && i + 1 < argc) {
+            flight_dir = argv[++i];
+        } else if (strcmp(argv[i], "--flight-window") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%u,%u", &flight_pre_s, &flight_post_s) != 2) {
+                std::cerr << "Invalid flight window " << argv[i] << ", expected PRE,POST" << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--annotate") == 0) {
+            annotation_name = ANNOTATION_DEFAULT_NAME;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                annotation_name = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--sched") == 0) {
+            sched_trace = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                sched_record_dir = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--sched-replay") == 0 && i + 1 < argc) {
+            SchedTraceDecoder decoder;
+            if (!replaySchedTrace(argv[++i], decoder)) {
+                std::cerr << "Cannot replay " << argv[i] << std::endl;
+                return 1;
+            }
+            printSchedReport(decoder);
+            return 0;
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            adaptive = true;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) {
+                if (sscanf(argv[++i], "%u,%u", &adaptive_min_ms, &adaptive_max_ms) != 2 || adaptive_min_ms == 0 ||
+                    adaptive_max_ms < adaptive_min_ms) {
+                    std::cerr << "Invalid sampling intervals " << argv[i] << ", expected MIN,MAX in ms" << std::endl;
+                    return 1;
+                }
+            }
+        } else if (strcmp(argv[i], "--cpu-budget") == 0 && i + 1 < argc) {
+            cpu_budget = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--alert") == 0 && i + 1 < argc) {
+            alert_rules.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+            if (!readRules(argv[++i], alert_rules)) {
+                std::cerr << "Cannot read rules from " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--alert-exec") == 0 && i + 1 < argc) {
+            alert_exec = argv[++i];
+        } else if (strcmp(argv[i], "--alert-log") == 0 && i + 1 < argc) {
+            alert_log_path = argv[++i];
+        } else if (strcmp(argv[i], "--probe") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%u", &probe_s) != 1 || probe_s == 0) {
+                std::cerr << "Invalid probe duration " << argv[i] << ", expected seconds" << std::endl;
+                return 1;
+            }
         } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             printUsage();
             return 0;
@@ -41,11 +402,132 @@ int main(int argc, char* argv[]) {
     }
 
     try {
-        Layout layout;
+        GPUStats gpu_stats;
+        SamplerThread sampler(gpu_stats);
+        ShmSnapshotReader reader;
+        uint64_t attached_sequence = 0;
+        ClusterAggregator aggregator(aggregate_hosts);
+        Layout::SnapshotSource source;
+
+        if (!aggregate_hosts.empty()) {
+            if (!aggregator.start()) {
+                throw std::runtime_error("Failed to start the aggregator");
+            }
+            source = [&](Snapshot& snapshot) {
+                return aggregator.getSnapshot(snapshot);
+            };
+        } else if (!attach_name.empty()) {
+            if (!reader.open(attach_name)) {
+                throw std::runtime_error("No snapshots published at " + attach_name);
+            }
+            source = [&](Snapshot& snapshot) {
+                // Snapshots stop advancing when the publisher restarted or went away
+                if (reader.getSequence() == attached_sequence && reader.isReplaced()) {
+                    reader.open(attach_name);
+                }
+                attached_sequence = reader.getSequence();
+                return readSharedSnapshot(reader, snapshot);
+            };
+        } else {
+            if (!gpu_stats.initialize()) {
+                throw std::runtime_error("Failed to initialize AMD GPU monitoring");
+            }
+            if (!ledger_path.empty() && !gpu_stats.openLedger(ledger_path)) {
+                throw std::runtime_error("Failed to open ledger " + ledger_path);
+            }
+            if (!block_record_dir.empty() && !block_rate_hz) {
+                block_rate_hz = BlockSampler::DEFAULT_RATE_HZ;
+            }
+            if (block_rate_hz && !gpu_stats.startBlockSampling(block_rate_hz, block_record_dir)) {
+                std::cerr << "Block sampling is not available on these GPUs" << std::endl;
+            }
+            if (adaptive) {
+                gpu_stats.setAdaptiveSampling(adaptive_min_ms, adaptive_max_ms, cpu_budget);
+            }
+            if (!residency_path.empty()) {
+                gpu_stats.exportResidency(residency_path);
+            }
+            if (!publish_name.empty() && !gpu_stats.publishSnapshots(publish_name)) {
+                throw std::runtime_error("Failed to publish snapshots to " + publish_name);
+            }
+            if (!annotation_name.empty() && !gpu_stats.collectAnnotations(annotation_name)) {
+                throw std::runtime_error("Failed to open the annotation socket " + annotation_name);
+            }
+            if (sched_trace && !gpu_stats.startSchedTrace(sched_record_dir)) {
+                throw std::runtime_error("Failed to trace the GPU scheduler (needs access to tracefs)");
+            }
+            if (!trace_path.empty() && !gpu_stats.startTrace(trace_path)) {
+                throw std::runtime_error("Failed to open trace " + trace_path);
+            }
+            if (!flight_trigger.empty()) {
+                FlightTrigger trigger;
+                std::string error;
+                if (!trigger.parse(flight_trigger, error)) {
+                    throw std::runtime_error("Invalid flight trigger \"" + flight_trigger + "\": " + error);
+                }
+                if (!gpu_stats.startFlightRecorder(trigger, flight_dir, flight_pre_s, flight_post_s)) {
+                    throw std::runtime_error("Failed to start the flight recorder");
+                }
+            }
+            if (probe_s && alert_rules.empty()) {
+                throw std::runtime_error("--probe needs alert rules to check");
+            }
+            for (const auto& rule : alert_rules) {
+                std::string error;
+                if (!gpu_stats.addAlertRule(rule, alert_exec, error)) {
+                    throw std::runtime_error("Invalid alert rule \"" + rule + "\": " + error);
+                }
+            }
+            if (!alert_log_path.empty()) {
+                alert_log = fopen(alert_log_path.c_str(), "a");
+                if (!alert_log) {
+                    throw std::runtime_error("Failed to open alert log " + alert_log_path);
+                }
+                gpu_stats.setAlertLog(alert_log);
+            } else if (!alert_rules.empty() && (text_mode || daemon_mode || probe_s || !agent_address.empty())) {
+                // The TUI owns the terminal, elsewhere alerts go to stderr
+                gpu_stats.setAlertLog(stderr);
+            }
+            gpu_stats.watchDevices();
+
+            if (probe_s) {
+                return runProbe(gpu_stats, probe_s);
+            }
+            if (!agent_address.empty()) {
+                SnapshotAgent agent(agent_address);
+                if (!agent.open()) {
+                    throw std::runtime_error("Failed to serve snapshots on " + agent_address);
+                }
+                runAgent(gpu_stats, agent);
+                return 0;
+            }
+            if (daemon_mode) {
+                runDaemon(gpu_stats);
+                return 0;
+            }
+            if (text_mode) {
+                // Give the first printed sample engine usage deltas instead of 0%
+                gpu_stats.update();
+                std::this_thread::sleep_for(SamplerThread::PRIME_INTERVAL);
+                source = [&](Snapshot& snapshot) {
+                    gpu_stats.updateDue();
+                    gpu_stats.getSnapshot(snapshot);
+                    return true;
+                };
+            } else {
+                // The TUI comes up at once and fills in as the sampler thread delivers
+                source = [&](Snapshot& snapshot) {
+                    return sampler.takeSnapshot(snapshot);
+                };
+            }
+        }
+
+        Layout layout(source);
 
         if (text_mode) {
             // Text mode: continuously print stats
             while (true) {
+                layout.update();
                 printTextMode(layout);
                 std::this_thread::sleep_for(std::chrono::seconds(1));
             }
@@ -57,23 +539,40 @@ int main(int argc, char* argv[]) {
                 return layout.render() | flex;
             });
 
-            auto component = Container::Vertical({
+            auto component = CatchEvent(Container::Vertical({
                 renderer
+            }), [&](Event event) {
+                return layout.handleEvent(event);
             });
 
+            auto refresh = [&] {
+                screen.Post([&] {
+                    layout.update();
+                    screen.RequestAnimationFrame();
+                });
+            };
+
             std::atomic<bool> refresh_ui = true;
-            std::thread refresh_thread([&] {
-                while (refresh_ui) {
-                    using namespace std::chrono_literals;
-                    std::this_thread::sleep_for(1s);
-                    screen.Post([&] { screen.RequestAnimationFrame(); });
-                }
-            });
+            std::thread refresh_thread;
+            if (attach_name.empty() && aggregate_hosts.empty()) {
+                sampler.start(refresh);
+            } else {
+                refresh_thread = std::thread([&] {
+                    while (refresh_ui) {
+                        using namespace std::chrono_literals;
+                        std::this_thread::sleep_for(1s);
+                        refresh();
+                    }
+                });
+            }
 
             screen.Loop(component);
             
             refresh_ui = false;
-            refresh_thread.join();
+            sampler.stop();
+            if (refresh_thread.joinable()) {
+                refresh_thread.join();
+            }
         }
 
     } catch (const std::exception& e) {
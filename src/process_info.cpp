@@ -8,18 +8,26 @@
 #include <fstream>
 #include "logger.hpp"
 
-std::vector<ProcessCache> ProcessMonitor::last_process_cache;
+std::string ProcessMonitor::proc_root = "/proc";
+unsigned ProcessMonitor::drm_major = ProcessMonitor::DRM_MAJOR;
+std::map<ProcessMonitor::ClientKey, ProcessCache> ProcessMonitor::last_process_cache;
+std::map<pid_t, ProcessMonitor::ProcessStatFiles> ProcessMonitor::process_stat_files;
 
-bool ProcessMonitor::isDRMFd(int fd_dir_fd, const char* name) {
+bool ProcessMonitor::isDRMFd(int fd_dir_fd, const char* name, dev_t& rdev) {
     struct stat stat_buf;
     int ret = fstatat(fd_dir_fd, name, &stat_buf, 0);
-    return ret == 0 && (stat_buf.st_mode & S_IFMT) == S_IFCHR && major(stat_buf.st_rdev) == 226;
+    if (ret != 0 || (stat_buf.st_mode & S_IFMT) != S_IFCHR || major(stat_buf.st_rdev) != drm_major) {
+        return false;
+    }
+    rdev = stat_buf.st_rdev;
+    return true;
 }
 
 bool ProcessMonitor::parseFdinfo(FILE* fdinfo_file, ProcessInfo& proc, unsigned& client_id) {
-    static const char* DRM_PDEV_OLD = "pdev";
     static const char* DRM_VRAM_OLD = "vram mem";
     static const char* DRM_VRAM_NEW = "drm-memory-vram";
+    static const char* DRM_GTT_OLD = "gtt mem";
+    static const char* DRM_GTT_NEW = "drm-memory-gtt";
     static const char* DRM_GFX_OLD = "gfx";
     static const char* DRM_GFX_NEW = "drm-engine-gfx";
     static const char* DRM_COMPUTE_OLD = "compute";
@@ -33,44 +41,9 @@ bool ProcessMonitor::parseFdinfo(FILE* fdinfo_file, ProcessInfo& proc, unsigned&
     size_t line_buf_size = 0;
     ssize_t count = 0;
     bool has_engine = false;
-    bool client_id_set = false;
-    std::string current_pasid;
-    uint64_t current_memory = 0;
-    static std::map<std::string, bool> processed_pasids;  // Track processed PASIDs
-
-    // Clear processed PASIDs at the start of each process
-    if (proc.memory_usage == 0) {
-        processed_pasids.clear();
-    }
 
     Logger::debug("=== Begin parsing fdinfo for PID " + std::to_string(proc.pid) + " ===");
 
-    // First pass: get current PASID
-    while ((count = getline(&line, &line_buf_size, fdinfo_file)) != -1) {
-        if (strstr(line, "pasid:")) {
-            char* val = strchr(line, ':');
-            if (val) {
-                val++;
-                while (*val && isspace(*val)) val++;
-                current_pasid = std::string(val);
-                if (current_pasid.back() == '\n') {
-                    current_pasid.pop_back();
-                }
-                Logger::debug("  Found PASID: " + current_pasid);
-                break;
-            }
-        }
-    }
-    rewind(fdinfo_file);
-
-    // Skip if we've already processed this PASID
-    if (processed_pasids[current_pasid]) {
-        Logger::debug("  Skipping already processed PASID: " + current_pasid);
-        free(line);
-        return has_engine;
-    }
-
-    // Second pass: parse all values
     while ((count = getline(&line, &line_buf_size, fdinfo_file)) != -1) {
         // Remove newline
         if (line[count - 1] == '\n') {
@@ -91,7 +64,6 @@ bool ProcessMonitor::parseFdinfo(FILE* fdinfo_file, ProcessInfo& proc, unsigned&
             char *endptr;
             client_id = strtoul(val, &endptr, 10);
             if (!*endptr) {
-                client_id_set = true;
                 Logger::debug("    -> Found client ID: " + std::to_string(client_id));
             }
             continue;
@@ -102,14 +74,20 @@ bool ProcessMonitor::parseFdinfo(FILE* fdinfo_file, ProcessInfo& proc, unsigned&
             char *endptr;
             unsigned long mem_kb = strtoul(val, &endptr, 10);
             if (endptr != val && (!strcmp(endptr, " kB") || !strcmp(endptr, " KiB"))) {
-                current_memory = mem_kb * 1024;
-                if (!processed_pasids[current_pasid]) {
-                    proc.memory_usage += current_memory;  // Accumulate memory only for new PASIDs
-                    processed_pasids[current_pasid] = true;
-                    Logger::debug("    -> Added VRAM usage for PASID " + current_pasid + 
-                                ": " + std::to_string(mem_kb) + " KiB" +
-                                " (Total: " + std::to_string(proc.memory_usage / 1024) + " KiB)");
-                }
+                proc.memory_usage = mem_kb * 1024;
+                Logger::debug("    -> Found VRAM usage: " + std::to_string(mem_kb) + " KiB");
+                has_engine = true;
+            }
+            continue;
+        }
+
+        // Parse GTT usage
+        if (!strcmp(key, DRM_GTT_OLD) || !strcmp(key, DRM_GTT_NEW)) {
+            char *endptr;
+            unsigned long mem_kb = strtoul(val, &endptr, 10);
+            if (endptr != val && (!strcmp(endptr, " kB") || !strcmp(endptr, " KiB"))) {
+                proc.gtt_usage = mem_kb * 1024;
+                Logger::debug("    -> Found GTT usage: " + std::to_string(mem_kb) + " KiB");
                 has_engine = true;
             }
             continue;
@@ -161,28 +139,27 @@ bool ProcessMonitor::parseFdinfo(FILE* fdinfo_file, ProcessInfo& proc, unsigned&
     return has_engine;
 }
 
-// Helper function to check if a field is valid
-bool isFieldValid(uint64_t value) {
-    return value != 0;
+// Helper function to calculate the engine time consumed between two samples
+uint64_t calculateEngineDelta(uint64_t current, uint64_t previous) {
+    return current >= previous ? current - previous : 0;
 }
 
 // Helper function to calculate rounded usage percentage
-float calculateUsagePercentage(uint64_t current, uint64_t previous, uint64_t time_elapsed) {
-    if (current < previous || time_elapsed == 0) return 0.0f;
-    uint64_t delta = current - previous;
-    if (delta > time_elapsed) return 0.0f;
-    return (float)delta / time_elapsed * 100.0f;
+float calculateUsagePercentage(uint64_t delta, uint64_t time_elapsed) {
+    if (time_elapsed == 0) return 0.0f;
+    float usage = (float)delta / time_elapsed * 100.0f;
+    return usage > 100.0f ? 100.0f : usage;
 }
 
-void ProcessMonitor::updateEngineUsage(ProcessInfo& proc, const ProcessCache* cache, const timespec& current_time) {
+void ProcessMonitor::updateEngineUsage(ProcessInfo& proc, const ProcessCache* cache, const ProcessCache& current) {
     if (!cache) {
-        proc.last_measurement_time = current_time;
-        Logger::debug("No cache found for PID " + std::to_string(proc.pid) + ", initializing cache");
+        proc.last_measurement_time = current.last_measurement_time;
+        Logger::debug("No cache found for PID " + std::to_string(proc.pid) + " client " +
+                     std::to_string(current.client_id) + ", initializing cache");
         return;
     }
 
-    uint64_t time_elapsed = (current_time.tv_sec - cache->last_measurement_time.tv_sec) * 1000000000ULL + 
-                           (current_time.tv_nsec - cache->last_measurement_time.tv_nsec);
+    uint64_t time_elapsed = getTimeDiffNs(cache->last_measurement_time, current.last_measurement_time);
     
     Logger::debug("Process " + std::to_string(proc.pid) + " time elapsed: " + std::to_string(time_elapsed) + " ns");
 
@@ -191,57 +168,111 @@ void ProcessMonitor::updateEngineUsage(ProcessInfo& proc, const ProcessCache* ca
         return;
     }
 
-    // Calculate GFX usage
-    if (isFieldValid(proc.gfx_engine_used) && isFieldValid(cache->gfx_engine_used) &&
-        proc.gfx_engine_used >= cache->gfx_engine_used) {
-        proc.gfx_usage = calculateUsagePercentage(proc.gfx_engine_used, cache->gfx_engine_used, time_elapsed);
-        Logger::debug("GFX usage: " + std::to_string(proc.gfx_usage) + "% " +
-                     "(current: " + std::to_string(proc.gfx_engine_used) + 
-                     ", prev: " + std::to_string(cache->gfx_engine_used) + ")");
+    // Accumulate this client's share; a process may own several clients per GPU
+    proc.gfx_engine_delta += calculateEngineDelta(current.gfx_engine_used, cache->gfx_engine_used);
+    proc.compute_engine_delta += calculateEngineDelta(current.compute_engine_used, cache->compute_engine_used);
+    proc.dec_engine_delta += calculateEngineDelta(current.dec_engine_used, cache->dec_engine_used);
+    proc.enc_engine_delta += calculateEngineDelta(current.enc_engine_used, cache->enc_engine_used);
+    if (time_elapsed > proc.sample_interval_ns) {
+        proc.sample_interval_ns = time_elapsed;
     }
 
-    // Calculate Compute usage
-    if (isFieldValid(proc.compute_engine_used) && isFieldValid(cache->compute_engine_used) &&
-        proc.compute_engine_used >= cache->compute_engine_used) {
-        proc.compute_usage = calculateUsagePercentage(proc.compute_engine_used, 
-                                                    cache->compute_engine_used, time_elapsed);
-        Logger::debug("Compute usage: " + std::to_string(proc.compute_usage) + "% " +
-                     "(current: " + std::to_string(proc.compute_engine_used) + 
-                     ", prev: " + std::to_string(cache->compute_engine_used) + ")");
-    }
+    proc.gfx_usage = calculateUsagePercentage(proc.gfx_engine_delta, proc.sample_interval_ns);
+    proc.compute_usage = calculateUsagePercentage(proc.compute_engine_delta, proc.sample_interval_ns);
+    proc.dec_usage = calculateUsagePercentage(proc.dec_engine_delta, proc.sample_interval_ns);
+    proc.enc_usage = calculateUsagePercentage(proc.enc_engine_delta, proc.sample_interval_ns);
 
-    // Calculate Decode usage
-    if (isFieldValid(proc.dec_engine_used) && isFieldValid(cache->dec_engine_used) &&
-        proc.dec_engine_used >= cache->dec_engine_used) {
-        proc.dec_usage = calculateUsagePercentage(proc.dec_engine_used, 
-                                                cache->dec_engine_used, time_elapsed);
-        Logger::debug("Decode usage: " + std::to_string(proc.dec_usage) + "% " +
-                     "(current: " + std::to_string(proc.dec_engine_used) + 
-                     ", prev: " + std::to_string(cache->dec_engine_used) + ")");
-    }
+    Logger::debug("GFX/Compute/Decode/Encode usage: " + std::to_string(proc.gfx_usage) + "% " +
+                 std::to_string(proc.compute_usage) + "% " + std::to_string(proc.dec_usage) + "% " +
+                 std::to_string(proc.enc_usage) + "%");
+
+    proc.last_measurement_time = current.last_measurement_time;
+}
 
-    // Calculate Encode usage
-    if (isFieldValid(proc.enc_engine_used) && isFieldValid(cache->enc_engine_used) &&
-        proc.enc_engine_used >= cache->enc_engine_used) {
-        proc.enc_usage = calculateUsagePercentage(proc.enc_engine_used, 
-                                                cache->enc_engine_used, time_elapsed);
-        Logger::debug("Encode usage: " + std::to_string(proc.enc_usage) + "% " +
-                     "(current: " + std::to_string(proc.enc_engine_used) + 
-                     ", prev: " + std::to_string(cache->enc_engine_used) + ")");
+/**
+ * Read name, CPU time, thread count, block IO delay and RSS of a process
+ *
+ * procfs regenerates stat/statm on every read at offset 0 just like sysfs,
+ * so the files stay open across scans. Rates need a previous sample of the
+ * same process; a recycled PID is told apart by its start time.
+ */
+bool ProcessMonitor::readProcessStats(pid_t pid, ProcessStatFiles& files, ProcessInfo& proc, const timespec& now) {
+    std::string dir = proc_root + "/" + std::to_string(pid);
+    char buf[1024];
+    ssize_t len = -1;
+
+    // Files kept from a process that exited fail with ESRCH, also when the PID
+    // has been reused since; they are reopened once for whoever has it now
+    for (int attempt = 0; attempt < 2 && len <= 0; attempt++) {
+        if (!files.stat.isOpen() && !(files.stat.open(dir + "/stat") && files.statm.open(dir + "/statm"))) {
+            files.stat.close();
+            files.statm.close();
+            return false;
+        }
+        len = files.stat.read(buf, sizeof(buf) - 1);
+        if (len <= 0) {
+            files.stat.close();
+            files.statm.close();
+        }
+    }
+    if (len <= 0) return false;
+    buf[len] = 0;
+
+    // comm may contain spaces and parentheses, the fields start after the last ')'
+    char* name_start = strchr(buf, '(');
+    char* name_end = strrchr(buf, ')');
+    if (!name_start || !name_end || name_end < name_start || strlen(name_end) < 4) return false;
+    proc.name.assign(name_start + 1, name_end);
+
+    // Fields numbered as in proc(5); field 3 is the state character
+    long long field[43] = {};
+    char* cursor = name_end + 4;
+    for (int i = 4; i <= 42 && *cursor; i++) {
+        field[i] = strtoll(cursor, &cursor, 10);
     }
 
-    proc.last_measurement_time = current_time;
+    uint64_t start_time = field[22];
+    uint64_t cpu_ticks = field[14] + field[15];  // utime + stime
+    uint64_t blkio_ticks = field[42];            // delayacct_blkio_ticks
+    proc.threads = field[20];
+    proc.start_time = start_time;
+
+    static const double ticks_per_second = sysconf(_SC_CLK_TCK);
+    if (files.last_read.tv_sec != 0 && files.start_time == start_time) {
+        double elapsed = getTimeDiffNs(files.last_read, now) / 1e9;
+        if (elapsed > 0) {
+            proc.cpu_usage = (cpu_ticks - files.cpu_ticks) / ticks_per_second / elapsed * 100.0;
+            proc.io_wait = (blkio_ticks - files.blkio_ticks) / ticks_per_second / elapsed * 100.0;
+        }
+    }
+    files.start_time = start_time;
+    files.cpu_ticks = cpu_ticks;
+    files.blkio_ticks = blkio_ticks;
+    files.last_read = now;
+
+    // statm: size resident shared text lib data dt, in pages
+    len = files.statm.read(buf, sizeof(buf) - 1);
+    if (len > 0) {
+        buf[len] = 0;
+        unsigned long long size, resident;
+        static const long page_size = sysconf(_SC_PAGESIZE);
+        if (sscanf(buf, "%llu %llu", &size, &resident) == 2) {
+            proc.rss = resident * page_size;
+        }
+    }
+    return true;
 }
 
-std::vector<ProcessInfo> ProcessMonitor::getProcesses(amdgpu_device_handle device, float gpu_usage) {
+std::vector<ProcessInfo> ProcessMonitor::getProcesses(const std::map<dev_t, dev_t>& drm_nodes) {
     std::vector<ProcessInfo> processes;
-    std::vector<ProcessCache> current_cache;
+    std::map<ClientKey, ProcessCache> current_cache;
+    std::map<pid_t, ProcessStatFiles> current_stat_files;
     timespec current_time;
     clock_gettime(CLOCK_MONOTONIC, &current_time);
 
     Logger::debug("Starting process scan");
 
-    DIR* proc_dir = opendir("/proc");
+    DIR* proc_dir = opendir(proc_root.c_str());
     if (!proc_dir) return processes;
 
     struct dirent* proc_entry;
@@ -251,87 +282,127 @@ std::vector<ProcessInfo> ProcessMonitor::getProcesses(amdgpu_device_handle devic
         pid_t pid = std::stoi(proc_entry->d_name);
         Logger::debug("Checking process: " + std::to_string(pid));
 
-        ProcessInfo proc;
-        proc.pid = pid;
-        bool uses_gpu = false;
-        unsigned client_id = 0;
+        // One entry per GPU the process holds clients on
+        std::map<dev_t, ProcessInfo> per_device;
 
         // Check fdinfo
-        std::string fdinfo_path = "/proc/" + std::string(proc_entry->d_name) + "/fdinfo";
+        std::string fdinfo_path = proc_root + "/" + std::string(proc_entry->d_name) + "/fdinfo";
         int fdinfo_dir_fd = open(fdinfo_path.c_str(), O_DIRECTORY);
         if (fdinfo_dir_fd >= 0) {
-            std::string fd_path = "/proc/" + std::string(proc_entry->d_name) + "/fd";
+            std::string fd_path = proc_root + "/" + std::string(proc_entry->d_name) + "/fd";
             DIR* fd_dir = opendir(fd_path.c_str());
             if (fd_dir) {
                 struct dirent* fd_entry;
                 while ((fd_entry = readdir(fd_dir))) {
                     if (!isdigit(fd_entry->d_name[0])) continue;
 
-                    if (isDRMFd(dirfd(fd_dir), fd_entry->d_name)) {
-                        int fdinfo_fd = openat(fdinfo_dir_fd, fd_entry->d_name, O_RDONLY);
-                        if (fdinfo_fd >= 0) {
-                            FILE* fdinfo_file = fdopen(fdinfo_fd, "r");
-                            if (fdinfo_file) {
-                                if (parseFdinfo(fdinfo_file, proc, client_id)) {
-                                    uses_gpu = true;
-                                }
-                                fclose(fdinfo_file);
-                            }
-                            close(fdinfo_fd);
-                        }
+                    dev_t rdev;
+                    if (!isDRMFd(dirfd(fd_dir), fd_entry->d_name, rdev)) continue;
+
+                    auto node = drm_nodes.find(rdev);
+                    if (node == drm_nodes.end()) continue;  // Not one of our GPUs
+
+                    int fdinfo_fd = openat(fdinfo_dir_fd, fd_entry->d_name, O_RDONLY);
+                    if (fdinfo_fd < 0) continue;
+
+                    FILE* fdinfo_file = fdopen(fdinfo_fd, "r");
+                    if (!fdinfo_file) {
+                        close(fdinfo_fd);
+                        continue;
+                    }
+
+                    ProcessInfo client;
+                    client.pid = pid;
+                    unsigned client_id = 0;
+                    bool uses_gpu = parseFdinfo(fdinfo_file, client, client_id);
+                    fclose(fdinfo_file);
+                    if (!uses_gpu) continue;
+
+                    // Kernels without drm-client-id get one client per fd
+                    ClientKey key(pid, client_id ? client_id : 0x80000000u | (unsigned)atoi(fd_entry->d_name));
+                    if (current_cache.count(key)) {
+                        continue;  // dup()ed fd of a client already accounted
                     }
+
+                    ProcessCache new_cache;
+                    new_cache.pid = pid;
+                    new_cache.client_id = key.second;
+                    new_cache.gfx_engine_used = client.gfx_engine_used;
+                    new_cache.compute_engine_used = client.compute_engine_used;
+                    new_cache.enc_engine_used = client.enc_engine_used;
+                    new_cache.dec_engine_used = client.dec_engine_used;
+                    new_cache.last_measurement_time = current_time;
+
+                    ProcessInfo& proc = per_device[node->second];
+                    proc.pid = pid;
+                    proc.drm_device = node->second;
+                    proc.memory_usage += client.memory_usage;
+                    proc.gtt_usage += client.gtt_usage;
+                    proc.gfx_engine_used += client.gfx_engine_used;
+                    proc.compute_engine_used += client.compute_engine_used;
+                    proc.enc_engine_used += client.enc_engine_used;
+                    proc.dec_engine_used += client.dec_engine_used;
+
+                    // Update usage based on engine times
+                    auto cache_entry = last_process_cache.find(key);
+                    updateEngineUsage(proc, cache_entry != last_process_cache.end() ? &cache_entry->second : nullptr,
+                                      new_cache);
+
+                    // Store current state in cache
+                    current_cache[key] = new_cache;
                 }
                 closedir(fd_dir);
             }
             close(fdinfo_dir_fd);
         }
 
-        if (uses_gpu) {
-            // Get process name
-            std::string comm_path = "/proc/" + std::string(proc_entry->d_name) + "/comm";
+        if (per_device.empty()) continue;
+
+        // Host side stats and name, only ever read for GPU clients
+        ProcessStatFiles& stat_files = current_stat_files[pid];
+        auto previous_stat_files = process_stat_files.find(pid);
+        if (previous_stat_files != process_stat_files.end()) {
+            stat_files = std::move(previous_stat_files->second);
+        }
+
+        ProcessInfo host;
+        if (!readProcessStats(pid, stat_files, host, current_time)) {
+            std::string comm_path = proc_root + "/" + std::string(proc_entry->d_name) + "/comm";
             std::ifstream comm_file(comm_path);
             if (comm_file) {
-                std::getline(comm_file, proc.name);
-                Logger::debug("Found GPU process: " + proc.name + " (PID: " + 
-                            std::to_string(pid) + ")");
+                std::getline(comm_file, host.name);
             }
-
-            // Find matching cache entry
-            const ProcessCache* cache_entry = nullptr;
-            for (const auto& cache : last_process_cache) {
-                if (cache.pid == pid && cache.client_id == client_id) {
-                    cache_entry = &cache;
-                    break;
-                }
-            }
-
-            // Update usage based on engine times
-            updateEngineUsage(proc, cache_entry, current_time);
-
-            // Store current state in cache
-            ProcessCache new_cache;
-            new_cache.pid = pid;
-            new_cache.client_id = client_id;
-            new_cache.gfx_engine_used = proc.gfx_engine_used;
-            new_cache.compute_engine_used = proc.compute_engine_used;
-            new_cache.enc_engine_used = proc.enc_engine_used;
-            new_cache.dec_engine_used = proc.dec_engine_used;
-            new_cache.last_measurement_time = current_time;
-            current_cache.push_back(new_cache);
-
-            processes.push_back(proc);
+        }
+        Logger::debug("Found GPU process: " + host.name + " (PID: " + std::to_string(pid) + ")");
+
+        for (auto& entry : per_device) {
+            entry.second.name = host.name;
+            entry.second.cpu_usage = host.cpu_usage;
+            entry.second.io_wait = host.io_wait;
+            entry.second.rss = host.rss;
+            entry.second.threads = host.threads;
+            entry.second.start_time = host.start_time;
+            processes.push_back(std::move(entry.second));
         }
     }
     closedir(proc_dir);
 
     Logger::debug("Found " + std::to_string(processes.size()) + " GPU processes");
 
-    // Update cache for next iteration
+    // Update cache for next iteration; files of processes that left the GPU are closed
     last_process_cache = std::move(current_cache);
+    process_stat_files = std::move(current_stat_files);
 
     return processes;
 }
 
+void ProcessMonitor::setProcRoot(const std::string& root, unsigned major_number) {
+    proc_root = root;
+    drm_major = major_number;
+    last_process_cache.clear();
+    process_stat_files.clear();
+}
+
 uint64_t ProcessMonitor::getTimeDiffNs(const timespec& start, const timespec& end) {
     return (end.tv_sec - start.tv_sec) * 1000000000ULL + (end.tv_nsec - start.tv_nsec);
 } 
\ No newline at end of file
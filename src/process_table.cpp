@@ -0,0 +1,176 @@
+#include "process_table.hpp"
+#include <algorithm>
+#include <cctype>
+
+template <typename T>
+static int compareValues(const T& a, const T& b) {
+    return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+static std::string toLower(const std::string& value) {
+    std::string result = value;
+    for (auto& c : result) {
+        c = std::tolower((unsigned char)c);
+    }
+    return result;
+}
+
+bool ProcessTable::before(uint32_t a, uint32_t b) const {
+    const ProcessInfo& x = entries[a].proc;
+    const ProcessInfo& y = entries[b].proc;
+
+    int order = 0;
+    switch (sort_column) {
+        case SORT_PID: order = compareValues(x.pid, y.pid); break;
+        case SORT_NAME: order = x.name.compare(y.name); break;
+        case SORT_GPU: order = compareValues(entries[a].gpu, entries[b].gpu); break;
+        case SORT_GFX: order = compareValues(x.gfx_usage, y.gfx_usage); break;
+        case SORT_COMPUTE: order = compareValues(x.compute_usage, y.compute_usage); break;
+        case SORT_ENC: order = compareValues(x.enc_usage, y.enc_usage); break;
+        case SORT_DEC: order = compareValues(x.dec_usage, y.dec_usage); break;
+        case SORT_VRAM: order = compareValues(x.memory_usage, y.memory_usage); break;
+        case SORT_GTT: order = compareValues(x.gtt_usage, y.gtt_usage); break;
+        case SORT_ENERGY: order = compareValues(x.energy_joules, y.energy_joules); break;
+        case SORT_CPU: order = compareValues(x.cpu_usage, y.cpu_usage); break;
+        case SORT_RSS: order = compareValues(x.rss, y.rss); break;
+        case SORT_GROWTH: order = compareValues(x.vram_growth, y.vram_growth); break;
+    }
+    if (order != 0) {
+        return descending ? order > 0 : order < 0;
+    }
+
+    // nth_element is not stable, ties need a total order or rows jump around
+    if (x.pid != y.pid) return x.pid < y.pid;
+    return x.drm_device < y.drm_device;
+}
+
+bool ProcessTable::matchesFilter(const Entry& entry, const std::string& lower_filter) const {
+    if (lower_filter.empty()) return true;
+
+    bool numeric = std::all_of(lower_filter.begin(), lower_filter.end(),
+                               [](char c) { return std::isdigit((unsigned char)c); });
+    if (numeric && std::to_string(entry.proc.pid).compare(0, lower_filter.size(), lower_filter) == 0) {
+        return true;
+    }
+    return toLower(entry.proc.name).find(lower_filter) != std::string::npos;
+}
+
+void ProcessTable::refilter(bool narrow) {
+    std::string lower_filter = toLower(filter);
+
+    if (narrow) {
+        // A longer filter only ever drops rows that matched the shorter one
+        matches.erase(std::remove_if(matches.begin(), matches.end(), [&](uint32_t index) {
+            return !matchesFilter(entries[index], lower_filter);
+        }), matches.end());
+        return;
+    }
+
+    matches.clear();
+    for (uint32_t i = 0; i < entries.size(); i++) {
+        if (matchesFilter(entries[i], lower_filter)) {
+            matches.push_back(i);
+        }
+    }
+}
+
+void ProcessTable::rememberSelection() {
+    if (selected >= matches.size()) return;
+    const ProcessInfo& proc = entries[matches[selected]].proc;
+    selected_pid = proc.pid;
+    selected_device = proc.drm_device;
+    has_selection_key = true;
+}
+
+// Move the selection to the followed client's position in the current order
+void ProcessTable::followSelection() {
+    if (!has_selection_key) return;
+
+    auto it = std::find_if(matches.begin(), matches.end(), [this](uint32_t index) {
+        return entries[index].proc.pid == selected_pid && entries[index].proc.drm_device == selected_device;
+    });
+    if (it == matches.end()) return;
+
+    uint32_t followed = *it;
+    selected = std::count_if(matches.begin(), matches.end(), [&](uint32_t index) {
+        return before(index, followed);
+    });
+}
+
+void ProcessTable::clampSelection() {
+    if (matches.empty()) {
+        selected = 0;
+        offset = 0;
+    } else if (selected >= matches.size()) {
+        selected = matches.size() - 1;
+    }
+}
+
+void ProcessTable::setEntries(std::vector<Entry> new_entries) {
+    entries = std::move(new_entries);
+    refilter(false);
+    followSelection();
+    clampSelection();
+}
+
+void ProcessTable::sortBy(SortColumn column) {
+    if (column == sort_column) {
+        descending = !descending;
+    } else {
+        sort_column = column;
+        // Usage columns are most interesting largest first, PID and name in natural order
+        descending = column != SORT_PID && column != SORT_NAME && column != SORT_GPU;
+    }
+    followSelection();
+}
+
+void ProcessTable::setFilter(const std::string& new_filter) {
+    bool narrow = new_filter.compare(0, filter.size(), filter) == 0;
+    filter = new_filter;
+    refilter(narrow);
+    selected = 0;
+    offset = 0;
+    has_selection_key = false;
+}
+
+void ProcessTable::moveSelection(long delta) {
+    if (matches.empty()) return;
+    long target = (long)selected + delta;
+    selected = (size_t)std::max(0L, std::min(target, (long)matches.size() - 1));
+    has_selection_key = false;
+}
+
+void ProcessTable::selectFirst() {
+    selected = 0;
+    has_selection_key = false;
+}
+
+void ProcessTable::selectLast() {
+    selected = matches.empty() ? 0 : matches.size() - 1;
+    has_selection_key = false;
+}
+
+std::vector<const ProcessTable::Entry*> ProcessTable::getVisibleRows(size_t rows) {
+    std::vector<const Entry*> visible;
+    clampSelection();
+    if (rows == 0 || matches.empty()) return visible;
+
+    // Scroll just enough to keep the selection in the window
+    if (selected < offset) offset = selected;
+    if (selected >= offset + rows) offset = selected - rows + 1;
+    if (offset + rows > matches.size()) offset = matches.size() > rows ? matches.size() - rows : 0;
+
+    auto order = [this](uint32_t a, uint32_t b) { return before(a, b); };
+    auto first = matches.begin() + offset;
+    auto last = matches.begin() + std::min(offset + rows, matches.size());
+    if (offset > 0) {
+        std::nth_element(matches.begin(), first, matches.end(), order);
+    }
+    std::partial_sort(first, last, matches.end(), order);
+
+    for (auto it = first; it != last; ++it) {
+        visible.push_back(&entries[*it]);
+    }
+    rememberSelection();
+    return visible;
+}
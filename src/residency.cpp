@@ -0,0 +1,229 @@
+#include "residency.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <time.h>
+#include "logger.hpp"
+
+// SMU_THROTTLER_* bits of indep_throttle_status, from kgd_pp_interface.h
+struct ThrottlerBit {
+    unsigned bit;
+    const char* name;
+};
+
+static const ThrottlerBit THROTTLER_BITS[] = {
+    {0, "PPT0"}, {1, "PPT1"}, {2, "PPT2"}, {3, "PPT3"},
+    {4, "SPL"}, {5, "FPPT"}, {6, "SPPT"}, {7, "SPPT_APU"},
+    {16, "TDC_GFX"}, {17, "TDC_SOC"}, {18, "TDC_MEM"}, {19, "TDC_VDD"},
+    {20, "TDC_CVIP"}, {21, "EDC_CPU"}, {22, "EDC_GFX"}, {23, "APCC"},
+    {32, "TEMP_GPU"}, {33, "TEMP_CORE"}, {34, "TEMP_MEM"}, {35, "TEMP_EDGE"},
+    {36, "TEMP_HOTSPOT"}, {37, "TEMP_SOC"}, {38, "TEMP_VR_GFX"}, {39, "TEMP_VR_SOC"},
+    {40, "TEMP_VR_MEM0"}, {41, "TEMP_VR_MEM1"}, {42, "TEMP_LIQUID0"}, {43, "TEMP_LIQUID1"},
+    {44, "VRHOT0"}, {45, "VRHOT1"}, {46, "PROCHOT_CPU"}, {47, "PROCHOT_GFX"},
+    {56, "PPM"}, {57, "FIT"},
+};
+
+// The bit ranges group the reasons: power 0-15, current 16-31, thermal 32-55
+static const char* throttlerCategory(unsigned bit) {
+    if (bit < 16) return "Power";
+    if (bit < 32) return "Current";
+    if (bit < 56) return "Thermal";
+    return "Other";
+}
+
+size_t ResidencyHistogram::declare(const std::string& label) {
+    auto it = index.find(label);
+    if (it != index.end()) return it->second;
+
+    buckets.push_back(Bucket());
+    buckets.back().label = label;
+    index[label] = buckets.size() - 1;
+    return buckets.size() - 1;
+}
+
+void ResidencyHistogram::record(double seconds, double now, const std::vector<size_t>& active) {
+    if (seconds <= 0) return;
+
+    session_time += seconds;
+    window_time += seconds;
+    for (size_t bucket : active) {
+        buckets[bucket].session += seconds;
+        buckets[bucket].window += seconds;
+    }
+    intervals.push_back({now, seconds, active});
+
+    while (!intervals.empty() && intervals.front().end <= now - window_seconds) {
+        const Interval& expired = intervals.front();
+        window_time -= expired.seconds;
+        for (size_t bucket : expired.active) {
+            buckets[bucket].window -= expired.seconds;
+        }
+        intervals.pop_front();
+    }
+}
+
+std::vector<ResidencyShare> ResidencyHistogram::getShares() const {
+    std::vector<ResidencyShare> shares;
+    for (const auto& bucket : buckets) {
+        ResidencyShare share;
+        share.label = bucket.label;
+        share.session = session_time > 0 ? (float)(bucket.session / session_time * 100.0) : 0.0f;
+        share.window = window_time > 0 ? (float)(bucket.window / window_time * 100.0) : 0.0f;
+        // Expiring intervals subtract what they added, which may leave rounding noise
+        share.window = std::max(0.0f, std::min(share.window, 100.0f));
+        shares.push_back(share);
+    }
+    return shares;
+}
+
+void ResidencyHistogram::write(FILE* file, const std::string& prefix) const {
+    for (const auto& share : getShares()) {
+        const Bucket& bucket = buckets[index.at(share.label)];
+        fprintf(file, "%s\t%s\t%.3f\t%.1f\t%.3f\t%.1f\n", prefix.c_str(), share.label.c_str(),
+                bucket.session, share.session, std::max(bucket.window, 0.0), share.window);
+    }
+}
+
+bool ResidencyTracker::open(const std::string& device_path) {
+    bool sclk_open = pp_dpm_sclk.open(device_path + "/pp_dpm_sclk");
+    bool mclk_open = pp_dpm_mclk.open(device_path + "/pp_dpm_mclk");
+    if (!sclk_open || !mclk_open) {
+        Logger::debug("No DPM level tables in " + device_path + ", bucketing current clocks");
+    }
+    throttle.declare("None");
+    return sclk_open || mclk_open;
+}
+
+bool ResidencyTracker::parseLevels(const std::string& content, std::vector<std::string>& labels, int& active) {
+    // "0: 500Mhz\n1: 1800Mhz *\n", MI300 adds a sleep level "S: 19Mhz"
+    std::istringstream lines(content);
+    std::string line;
+    labels.clear();
+    active = -1;
+
+    while (std::getline(lines, line)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+
+        std::string label = line.substr(colon + 1);
+        if (label.find('*') != std::string::npos) {
+            active = (int)labels.size();
+            label.erase(label.find('*'));
+        }
+        label.erase(0, label.find_first_not_of(' '));
+        label.erase(label.find_last_not_of(' ') + 1);
+        labels.push_back(label);
+    }
+    return active >= 0;
+}
+
+void ResidencyTracker::recordClock(ResidencyHistogram& histogram, const SysfsFile& levels, uint32_t clock,
+                                   double elapsed, double now) {
+    std::string content;
+    std::vector<std::string> labels;
+    int active;
+
+    if (levels.isOpen() && levels.readString(content) && parseLevels(content, labels, active)) {
+        size_t bucket = 0;
+        for (size_t i = 0; i < labels.size(); i++) {
+            size_t index = histogram.declare(labels[i]);
+            if ((int)i == active) bucket = index;
+        }
+        histogram.record(elapsed, now, {bucket});
+    } else if (clock > 0) {
+        uint32_t rounded = (clock + 50) / 100 * 100;
+        histogram.record(elapsed, now, {histogram.declare(std::to_string(rounded) + "Mhz")});
+    }
+}
+
+void ResidencyTracker::decodeIndepThrottleStatus(uint64_t status, std::vector<const char*>& reasons,
+                                                 std::vector<const char*>& categories) {
+    for (const auto& throttler : THROTTLER_BITS) {
+        if (!(status & (1ULL << throttler.bit))) continue;
+
+        reasons.push_back(throttler.name);
+        const char* category = throttlerCategory(throttler.bit);
+        if (std::find(categories.begin(), categories.end(), category) == categories.end()) {
+            categories.push_back(category);
+        }
+    }
+}
+
+void ResidencyTracker::update(const GPUMetricsTable* table, uint32_t gpu_clock, uint32_t memory_clock,
+                              double elapsed) {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    double now = ts.tv_sec + ts.tv_nsec / 1e9;
+
+    // gpu_metrics clocks are sampled by the SMU, the sensor query may wake the GPU
+    if (table && table->has_current_clocks) {
+        gpu_clock = table->current_gfxclk;
+        memory_clock = table->current_uclk;
+    }
+    recordClock(sclk, pp_dpm_sclk, gpu_clock, elapsed, now);
+    recordClock(mclk, pp_dpm_mclk, memory_clock, elapsed, now);
+
+    active_reasons.clear();
+    if (!table || (!table->has_indep_throttle_status && !table->has_throttle_status)) return;
+
+    std::vector<std::string> reasons;
+    std::vector<const char*> categories;
+    if (table->has_indep_throttle_status) {
+        std::vector<const char*> names;
+        decodeIndepThrottleStatus(table->indep_throttle_status, names, categories);
+        reasons.assign(names.begin(), names.end());
+    } else {
+        // The ASIC specific layout differs per SMU generation, report raw bits
+        for (unsigned bit = 0; bit < 32; bit++) {
+            if (table->throttle_status & (1u << bit)) {
+                reasons.push_back("bit " + std::to_string(bit));
+            }
+        }
+        if (!reasons.empty()) categories.push_back("Throttled");
+    }
+
+    std::vector<size_t> active;
+    for (const char* category : categories) {
+        active.push_back(throttle.declare(category));
+    }
+    if (active.empty()) {
+        active.push_back(throttle.declare("None"));
+    }
+    throttle.record(elapsed, now, active);
+
+    active.clear();
+    for (const auto& reason : reasons) {
+        active.push_back(throttle_reasons.declare(reason));
+    }
+    throttle_reasons.record(elapsed, now, active);
+    active_reasons = reasons;
+}
+
+std::vector<ResidencyShare> ResidencyTracker::sortByClock(std::vector<ResidencyShare> shares) {
+    std::stable_sort(shares.begin(), shares.end(), [](const ResidencyShare& a, const ResidencyShare& b) {
+        return strtoul(a.label.c_str(), nullptr, 10) < strtoul(b.label.c_str(), nullptr, 10);
+    });
+    return shares;
+}
+
+std::vector<ResidencyShare> ResidencyTracker::getSclkShares() const {
+    return sortByClock(sclk.getShares());
+}
+
+std::vector<ResidencyShare> ResidencyTracker::getMclkShares() const {
+    return sortByClock(mclk.getShares());
+}
+
+void ResidencyTracker::inheritHistory(const ResidencyTracker& previous) {
+    sclk = previous.sclk;
+    mclk = previous.mclk;
+    throttle = previous.throttle;
+    throttle_reasons = previous.throttle_reasons;
+}
+
+void ResidencyTracker::write(FILE* file, const std::string& prefix) const {
+    sclk.write(file, prefix + "\tsclk");
+    mclk.write(file, prefix + "\tmclk");
+    throttle.write(file, prefix + "\tthrottle");
+    throttle_reasons.write(file, prefix + "\tthrottle_reason");
+}
@@ -0,0 +1,677 @@
+#include "rules.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "logger.hpp"
+#include "snapshot.hpp"
+
+extern char** environ;
+
+static constexpr uint64_t NS_PER_S = 1000000000ULL;
+
+enum Kind { PERCENT, BYTES, CELSIUS, WATTS, MHZ, RPM, JOULES, PER_SECOND, COUNT, BYTES_PER_SECOND };
+
+// Fields in table order; the process fields follow the GPU fields
+enum Field {
+    GPU_USAGE, GPU_VRAM, GPU_VRAM_USED, GPU_GTT, GPU_GTT_USED, GPU_TEMPERATURE, GPU_JUNCTION,
+    GPU_MEMORY_TEMPERATURE, GPU_POWER, GPU_POWER_CAP, GPU_SCLK, GPU_MCLK, GPU_FAN, GPU_EVICTIONS,
+    GPU_THROTTLED, GPU_ENERGY, GPU_CLIENTS,
+    PROC_USAGE, PROC_GFX, PROC_COMPUTE, PROC_ENC, PROC_DEC, PROC_CPU, PROC_VRAM, PROC_GTT, PROC_RSS,
+    PROC_ENERGY, PROC_THREADS, PROC_VRAM_GROWTH, PROC_GTT_GROWTH, PROC_LEAK,
+    FIELD_COUNT
+};
+
+static constexpr int PROC_FIRST = PROC_USAGE;
+
+struct FieldInfo {
+    const char* name;
+    bool process;
+    Kind kind;
+};
+
+static const FieldInfo FIELDS[FIELD_COUNT] = {
+    {"usage", false, PERCENT}, {"vram", false, PERCENT}, {"vram_used", false, BYTES}, {"gtt", false, PERCENT},
+    {"gtt_used", false, BYTES}, {"temperature", false, CELSIUS}, {"junction", false, CELSIUS},
+    {"memory_temperature", false, CELSIUS}, {"power", false, WATTS}, {"power_cap", false, PERCENT},
+    {"sclk", false, MHZ}, {"mclk", false, MHZ}, {"fan", false, RPM}, {"evictions", false, PER_SECOND},
+    {"throttled", false, COUNT}, {"energy", false, JOULES}, {"clients", false, COUNT},
+    {"usage", true, PERCENT}, {"gfx", true, PERCENT}, {"compute", true, PERCENT}, {"enc", true, PERCENT},
+    {"dec", true, PERCENT}, {"cpu", true, PERCENT}, {"vram", true, BYTES}, {"gtt", true, BYTES},
+    {"rss", true, BYTES}, {"energy", true, JOULES}, {"threads", true, COUNT},
+    {"vram_growth", true, BYTES_PER_SECOND}, {"gtt_growth", true, BYTES_PER_SECOND}, {"leak", true, COUNT},
+};
+
+static const std::pair<const char*, const char*> ALIASES[] = {
+    {"temp", "temperature"}, {"gpu_usage", "usage"}, {"power_usage", "power"},
+};
+
+struct Unit {
+    const char* suffix;
+    double scale;
+    Kind kind;
+};
+
+// Longer suffixes first, so "MiB" is not taken for "M"
+static const Unit UNITS[] = {
+    {"%", 1, PERCENT}, {"°C", 1, CELSIUS}, {"MHz", 1, MHZ}, {"rpm", 1, RPM}, {"RPM", 1, RPM},
+    {"TiB", 1099511627776.0, BYTES}, {"GiB", 1073741824.0, BYTES}, {"MiB", 1048576.0, BYTES},
+    {"KiB", 1024.0, BYTES}, {"TB", 1e12, BYTES}, {"GB", 1e9, BYTES}, {"MB", 1e6, BYTES}, {"KB", 1e3, BYTES},
+    {"kB", 1e3, BYTES}, {"T", 1099511627776.0, BYTES}, {"G", 1073741824.0, BYTES}, {"M", 1048576.0, BYTES},
+    {"K", 1024.0, BYTES}, {"B", 1, BYTES}, {"C", 1, CELSIUS}, {"W", 1, WATTS}, {"J", 1, JOULES},
+};
+
+static const char* KIND_NAMES[] = {"percent", "bytes", "°C", "W", "MHz", "RPM", "J", "per second", "count",
+                                   "bytes per second"};
+
+static void skipSpace(const char*& p) {
+    while (isspace((unsigned char)*p)) p++;
+}
+
+static std::string readWord(const char*& p) {
+    const char* start = p;
+    while (isalnum((unsigned char)*p) || *p == '_') p++;
+    return std::string(start, p);
+}
+
+// Suffix s at p, not followed by more of a word
+static bool takeSuffix(const char*& p, const char* s) {
+    size_t length = strlen(s);
+    if (strncmp(p, s, length) != 0 || isalpha((unsigned char)p[length])) return false;
+    p += length;
+    return true;
+}
+
+// "30s", "500ms", "5m", "5min", "2h", "1d"; seconds without a unit
+static bool parseDuration(const char*& p, uint64_t& ns) {
+    skipSpace(p);
+    char* end;
+    double value = strtod(p, &end);
+    if (end == p || value < 0) return false;
+    p = end;
+    skipSpace(p);  // "1 m" as well as "1m"
+    double scale = 1;
+    if (takeSuffix(p, "ms")) {
+        scale = 0.001;
+    } else if (takeSuffix(p, "s")) {
+    } else if (takeSuffix(p, "min") || takeSuffix(p, "m")) {
+        scale = 60;
+    } else if (takeSuffix(p, "h")) {
+        scale = 3600;
+    } else if (takeSuffix(p, "d")) {
+        scale = 86400;
+    }
+    ns = (uint64_t)(value * scale * NS_PER_S);
+    return true;
+}
+
+static int findField(const std::string& name, bool process) {
+    std::string resolved = name;
+    for (const auto& alias : ALIASES) {
+        if (name == alias.first) resolved = alias.second;
+    }
+    for (int i = 0; i < FIELD_COUNT; i++) {
+        if (FIELDS[i].process == process && resolved == FIELDS[i].name) return i;
+    }
+    return -1;
+}
+
+static std::string formatValue(double value, Kind kind, bool rate) {
+    static const char* SIZES[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    char text[48];
+    if (std::isnan(value)) return "n/a";
+    if (kind == BYTES || kind == BYTES_PER_SECOND) {
+        rate = rate || kind == BYTES_PER_SECOND;
+        int unit = 0;
+        while (std::fabs(value) >= 1024 && unit < 4) {
+            value /= 1024;
+            unit++;
+        }
+        snprintf(text, sizeof(text), "%.1f %s", value, SIZES[unit]);
+    } else if (kind == PERCENT) {
+        snprintf(text, sizeof(text), "%.1f%%", value);
+    } else if (kind == PER_SECOND || kind == COUNT) {
+        snprintf(text, sizeof(text), "%.3g", value);
+    } else {
+        snprintf(text, sizeof(text), "%.3g %s", value, KIND_NAMES[kind]);
+    }
+    std::string formatted = text;
+    if (rate) formatted += "/s";
+    return formatted;
+}
+
+RuleEngine::~RuleEngine() {
+    reapHooks();
+}
+
+// [rate(] [gpu|proc [ '[' SELECTOR ']' ] .] FIELD [, WINDOW )]
+bool RuleEngine::parseTerm(const char*& p, Rule& rule, bool& scoped, Term& term, std::string& error) {
+    skipSpace(p);
+    std::string word = readWord(p);
+    if (word.empty()) {
+        error = *p ? std::string("unexpected '") + *p + "'" : "expected a field";
+        return false;
+    }
+
+    skipSpace(p);
+    if (word == "rate" && *p == '(') {
+        p++;
+        if (!parseTerm(p, rule, scoped, term, error)) return false;
+        if (term.rate) {
+            error = "rate() of a rate";
+            return false;
+        }
+        term.rate = true;
+        skipSpace(p);
+        if (*p == ',') {
+            p++;
+            if (!parseDuration(p, term.window_ns) || term.window_ns == 0) {
+                error = "expected a window after ',' in rate()";
+                return false;
+            }
+            skipSpace(p);
+        }
+        if (*p != ')') {
+            error = "expected ')' after rate(" + term.name;
+            return false;
+        }
+        p++;
+        return true;
+    }
+
+    if ((word == "gpu" || word == "proc") && (*p == '[' || *p == '.')) {
+        Scope scope = word == "gpu" ? GPU : PROCESS;
+        long index = -1;
+        std::string selector;
+        if (*p == '[') {
+            const char* close = strchr(p, ']');
+            if (!close) {
+                error = "expected ']' after " + word + "[";
+                return false;
+            }
+            std::string inside(p + 1, close);
+            p = close + 1;
+            if (!inside.empty() && std::all_of(inside.begin(), inside.end(), ::isdigit)) {
+                index = atol(inside.c_str());
+            } else if (inside != "*") {
+                if (scope == GPU) {
+                    error = "GPUs are selected by index, not '" + inside + "'";
+                    return false;
+                }
+                selector = inside;
+            }
+        }
+        if (*p != '.') {
+            error = "expected '.' after " + word;
+            return false;
+        }
+        p++;
+
+        if (scoped && (scope != rule.scope)) {
+            error = "a rule looks at either GPUs or processes, not both";
+            return false;
+        }
+        if (scoped && (index != rule.index || selector != rule.selector) && (index != -1 || !selector.empty())) {
+            error = "every term of a rule must select the same " + std::string(scope == GPU ? "GPUs" : "processes");
+            return false;
+        }
+        if (!scoped || index != -1 || !selector.empty()) {
+            rule.index = index;
+            rule.selector = selector;
+        }
+        rule.scope = scope;
+        scoped = true;
+
+        word = readWord(p);
+        if (word.empty()) {
+            error = "expected a field after " + std::string(scope == GPU ? "gpu." : "proc.");
+            return false;
+        }
+    }
+
+    term.name = word;
+    return true;
+}
+
+// NUMBER [UNIT] [/s | /min | /h]
+static bool parseValue(const char*& p, double& value, int& unit, bool& per_time, std::string& error) {
+    skipSpace(p);
+    char* end;
+    value = strtod(p, &end);
+    if (end == p) {
+        error = "expected a number";
+        return false;
+    }
+    p = end;
+    skipSpace(p);
+
+    unit = -1;
+    for (const auto& candidate : UNITS) {
+        if (takeSuffix(p, candidate.suffix)) {
+            value *= candidate.scale;
+            unit = candidate.kind;
+            break;
+        }
+    }
+
+    per_time = false;
+    if (*p == '/') {
+        p++;
+        double seconds = takeSuffix(p, "s") ? 1 : takeSuffix(p, "min") || takeSuffix(p, "m") ? 60 :
+                         takeSuffix(p, "h") ? 3600 : takeSuffix(p, "d") ? 86400 : 0;
+        if (seconds == 0) {
+            error = "expected s, min, h or d after '/'";
+            return false;
+        }
+        value /= seconds;
+        per_time = true;
+    }
+    return true;
+}
+
+bool RuleEngine::add(const std::string& text, const std::string& exec, std::string& error) {
+    Rule rule;
+    rule.text = text;
+    rule.exec = exec;
+    rule.any_of.emplace_back();
+    bool scoped = false;
+    bool expect_condition = true;
+
+    const char* p = text.c_str();
+    while (true) {
+        skipSpace(p);
+        if (!*p) break;
+
+        const char* word_start = p;
+        std::string word = readWord(p);
+        if (word == "and" || word == "or") {
+            if (expect_condition) {
+                error = "expected a condition before '" + word + "'";
+                return false;
+            }
+            if (word == "or") rule.any_of.emplace_back();
+            expect_condition = true;
+            continue;
+        }
+        if (word == "for") {
+            if (!parseDuration(p, rule.hold_ns)) {
+                error = "expected a duration after 'for'";
+                return false;
+            }
+            continue;
+        }
+        if (!expect_condition) {
+            error = "expected 'and', 'or' or 'for' before '" + std::string(word_start) + "'";
+            return false;
+        }
+
+        p = word_start;
+        Term term;
+        if (!parseTerm(p, rule, scoped, term, error)) return false;
+
+        Condition condition;
+        skipSpace(p);
+        if (p[0] == '<' && p[1] == '=') {
+            condition.op = LESS_EQUAL;
+            p += 2;
+        } else if (p[0] == '>' && p[1] == '=') {
+            condition.op = GREATER_EQUAL;
+            p += 2;
+        } else if (p[0] == '<') {
+            condition.op = LESS;
+            p++;
+        } else if (p[0] == '>') {
+            condition.op = GREATER;
+            p++;
+        } else {
+            error = "expected <, <=, > or >= after '" + term.name + "'";
+            return false;
+        }
+        if (!parseValue(p, condition.value, condition.unit, condition.per_time, error)) {
+            error += " after the comparison of '" + term.name + "'";
+            return false;
+        }
+
+        // Conditions on the same term share its value and rate state
+        auto same = std::find_if(rule.terms.begin(), rule.terms.end(), [&](const Term& other) {
+            return other.name == term.name && other.rate == term.rate && other.window_ns == term.window_ns;
+        });
+        condition.term = same - rule.terms.begin();
+        if (same == rule.terms.end()) rule.terms.push_back(term);
+        rule.any_of.back().push_back(condition);
+        expect_condition = false;
+    }
+
+    if (expect_condition) {
+        error = rule.terms.empty() ? "no condition" : "expected a condition at the end";
+        return false;
+    }
+
+    // Bare fields take the scope of the rule, and values must be in their unit
+    for (auto& term : rule.terms) {
+        term.field = findField(term.name, rule.scope == PROCESS);
+        if (term.field < 0) {
+            error = "unknown " + std::string(rule.scope == GPU ? "GPU" : "process") + " field '" + term.name + "'";
+            return false;
+        }
+    }
+    for (const auto& group : rule.any_of) {
+        for (const auto& condition : group) {
+            const Term& term = rule.terms[condition.term];
+            Kind kind = FIELDS[term.field].kind;
+            Kind unit = kind == BYTES_PER_SECOND ? BYTES : kind;
+            if (condition.unit >= 0 && condition.unit != unit) {
+                error = "'" + term.name + "' is in " + KIND_NAMES[kind] + ", not " + KIND_NAMES[condition.unit];
+                return false;
+            }
+            if (condition.per_time && !term.rate && kind != PER_SECOND && kind != BYTES_PER_SECOND) {
+                error = "'" + term.name + "' is not a rate, use rate(" + term.name + ")";
+                return false;
+            }
+        }
+    }
+
+    rules.push_back(std::move(rule));
+    return true;
+}
+
+// Device wide value of a GPU, in the base unit of the field
+static double gpuValue(const GPUSnapshot& gpu, int field) {
+    const GPUDevice::Metrics& metrics = gpu.metrics;
+    switch (field) {
+        case GPU_USAGE: return metrics.gpu_usage;
+        case GPU_VRAM: return metrics.memory_total > 0 ? metrics.memory_used * 100.0 / metrics.memory_total : 0;
+        case GPU_VRAM_USED: return metrics.memory_used * 1048576.0;
+        case GPU_GTT: return metrics.gtt_total > 0 ? metrics.gtt_used * 100.0 / metrics.gtt_total : 0;
+        case GPU_GTT_USED: return metrics.gtt_used * 1048576.0;
+        case GPU_TEMPERATURE: return metrics.temperature;
+        case GPU_JUNCTION: return metrics.temperature_junction;
+        case GPU_MEMORY_TEMPERATURE: return metrics.temperature_memory;
+        case GPU_POWER: return metrics.power_usage;
+        case GPU_POWER_CAP: return metrics.power_cap > 0 ? metrics.power_usage * 100.0 / metrics.power_cap : 0;
+        case GPU_SCLK: return metrics.gpu_clock;
+        case GPU_MCLK: return metrics.memory_clock;
+        case GPU_FAN: return metrics.fan_speed;
+        case GPU_EVICTIONS: return metrics.evictions_rate;
+        case GPU_THROTTLED: return metrics.throttle_reasons.size();
+        case GPU_ENERGY: return metrics.energy;
+        case GPU_CLIENTS: {
+            size_t clients = 0;
+            for (const auto& node : gpu.nodes) clients += node.processes.size();
+            return clients;
+        }
+    }
+    return 0;
+}
+
+// Values of one process summed over the GPUs and partitions it uses
+struct ProcessTotals {
+    pid_t pid = 0;
+    std::string name;
+    double values[FIELD_COUNT - PROC_FIRST] = {};
+};
+
+static void addProcess(ProcessTotals& totals, const ProcessInfo& proc) {
+    auto value = [&totals](int field) -> double& { return totals.values[field - PROC_FIRST]; };
+    value(PROC_USAGE) += proc.gfx_usage + proc.compute_usage + proc.enc_usage + proc.dec_usage;
+    value(PROC_GFX) += proc.gfx_usage;
+    value(PROC_COMPUTE) += proc.compute_usage;
+    value(PROC_ENC) += proc.enc_usage;
+    value(PROC_DEC) += proc.dec_usage;
+    value(PROC_VRAM) += proc.memory_usage;
+    value(PROC_GTT) += proc.gtt_usage;
+    value(PROC_ENERGY) += proc.energy_joules;
+    value(PROC_VRAM_GROWTH) += proc.vram_growth;
+    value(PROC_GTT_GROWTH) += proc.gtt_growth;
+    value(PROC_LEAK) = std::max(value(PROC_LEAK), proc.vram_growing || proc.gtt_growing ? 1.0 : 0.0);
+    // Host figures of the process, the same on every GPU
+    value(PROC_CPU) = proc.cpu_usage;
+    value(PROC_RSS) = proc.rss;
+    value(PROC_THREADS) = proc.threads;
+}
+
+void RuleEngine::evaluate(const Snapshot& snapshot) {
+    reapHooks();
+    generation++;
+
+    // Process rules only look at new scans, which adaptive sampling takes less often
+    uint64_t scanned = snapshot.timestamp_ns;
+    if (!snapshot.gpus.empty() && !snapshot.gpus[0].nodes.empty() && snapshot.gpus[0].nodes[0].processes_timestamp_ns) {
+        scanned = snapshot.gpus[0].nodes[0].processes_timestamp_ns;
+    }
+    bool new_scan = !snapshot.processes_pending && scanned != last_scan_ns;
+    std::vector<ProcessTotals> processes;
+    bool has_processes = false;
+
+    for (auto& rule : rules) {
+        values.resize(rule.terms.size());
+
+        if (rule.scope == GPU) {
+            for (size_t i = 0; i < snapshot.gpus.size(); i++) {
+                if (rule.index >= 0 && (size_t)rule.index != i) continue;
+                const GPUSnapshot& gpu = snapshot.gpus[i];
+                for (size_t t = 0; t < rule.terms.size(); t++) {
+                    values[t] = gpuValue(gpu, rule.terms[t].field);
+                }
+                std::string target = (gpu.host.empty() ? "" : gpu.host + " ") + "gpu" + std::to_string(i) + " " +
+                                     gpu.pci_path;
+                evaluateTarget(rule, gpu.host + "/" + gpu.pci_path, target,
+                               gpu.metrics.timestamp_ns ? gpu.metrics.timestamp_ns : snapshot.timestamp_ns);
+            }
+        } else {
+            if (!new_scan) continue;
+            if (!has_processes) {
+                std::unordered_map<pid_t, size_t> index;
+                for (const auto& gpu : snapshot.gpus) {
+                    for (const auto& node : gpu.nodes) {
+                        for (const auto& proc : node.processes) {
+                            auto inserted = index.emplace(proc.pid, processes.size());
+                            if (inserted.second) {
+                                processes.emplace_back();
+                                processes.back().pid = proc.pid;
+                                processes.back().name = proc.name;
+                            }
+                            addProcess(processes[inserted.first->second], proc);
+                        }
+                    }
+                }
+                has_processes = true;
+            }
+            for (const auto& process : processes) {
+                if (rule.index >= 0 && process.pid != rule.index) continue;
+                if (!rule.selector.empty() && process.name != rule.selector) continue;
+                for (size_t t = 0; t < rule.terms.size(); t++) {
+                    values[t] = process.values[rule.terms[t].field - PROC_FIRST];
+                }
+                evaluateTarget(rule, std::to_string(process.pid),
+                               "pid " + std::to_string(process.pid) + " (" + process.name + ")", scanned);
+            }
+        }
+
+        // Targets that went away clear their alerts
+        for (auto it = rule.targets.begin(); it != rule.targets.end();) {
+            if (it->second.generation == generation) {
+                ++it;
+                continue;
+            }
+            if (it->second.firing) {
+                notify(rule, it->second.label, false, it->second);
+            }
+            it = rule.targets.erase(it);
+        }
+    }
+
+    if (new_scan) last_scan_ns = scanned;
+}
+
+void RuleEngine::evaluateTarget(Rule& rule, const std::string& key, const std::string& target, uint64_t now_ns) {
+    TargetState& state = rule.targets[key];
+    state.generation = generation;
+    state.label = target;
+    if (state.sampled_ns == now_ns) return;  // Not sampled again since
+
+    bool first = state.values.empty();
+    if (first) {
+        state.values.assign(rule.terms.size(), 0);
+        state.rates.assign(rule.terms.size(), 0);
+    }
+    double elapsed = !first && now_ns > state.sampled_ns ? (now_ns - state.sampled_ns) / 1e9 : 0;
+    for (size_t t = 0; t < rule.terms.size(); t++) {
+        const Term& term = rule.terms[t];
+        if (term.rate && elapsed > 0) {
+            // Exponentially weighted over the window, correct for uneven sample intervals
+            double instant = (values[t] - state.values[t]) / elapsed;
+            double weight = 1 - std::exp(-elapsed * NS_PER_S / term.window_ns);
+            state.rates[t] += (instant - state.rates[t]) * weight;
+        }
+        state.values[t] = values[t];
+    }
+    state.sampled_ns = now_ns;
+
+    bool match = false;
+    for (const auto& group : rule.any_of) {
+        bool all = true;
+        for (const auto& condition : group) {
+            const Term& term = rule.terms[condition.term];
+            if (term.rate && first) {
+                all = false;  // No rate before the second sample
+                break;
+            }
+            double value = term.rate ? state.rates[condition.term] : state.values[condition.term];
+            bool holds = condition.op == LESS ? value < condition.value :
+                         condition.op == LESS_EQUAL ? value <= condition.value :
+                         condition.op == GREATER ? value > condition.value :
+                         value >= condition.value;
+            if (!holds) {
+                all = false;
+                break;
+            }
+        }
+        if (all) {
+            match = true;
+            break;
+        }
+    }
+
+    if (!match) {
+        state.holding = false;
+        if (state.firing) {
+            state.firing = false;
+            notify(rule, target, false, state);
+        }
+        return;
+    }
+    if (!state.holding) {
+        state.holding = true;
+        state.holding_since_ns = now_ns;
+    }
+    if (!state.firing && now_ns - state.holding_since_ns >= rule.hold_ns) {
+        state.firing = true;
+        fired++;
+        notify(rule, target, true, state);
+    }
+}
+
+size_t RuleEngine::getFiringCount() const {
+    size_t firing = 0;
+    for (const auto& rule : rules) {
+        for (const auto& target : rule.targets) {
+            if (target.second.firing) firing++;
+        }
+    }
+    return firing;
+}
+
+void RuleEngine::notify(const Rule& rule, const std::string& target, bool firing, const TargetState& state) {
+    // The value of the first term says what the rule is about
+    const Term& term = rule.terms[0];
+    std::string value = state.values.empty() ? "n/a" :
+        formatValue(term.rate ? state.rates[0] : state.values[0], FIELDS[term.field].kind, term.rate);
+
+    std::string message = std::string(firing ? "FIRING " : "CLEARED ") + target + ": " + rule.text + " (" +
+                          (term.rate ? "rate(" + term.name + ")" : term.name) + " " + value + ")";
+    if (firing) {
+        Logger::warning("Alert " + message);
+    } else {
+        Logger::info("Alert " + message);
+    }
+    if (log) {
+        time_t now = time(nullptr);
+        char timestamp[32];
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+        fprintf(log, "%s %s\n", timestamp, message.c_str());
+        fflush(log);
+    }
+    if (!rule.exec.empty()) {
+        runHook(rule, target, firing, value);
+    }
+}
+
+/**
+ * Run the exec hook of a rule without waiting for it
+ *
+ * The hook gets the alert in its environment (AMDGPU_TOP_STATE firing or
+ * cleared, AMDGPU_TOP_RULE, AMDGPU_TOP_TARGET, AMDGPU_TOP_VALUE) and
+ * /dev/null as input. Finished hooks are reaped on later evaluations; past
+ * MAX_HOOKS running ones, further alerts are only logged.
+ */
+void RuleEngine::runHook(const Rule& rule, const std::string& target, bool firing, const std::string& value) {
+    reapHooks();
+    if (hooks.size() >= MAX_HOOKS) {
+        Logger::warning("Alert hook skipped, " + std::to_string(hooks.size()) + " still running: " + rule.exec);
+        return;
+    }
+
+    std::vector<std::string> variables = {
+        std::string("AMDGPU_TOP_STATE=") + (firing ? "firing" : "cleared"),
+        "AMDGPU_TOP_RULE=" + rule.text,
+        "AMDGPU_TOP_TARGET=" + target,
+        "AMDGPU_TOP_VALUE=" + value,
+    };
+    std::vector<char*> environment;
+    for (char** variable = environ; *variable; variable++) {
+        if (strncmp(*variable, "AMDGPU_TOP_", 11) != 0) environment.push_back(*variable);
+    }
+    for (auto& variable : variables) {
+        environment.push_back(&variable[0]);
+    }
+    environment.push_back(nullptr);
+
+    char shell[] = "/bin/sh";
+    char flag[] = "-c";
+    std::string command = rule.exec;
+    char* argv[] = {shell, flag, &command[0], nullptr};
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    pid_t pid;
+    int result = posix_spawn(&pid, shell, &actions, nullptr, argv, environment.data());
+    posix_spawn_file_actions_destroy(&actions);
+    if (result != 0) {
+        Logger::error("Cannot run alert hook " + rule.exec + ": " + strerror(result));
+        return;
+    }
+    hooks.push_back(pid);
+}
+
+void RuleEngine::reapHooks() {
+    for (auto it = hooks.begin(); it != hooks.end();) {
+        int status;
+        pid_t result = waitpid(*it, &status, WNOHANG);
+        if (result == 0 || (result < 0 && errno == EINTR)) {
+            ++it;
+            continue;
+        }
+        if (result > 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+            Logger::warning("Alert hook " + std::to_string(*it) + " failed");
+        }
+        it = hooks.erase(it);
+    }
+}
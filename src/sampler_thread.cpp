@@ -0,0 +1,77 @@
+#include "sampler_thread.hpp"
+#include <utility>
+
+SamplerThread::~SamplerThread() {
+    stop();
+}
+
+void SamplerThread::start(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+    on_sample = std::move(callback);
+    running = true;
+    thread = std::thread(&SamplerThread::run, this);
+}
+
+void SamplerThread::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+bool SamplerThread::takeSnapshot(Snapshot& snapshot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!has_latest) return false;
+    // The caller's previous snapshot comes back as the next buffer to fill
+    std::swap(snapshot, latest);
+    has_latest = false;
+    return true;
+}
+
+void SamplerThread::deliver() {
+    stats.getSnapshot(scratch);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(scratch, latest);
+        has_latest = true;
+    }
+    if (on_sample) on_sample();
+}
+
+void SamplerThread::run() {
+    stats.sampleDevices();
+    deliver();
+    stats.update();
+    deliver();
+
+    std::chrono::milliseconds interval = PRIME_INTERVAL;
+    auto next = std::chrono::steady_clock::now();
+    bool primed = false;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        if (primed && stats.isAdaptive()) {
+            next = stats.getNextSampleTime();
+        } else {
+            next += interval;
+            interval = UPDATE_INTERVAL;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (next < now) next = now;
+        if (wake.wait_until(lock, next, [this] { return !running; })) break;
+
+        lock.unlock();
+        if (primed) {
+            stats.updateDue();
+        } else {
+            stats.update();
+            primed = true;
+        }
+        deliver();
+        lock.lock();
+    }
+}
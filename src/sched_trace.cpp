@@ -0,0 +1,658 @@
+#include "sched_trace.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <poll.h>
+#include <sstream>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include "logger.hpp"
+
+// Ring buffer event types (kernel/trace/ring_buffer.c)
+static constexpr unsigned TYPE_PADDING = 29;
+static constexpr unsigned TYPE_TIME_EXTEND = 30;
+static constexpr unsigned TYPE_TIME_STAMP = 31;
+static constexpr unsigned TIME_SHIFT = 27;
+static constexpr uint64_t COMMIT_MISSED_EVENTS = 1ULL << 31;
+static constexpr uint64_t COMMIT_LENGTH_MASK = (1ULL << 30) - 1;
+
+static const char* const SCHED_EVENTS[] = {
+    "gpu_scheduler/drm_sched_job",
+    "gpu_scheduler/drm_run_job",
+    "gpu_scheduler/drm_sched_process_job",
+    "amdgpu/amdgpu_cs_ioctl",  // optional, not every kernel has it
+};
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t monotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool readFile(const std::string& path, std::string& content) {
+    std::ifstream file(path);
+    if (!file) return false;
+    std::stringstream ss;
+    ss << file.rdbuf();
+    content = ss.str();
+    return true;
+}
+
+static bool writeFile(const std::string& path, const std::string& content) {
+    int fd = open(path.c_str(), O_WRONLY | O_TRUNC | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = write(fd, content.data(), content.size()) == (ssize_t)content.size();
+    close(fd);
+    return ok;
+}
+
+// Value of "key:N;" in a line of a format file
+static long formatValue(const std::string& line, const char* key) {
+    size_t pos = line.find(key);
+    return pos == std::string::npos ? -1 : strtol(line.c_str() + pos + strlen(key), nullptr, 10);
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    counts[bucketOf(ns)]++;
+    count++;
+    sum += ns;
+    max = std::max(max, ns);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (unsigned i = 0; i < BUCKETS; i++) {
+        counts[i] += other.counts[i];
+    }
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+}
+
+unsigned LatencyHistogram::bucketOf(uint64_t ns) {
+    if (ns < (1u << SUB_BITS)) return ns;
+    unsigned exponent = 63 - __builtin_clzll(ns);
+    return ((exponent - SUB_BITS + 1) << SUB_BITS) + ((ns >> (exponent - SUB_BITS)) & ((1u << SUB_BITS) - 1));
+}
+
+uint64_t LatencyHistogram::bucketLow(unsigned bucket) {
+    if (bucket < (1u << SUB_BITS)) return bucket;
+    unsigned exponent = (bucket >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t mantissa = (1u << SUB_BITS) + (bucket & ((1u << SUB_BITS) - 1));
+    return mantissa << (exponent - SUB_BITS);
+}
+
+uint64_t LatencyHistogram::getPercentile(double percent) const {
+    if (!count) return 0;
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)(percent / 100.0 * count + 0.5));
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen < rank) continue;
+        uint64_t low = bucketLow(i);
+        uint64_t width = i + 1 < BUCKETS ? bucketLow(i + 1) - low : low;
+        return std::min(low + width / 2, max);
+    }
+    return max;
+}
+
+bool SchedTraceDecoder::addFormat(const std::string& format) {
+    std::istringstream in(format);
+    std::string line;
+    std::string name;
+    long id = -1;
+    EventFormat event = {};
+
+    while (std::getline(in, line)) {
+        if (line.compare(0, 6, "name: ") == 0) {
+            name = line.substr(6);
+            continue;
+        }
+        if (line.compare(0, 4, "ID: ") == 0) {
+            id = strtol(line.c_str() + 4, nullptr, 10);
+            continue;
+        }
+
+        // "\tfield:struct dma_fence * fence;\toffset:16;\tsize:8;\tsigned:0;"
+        size_t start = line.find("field:");
+        size_t end = line.find(';', start);
+        if (start == std::string::npos || end == std::string::npos) continue;
+        std::string declaration = line.substr(start + 6, end - start - 6);
+        size_t bracket = declaration.find('[');
+        bool data_loc = declaration.find("__data_loc") != std::string::npos;
+        if (bracket != std::string::npos && !data_loc) declaration.resize(bracket);
+        size_t name_start = declaration.find_last_of(" *");
+        std::string field_name = declaration.substr(name_start == std::string::npos ? 0 : name_start + 1);
+
+        Field field;
+        long offset = formatValue(line, "offset:");
+        long size = formatValue(line, "size:");
+        if (offset < 0 || size <= 0 || offset > 0xffff) continue;
+        field.offset = offset;
+        field.size = std::min<long>(size, 8);
+
+        if (field_name == "fence") {
+            event.fence = field;
+        } else if (field_name == "fence_context") {
+            event.fence_context = field;
+        } else if (field_name == "fence_seqno") {
+            event.fence_seqno = field;
+        } else if (data_loc && (field_name == "name" || field_name == "ring")) {
+            event.ring = field;
+        }
+    }
+
+    if (name == "amdgpu_cs_ioctl") {
+        event.kind = CS_IOCTL;
+    } else if (name == "drm_sched_job") {
+        event.kind = SCHED_JOB;
+    } else if (name == "drm_run_job") {
+        event.kind = RUN_JOB;
+    } else if (name == "drm_sched_process_job") {
+        event.kind = PROCESS_JOB;
+    } else {
+        return false;
+    }
+    if (id < 0 || (!event.fence.size && !(event.fence_context.size && event.fence_seqno.size))) {
+        return false;
+    }
+    formats[id] = event;
+    return true;
+}
+
+void SchedTraceDecoder::setHeaderPage(const std::string& header_page) {
+    std::istringstream in(header_page);
+    std::string line;
+    while (std::getline(in, line)) {
+        long offset = formatValue(line, "offset:");
+        long size = formatValue(line, "size:");
+        if (offset < 0 || size <= 0) continue;
+        if (line.find(" commit;") != std::string::npos) {
+            commit_size = std::min<long>(size, 8);
+        } else if (line.find(" data;") != std::string::npos) {
+            data_offset = offset;
+        }
+    }
+}
+
+size_t SchedTraceDecoder::decodePage(const uint8_t* page, size_t size) {
+    if (size < data_offset) return 0;
+
+    uint64_t timestamp = getPageTimestamp(page);
+    uint64_t commit = 0;
+    memcpy(&commit, page + 8, commit_size);
+    if (commit & COMMIT_MISSED_EVENTS) lost_pages++;
+
+    const uint8_t* p = page + data_offset;
+    const uint8_t* end = p + std::min<size_t>(commit & COMMIT_LENGTH_MASK, size - data_offset);
+    size_t events = 0;
+
+    while (end - p >= 4) {
+        uint32_t header = read32(p);
+        unsigned type_len = header & 0x1f;
+        uint32_t delta = header >> 5;
+        p += 4;
+
+        if (type_len == TYPE_PADDING) {
+            // Without a delta it marks the end of the data, otherwise a discarded event
+            if (!delta || end - p < 4) break;
+            uint32_t skip = read32(p);
+            if (skip > (size_t)(end - p)) break;
+            p += skip;
+            continue;
+        }
+        if (type_len == TYPE_TIME_EXTEND || type_len == TYPE_TIME_STAMP) {
+            if (end - p < 4) break;
+            uint64_t extended = ((uint64_t)read32(p) << TIME_SHIFT) + delta;
+            p += 4;
+            // Absolute stamps have 59 bits, the page keeps the rest
+            timestamp = type_len == TYPE_TIME_EXTEND ? timestamp + extended
+                                                     : extended | (timestamp & ~((1ULL << 59) - 1));
+            continue;
+        }
+
+        size_t length;
+        if (type_len == 0) {
+            if (end - p < 4) break;
+            uint32_t stored = read32(p);
+            p += 4;
+            if (stored < 4) break;
+            length = (stored - 4 + 3) & ~3u;
+        } else {
+            length = type_len * 4;
+        }
+        if (length > (size_t)(end - p)) break;
+
+        timestamp += delta;
+        decodeEvent(p, length, timestamp);
+        p += length;
+        events++;
+    }
+    return events;
+}
+
+uint16_t SchedTraceDecoder::internRing(const char* name, size_t length) {
+    for (size_t i = 0; i < rings.size(); i++) {
+        if (rings[i].size() == length && memcmp(rings[i].data(), name, length) == 0) return i;
+    }
+    if (rings.size() >= 0xffff) return 0;
+    rings.emplace_back(name, length);
+    return rings.size() - 1;
+}
+
+void SchedTraceDecoder::decodeEvent(const uint8_t* data, size_t length, uint64_t timestamp) {
+    if (length < 8) return;
+    uint16_t type;
+    memcpy(&type, data, sizeof(type));
+    auto format = formats.find(type);
+    if (format == formats.end()) return;
+    const EventFormat& event = format->second;
+
+    int32_t pid;
+    memcpy(&pid, data + 4, sizeof(pid));
+    auto read = [&](const Field& field) -> uint64_t {
+        uint64_t value = 0;
+        if (field.size && field.offset + field.size <= length) memcpy(&value, data + field.offset, field.size);
+        return value;
+    };
+
+    uint64_t fence = event.fence.size ? read(event.fence)
+                                      : read(event.fence_context) * 0x9E3779B97F4A7C15ULL + read(event.fence_seqno);
+    if (!fence) return;
+    newest_ns = std::max(newest_ns, timestamp);
+
+    auto found = jobs.find(fence);
+    if (found == jobs.end()) {
+        if (jobs.size() >= MAX_PENDING_JOBS) sweep();
+        if (jobs.size() >= MAX_PENDING_JOBS) return;
+        found = jobs.emplace(fence, Job()).first;
+    }
+    Job& job = found->second;
+
+    switch (event.kind) {
+        case CS_IOCTL:
+        case SCHED_JOB:
+            job.submit_ns = job.submit_ns ? std::min(job.submit_ns, timestamp) : timestamp;
+            if (!job.pid) job.pid = getThreadGroup(pid);
+            break;
+        case RUN_JOB:
+            job.run_ns = timestamp;
+            break;
+        case PROCESS_JOB:
+            job.done_ns = timestamp;
+            break;
+    }
+
+    // __data_loc: offset in the low, length with the terminator in the high half
+    if (event.ring.size && !job.has_ring) {
+        uint32_t location = read(event.ring);
+        size_t offset = location & 0xffff;
+        size_t size = location >> 16;
+        if (size && offset + size <= length) {
+            const char* name = reinterpret_cast<const char*>(data + offset);
+            job.ring = internRing(name, strnlen(name, size));
+            job.has_ring = true;
+        }
+    }
+
+    if (job.submit_ns && job.run_ns && job.done_ns) {
+        auto key = std::make_pair(job.pid, job.ring);
+        auto entry = stats.find(key);
+        if (entry == stats.end()) {
+            entry = stats.emplace(key, SchedJobStats()).first;
+            entry->second.pid = job.pid;
+            entry->second.ring = job.has_ring ? rings[job.ring] : "?";
+        }
+        SchedJobStats& job_stats = entry->second;
+        if (job.run_ns >= job.submit_ns) job_stats.queue.record(job.run_ns - job.submit_ns);
+        if (job.done_ns >= job.run_ns) job_stats.exec.record(job.done_ns - job.run_ns);
+        if (job.done_ns >= job.submit_ns) job_stats.total.record(job.done_ns - job.submit_ns);
+        jobs.erase(found);
+    }
+
+    if (++events_since_sweep >= SWEEP_EVENTS) sweep();
+}
+
+pid_t SchedTraceDecoder::getThreadGroup(pid_t tid) {
+    if (tid <= 0) return tid;
+    auto found = tgids.find(tid);
+    if (found != tgids.end()) return found->second;
+    if (!resolve_tgids) return tid;
+
+    // A thread that is already gone stays keyed by itself
+    pid_t tgid = tid;
+    std::ifstream status("/proc/" + std::to_string(tid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 5, "Tgid:") == 0) {
+            tgid = atoi(line.c_str() + 5);
+            break;
+        }
+    }
+    tgids[tid] = tgid;
+    if (tgid_record) fprintf(tgid_record, "%d %d\n", (int)tid, (int)tgid);
+    return tgid;
+}
+
+void SchedTraceDecoder::sweep() {
+    events_since_sweep = 0;
+    for (auto it = jobs.begin(); it != jobs.end();) {
+        const Job& job = it->second;
+        uint64_t latest = std::max(job.submit_ns, std::max(job.run_ns, job.done_ns));
+        if (latest + STALE_NS < newest_ns) {
+            it = jobs.erase(it);
+            stale_jobs++;
+        } else {
+            ++it;
+        }
+    }
+}
+
+void SchedTraceDecoder::forgetExitedProcesses() {
+    for (auto it = stats.begin(); it != stats.end();) {
+        if (it->first.first > 0 && kill(it->first.first, 0) < 0 && errno == ESRCH) {
+            it = stats.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    // Thread IDs get reused, look them up again once they are gone
+    for (auto it = tgids.begin(); it != tgids.end();) {
+        if (kill(it->first, 0) < 0 && errno == ESRCH) {
+            it = tgids.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::string formatLatency(uint64_t ns) {
+    char text[32];
+    if (ns >= 1000000000ULL) {
+        snprintf(text, sizeof(text), "%.2f s", ns / 1e9);
+    } else if (ns >= 1000000) {
+        snprintf(text, sizeof(text), "%.2f ms", ns / 1e6);
+    } else if (ns >= 1000) {
+        snprintf(text, sizeof(text), "%.1f us", ns / 1e3);
+    } else {
+        snprintf(text, sizeof(text), "%llu ns", (unsigned long long)ns);
+    }
+    return text;
+}
+
+SchedTracer::~SchedTracer() {
+    stop();
+}
+
+bool SchedTracer::loadFormats(const std::string& events_path) {
+    std::string header_page;
+    if (readFile(std::string(TRACEFS_PATH) + "/events/header_page", header_page)) {
+        decoder.setHeaderPage(header_page);
+        if (!record_dir.empty()) writeFile(record_dir + "/header_page", header_page);
+    }
+
+    bool has_sched = false;
+    for (const char* event : SCHED_EVENTS) {
+        std::string format;
+        if (!readFile(events_path + "/" + event + "/format", format) || !decoder.addFormat(format)) continue;
+        if (!writeFile(events_path + "/" + event + "/enable", "1")) {
+            Logger::warning(std::string("Cannot enable tracepoint ") + event + ": " + strerror(errno));
+            continue;
+        }
+        has_sched |= strncmp(event, "gpu_scheduler/", 14) == 0;
+        if (!record_dir.empty()) {
+            const char* name = strchr(event, '/') + 1;
+            std::ofstream(record_dir + "/" + name + ".format") << format;
+        }
+    }
+    if (!record_dir.empty()) {
+        std::ofstream(record_dir + "/page_size") << page_size << "\n";
+    }
+    return has_sched;
+}
+
+bool SchedTracer::start() {
+    page_size = sysconf(_SC_PAGESIZE);
+    instance_path = std::string(TRACEFS_PATH) + "/instances/" + INSTANCE_NAME;
+    if (mkdir(instance_path.c_str(), 0755) < 0 && errno != EEXIST) {
+        Logger::error("Cannot create the tracefs instance " + instance_path + ": " + strerror(errno));
+        return false;
+    }
+
+    // Monotonic stamps line up with the rest of our timestamps; wake readers on any data
+    writeFile(instance_path + "/trace_clock", "mono");
+    writeFile(instance_path + "/buffer_size_kb", "1024");
+    writeFile(instance_path + "/buffer_percent", "0");
+
+    if (!record_dir.empty()) {
+        mkdir(record_dir.c_str(), 0755);
+        // Threads of the recording machine mean nothing elsewhere, replay takes their process from here
+        std::string tgids = record_dir + "/tgids";
+        tgid_file = fopen(tgids.c_str(), "we");
+        if (!tgid_file) Logger::error("Cannot record to " + tgids + ": " + strerror(errno));
+    }
+    decoder.resolveThreadGroups(tgid_file);
+    if (!loadFormats(instance_path + "/events")) {
+        Logger::error("The gpu_scheduler tracepoints are not available");
+        cleanup();
+        return false;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    for (long cpu = 0; cpu < cpus; cpu++) {
+        std::string path = instance_path + "/per_cpu/cpu" + std::to_string(cpu) + "/trace_pipe_raw";
+        int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) continue;
+        cpu_fds.push_back(fd);
+        if (!record_dir.empty()) {
+            std::string raw = record_dir + "/cpu" + std::to_string(cpu) + ".raw";
+            FILE* file = fopen(raw.c_str(), "we");
+            if (!file) Logger::error("Cannot record to " + raw + ": " + strerror(errno));
+            record_files.push_back(file);
+        }
+    }
+    if (cpu_fds.empty()) {
+        Logger::error("Cannot read " + instance_path + "/per_cpu: " + strerror(errno));
+        cleanup();
+        return false;
+    }
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        Logger::error(std::string("eventfd failed: ") + strerror(errno));
+        cleanup();
+        return false;
+    }
+    writeFile(instance_path + "/tracing_on", "1");
+
+    running = true;
+    thread = std::thread(&SchedTracer::run, this);
+    Logger::info("Tracing GPU scheduler jobs in " + instance_path);
+    return true;
+}
+
+void SchedTracer::stop() {
+    if (running) {
+        running = false;
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0) {
+            Logger::debug(std::string("Scheduler tracer wakeup failed: ") + strerror(errno));
+        }
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+    cleanup();
+}
+
+void SchedTracer::cleanup() {
+    if (instance_path.empty()) return;
+    writeFile(instance_path + "/tracing_on", "0");
+    for (const char* event : SCHED_EVENTS) {
+        writeFile(instance_path + "/events/" + event + "/enable", "0");
+    }
+    for (int fd : cpu_fds) {
+        close(fd);
+    }
+    cpu_fds.clear();
+    for (FILE* file : record_files) {
+        if (file) fclose(file);
+    }
+    record_files.clear();
+    if (tgid_file) {
+        fclose(tgid_file);
+        tgid_file = nullptr;
+        decoder.resolveThreadGroups(nullptr);
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+    // Only goes once no file of the instance is open
+    if (rmdir(instance_path.c_str()) < 0) {
+        Logger::debug("Cannot remove " + instance_path + ": " + strerror(errno));
+    }
+    instance_path.clear();
+}
+
+void SchedTracer::run() {
+    std::vector<pollfd> fds;
+    for (int fd : cpu_fds) {
+        fds.push_back({fd, POLLIN, 0});
+    }
+    fds.push_back({wake_fd, POLLIN, 0});
+    std::vector<uint8_t> page(page_size);
+
+    while (running) {
+        // Partly filled pages are only handed out on a read, so read every CPU at least once a second
+        if (poll(fds.data(), fds.size(), 1000) < 0 && errno != EINTR) {
+            Logger::error(std::string("Scheduler tracer poll failed: ") + strerror(errno));
+            break;
+        }
+        for (size_t cpu = 0; cpu < cpu_fds.size() && running; cpu++) {
+            ssize_t size;
+            while ((size = read(cpu_fds[cpu], page.data(), page.size())) > 0) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    decoder.decodePage(page.data(), size);
+                }
+                if (cpu < record_files.size() && record_files[cpu]) {
+                    // Pages are recorded whole, so the recording can be read back page by page
+                    if (size < (ssize_t)page.size()) memset(page.data() + size, 0, page.size() - size);
+                    fwrite(page.data(), 1, page.size(), record_files[cpu]);
+                }
+            }
+        }
+    }
+}
+
+void SchedTracer::getLatencies(std::vector<SchedLatency>& latencies) {
+    std::lock_guard<std::mutex> lock(mutex);
+    decoder.forgetExitedProcesses();
+
+    uint64_t now = monotonicNs();
+    double seconds = last_summary_ns ? (now - last_summary_ns) / 1e9 : 0;
+    last_summary_ns = now;
+
+    std::map<std::pair<pid_t, uint16_t>, uint64_t> jobs;
+    latencies.clear();
+    for (const auto& entry : decoder.getStats()) {
+        const SchedJobStats& stats = entry.second;
+        SchedLatency latency;
+        latency.pid = stats.pid;
+        latency.ring = stats.ring;
+        latency.jobs = stats.total.getCount();
+        auto reported = reported_jobs.find(entry.first);
+        uint64_t previous = reported != reported_jobs.end() ? reported->second : 0;
+        latency.jobs_per_second = seconds > 0 ? (latency.jobs - previous) / seconds : 0;
+        latency.queue_p50_ns = stats.queue.getPercentile(50);
+        latency.queue_p99_ns = stats.queue.getPercentile(99);
+        latency.exec_p50_ns = stats.exec.getPercentile(50);
+        latency.exec_p99_ns = stats.exec.getPercentile(99);
+        latency.total_p99_ns = stats.total.getPercentile(99);
+        latencies.push_back(std::move(latency));
+        jobs[entry.first] = stats.total.getCount();
+    }
+    reported_jobs.swap(jobs);
+}
+
+bool replaySchedTrace(const std::string& dir, SchedTraceDecoder& decoder) {
+    std::string content;
+    if (readFile(dir + "/header_page", content)) {
+        decoder.setHeaderPage(content);
+    }
+    size_t page_size = 4096;
+    if (readFile(dir + "/page_size", content) && strtoul(content.c_str(), nullptr, 10) > 0) {
+        page_size = strtoul(content.c_str(), nullptr, 10);
+    }
+    std::ifstream tgids(dir + "/tgids");
+    int tid, tgid;
+    while (tgids >> tid >> tgid) {
+        decoder.addThreadGroup(tid, tgid);
+    }
+
+    struct Input {
+        FILE* file;
+        std::vector<uint8_t> page;
+        bool has_page;
+    };
+    std::vector<Input> inputs;
+
+    DIR* directory = opendir(dir.c_str());
+    if (!directory) {
+        Logger::error("Cannot open " + dir + ": " + strerror(errno));
+        return false;
+    }
+    while (dirent* entry = readdir(directory)) {
+        std::string name = entry->d_name;
+        auto endsWith = [&](const char* suffix) {
+            size_t length = strlen(suffix);
+            return name.size() > length && name.compare(name.size() - length, length, suffix) == 0;
+        };
+        if (endsWith(".format") && readFile(dir + "/" + name, content)) {
+            decoder.addFormat(content);
+        } else if (name.compare(0, 3, "cpu") == 0 && endsWith(".raw")) {
+            FILE* file = fopen((dir + "/" + name).c_str(), "rbe");
+            if (file) inputs.push_back({file, std::vector<uint8_t>(page_size), false});
+        }
+    }
+    closedir(directory);
+
+    if (!decoder.hasFormats() || inputs.empty()) {
+        Logger::error(dir + " has no scheduler event formats or raw CPU buffers");
+        for (auto& input : inputs) fclose(input.file);
+        return false;
+    }
+
+    // Merge the CPUs by page time, so jobs are not swept while their other stages are still unread
+    while (true) {
+        Input* next = nullptr;
+        for (auto& input : inputs) {
+            if (!input.has_page && input.file) {
+                input.has_page = fread(input.page.data(), 1, page_size, input.file) == page_size;
+                if (!input.has_page) {
+                    fclose(input.file);
+                    input.file = nullptr;
+                }
+            }
+            if (input.has_page && (!next || SchedTraceDecoder::getPageTimestamp(input.page.data()) <
+                                                SchedTraceDecoder::getPageTimestamp(next->page.data()))) {
+                next = &input;
+            }
+        }
+        if (!next) break;
+        decoder.decodePage(next->page.data(), page_size);
+        next->has_page = false;
+    }
+    return true;
+}
@@ -0,0 +1,412 @@
+#include "snapshot.hpp"
+#include <cerrno>
+#include <cstring>
+#include <set>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "logger.hpp"
+
+// Truncating copy into a fixed size field, always terminated
+template <size_t N>
+static void copyString(char (&field)[N], const std::string& value) {
+    size_t length = std::min(value.size(), N - 1);
+    memcpy(field, value.data(), length);
+    field[length] = 0;
+}
+
+static void writeMetrics(const GPUDevice::Metrics& metrics, ShmMetrics& shared) {
+    shared.gpu_usage = metrics.gpu_usage;
+    shared.memory_used = metrics.memory_used;
+    shared.memory_total = metrics.memory_total;
+    shared.memory_cpu_accessible_used = metrics.memory_cpu_accessible_used;
+    shared.memory_cpu_accessible_total = metrics.memory_cpu_accessible_total;
+    shared.gtt_used = metrics.gtt_used;
+    shared.gtt_total = metrics.gtt_total;
+    shared.evictions_rate = metrics.evictions_rate;
+    shared.bytes_moved_rate = metrics.bytes_moved_rate;
+    shared.cpu_page_faults_rate = metrics.cpu_page_faults_rate;
+    shared.vram_lost_counter = metrics.vram_lost_counter;
+    shared.reset_count = metrics.reset_count;
+    shared.eviction_pressure = metrics.eviction_pressure;
+    shared.temperature = metrics.temperature;
+    shared.temperature_junction = metrics.temperature_junction;
+    shared.temperature_memory = metrics.temperature_memory;
+    shared.power_usage = metrics.power_usage;
+    shared.power_cap = metrics.power_cap;
+    shared.fan_speed = metrics.fan_speed;
+    shared.fan_pwm = metrics.fan_pwm;
+    shared.voltage_gfx = metrics.voltage_gfx;
+    shared.voltage_northbridge = metrics.voltage_northbridge;
+    shared.gpu_clock = metrics.gpu_clock;
+    shared.memory_clock = metrics.memory_clock;
+    shared.energy = metrics.energy;
+    shared.energy_from_accumulator = metrics.energy_from_accumulator;
+
+    const LinkStats& link = metrics.link;
+    shared.pcie_speed = link.pcie_speed;
+    shared.pcie_max_speed = link.pcie_max_speed;
+    shared.pcie_width = link.pcie_width;
+    shared.pcie_max_width = link.pcie_max_width;
+    shared.pcie_rx_rate = link.pcie_rx_rate;
+    shared.pcie_tx_rate = link.pcie_tx_rate;
+    shared.pcie_bandwidth = link.pcie_bandwidth;
+    shared.xgmi_width = link.xgmi_width;
+    shared.xgmi_speed = link.xgmi_speed;
+    shared.xgmi_links = link.xgmi_links;
+    shared.xgmi_read_rate = link.xgmi_read_rate;
+    shared.xgmi_write_rate = link.xgmi_write_rate;
+    shared.timestamp_ns = metrics.timestamp_ns;
+}
+
+static void readMetrics(const ShmMetrics& shared, GPUDevice::Metrics& metrics) {
+    metrics.gpu_usage = shared.gpu_usage;
+    metrics.memory_used = shared.memory_used;
+    metrics.memory_total = shared.memory_total;
+    metrics.memory_cpu_accessible_used = shared.memory_cpu_accessible_used;
+    metrics.memory_cpu_accessible_total = shared.memory_cpu_accessible_total;
+    metrics.gtt_used = shared.gtt_used;
+    metrics.gtt_total = shared.gtt_total;
+    metrics.evictions_rate = shared.evictions_rate;
+    metrics.bytes_moved_rate = shared.bytes_moved_rate;
+    metrics.cpu_page_faults_rate = shared.cpu_page_faults_rate;
+    metrics.vram_lost_counter = shared.vram_lost_counter;
+    metrics.reset_count = shared.reset_count;
+    metrics.eviction_pressure = shared.eviction_pressure <= GPUDevice::PRESSURE_SEVERE ?
+        (GPUDevice::PressureLevel)shared.eviction_pressure : GPUDevice::PRESSURE_NONE;
+    metrics.temperature = shared.temperature;
+    metrics.temperature_junction = shared.temperature_junction;
+    metrics.temperature_memory = shared.temperature_memory;
+    metrics.power_usage = shared.power_usage;
+    metrics.power_cap = shared.power_cap;
+    metrics.fan_speed = shared.fan_speed;
+    metrics.fan_pwm = shared.fan_pwm;
+    metrics.voltage_gfx = shared.voltage_gfx;
+    metrics.voltage_northbridge = shared.voltage_northbridge;
+    metrics.gpu_clock = shared.gpu_clock;
+    metrics.memory_clock = shared.memory_clock;
+    metrics.energy = shared.energy;
+    metrics.energy_from_accumulator = shared.energy_from_accumulator != 0;
+
+    LinkStats& link = metrics.link;
+    link.pcie_speed = shared.pcie_speed;
+    link.pcie_max_speed = shared.pcie_max_speed;
+    link.pcie_width = shared.pcie_width;
+    link.pcie_max_width = shared.pcie_max_width;
+    link.pcie_rx_rate = shared.pcie_rx_rate;
+    link.pcie_tx_rate = shared.pcie_tx_rate;
+    link.pcie_bandwidth = shared.pcie_bandwidth;
+    link.xgmi_width = shared.xgmi_width;
+    link.xgmi_speed = shared.xgmi_speed;
+    link.xgmi_links = shared.xgmi_links;
+    link.xgmi_read_rate = shared.xgmi_read_rate;
+    link.xgmi_write_rate = shared.xgmi_write_rate;
+    metrics.timestamp_ns = shared.timestamp_ns;
+}
+
+template <size_t N>
+static uint32_t writeShares(const std::vector<ResidencyShare>& shares, ShmShare (&shared)[N]) {
+    uint32_t count = std::min(shares.size(), N);
+    for (uint32_t i = 0; i < count; i++) {
+        copyString(shared[i].label, shares[i].label);
+        shared[i].session = shares[i].session;
+        shared[i].window = shares[i].window;
+    }
+    return count;
+}
+
+template <size_t N>
+static void readShares(const ShmShare (&shared)[N], uint32_t count, std::vector<ResidencyShare>& shares) {
+    shares.clear();
+    for (uint32_t i = 0; i < std::min<uint32_t>(count, N); i++) {
+        shares.push_back({shmString(shared[i].label), shared[i].session, shared[i].window});
+    }
+}
+
+// BlockUsage names point at static tables; names read back are kept here for good
+static const char* internBlockName(const std::string& name) {
+    static std::set<std::string> names;
+    return names.insert(name).first->c_str();
+}
+
+static void writeGPU(const GPUSnapshot& gpu, ShmGPU& shared) {
+    copyString(shared.market_name, gpu.market_name);
+    copyString(shared.pci_path, gpu.pci_path);
+    copyString(shared.partition_mode, gpu.partition_mode);
+    writeMetrics(gpu.metrics, shared.metrics);
+
+    shared.block_count = std::min<uint32_t>(gpu.metrics.block_usage.size(), AMDGPU_TOP_MAX_BLOCKS);
+    for (uint32_t i = 0; i < shared.block_count; i++) {
+        copyString(shared.blocks[i].name, gpu.metrics.block_usage[i].name);
+        shared.blocks[i].busy = gpu.metrics.block_usage[i].busy;
+    }
+    shared.sclk_count = writeShares(gpu.metrics.sclk_residency, shared.sclk);
+    shared.mclk_count = writeShares(gpu.metrics.mclk_residency, shared.mclk);
+    shared.throttle_count = writeShares(gpu.metrics.throttle_residency, shared.throttle);
+    shared.throttle_reason_count = std::min<uint32_t>(gpu.metrics.throttle_reasons.size(),
+                                                    AMDGPU_TOP_MAX_THROTTLE_REASONS);
+    for (uint32_t i = 0; i < shared.throttle_reason_count; i++) {
+        copyString(shared.throttle_reasons[i], gpu.metrics.throttle_reasons[i]);
+    }
+}
+
+static void readGPU(const ShmGPU& shared, GPUSnapshot& gpu) {
+    gpu.market_name = shmString(shared.market_name);
+    gpu.pci_path = shmString(shared.pci_path);
+    gpu.partition_mode = shmString(shared.partition_mode);
+    readMetrics(shared.metrics, gpu.metrics);
+
+    gpu.metrics.block_usage.clear();
+    for (uint32_t i = 0; i < std::min<uint32_t>(shared.block_count, AMDGPU_TOP_MAX_BLOCKS); i++) {
+        gpu.metrics.block_usage.push_back({internBlockName(shmString(shared.blocks[i].name)), shared.blocks[i].busy});
+    }
+    readShares(shared.sclk, shared.sclk_count, gpu.metrics.sclk_residency);
+    readShares(shared.mclk, shared.mclk_count, gpu.metrics.mclk_residency);
+    readShares(shared.throttle, shared.throttle_count, gpu.metrics.throttle_residency);
+    gpu.metrics.throttle_reasons.clear();
+    for (uint32_t i = 0; i < std::min<uint32_t>(shared.throttle_reason_count, AMDGPU_TOP_MAX_THROTTLE_REASONS); i++) {
+        gpu.metrics.throttle_reasons.push_back(shmString(shared.throttle_reasons[i]));
+    }
+}
+
+static void writeProcess(const ProcessInfo& proc, uint32_t node, ShmProcess& shared) {
+    shared.pid = proc.pid;
+    shared.node = node;
+    copyString(shared.name, proc.name);
+    shared.is_rocm = proc.is_rocm;
+    shared.gfx_usage = proc.gfx_usage;
+    shared.compute_usage = proc.compute_usage;
+    shared.enc_usage = proc.enc_usage;
+    shared.dec_usage = proc.dec_usage;
+    shared.cpu_usage = proc.cpu_usage;
+    shared.io_wait = proc.io_wait;
+    shared.threads = proc.threads;
+    shared.memory_usage = proc.memory_usage;
+    shared.gtt_usage = proc.gtt_usage;
+    shared.rss = proc.rss;
+    shared.energy_joules = proc.energy_joules;
+    shared.vram_growth = proc.vram_growth;
+    shared.gtt_growth = proc.gtt_growth;
+    shared.vram_full_seconds = proc.vram_full_seconds;
+    shared.growth_flags = (proc.vram_growing ? AMDGPU_TOP_GROWTH_VRAM : 0) | (proc.gtt_growing ? AMDGPU_TOP_GROWTH_GTT : 0);
+}
+
+static void readProcess(const ShmProcess& shared, ProcessInfo& proc) {
+    proc.pid = shared.pid;
+    proc.name = shmString(shared.name);
+    proc.is_rocm = shared.is_rocm != 0;
+    proc.gfx_usage = shared.gfx_usage;
+    proc.compute_usage = shared.compute_usage;
+    proc.enc_usage = shared.enc_usage;
+    proc.dec_usage = shared.dec_usage;
+    proc.cpu_usage = shared.cpu_usage;
+    proc.io_wait = shared.io_wait;
+    proc.threads = shared.threads;
+    proc.memory_usage = shared.memory_usage;
+    proc.gtt_usage = shared.gtt_usage;
+    proc.rss = shared.rss;
+    proc.energy_joules = shared.energy_joules;
+    proc.vram_growth = shared.vram_growth;
+    proc.gtt_growth = shared.gtt_growth;
+    proc.vram_full_seconds = shared.vram_full_seconds;
+    proc.vram_growing = (shared.growth_flags & AMDGPU_TOP_GROWTH_VRAM) != 0;
+    proc.gtt_growing = (shared.growth_flags & AMDGPU_TOP_GROWTH_GTT) != 0;
+    // The render node only has a meaning on the publishing host, the node index
+    // keeps clients of different partitions apart for the process table
+    proc.drm_device = shared.node;
+}
+
+bool flattenSnapshot(const Snapshot& snapshot, amdgpu_top_snapshot& flat) {
+    flat.timestamp_ns = snapshot.timestamp_ns;
+    flat.gpu_count = flat.node_count = flat.process_count = 0;
+    flat.gpu_total = flat.node_total = flat.process_total = 0;
+
+    for (const auto& gpu : snapshot.gpus) {
+        flat.gpu_total++;
+        flat.node_total += gpu.nodes.size();
+        for (const auto& node : gpu.nodes) {
+            flat.process_total += node.processes.size();
+        }
+
+        // A GPU goes in with all of its nodes or not at all, readers index them
+        if (flat.gpu_count == flat.gpu_capacity || flat.node_count + gpu.nodes.size() > flat.node_capacity) {
+            continue;
+        }
+
+        amdgpu_top_gpu& flat_gpu = flat.gpus[flat.gpu_count];
+        writeGPU(gpu, flat_gpu);
+        flat_gpu.first_node = flat.node_count;
+        flat_gpu.node_count = gpu.nodes.size();
+
+        for (const auto& node : gpu.nodes) {
+            amdgpu_top_node& flat_node = flat.nodes[flat.node_count];
+            flat_node.gpu = flat.gpu_count;
+            flat_node.partition = node.partition;
+            flat_node.processes_timestamp_ns = node.processes_timestamp_ns;
+            writeMetrics(node.metrics, flat_node.metrics);
+            flat_node.first_process = flat.process_count;
+
+            for (const auto& proc : node.processes) {
+                if (flat.process_count == flat.process_capacity) break;
+                writeProcess(proc, flat.node_count, flat.processes[flat.process_count++]);
+            }
+            flat_node.process_count = flat.process_count - flat_node.first_process;
+            flat.node_count++;
+        }
+        flat.gpu_count++;
+    }
+
+    return flat.gpu_count < flat.gpu_total || flat.node_count < flat.node_total ||
+           flat.process_count < flat.process_total;
+}
+
+void fillSharedSnapshot(const Snapshot& snapshot, uint64_t sample_count, ShmSnapshot& segment) {
+    amdgpu_top_snapshot flat = {};
+    flat.gpus = segment.gpus;
+    flat.gpu_capacity = SHM_MAX_GPUS;
+    flat.nodes = segment.nodes;
+    flat.node_capacity = SHM_MAX_NODES;
+    flat.processes = segment.processes;
+    flat.process_capacity = SHM_MAX_PROCESSES;
+    flattenSnapshot(snapshot, flat);
+
+    segment.timestamp_ns = snapshot.timestamp_ns;
+    segment.sample_count = sample_count;
+    segment.gpu_count = flat.gpu_count;
+    segment.node_count = flat.node_count;
+    segment.process_count = flat.process_count;
+    segment.dropped_processes = flat.process_total - flat.process_count;
+}
+
+bool expandSnapshot(const amdgpu_top_gpu* gpus, uint32_t gpu_count, const amdgpu_top_node* nodes,
+                    uint32_t node_count, const amdgpu_top_process* processes, uint32_t process_count,
+                    Snapshot& snapshot) {
+    snapshot.gpus.resize(gpu_count);
+    for (uint32_t i = 0; i < gpu_count; i++) {
+        const amdgpu_top_gpu& flat_gpu = gpus[i];
+        GPUSnapshot& gpu = snapshot.gpus[i];
+        readGPU(flat_gpu, gpu);
+
+        // Ranges are clamped to the arrays, the records may come from a torn read or the network
+        gpu.nodes.clear();
+        uint32_t node_end = (uint32_t)std::min<uint64_t>((uint64_t)flat_gpu.first_node + flat_gpu.node_count, node_count);
+        for (uint32_t n = std::min(flat_gpu.first_node, node_count); n < node_end; n++) {
+            const amdgpu_top_node& flat_node = nodes[n];
+            NodeSnapshot node;
+            node.partition = flat_node.partition;
+            node.processes_timestamp_ns = flat_node.processes_timestamp_ns;
+            readMetrics(flat_node.metrics, node.metrics);
+            uint32_t process_end = (uint32_t)std::min<uint64_t>(
+                (uint64_t)flat_node.first_process + flat_node.process_count, process_count);
+            for (uint32_t p = std::min(flat_node.first_process, process_count); p < process_end; p++) {
+                ProcessInfo proc;
+                readProcess(processes[p], proc);
+                node.processes.push_back(std::move(proc));
+            }
+            gpu.nodes.push_back(std::move(node));
+        }
+    }
+
+    // The front ends index the first node of every GPU
+    for (const auto& gpu : snapshot.gpus) {
+        if (gpu.nodes.empty()) return false;
+    }
+    return true;
+}
+
+bool readSharedSnapshot(const ShmSnapshotReader& reader, Snapshot& snapshot) {
+    // The callback may see a torn snapshot, so fill a scratch copy and only keep it once it checked out
+    Snapshot next;
+    bool complete = false;
+    bool consistent = reader.read([&](const ShmSnapshot& segment) {
+        next.timestamp_ns = segment.timestamp_ns;
+        complete = expandSnapshot(segment.gpus, segment.gpuCount(), segment.nodes, segment.nodeCount(),
+                                  segment.processes, segment.processCount(), next);
+    });
+
+    if (!consistent || !complete) return false;
+    snapshot = std::move(next);
+    return true;
+}
+
+SnapshotPublisher::~SnapshotPublisher() {
+    if (segment) {
+        munmap(segment, sizeof(ShmSnapshot));
+        shm_unlink(name.c_str());
+    }
+}
+
+bool SnapshotPublisher::open() {
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        Logger::error("Cannot create snapshot segment " + name + ": " + strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        Logger::error("Cannot stat snapshot segment " + name + ": " + strerror(errno));
+        close(fd);
+        return false;
+    }
+    if (st.st_size != 0 && (size_t)st.st_size != sizeof(ShmSnapshot)) {
+        // Another layout: resizing it would fault its readers, give them their own copy to go stale
+        close(fd);
+        shm_unlink(name.c_str());
+        return open();
+    }
+
+    bool fresh = st.st_size == 0;
+    if (fresh && ftruncate(fd, sizeof(ShmSnapshot)) < 0) {
+        Logger::error("Cannot size snapshot segment " + name + ": " + strerror(errno));
+        close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, sizeof(ShmSnapshot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        Logger::error("Cannot map snapshot segment " + name + ": " + strerror(errno));
+        return false;
+    }
+    segment = static_cast<ShmSnapshot*>(mapping);
+
+    if (fresh) {
+        segment->magic = SHM_SNAPSHOT_MAGIC;
+        segment->version = SHM_SNAPSHOT_VERSION;
+        segment->size = sizeof(ShmSnapshot);
+    } else if (segment->magic != SHM_SNAPSHOT_MAGIC || segment->version != SHM_SNAPSHOT_VERSION ||
+               segment->size != sizeof(ShmSnapshot)) {
+        munmap(segment, sizeof(ShmSnapshot));
+        segment = nullptr;
+        shm_unlink(name.c_str());
+        return open();
+    } else if (segment->writer_pid != getpid() && kill(segment->writer_pid, 0) == 0) {
+        // Two writers would break the sequence lock
+        Logger::error("Snapshot segment " + name + " is published by pid " + std::to_string(segment->writer_pid));
+        munmap(segment, sizeof(ShmSnapshot));
+        segment = nullptr;
+        return false;
+    } else {
+        // Left by a run that did not get to unlink it; readers may still have it mapped
+        Logger::info("Taking over snapshot segment " + name + " from pid " + std::to_string(segment->writer_pid));
+        sample_count = segment->sample_count;
+    }
+    segment->writer_pid = getpid();
+    Logger::info("Publishing snapshots to " + name);
+    return true;
+}
+
+void SnapshotPublisher::publish(const Snapshot& snapshot) {
+    if (!segment) return;
+
+    // Odd while the snapshot is incomplete; a taken over segment may already be odd
+    uint64_t sequence = segment->sequence.load(std::memory_order_relaxed) | 1;
+    segment->sequence.store(sequence, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    fillSharedSnapshot(snapshot, ++sample_count, *segment);
+
+    segment->sequence.store(sequence + 1, std::memory_order_release);
+}
@@ -0,0 +1,228 @@
+#include "snapshot_stream.hpp"
+#include <cstring>
+
+// Shorter zero runs stay inside a literal, where they are cheaper than a new token
+static constexpr size_t MIN_ZERO_RUN = 4;
+
+static void appendVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)value | 0x80);
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+static bool readVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && data < end; shift += 7) {
+        uint8_t byte = *data++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Bytes of current XOR base, base zero-extended to the length of current
+static inline uint8_t deltaAt(const std::vector<uint8_t>& current, const std::vector<uint8_t>& base, size_t i) {
+    return current[i] ^ (i < base.size() ? base[i] : 0);
+}
+
+// Tokens of (zero run, literal length, literal bytes) until the end of current
+static void encodeDelta(const std::vector<uint8_t>& current, const std::vector<uint8_t>& base,
+                        std::vector<uint8_t>& out) {
+    size_t i = 0;
+    while (i < current.size()) {
+        size_t run_start = i;
+        while (i < current.size() && deltaAt(current, base, i) == 0) i++;
+        size_t run = i - run_start;
+
+        size_t literal_start = i;
+        size_t zeros = 0;
+        while (i < current.size() && zeros < MIN_ZERO_RUN) {
+            zeros = deltaAt(current, base, i) == 0 ? zeros + 1 : 0;
+            i++;
+        }
+        // Give a trailing zero run back to the next token
+        if (zeros == MIN_ZERO_RUN) i -= zeros;
+        size_t literal = i - literal_start;
+
+        appendVarint(out, run);
+        appendVarint(out, literal);
+        for (size_t j = literal_start; j < i; j++) {
+            out.push_back(deltaAt(current, base, j));
+        }
+    }
+}
+
+static bool applyDelta(const uint8_t* data, const uint8_t* end, std::vector<uint8_t>& records) {
+    size_t position = 0;
+    while (data < end) {
+        uint64_t run, literal;
+        if (!readVarint(data, end, run) || !readVarint(data, end, literal)) return false;
+        if (run > records.size() - position) return false;
+        position += run;
+        if (literal > records.size() - position || literal > (uint64_t)(end - data)) return false;
+        for (uint64_t j = 0; j < literal; j++) {
+            records[position++] ^= *data++;
+        }
+    }
+    return true;
+}
+
+// Unused label bytes and padding must not differ between frames, or they would travel
+template <typename T>
+static void clearRecords(std::vector<T>& records, size_t count) {
+    records.resize(count);
+    if (count) memset(records.data(), 0, count * sizeof(T));
+}
+
+template <typename T>
+static void appendRecords(const T* records, uint32_t count, std::vector<uint8_t>& out) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(records);
+    out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+template <typename T>
+static const uint8_t* readRecords(const uint8_t* bytes, uint32_t count, std::vector<T>& records) {
+    records.resize(count);
+    if (count) memcpy(records.data(), bytes, count * sizeof(T));
+    return bytes + count * sizeof(T);
+}
+
+void SnapshotEncoder::encode(const Snapshot& snapshot, std::vector<uint8_t>& frame) {
+    size_t node_total = 0;
+    size_t process_total = 0;
+    for (const auto& gpu : snapshot.gpus) {
+        node_total += gpu.nodes.size();
+        for (const auto& node : gpu.nodes) {
+            process_total += node.processes.size();
+        }
+    }
+
+    clearRecords(gpus, snapshot.gpus.size());
+    clearRecords(nodes, node_total);
+    clearRecords(processes, process_total);
+
+    amdgpu_top_snapshot flat = {};
+    flat.gpus = gpus.data();
+    flat.gpu_capacity = gpus.size();
+    flat.nodes = nodes.data();
+    flat.node_capacity = nodes.size();
+    flat.processes = processes.data();
+    flat.process_capacity = processes.size();
+    flattenSnapshot(snapshot, flat);
+    encode(flat, frame);
+}
+
+void SnapshotEncoder::encode(const amdgpu_top_snapshot& flat, std::vector<uint8_t>& frame) {
+    previous.swap(current);
+    current.clear();
+    appendRecords(flat.gpus, flat.gpu_count, current);
+    appendRecords(flat.nodes, flat.node_count, current);
+    appendRecords(flat.processes, flat.process_count, current);
+
+    header.magic = STREAM_MAGIC;
+    header.version = STREAM_VERSION;
+    header.gpu_record_size = sizeof(amdgpu_top_gpu);
+    header.node_record_size = sizeof(amdgpu_top_node);
+    header.process_record_size = sizeof(amdgpu_top_process);
+    header.gpu_count = flat.gpu_count;
+    header.node_count = flat.node_count;
+    header.process_count = flat.process_count;
+    header.sequence++;
+    header.timestamp_ns = flat.timestamp_ns;
+
+    // The first frame has nothing to refer to
+    if (header.sequence == 1) {
+        encodeKeyframe(frame);
+    } else {
+        appendFrame(0, previous, frame);
+    }
+}
+
+void SnapshotEncoder::encodeKeyframe(std::vector<uint8_t>& frame) const {
+    static const std::vector<uint8_t> nothing;
+    appendFrame(STREAM_KEYFRAME, nothing, frame);
+}
+
+void SnapshotEncoder::appendFrame(uint16_t flags, const std::vector<uint8_t>& base,
+                                  std::vector<uint8_t>& frame) const {
+    size_t start = frame.size();
+    frame.resize(start + sizeof(StreamFrameHeader));
+    encodeDelta(current, base, frame);
+
+    StreamFrameHeader frame_header = header;
+    frame_header.flags = flags;
+    frame_header.payload_size = frame.size() - start - sizeof(StreamFrameHeader);
+    memcpy(&frame[start], &frame_header, sizeof(frame_header));
+}
+
+void encodeMarkers(const StreamMarker* markers, size_t count, std::vector<uint8_t>& frame) {
+    StreamFrameHeader header = {};
+    header.magic = STREAM_MAGIC;
+    header.version = STREAM_VERSION;
+    header.flags = STREAM_MARKERS;
+    header.gpu_record_size = sizeof(amdgpu_top_gpu);
+    header.node_record_size = sizeof(amdgpu_top_node);
+    header.process_record_size = sizeof(amdgpu_top_process);
+    header.reserved = sizeof(StreamMarker);
+    header.payload_size = count * sizeof(StreamMarker);
+    header.timestamp_ns = count ? markers[count - 1].timestamp_ns : 0;
+
+    size_t start = frame.size();
+    frame.resize(start + sizeof(header) + header.payload_size);
+    memcpy(&frame[start], &header, sizeof(header));
+    if (count) memcpy(&frame[start + sizeof(header)], markers, header.payload_size);
+}
+
+bool decodeMarkers(const StreamFrameHeader& header, const uint8_t* payload, std::vector<StreamMarker>& markers) {
+    if (!(header.flags & STREAM_MARKERS) || header.reserved != sizeof(StreamMarker) ||
+        header.payload_size % sizeof(StreamMarker) != 0) {
+        return false;
+    }
+    markers.resize(header.payload_size / sizeof(StreamMarker));
+    if (!markers.empty()) memcpy(markers.data(), payload, header.payload_size);
+    return true;
+}
+
+bool SnapshotDecoder::isCompatible(const StreamFrameHeader& header) {
+    return header.magic == STREAM_MAGIC && header.version == STREAM_VERSION &&
+           header.gpu_record_size == sizeof(amdgpu_top_gpu) &&
+           header.node_record_size == sizeof(amdgpu_top_node) &&
+           header.process_record_size == sizeof(amdgpu_top_process) &&
+           header.payload_size <= STREAM_MAX_PAYLOAD;
+}
+
+bool SnapshotDecoder::decode(const StreamFrameHeader& header, const uint8_t* payload, Snapshot& snapshot) {
+    if (!isCompatible(header) || header.gpu_count > STREAM_MAX_RECORDS ||
+        header.node_count > STREAM_MAX_RECORDS || header.process_count > STREAM_MAX_RECORDS) {
+        return false;
+    }
+
+    if (header.flags & STREAM_MARKERS) return false;
+    bool keyframe = header.flags & STREAM_KEYFRAME;
+    if (!keyframe && !has_keyframe) return false;
+
+    size_t size = (size_t)header.gpu_count * sizeof(amdgpu_top_gpu) +
+                  (size_t)header.node_count * sizeof(amdgpu_top_node) +
+                  (size_t)header.process_count * sizeof(amdgpu_top_process);
+    if (keyframe) {
+        records.assign(size, 0);
+    } else {
+        records.resize(size, 0);
+    }
+    if (!applyDelta(payload, payload + header.payload_size, records)) {
+        has_keyframe = false;
+        return false;
+    }
+    has_keyframe = true;
+
+    const uint8_t* bytes = records.data();
+    bytes = readRecords(bytes, header.gpu_count, gpus);
+    bytes = readRecords(bytes, header.node_count, nodes);
+    readRecords(bytes, header.process_count, processes);
+
+    snapshot.timestamp_ns = header.timestamp_ns;
+    return expandSnapshot(gpus.data(), gpus.size(), nodes.data(), nodes.size(), processes.data(),
+                          processes.size(), snapshot);
+}
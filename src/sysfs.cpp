@@ -0,0 +1,56 @@
+#include "sysfs.hpp"
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+SysfsFile::~SysfsFile() {
+    close();
+}
+
+SysfsFile& SysfsFile::operator=(SysfsFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        fd = other.fd;
+        other.fd = -1;
+    }
+    return *this;
+}
+
+bool SysfsFile::open(const std::string& path) {
+    close();
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    return fd >= 0;
+}
+
+void SysfsFile::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+ssize_t SysfsFile::read(void* buf, size_t size) const {
+    if (fd < 0) return -1;
+    return pread(fd, buf, size, 0);
+}
+
+bool SysfsFile::readString(std::string& value) const {
+    char buf[4096];
+    ssize_t count = read(buf, sizeof(buf) - 1);
+    if (count <= 0) return false;
+
+    while (count > 0 && (buf[count - 1] == '\n' || buf[count - 1] == ' ')) count--;
+    value.assign(buf, count);
+    return true;
+}
+
+bool SysfsFile::readInt(int64_t& value) const {
+    char buf[64];
+    ssize_t count = read(buf, sizeof(buf) - 1);
+    if (count <= 0) return false;
+    buf[count] = '\0';
+
+    char* endptr;
+    value = strtoll(buf, &endptr, 10);
+    return endptr != buf;
+}
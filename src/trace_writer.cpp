@@ -0,0 +1,211 @@
+#include "trace_writer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include "logger.hpp"
+#include "snapshot.hpp"
+
+static uint64_t clockNs(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void appendString(std::string& out, const std::string& text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+TraceWriter::~TraceWriter() {
+    if (file) {
+        fputs("\n]\n", file);
+        fclose(file);
+    }
+}
+
+bool TraceWriter::open() {
+    file = fopen(path.c_str(), "we");
+    if (!file) {
+        Logger::error("Cannot write trace " + path + ": " + strerror(errno));
+        return false;
+    }
+    fputs("[\n", file);
+    return true;
+}
+
+void TraceWriter::beginEvent(const char* phase, const std::string& name, long pid, uint64_t ts_ns, long tid) {
+    char fields[112];
+    buffer += has_events ? ",\n{\"ph\":\"" : "{\"ph\":\"";
+    has_events = true;
+    buffer += phase;
+    buffer += "\",\"name\":";
+    appendString(buffer, name);
+    snprintf(fields, sizeof(fields), ",\"pid\":%ld,\"tid\":%ld,\"ts\":%.3f,\"args\":{", pid, tid, ts_ns / 1000.0);
+    buffer += fields;
+}
+
+void TraceWriter::counter(long pid, uint64_t ts_ns, const std::string& name, std::initializer_list<Arg> args) {
+    counter(pid, ts_ns, name, args.begin(), args.size());
+}
+
+void TraceWriter::counter(long pid, uint64_t ts_ns, const std::string& name, const Arg* args, size_t count) {
+    beginEvent("C", name, pid, ts_ns);
+    char value[48];
+    for (size_t i = 0; i < count; i++) {
+        if (i) buffer += ',';
+        appendString(buffer, args[i].first);
+        snprintf(value, sizeof(value), ":%.9g", args[i].second);
+        buffer += value;
+    }
+    buffer += "}}";
+}
+
+void TraceWriter::processName(long pid, const std::string& name, int sort_index) {
+    beginEvent("M", "process_name", pid, 0);
+    buffer += "\"name\":";
+    appendString(buffer, name);
+    buffer += "}}";
+    if (sort_index >= 0) {
+        beginEvent("M", "process_sort_index", pid, 0);
+        buffer += "\"sort_index\":" + std::to_string(sort_index) + "}}";
+    }
+}
+
+void TraceWriter::write(const Snapshot& snapshot) {
+    if (!file) return;
+    buffer.clear();
+
+    // Snapshots carry the wall clock; move the samples onto the monotonic clock of this instant
+    int64_t offset = (int64_t)(clockNs(CLOCK_MONOTONIC) - clockNs(CLOCK_REALTIME));
+    auto monotonic = [offset](uint64_t realtime_ns) -> uint64_t {
+        return std::max<int64_t>((int64_t)realtime_ns + offset, 0);
+    };
+
+    // With adaptive sampling devices and the process scan have times of their own, and
+    // whatever was not sampled again since the previous snapshot is left out
+    uint64_t scanned = snapshot.timestamp_ns;
+    if (!snapshot.gpus.empty() && !snapshot.gpus[0].nodes.empty()) {
+        uint64_t node_scanned = snapshot.gpus[0].nodes[0].processes_timestamp_ns;
+        if (node_scanned) scanned = node_scanned;
+    }
+    bool new_scan = !snapshot.processes_pending && scanned != last_scan_ns;
+    uint64_t scan_ts = monotonic(scanned);
+
+    // Markers come with the scan and stay in the snapshots until the next one; they already
+    // carry monotonic time. They go before the samples, which they are older than.
+    if (new_scan) {
+        for (const auto& marker : snapshot.markers) {
+            beginEvent(marker.begin ? "B" : "E", marker.name, marker.pid, marker.timestamp_ns, marker.pid);
+            buffer += "}}";
+        }
+    }
+
+    if (gpu_names.size() < snapshot.gpus.size()) {
+        gpu_names.resize(snapshot.gpus.size());
+        gpu_samples.resize(snapshot.gpus.size());
+    }
+    for (size_t i = 0; i < snapshot.gpus.size(); i++) {
+        const GPUSnapshot& gpu = snapshot.gpus[i];
+        const GPUDevice::Metrics& metrics = gpu.metrics;
+        long pid = GPU_PID_BASE + i;
+
+        std::string name = "GPU " + std::to_string(i) + ": " + gpu.market_name + " (" + gpu.pci_path + ")";
+        if (gpu_names[i] != name) {
+            processName(pid, name, i);
+            gpu_names[i] = name;
+            gpu_samples[i] = 0;
+        }
+
+        uint64_t sampled = metrics.timestamp_ns ? metrics.timestamp_ns : snapshot.timestamp_ns;
+        if (sampled != gpu_samples[i]) {
+            gpu_samples[i] = sampled;
+            writeDevice(gpu, pid, monotonic(sampled));
+        }
+
+        if (!new_scan) continue;
+        std::string prefix = "GPU " + std::to_string(i);
+        for (const auto& node : gpu.nodes) {
+            std::string track = gpu.nodes.size() > 1 ? prefix + "/" + std::to_string(node.partition) : prefix;
+            for (const auto& process : node.processes) {
+                if (!tracks.count({process.pid, track}) && !live_tracks.count({process.pid, track})) {
+                    processName(process.pid, process.name, -1);
+                }
+                live_tracks.insert({process.pid, track});
+                counter(process.pid, scan_ts, track + " engines %",
+                        {{"gfx", process.gfx_usage}, {"compute", process.compute_usage},
+                         {"enc", process.enc_usage}, {"dec", process.dec_usage}});
+                counter(process.pid, scan_ts, track + " memory MiB",
+                        {{"vram", process.memory_usage / 1048576.0}, {"gtt", process.gtt_usage / 1048576.0}});
+            }
+        }
+    }
+
+    if (new_scan) {
+        // Drop exited clients to zero, or their tracks would hold the last value to the end
+        for (const auto& track : tracks) {
+            if (live_tracks.count(track)) continue;
+            counter(track.first, scan_ts, track.second + " engines %",
+                    {{"gfx", 0}, {"compute", 0}, {"enc", 0}, {"dec", 0}});
+            counter(track.first, scan_ts, track.second + " memory MiB", {{"vram", 0}, {"gtt", 0}});
+        }
+        tracks.swap(live_tracks);
+        live_tracks.clear();
+        last_scan_ns = scanned;
+    }
+
+    if (fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size() || fflush(file) != 0) {
+        Logger::error("Cannot write trace " + path + ": " + strerror(errno));
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+// Device counters of one GPU
+void TraceWriter::writeDevice(const GPUSnapshot& gpu, long pid, uint64_t ts) {
+    const GPUDevice::Metrics& metrics = gpu.metrics;
+
+    counter(pid, ts, "usage %", {{"gpu", metrics.gpu_usage}});
+    if (gpu.nodes.size() > 1) {
+        for (const auto& node : gpu.nodes) {
+            counter(pid, ts, "xcp" + std::to_string(node.partition) + " usage %",
+                    {{"gpu", node.metrics.gpu_usage}});
+        }
+    }
+    counter(pid, ts, "memory MiB", {{"vram", metrics.memory_used}, {"gtt", metrics.gtt_used}});
+    counter(pid, ts, "clock MHz", {{"sclk", (double)metrics.gpu_clock}, {"mclk", (double)metrics.memory_clock}});
+    counter(pid, ts, "temperature °C", {{"edge", (double)metrics.temperature},
+                                        {"junction", (double)metrics.temperature_junction},
+                                        {"memory", (double)metrics.temperature_memory}});
+    counter(pid, ts, "power W", {{"power", (double)metrics.power_usage}});
+    counter(pid, ts, "energy J", {{"energy", metrics.energy}});
+    counter(pid, ts, "fan RPM", {{"fan", (double)metrics.fan_speed}});
+    counter(pid, ts, "memory traffic /s", {{"evictions", metrics.evictions_rate},
+                                           {"bytes moved", metrics.bytes_moved_rate},
+                                           {"cpu page faults", metrics.cpu_page_faults_rate}});
+    if (metrics.link.pcie_rx_rate >= 0) {
+        counter(pid, ts, "pcie MB/s", {{"rx", metrics.link.pcie_rx_rate / 1e6},
+                                       {"tx", metrics.link.pcie_tx_rate / 1e6}});
+    }
+    counter(pid, ts, "throttle reasons", {{"active", (double)metrics.throttle_reasons.size()}});
+    if (!metrics.block_usage.empty()) {
+        Arg blocks[64];
+        size_t count = std::min(metrics.block_usage.size(), sizeof(blocks) / sizeof(blocks[0]));
+        for (size_t j = 0; j < count; j++) {
+            blocks[j] = {metrics.block_usage[j].name, metrics.block_usage[j].busy};
+        }
+        counter(pid, ts, "blocks busy %", blocks, count);
+    }
+}